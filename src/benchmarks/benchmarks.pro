@@ -0,0 +1,45 @@
+TEMPLATE = app
+
+QT += gui gui-private widgets sql webkitwidgets
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+use_webengine {
+    QT      += webenginewidgets
+    DEFINES += USE_WEBENGINE
+}
+
+# Not installed, see main.cpp for how to run it
+TARGET = zeal-benchmarks
+
+VERSION = $$(ZEAL_VERSION)
+isEmpty(VERSION) {
+    VERSION = 0.0.0
+}
+DEFINES += ZEAL_VERSION=\\\"$${VERSION}\\\"
+
+INCLUDEPATH += $$PWD/..
+
+HEADERS += \
+    docsetgenerator.h
+
+SOURCES += \
+    docsetgenerator.cpp \
+    main.cpp
+
+# The registry is measured as the application links it
+include(../core/core.pri)
+include(../registry/registry.pri)
+include(../ui/ui.pri)
+include(../3rdparty/qxtglobalshortcut/qxtglobalshortcut.pri)
+
+!msvc:LIBS += -lz -L/usr/lib
+
+msvc:QMAKE_LIBS += user32.lib
+
+macx {
+    QMAKE_CXXFLAGS += -mmacosx-version-min=10.7 -stdlib=libc+
+}
+
+RESOURCES += \
+    ../zeal.qrc
@@ -0,0 +1,228 @@
+#include "docsetgenerator.h"
+
+#include <QDir>
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QVariant>
+
+using namespace Zeal::Benchmarks;
+
+namespace {
+const char *const Prefixes[] = {
+    "Abstract", "Async", "Audio", "Buffered", "Cached", "Concurrent", "Core", "Data",
+    "Default", "File", "Graphics", "Http", "Image", "Json", "Local", "Mutable",
+    "Network", "Object", "Opengl", "Persistent", "Plain", "Remote", "Scoped", "Shared",
+    "Socket", "Sql", "Static", "Text", "Thread", "Ui", "Vector", "Xml"
+};
+const char *const Nouns[] = {
+    "Array", "Buffer", "Cache", "Channel", "Codec", "Context", "Cursor", "Device",
+    "Document", "Engine", "Event", "Factory", "Filter", "Handle", "Index", "Iterator",
+    "List", "Loader", "Manager", "Map", "Model", "Node", "Pool", "Queue",
+    "Reader", "Request", "Scheduler", "Session", "Stream", "Timer", "View", "Writer"
+};
+const char *const Verbs[] = {
+    "add", "begin", "clear", "close", "create", "find", "flush", "get",
+    "insert", "open", "read", "remove", "reset", "set", "update", "write"
+};
+// Every eighth symbol is a type, the others are members of one. Methods come up twice.
+const char *const Types[] = {
+    "Class", "Method", "Function", "Property", "Constant", "Enum", "Variable", "Method"
+};
+const int WordCount = 32;
+const int VerbCount = 16;
+const int TypeCount = 8;
+
+// Symbols documented on the same page
+const int SymbolsPerPage = 256;
+
+// Spreads consecutive numbers over all words
+quint32 mix(quint32 value)
+{
+    value ^= value >> 16;
+    value *= 0x7feb352d;
+    value ^= value >> 15;
+    value *= 0x846ca68b;
+    value ^= value >> 16;
+    return value;
+}
+
+QString pagePath(int index)
+{
+    return QStringLiteral("docs/page%1.html").arg(index / SymbolsPerPage);
+}
+
+// Names repeat, like overloads do, their anchors do not
+QString anchor(int index)
+{
+    return QStringLiteral("//apple_ref/cpp/%1/%2/%3").arg(QLatin1String(Types[index % TypeCount]))
+            .arg(DocsetGenerator::symbolName(index)).arg(index);
+}
+}
+
+DocsetGenerator::DocsetGenerator(Format format, int symbolCount) :
+    m_format(format),
+    m_symbolCount(symbolCount)
+{
+}
+
+QString DocsetGenerator::name() const
+{
+    return QStringLiteral("%1-%2").arg(m_format == Format::Dash ? QStringLiteral("Dash")
+                                                                : QStringLiteral("ZDash"))
+            .arg(m_symbolCount);
+}
+
+QString DocsetGenerator::generate(const QString &root) const
+{
+    const QString docsetPath = QDir(root).absoluteFilePath(name() + QStringLiteral(".docset"));
+    const QDir resourcesDir(docsetPath + QStringLiteral("/Contents/Resources"));
+    const QString indexPath = resourcesDir.absoluteFilePath(QStringLiteral("docSet.dsidx"));
+
+    // The index is moved into place last
+    if (QFile::exists(indexPath))
+        return docsetPath;
+
+    if (!QDir().mkpath(resourcesDir.absoluteFilePath(QStringLiteral("Documents")))
+            || !writeInfo(docsetPath)) {
+        return QString();
+    }
+
+    const QString tempPath = indexPath + QStringLiteral(".part");
+    QFile::remove(tempPath);
+    if (!writeIndex(tempPath) || !QFile::rename(tempPath, indexPath)) {
+        QFile::remove(tempPath);
+        return QString();
+    }
+
+    return docsetPath;
+}
+
+void DocsetGenerator::removeCaches(const QString &docsetPath)
+{
+    const QDir resourcesDir(docsetPath + QStringLiteral("/Contents/Resources"));
+    const QStringList fileNames = resourcesDir.entryList({QStringLiteral("docSet.zeal.*")},
+                                                         QDir::Files);
+    for (const QString &fileName : fileNames)
+        QFile::remove(resourcesDir.absoluteFilePath(fileName));
+}
+
+QString DocsetGenerator::symbolName(int index)
+{
+    const quint32 hash = mix(quint32(index));
+    const QString type = QLatin1String(Prefixes[hash % WordCount])
+            + QLatin1String(Nouns[(hash >> 5) % WordCount]);
+    if (index % TypeCount == 0)
+        return type;
+
+    return type + QStringLiteral("::") + QLatin1String(Verbs[(hash >> 10) % VerbCount])
+            + QLatin1String(Nouns[(hash >> 14) % WordCount]);
+}
+
+bool DocsetGenerator::writeInfo(const QString &docsetPath) const
+{
+    QFile file(docsetPath + QStringLiteral("/Contents/Info.plist"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    const QString plist = QStringLiteral(
+                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<plist version=\"1.0\">\n"
+                "<dict>\n"
+                "    <key>CFBundleIdentifier</key>\n"
+                "    <string>%1</string>\n"
+                "    <key>CFBundleName</key>\n"
+                "    <string>%1</string>\n"
+                "    <key>DocSetPlatformFamily</key>\n"
+                "    <string>%1</string>\n"
+                "    <key>isDashDocset</key>\n"
+                "    <true/>\n"
+                "</dict>\n"
+                "</plist>\n").arg(name().toLower());
+    return file.write(plist.toUtf8()) != -1;
+}
+
+bool DocsetGenerator::writeIndex(const QString &fileName) const
+{
+    const QString connectionName = QStringLiteral("generator#%1").arg(name());
+    bool ok;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), connectionName);
+        db.setDatabaseName(fileName);
+        ok = db.open();
+
+        QSqlQuery query(db);
+        // The file is only moved into place once complete, so durability does not matter
+        query.exec(QStringLiteral("pragma journal_mode = off"));
+        query.exec(QStringLiteral("pragma synchronous = off"));
+        ok = ok && db.transaction();
+
+        if (m_format == Format::Dash) {
+            ok = ok && query.exec(QStringLiteral("create table searchIndex(id integer primary key, "
+                                                 "name text, type text, path text)"));
+            ok = ok && query.prepare(QStringLiteral("insert into searchIndex (name, type, path) "
+                                                    "values (?, ?, ?)"));
+            for (int i = 0; ok && i < m_symbolCount; ++i) {
+                query.addBindValue(symbolName(i));
+                query.addBindValue(QLatin1String(Types[i % TypeCount]));
+                query.addBindValue(pagePath(i) + QLatin1Char('#') + anchor(i));
+                ok = query.exec();
+            }
+            ok = ok && query.exec(QStringLiteral("create unique index anchor "
+                                                 "on searchIndex (name, type, path)"));
+        } else {
+            ok = ok && query.exec(QStringLiteral("create table ztokentype(z_pk integer primary key, "
+                                                 "ztypename varchar)"));
+            ok = ok && query.exec(QStringLiteral("create table zfilepath(z_pk integer primary key, "
+                                                 "zpath varchar)"));
+            ok = ok && query.exec(QStringLiteral("create table ztokenmetainformation("
+                                                 "z_pk integer primary key, zfile integer, "
+                                                 "zanchor varchar)"));
+            ok = ok && query.exec(QStringLiteral("create table ztoken(z_pk integer primary key, "
+                                                 "ztokenname varchar, ztokentype integer, "
+                                                 "zmetainformation integer)"));
+
+            // Primary keys start at 1, as in Core Data stores
+            ok = ok && query.prepare(QStringLiteral("insert into ztokentype (z_pk, ztypename) "
+                                                    "values (?, ?)"));
+            for (int i = 0; ok && i < TypeCount; ++i) {
+                query.addBindValue(i + 1);
+                query.addBindValue(QLatin1String(Types[i]));
+                ok = query.exec();
+            }
+
+            ok = ok && query.prepare(QStringLiteral("insert into zfilepath (z_pk, zpath) "
+                                                    "values (?, ?)"));
+            for (int i = 0; ok && i < m_symbolCount; i += SymbolsPerPage) {
+                query.addBindValue(i / SymbolsPerPage + 1);
+                query.addBindValue(pagePath(i));
+                ok = query.exec();
+            }
+
+            QSqlQuery tokenQuery(db);
+            ok = ok && query.prepare(QStringLiteral("insert into ztokenmetainformation "
+                                                    "(z_pk, zfile, zanchor) values (?, ?, ?)"));
+            ok = ok && tokenQuery.prepare(QStringLiteral("insert into ztoken (z_pk, ztokenname, "
+                                                         "ztokentype, zmetainformation) "
+                                                         "values (?, ?, ?, ?)"));
+            for (int i = 0; ok && i < m_symbolCount; ++i) {
+                query.addBindValue(i + 1);
+                query.addBindValue(i / SymbolsPerPage + 1);
+                query.addBindValue(anchor(i));
+
+                tokenQuery.addBindValue(i + 1);
+                tokenQuery.addBindValue(symbolName(i));
+                tokenQuery.addBindValue(i % TypeCount + 1);
+                tokenQuery.addBindValue(i + 1);
+                ok = query.exec() && tokenQuery.exec();
+            }
+        }
+
+        ok = ok && db.commit();
+        query.clear();
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    return ok;
+}
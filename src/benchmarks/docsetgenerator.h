@@ -0,0 +1,49 @@
+#ifndef DOCSETGENERATOR_H
+#define DOCSETGENERATOR_H
+
+#include <QString>
+
+namespace Zeal {
+namespace Benchmarks {
+
+/**
+ * @short Writes synthetic docsets, with symbols spread over types and pages like real ones.
+ *
+ * Dash docsets get a searchIndex table, ZDash docsets the Core Data tables of Apple
+ * docsets, which are read through joins. Symbols only depend on their number, so every
+ * run searches the same docsets.
+ */
+class DocsetGenerator
+{
+public:
+    enum class Format {
+        Dash,
+        ZDash
+    };
+
+    explicit DocsetGenerator(Format format, int symbolCount);
+
+    // Also the name of the folder of the docset, without ".docset"
+    QString name() const;
+    // Writes the docset into \a root, unless a complete one is there already.
+    // Returns the path of the docset, or an empty string on errors.
+    QString generate(const QString &root) const;
+
+    // Removes what Zeal writes next to the index, e.g. sidecars and symbol caches
+    static void removeCaches(const QString &docsetPath);
+
+    // Name of symbol \a index, e.g. "HttpSocket::readBuffer"
+    static QString symbolName(int index);
+
+private:
+    bool writeInfo(const QString &docsetPath) const;
+    bool writeIndex(const QString &fileName) const;
+
+    Format m_format;
+    int m_symbolCount;
+};
+
+} // namespace Benchmarks
+} // namespace Zeal
+
+#endif // DOCSETGENERATOR_H
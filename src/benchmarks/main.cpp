@@ -0,0 +1,245 @@
+#include "docsetgenerator.h"
+
+#include "registry/docset.h"
+#include "registry/docsetregistry.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QStandardPaths>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Zeal;
+using namespace Zeal::Benchmarks;
+
+namespace {
+const char DefaultSizes[] = "10000,100000,1000000,5000000";
+// Words typed character by character into each docset
+const int DefaultWordCount = 50;
+
+struct Result
+{
+    QString docset;
+    int symbolCount = 0;
+    // Until the docset is loaded, and until the first query of a fresh registry completed,
+    // in milliseconds. Cold runs start without any cache Zeal writes.
+    double coldLoad = 0;
+    double coldFirstQuery = 0;
+    double warmLoad = 0;
+    double warmFirstQuery = 0;
+    // From runQuery() until queryCompleted() of each keystroke, in milliseconds
+    QVector<double> keystrokes;
+};
+
+double milliseconds(const QElapsedTimer &timer)
+{
+    return timer.nsecsElapsed() / 1000000.0;
+}
+
+// Runs \a query and returns the time until all of its results arrived, in milliseconds
+double timeQuery(DocsetRegistry *registry, const QString &query)
+{
+    QEventLoop loop;
+    int queryNum = -1;
+    const QMetaObject::Connection connection = QObject::connect(
+                registry, &DocsetRegistry::queryCompleted, &loop,
+                [&loop, &queryNum](const SearchResultBlock::Shared &results) {
+        if (results->queryNum == queryNum)
+            loop.quit();
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    // Only runs once the event loop does, so the result cannot be missed
+    queryNum = registry->runQuery(query);
+    loop.exec();
+    const double elapsed = milliseconds(timer);
+
+    QObject::disconnect(connection);
+    return elapsed;
+}
+
+// Loads the docsets in \a root into a fresh registry and runs \a firstQuery, as Zeal does
+// on startup. Returns the registry, which the caller owns.
+DocsetRegistry *startRegistry(const QString &root, const QString &firstQuery, double *load,
+                              double *firstQueryTime)
+{
+    QElapsedTimer timer;
+    timer.start();
+    DocsetRegistry *registry = new DocsetRegistry();
+    registry->initialiseDocsets({root});
+    *load = milliseconds(timer);
+    *firstQueryTime = timeQuery(registry, firstQuery);
+    return registry;
+}
+
+// Typed words are names of types or members, "::" would start a docset filter
+QStringList typedWords(int symbolCount, int wordCount)
+{
+    QStringList words;
+    for (int i = 0; i < wordCount; ++i) {
+        const QString name = DocsetGenerator::symbolName(int(qint64(symbolCount) * i / wordCount));
+        const int separator = name.indexOf(QLatin1String("::"));
+        words.append((i % 2 || separator == -1 ? name.left(separator) : name.mid(separator + 2))
+                     .toLower());
+    }
+    return words;
+}
+
+double percentile(QVector<double> values, double quantile)
+{
+    if (values.isEmpty())
+        return 0;
+
+    std::sort(values.begin(), values.end());
+    const int rank = qMax(1, int(std::ceil(quantile * values.size())));
+    return values.at(rank - 1);
+}
+
+bool runBenchmark(const DocsetGenerator &generator, int symbolCount, const QString &dataPath,
+                  int wordCount, Result *result)
+{
+    const QString root = QDir(dataPath).absoluteFilePath(generator.name());
+    const QString docsetPath = generator.generate(root);
+    if (docsetPath.isEmpty())
+        return false;
+
+    result->docset = generator.name();
+    result->symbolCount = symbolCount;
+
+    const QStringList words = typedWords(symbolCount, wordCount);
+    const QString firstQuery = words.first().left(1);
+
+    // Cold start, as after installing the docset
+    DocsetGenerator::removeCaches(docsetPath);
+    QFile::remove(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                  + QLatin1String("/manifests.dat"));
+    delete startRegistry(root, firstQuery, &result->coldLoad, &result->coldFirstQuery);
+
+    // The registry builds the sidecar in the background, which is cancelled along with it
+    Docset(docsetPath, nullptr).buildSidecar();
+
+    DocsetRegistry *registry = startRegistry(root, firstQuery, &result->warmLoad,
+                                             &result->warmFirstQuery);
+    for (const QString &word : words) {
+        for (int length = 1; length <= word.size(); ++length)
+            result->keystrokes.append(timeQuery(registry, word.left(length)));
+    }
+    delete registry;
+
+    return true;
+}
+
+void printResult(QTextStream &out, const Result &result)
+{
+    out << qSetFieldWidth(14) << left << result.docset << right
+        << qSetFieldWidth(9) << result.symbolCount
+        << qSetFieldWidth(11) << qSetRealNumberPrecision(1) << fixed
+        << result.coldLoad << result.coldFirstQuery << result.warmLoad << result.warmFirstQuery
+        << qSetFieldWidth(9) << result.keystrokes.size()
+        << qSetFieldWidth(9) << qSetRealNumberPrecision(2)
+        << percentile(result.keystrokes, 0.5) << percentile(result.keystrokes, 0.99)
+        << percentile(result.keystrokes, 1.0)
+        << qSetFieldWidth(0) << endl;
+}
+}
+
+/**
+ * Measures startup and keystroke latency of the docset registry on synthetic Dash and
+ * ZDash docsets. Docsets are generated into the data directory on first use and kept for
+ * later runs, the largest ones take minutes to write.
+ *
+ * Times are in milliseconds. "load" is initialiseDocsets(), "first" the first query of the
+ * registry after it, which loads the symbol index. Cold runs remove the caches Zeal writes
+ * beforehand, warm runs find all of them. The operating system keeps caching the files
+ * either way, reported cold times are those of a repeated installation.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("zeal-benchmarks"));
+    // Leaves the manifest cache and usage statistics of Zeal alone
+    QStandardPaths::setTestModeEnabled(true);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Measures the docset registry of Zeal."));
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption(QStringLiteral("sizes"),
+                                        QStringLiteral("Comma-separated symbol counts of the "
+                                                       "docsets, %1 by default.")
+                                        .arg(QLatin1String(DefaultSizes)),
+                                        QStringLiteral("counts"), QLatin1String(DefaultSizes)));
+    parser.addOption(QCommandLineOption(QStringLiteral("formats"),
+                                        QStringLiteral("Comma-separated docset formats, 'dash' "
+                                                       "and 'zdash' by default."),
+                                        QStringLiteral("formats"), QStringLiteral("dash,zdash")));
+    parser.addOption(QCommandLineOption(QStringLiteral("words"),
+                                        QStringLiteral("Number of words typed into each docset, "
+                                                       "%1 by default.").arg(DefaultWordCount),
+                                        QStringLiteral("count"),
+                                        QString::number(DefaultWordCount)));
+    parser.addOption(QCommandLineOption(QStringLiteral("data"),
+                                        QStringLiteral("Directory of the generated docsets."),
+                                        QStringLiteral("path"),
+                                        QDir::temp().absoluteFilePath(QStringLiteral("zeal-benchmarks"))));
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const int wordCount = parser.value(QStringLiteral("words")).toInt();
+    if (wordCount <= 0) {
+        err << "Invalid word count" << endl;
+        return 2;
+    }
+
+    QList<int> sizes;
+    for (const QString &size : parser.value(QStringLiteral("sizes")).split(QLatin1Char(','))) {
+        bool ok;
+        sizes.append(size.toInt(&ok));
+        if (!ok || sizes.last() <= 0) {
+            err << "Invalid symbol count: " << size << endl;
+            return 2;
+        }
+    }
+
+    QList<DocsetGenerator::Format> formats;
+    for (const QString &format : parser.value(QStringLiteral("formats")).split(QLatin1Char(','))) {
+        if (format == QLatin1String("dash")) {
+            formats.append(DocsetGenerator::Format::Dash);
+        } else if (format == QLatin1String("zdash")) {
+            formats.append(DocsetGenerator::Format::ZDash);
+        } else {
+            err << "Unknown docset format: " << format << endl;
+            return 2;
+        }
+    }
+
+    out << qSetFieldWidth(14) << left << "docset" << right
+        << qSetFieldWidth(9) << "symbols"
+        << qSetFieldWidth(11) << "cold load" << "cold first" << "warm load" << "warm first"
+        << qSetFieldWidth(9) << "keys" << "p50" << "p99" << "max"
+        << qSetFieldWidth(0) << endl;
+
+    const QString dataPath = parser.value(QStringLiteral("data"));
+    for (const DocsetGenerator::Format format : formats) {
+        for (const int size : sizes) {
+            const DocsetGenerator generator(format, size);
+            Result result;
+            if (!runBenchmark(generator, size, dataPath, wordCount, &result)) {
+                err << "Cannot generate docset " << generator.name() << " in " << dataPath
+                    << endl;
+                return 1;
+            }
+            printResult(out, result);
+        }
+    }
+
+    return 0;
+}
@@ -1,13 +1,19 @@
 #include "application.h"
 
+#include "download.h"
+#include "downloadqueue.h"
 #include "extractor.h"
+#include "metrics.h"
+#include "mirrorranker.h"
+#include "queryserver.h"
 #include "settings.h"
+#include "registry/docsetcontentcache.h"
+#include "registry/docseticoncache.h"
 #include "registry/docsetregistry.h"
 #include "ui/mainwindow.h"
 
-#include <QLocalServer>
-#include <QLocalSocket>
-#include <QMetaObject>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QNetworkAccessManager>
 #include <QNetworkProxy>
 #include <QThread>
@@ -21,44 +27,71 @@ const char *LocalServerName = "ZealLocalServer";
 
 Application *Application::m_instance = nullptr;
 
-Application::Application(const QString &query, QObject *parent) :
+Application::Application(const QString &query, Mode mode, QObject *parent) :
     QObject(parent)
 {
     // Ensure only one instance of Application
     Q_ASSERT(!m_instance);
     m_instance = this;
 
+    QElapsedTimer startupTimer;
+    startupTimer.start();
+    QElapsedTimer phaseTimer;
+    phaseTimer.start();
+
+    // Whether to record anything is only known once the settings are loaded
     m_settings = new Settings(this);
-    m_localServer = new QLocalServer(this);
+    Metrics::setEnabled(m_settings->metricsEnabled);
+    Metrics::record(Metrics::StartupSettings, quint64(phaseTimer.nsecsElapsed() / 1000));
+
     m_networkManager = new QNetworkAccessManager(this);
-    m_extractorThread = new QThread(this);
-    m_extractor = new Extractor();
+    m_downloadQueue = new DownloadQueue(this);
+    m_mirrorRanker = new MirrorRanker(m_networkManager, m_settings, this);
+    m_extractor = new Extractor(this);
     m_docsetRegistry = new DocsetRegistry();
-    m_mainWindow = new MainWindow(this);
-
-    // Server for detecting already running instances
-    connect(m_localServer, &QLocalServer::newConnection, [this]() {
-        QLocalSocket *connection = m_localServer->nextPendingConnection();
-        // Wait a little while the other side writes the bytes
-        connection->waitForReadyRead();
-        if (connection->bytesAvailable())
-            m_mainWindow->bringToFront(QString::fromLocal8Bit(connection->readAll()));
-        else
-            m_mainWindow->bringToFront();
+    m_docsetIconCache = new DocsetIconCache(m_docsetRegistry, this);
+    m_docsetContentCache = new DocsetContentCache(m_docsetRegistry, this);
+    if (mode == Mode::Desktop) {
+        phaseTimer.restart();
+        m_mainWindow = new MainWindow(this);
+        Metrics::record(Metrics::StartupMainWindow, quint64(phaseTimer.nsecsElapsed() / 1000));
+    } else {
+        // Done by the main window otherwise. Nothing competes with warming up all docsets.
+        m_docsetRegistry->initialiseDocsets(m_settings->localDocsetPaths(),
+                                            m_settings->remoteDocsetPaths);
+        m_docsetRegistry->warmUp(m_docsetRegistry->names());
+    }
+
+    // Server for already running instances and other tools, answered on its own thread
+    phaseTimer.restart();
+    m_queryServerThread = new QThread(this);
+    m_queryServer = new QueryServer(m_docsetRegistry);
+    m_queryServer->moveToThread(m_queryServerThread);
+    connect(m_queryServerThread, &QThread::finished, m_queryServer, &QObject::deleteLater);
+    connect(m_queryServer, &QueryServer::showRequested, this, [this](const QString &query) {
+        if (m_mainWindow)
+            m_mainWindow->bringToFront(query);
     });
-    /// TODO: Verify if removeServer() is needed
-    QLocalServer::removeServer(LocalServerName);  // remove in case previous instance crashed
-    m_localServer->listen(LocalServerName);
+    m_queryServerThread->start();
+    QMetaObject::invokeMethod(m_queryServer, "listen", Qt::QueuedConnection,
+                              Q_ARG(QString, LocalServerName));
+    Metrics::record(Metrics::StartupQueryServer, quint64(phaseTimer.nsecsElapsed() / 1000));
 
-    // Extractor setup
-    m_extractor->moveToThread(m_extractorThread);
-    m_extractorThread->start();
+    // Extractor setup, archives are extracted on its own threads
     connect(m_extractor, &Extractor::completed, this, &Application::extractionCompleted);
     connect(m_extractor, &Extractor::error, this, &Application::extractionError);
+    connect(m_extractor, &Extractor::progress, this, &Application::extractionProgress);
+    connect(m_extractor, &Extractor::streamDrained, this, &Application::extractionDrained);
 
     connect(m_settings, &Settings::updated, this, &Application::applySettings);
     applySettings();
 
+    // Showing the window is left out, it depends on the window system more than on Zeal
+    Metrics::record(Metrics::StartupTotal, quint64(startupTimer.nsecsElapsed() / 1000));
+
+    if (!m_mainWindow)
+        return;
+
     if (!query.isEmpty())
         m_mainWindow->bringToFront(query);
     else if (!m_settings->startMinimized)
@@ -67,8 +100,13 @@ Application::Application(const QString &query, QObject *parent) :
 
 Application::~Application()
 {
-    m_extractorThread->quit();
-    m_extractorThread->wait();
+    // Searches of the query server use the registry
+    m_queryServerThread->quit();
+    m_queryServerThread->wait();
+
+    stopMetrics();
+
+    // Waits for running extractions
     delete m_extractor;
     delete m_mainWindow;
     delete m_docsetRegistry;
@@ -79,6 +117,11 @@ QString Application::localServerName()
     return LocalServerName;
 }
 
+QString Application::userAgent()
+{
+    return QStringLiteral("Zeal/") + QStringLiteral(ZEAL_VERSION);
+}
+
 QNetworkAccessManager *Application::networkManager() const
 {
     return m_networkManager;
@@ -89,27 +132,109 @@ Settings *Application::settings() const
     return m_settings;
 }
 
+MirrorRanker *Application::mirrorRanker() const
+{
+    return m_mirrorRanker;
+}
+
 DocsetRegistry *Application::docsetRegistry()
 {
     return m_instance->m_docsetRegistry;
 }
 
-void Application::extract(const QString &filePath, const QString &destination, const QString &root)
+DocsetIconCache *Application::docsetIconCache()
 {
-    QMetaObject::invokeMethod(m_extractor, "extract", Qt::QueuedConnection,
-                              Q_ARG(QString, filePath), Q_ARG(QString, destination),
-                              Q_ARG(QString, root));
+    return m_instance->m_docsetIconCache;
+}
+
+DocsetContentCache *Application::docsetContentCache()
+{
+    return m_instance->m_docsetContentCache;
+}
+
+void Application::startPerformanceLog(const QString &fileName)
+{
+    QFile *file = new QFile(this);
+    bool opened;
+    if (fileName == QLatin1String("-")) {
+        opened = file->open(stderr, QIODevice::WriteOnly);
+    } else {
+        file->setFileName(fileName);
+        opened = file->open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+    }
+
+    if (!opened) {
+        qWarning("Cannot open performance log '%s': %s", qPrintable(fileName),
+                 qPrintable(file->errorString()));
+        delete file;
+        return;
+    }
+
+    // Startup is over by now, repeated runs tell cold from warm disk caches
+    const QString startup = QStringLiteral("startup: %1 docsets loaded in %2 ms\n")
+            .arg(m_docsetRegistry->count()).arg(m_docsetRegistry->initialisationTime());
+    file->write(startup.toUtf8());
+    file->flush();
+
+    connect(m_docsetRegistry, &DocsetRegistry::queryProfiled,
+            this, [file](const QueryProfile &profile) {
+        file->write(profile.toString().toUtf8() + '\n');
+        file->flush();
+    });
+}
+
+void Application::startExtraction(const QString &name, const QString &destination,
+                                  const QString &root)
+{
+    // Release mapped files of an installed version, they are about to be replaced
+    m_docsetContentCache->invalidate(name);
+    m_extractor->startStream(name, destination, root);
+}
+
+bool Application::appendExtractionData(const QString &name, const QByteArray &data)
+{
+    return m_extractor->appendData(name, data);
+}
+
+void Application::finishExtraction(const QString &name)
+{
+    m_extractor->finishStream(name);
+}
+
+void Application::abortExtraction(const QString &name)
+{
+    m_extractor->abortStream(name);
 }
 
 QNetworkReply *Application::download(const QUrl &url)
 {
     QNetworkRequest request(url);
-    request.setHeader(QNetworkRequest::UserAgentHeader, QStringLiteral("Zeal/") + QStringLiteral(ZEAL_VERSION));
+    request.setHeader(QNetworkRequest::UserAgentHeader, userAgent());
     return m_networkManager->get(request);
 }
 
+Download *Application::download(const QUrl &url, const QString &fileName, int priority)
+{
+    Download *download = new Download(m_networkManager, url, fileName, this);
+    m_downloadQueue->enqueue(download, priority);
+    return download;
+}
+
 void Application::applySettings()
 {
+    Metrics::setEnabled(m_settings->metricsEnabled);
+    if (m_settings->metricsEnabled)
+        startMetrics();
+    else
+        stopMetrics();
+
+    m_docsetRegistry->setResultLimit(m_settings->searchResultLimit);
+    m_docsetRegistry->setFuzzySearchEnabled(m_settings->fuzzySearch);
+
+    m_downloadQueue->setMaxActiveDownloads(m_settings->maxParallelDownloads);
+    m_downloadQueue->setMaxDownloadsPerHost(m_settings->maxDownloadsPerHost);
+    m_downloadQueue->setBandwidthLimit(qint64(m_settings->downloadRateLimit) * 1024);
+
     // HTTP Proxy Settings
     switch (m_settings->proxyType) {
     case Core::Settings::ProxyType::None:
@@ -131,3 +256,34 @@ void Application::applySettings()
     }
     }
 }
+
+// Also applies changed metrics settings to a running exporter
+void Application::startMetrics()
+{
+    if (!m_metrics) {
+        m_metricsThread = new QThread(this);
+        m_metrics = new Metrics();
+        m_metrics->moveToThread(m_metricsThread);
+        connect(m_metricsThread, &QThread::finished, m_metrics, &QObject::deleteLater);
+        m_metricsThread->start();
+    }
+
+    QMetaObject::invokeMethod(m_metrics, "configure", Qt::QueuedConnection,
+                              Q_ARG(QString, m_settings->metricsTarget),
+                              Q_ARG(QString, m_settings->metricsFormat),
+                              Q_ARG(int, m_settings->metricsInterval));
+}
+
+// Values recorded so far are kept, and exported again if metrics are enabled later
+void Application::stopMetrics()
+{
+    if (!m_metrics)
+        return;
+
+    // The exporter is deleted by the thread as it finishes
+    m_metricsThread->quit();
+    m_metricsThread->wait();
+    delete m_metricsThread;
+    m_metricsThread = nullptr;
+    m_metrics = nullptr;
+}
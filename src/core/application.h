@@ -3,62 +3,109 @@
 
 #include <QObject>
 
-class QLocalServer;
+class QThread;
 
 class MainWindow;
 
 class QNetworkAccessManager;
 class QNetworkReply;
-class QThread;
 
 namespace Zeal {
 
+class DocsetContentCache;
+class DocsetIconCache;
 class DocsetRegistry;
 
 namespace Core {
 
+class Download;
+class DownloadQueue;
 class Extractor;
+class Metrics;
+class MirrorRanker;
+class QueryServer;
 class Settings;
 
 class Application : public QObject
 {
     Q_OBJECT
 public:
-    explicit Application(const QString &query = QString(), QObject *parent = nullptr);
+    enum class Mode {
+        Desktop,
+        // No window, only the query server is running
+        Headless
+    };
+
+    explicit Application(const QString &query = QString(), Mode mode = Mode::Desktop,
+                         QObject *parent = nullptr);
     ~Application() override;
 
     static QString localServerName();
+    static QString userAgent();
 
     QNetworkAccessManager *networkManager() const;
     Settings *settings() const;
+    MirrorRanker *mirrorRanker() const;
 
     static DocsetRegistry *docsetRegistry();
+    static DocsetIconCache *docsetIconCache();
+    static DocsetContentCache *docsetContentCache();
+
+    // Writes a summary of each completed query to \a fileName, or to stderr for "-"
+    void startPerformanceLog(const QString &fileName);
+
+    // Extracts an archive as it downloads, see Extractor::startStream()
+    void startExtraction(const QString &name, const QString &destination,
+                         const QString &root = QString());
+    // Returns false to pause the data until extractionDrained()
+    bool appendExtractionData(const QString &name, const QByteArray &data);
+    void finishExtraction(const QString &name);
+    void abortExtraction(const QString &name);
+
+    // Downloads \a url into \a fileName, resuming an earlier partial download of it.
+    // Starts once the DownloadQueue gets to it, see DownloadQueue::Priority.
+    Download *download(const QUrl &url, const QString &fileName, int priority = 0);
 
 public slots:
-    void extract(const QString &filePath, const QString &destination, const QString &root = QString());
     QNetworkReply *download(const QUrl &url);
 
 signals:
     void extractionCompleted(const QString &filePath);
     void extractionError(const QString &filePath, const QString &errorString);
+    void extractionProgress(const QString &filePath, qint64 readBytes, qint64 extractedBytes,
+                            int extractedEntries);
+    void extractionDrained(const QString &name);
 
 private slots:
     void applySettings();
 
 private:
+    void startMetrics();
+    void stopMetrics();
+
     static Application *m_instance;
 
     Settings *m_settings = nullptr;
 
-    QLocalServer *m_localServer = nullptr;
+    // Lives on m_queryServerThread
+    QueryServer *m_queryServer = nullptr;
+    QThread *m_queryServerThread = nullptr;
     QNetworkAccessManager *m_networkManager = nullptr;
+    DownloadQueue *m_downloadQueue = nullptr;
+    MirrorRanker *m_mirrorRanker = nullptr;
 
-    QThread *m_extractorThread = nullptr;
     Extractor *m_extractor = nullptr;
 
     DocsetRegistry *m_docsetRegistry = nullptr;
+    DocsetIconCache *m_docsetIconCache = nullptr;
+    DocsetContentCache *m_docsetContentCache = nullptr;
 
+    // nullptr in headless mode
     MainWindow *m_mainWindow = nullptr;
+
+    // Lives on m_metricsThread, only while metrics are enabled
+    Metrics *m_metrics = nullptr;
+    QThread *m_metricsThread = nullptr;
 };
 
 } // namespace Core
@@ -0,0 +1,32 @@
+#include "bandwidthlimiter.h"
+
+using namespace Zeal::Core;
+
+BandwidthLimiter::BandwidthLimiter()
+{
+    m_timer.start();
+}
+
+qint64 BandwidthLimiter::limit() const
+{
+    return m_limit;
+}
+
+void BandwidthLimiter::setLimit(qint64 limit)
+{
+    m_limit = qMax<qint64>(limit, 0);
+    m_budget = 0;
+    m_timer.restart();
+}
+
+qint64 BandwidthLimiter::take(qint64 bytes)
+{
+    if (!m_limit)
+        return bytes;
+
+    // Kept in thousandths of a byte, so frequent calls do not round the budget away
+    m_budget = qMin(m_budget + m_timer.restart() * m_limit, m_limit * 1000);
+    const qint64 taken = qMin(bytes, m_budget / 1000);
+    m_budget -= taken * 1000;
+    return taken;
+}
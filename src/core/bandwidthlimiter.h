@@ -0,0 +1,32 @@
+#ifndef BANDWIDTHLIMITER_H
+#define BANDWIDTHLIMITER_H
+
+#include <QElapsedTimer>
+
+namespace Zeal {
+namespace Core {
+
+// A budget of bytes per second shared by all downloads of a DownloadQueue. Unused budget
+// is saved up for at most a second, which is the largest burst allowed.
+class BandwidthLimiter
+{
+public:
+    explicit BandwidthLimiter();
+
+    qint64 limit() const;
+    // In bytes per second, 0 for no limit
+    void setLimit(qint64 limit);
+
+    // Returns how many of \a bytes can be read now, and takes them from the budget
+    qint64 take(qint64 bytes);
+
+private:
+    qint64 m_limit = 0;
+    qint64 m_budget = 0; // 1/1000 bytes
+    QElapsedTimer m_timer;
+};
+
+} // namespace Core
+} // namespace Zeal
+
+#endif // BANDWIDTHLIMITER_H
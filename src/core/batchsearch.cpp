@@ -0,0 +1,147 @@
+#include "batchsearch.h"
+
+#include "queryserver.h"
+#include "settings.h"
+#include "task.h"
+#include "registry/docsetregistry.h"
+
+#include <QDir>
+#include <QIODevice>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <functional>
+
+using namespace Zeal;
+using namespace Zeal::Core;
+
+namespace {
+// Queries searched ahead of the one written next, per thread
+const int QueriesInFlightPerThread = 4;
+
+// Tabs and line breaks would break up TSV records
+QByteArray tsvField(const QString &value)
+{
+    QString field = value;
+    field.replace(QLatin1Char('\t'), QLatin1Char(' '));
+    field.replace(QLatin1Char('\n'), QLatin1Char(' '));
+    return field.toUtf8();
+}
+
+struct Output
+{
+    bool done = false;
+    bool found = false;
+    QByteArray data;
+};
+}
+
+BatchSearch::BatchSearch(Format format, int limit) :
+    m_format(format),
+    m_limit(limit)
+{
+}
+
+int BatchSearch::run(QIODevice *input, QIODevice *output)
+{
+    if (!input->isReadable() || !output->isWritable())
+        return 2;
+
+    Settings settings;
+    DocsetRegistry docsetRegistry;
+    docsetRegistry.setResultLimit(settings.searchResultLimit);
+    docsetRegistry.setFuzzySearchEnabled(settings.fuzzySearch);
+    docsetRegistry.initialiseDocsets(settings.localDocsetPaths(), settings.remoteDocsetPaths);
+
+    QThreadPool pool;
+    // Docsets keep per-thread database connections, so search threads should never expire
+    pool.setExpiryTimeout(-1);
+    const int maxInFlight = QueriesInFlightPerThread * qMax(1, QThread::idealThreadCount());
+
+    // Outputs of queries not written yet, starting with query number written
+    QVector<Output> outputs;
+    int written = 0;
+    QMutex mutex;
+    QWaitCondition outputDone;
+    bool allFound = true;
+
+    // Writes finished outputs in order, waiting until no more than maxPending are left
+    auto writeOutputs = [&](int maxPending) {
+        QMutexLocker locker(&mutex);
+        while (!outputs.isEmpty()) {
+            if (!outputs.first().done) {
+                if (outputs.size() <= maxPending)
+                    break;
+                outputDone.wait(&mutex);
+                continue;
+            }
+
+            const Output finished = outputs.takeFirst();
+            ++written;
+            locker.unlock();
+            allFound = allFound && finished.found;
+            output->write(finished.data);
+            locker.relock();
+        }
+    };
+
+    const int limit = m_limit;
+    const Format format = m_format;
+    int queryNum = 0;
+    // Blocks until a line is available, and returns nothing only at the end of the input
+    QByteArray line;
+    while (!(line = input->readLine()).isEmpty()) {
+        const QString query = QString::fromUtf8(line).trimmed();
+        if (query.isEmpty())
+            continue;
+
+        {
+            QMutexLocker locker(&mutex);
+            outputs.append(Output());
+        }
+
+        const int index = queryNum++;
+        pool.start(new Task([&, index, query]() {
+            const QList<SearchResult> results = docsetRegistry.search(query, limit);
+
+            QByteArray data;
+            if (format == Format::Json) {
+                QJsonArray array;
+                for (const SearchResult &result : results)
+                    array.append(QueryServer::toJson(result, docsetRegistry.entry(result.docsetName())));
+
+                QJsonObject object;
+                object.insert(QStringLiteral("query"), query);
+                object.insert(QStringLiteral("results"), array);
+                data = QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+            } else {
+                const QByteArray queryField = tsvField(query);
+                for (const SearchResult &result : results) {
+                    const QDir dir(docsetRegistry.entry(result.docsetName()).documentPath());
+                    data += queryField + '\t' + tsvField(result.name()) + '\t'
+                            + tsvField(result.parentName()) + '\t' + tsvField(result.docsetName())
+                            + '\t' + tsvField(dir.absoluteFilePath(result.path())) + '\n';
+                }
+            }
+
+            QMutexLocker locker(&mutex);
+            Output &finished = outputs[index - written];
+            finished.done = true;
+            finished.found = !results.isEmpty();
+            finished.data = data;
+            outputDone.wakeAll();
+        }));
+
+        // Results stream out while later queries are still being read
+        writeOutputs(maxInFlight);
+    }
+
+    writeOutputs(0);
+    pool.waitForDone();
+    return allFound ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+#ifndef BATCHSEARCH_H
+#define BATCHSEARCH_H
+
+class QIODevice;
+
+namespace Zeal {
+namespace Core {
+
+/**
+ * @short Runs queries read line by line against the installed docsets, without a user
+ * interface.
+ *
+ * Queries are searched concurrently on all cores, and the results of each are written
+ * in input order as soon as it and the queries before it are done. Works with a plain
+ * QCoreApplication.
+ */
+class BatchSearch
+{
+public:
+    enum class Format {
+        // One result per line: query, name, parent, docset, path
+        Tsv,
+        // One object per query: {"query": ..., "results": [...]}, see QueryServer
+        Json
+    };
+
+    explicit BatchSearch(Format format = Format::Tsv, int limit = 0);
+
+    // Returns 0 if every query had results, 1 if some had none, and 2 on errors
+    int run(QIODevice *input, QIODevice *output);
+
+private:
+    Format m_format;
+    int m_limit;
+};
+
+} // namespace Core
+} // namespace Zeal
+
+#endif // BATCHSEARCH_H
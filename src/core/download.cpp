@@ -0,0 +1,509 @@
+#include "download.h"
+
+#include "application.h"
+#include "bandwidthlimiter.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkAccessManager>
+#include <QSaveFile>
+#include <QTimer>
+
+using namespace Zeal::Core;
+
+namespace {
+// Files smaller than this are fetched in a single request
+const qint64 MinChunkedSize = 8 * 1024 * 1024;
+const int ChunkCount = 4;
+const int MaxRetries = 5;
+const int RetryDelay = 2000; // ms, multiplied by the number of attempts
+const int MaxRedirects = 5;
+// Progress is saved at most this often while data arrives
+const int StateSaveInterval = 1000; // ms
+// Bytes handed out per deliver() call, so that resuming a large file does not
+// hold the event loop
+const qint64 MaxDeliverySize = 4 * 1024 * 1024;
+// With a bandwidth limit, replies buffer at most this much, which leaves the rest of the
+// throttling to TCP flow control
+const qint64 ThrottledBufferSize = 64 * 1024;
+// How often throttled chunk data is read
+const int ThrottleInterval = 50; // ms
+
+QString stateFileName(const QString &fileName)
+{
+    return fileName + QLatin1String(".state");
+}
+}
+
+Download::Download(QNetworkAccessManager *networkManager, const QUrl &url,
+                   const QString &fileName, QObject *parent) :
+    QObject(parent),
+    m_networkManager(networkManager),
+    m_url(url),
+    m_resolvedUrl(url),
+    m_fileName(fileName)
+{
+}
+
+Download::~Download()
+{
+    if (m_finished)
+        return;
+
+    // Like abort(), without telling anyone
+    m_finished = true;
+    if (m_headReply)
+        m_headReply->abort();
+    abortChunks();
+    saveState();
+}
+
+QUrl Download::url() const
+{
+    return m_url;
+}
+
+QString Download::fileName() const
+{
+    return m_fileName;
+}
+
+qint64 Download::transferredBytes() const
+{
+    return m_transferred;
+}
+
+QNetworkReply::NetworkError Download::error() const
+{
+    return m_error;
+}
+
+QString Download::errorString() const
+{
+    return m_errorString;
+}
+
+void Download::setBandwidthLimiter(BandwidthLimiter *limiter)
+{
+    m_bandwidthLimiter = limiter;
+}
+
+void Download::start()
+{
+    // Size, range support and validator of the file decide how it is fetched
+    m_headReply = m_networkManager->head(request(m_resolvedUrl));
+    connect(m_headReply, &QNetworkReply::finished, this, &Download::headFinished);
+
+    // Redirects start over
+    if (!m_redirects)
+        emit started();
+}
+
+void Download::abort()
+{
+    finish(QNetworkReply::OperationCanceledError, tr("Download was cancelled"));
+}
+
+void Download::headFinished()
+{
+    QNetworkReply *reply = m_headReply;
+    m_headReply = nullptr;
+    reply->deleteLater();
+
+    if (m_finished)
+        return;
+
+    if (reply->error() != QNetworkReply::NoError) {
+        finish(reply->error(), reply->errorString());
+        return;
+    }
+
+    const QUrl redirectUrl = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+    if (redirectUrl.isValid()) {
+        if (++m_redirects > MaxRedirects) {
+            finish(QNetworkReply::ProtocolFailure, tr("Too many redirects"));
+            return;
+        }
+        m_resolvedUrl = m_resolvedUrl.resolved(redirectUrl);
+        start();
+        return;
+    }
+
+    bool ok;
+    m_size = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong(&ok);
+    if (!ok)
+        m_size = -1;
+    m_acceptsRanges = m_size > 0 && reply->rawHeader("Accept-Ranges") == "bytes";
+    m_validator = reply->rawHeader("ETag");
+    if (m_validator.isEmpty())
+        m_validator = reply->rawHeader("Last-Modified");
+
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+    const bool resumed = m_acceptsRanges && loadState();
+
+    // Unbuffered, as chunks write and deliver() reads at different offsets
+    QIODevice::OpenMode mode = QIODevice::ReadWrite | QIODevice::Unbuffered;
+    if (!resumed)
+        mode |= QIODevice::Truncate;
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(mode)) {
+        finish(QNetworkReply::UnknownContentError, m_file.errorString());
+        return;
+    }
+
+    if (!resumed) {
+        const int count = m_acceptsRanges && m_size >= MinChunkedSize ? ChunkCount : 1;
+        m_chunks.clear();
+        for (int i = 0; i < count; ++i) {
+            Chunk chunk;
+            if (m_size >= 0) {
+                chunk.start = m_size * i / count;
+                chunk.end = m_size * (i + 1) / count;
+            }
+            m_chunks.append(chunk);
+        }
+
+        // Chunks write straight to their place in the file
+        if (m_size > 0)
+            m_file.resize(m_size);
+    }
+
+    m_stateSaveTimer.start();
+    emit progress(receivedBytes(), m_size);
+
+    bool complete = true;
+    for (int i = 0; i < m_chunks.size(); ++i) {
+        if (m_chunks.at(i).isComplete())
+            continue;
+        complete = false;
+        startChunk(i);
+    }
+
+    // Data kept from an earlier run is handed out first
+    m_complete = complete;
+    deliver();
+}
+
+bool Download::isDeliveryPaused() const
+{
+    return m_deliveryPaused;
+}
+
+void Download::setDeliveryPaused(bool paused)
+{
+    if (m_deliveryPaused == paused)
+        return;
+
+    m_deliveryPaused = paused;
+    if (!paused)
+        deliver();
+}
+
+void Download::deliver()
+{
+    if (m_finished || m_deliveryPaused)
+        return;
+
+    const qint64 available = availableBytes();
+    if (m_delivered < available) {
+        m_file.seek(m_delivered);
+        const QByteArray data = m_file.read(qMin(available - m_delivered, MaxDeliverySize));
+        if (data.isEmpty()) {
+            finish(QNetworkReply::UnknownContentError, m_file.errorString());
+            return;
+        }
+
+        m_delivered += data.size();
+        emit dataAvailable(data);
+
+        if (m_delivered < available) {
+            QTimer::singleShot(0, this, &Download::deliver);
+            return;
+        }
+    }
+
+    if (m_complete && m_delivered == m_size) {
+        QFile::remove(stateFileName(m_fileName));
+        finish(QNetworkReply::NoError);
+    }
+}
+
+QNetworkRequest Download::request(const QUrl &url) const
+{
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::UserAgentHeader, Application::userAgent());
+    return request;
+}
+
+bool Download::loadState()
+{
+    QFile file(stateFileName(m_fileName));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    // Only the same version of the file can be resumed
+    const QJsonObject state = QJsonDocument::fromJson(file.readAll()).object();
+    if (m_validator.isEmpty()
+            || state[QStringLiteral("validator")].toString().toLatin1() != m_validator
+            || qint64(state[QStringLiteral("size")].toDouble()) != m_size
+            || QFileInfo(m_fileName).size() != m_size) {
+        return false;
+    }
+
+    QVector<Chunk> chunks;
+    for (const QJsonValue &value : state[QStringLiteral("chunks")].toArray()) {
+        const QJsonObject object = value.toObject();
+        Chunk chunk;
+        chunk.start = qint64(object[QStringLiteral("start")].toDouble());
+        chunk.end = qint64(object[QStringLiteral("end")].toDouble());
+        chunk.received = qint64(object[QStringLiteral("received")].toDouble());
+        if (chunk.start < 0 || chunk.end > m_size || chunk.received < 0
+                || chunk.start + chunk.received > chunk.end) {
+            return false;
+        }
+        chunks.append(chunk);
+    }
+
+    if (chunks.isEmpty())
+        return false;
+
+    m_chunks = chunks;
+    return true;
+}
+
+void Download::saveState() const
+{
+    if (!m_acceptsRanges || m_validator.isEmpty())
+        return;
+
+    QJsonArray chunks;
+    for (const Chunk &chunk : m_chunks) {
+        QJsonObject object;
+        object[QStringLiteral("start")] = double(chunk.start);
+        object[QStringLiteral("end")] = double(chunk.end);
+        object[QStringLiteral("received")] = double(chunk.received);
+        chunks.append(object);
+    }
+
+    QJsonObject state;
+    state[QStringLiteral("url")] = m_resolvedUrl.toString();
+    state[QStringLiteral("size")] = double(m_size);
+    state[QStringLiteral("validator")] = QString::fromLatin1(m_validator);
+    state[QStringLiteral("chunks")] = chunks;
+
+    QSaveFile file(stateFileName(m_fileName));
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    file.write(QJsonDocument(state).toJson(QJsonDocument::Compact));
+    file.commit();
+}
+
+void Download::startChunk(int index)
+{
+    Chunk &chunk = m_chunks[index];
+
+    QNetworkRequest request = this->request(m_resolvedUrl);
+    if (m_acceptsRanges) {
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(chunk.start + chunk.received)
+                             + '-' + QByteArray::number(chunk.end - 1));
+        // The server sends the whole file if it changed meanwhile
+        if (!m_validator.isEmpty())
+            request.setRawHeader("If-Range", m_validator);
+    } else {
+        chunk.received = 0;
+    }
+
+    chunk.reply = m_networkManager->get(request);
+    chunk.throttled = false;
+    chunk.finishDeferred = false;
+    if (m_bandwidthLimiter)
+        chunk.reply->setReadBufferSize(ThrottledBufferSize);
+    connect(chunk.reply, &QNetworkReply::readyRead, this, [this, index]() {
+        chunkDataReceived(index);
+    });
+    connect(chunk.reply, &QNetworkReply::finished, this, [this, index]() {
+        chunkFinished(index);
+    });
+}
+
+void Download::chunkDataReceived(int index)
+{
+    Chunk &chunk = m_chunks[index];
+    QNetworkReply *reply = chunk.reply;
+    // Throttled reads come late
+    if (!reply || m_finished)
+        return;
+
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (m_acceptsRanges && status != 206) {
+        // Starting over next time is the only way to get a consistent file
+        QFile::remove(stateFileName(m_fileName));
+        m_acceptsRanges = false;
+        finish(QNetworkReply::ContentConflictError, tr("The file changed during the download"));
+        return;
+    }
+
+    qint64 size = reply->bytesAvailable();
+    if (m_bandwidthLimiter)
+        size = m_bandwidthLimiter->take(size);
+
+    // The rest is read once the budget allows, readyRead() is not emitted for it again
+    if (size < reply->bytesAvailable() && !chunk.throttled) {
+        chunk.throttled = true;
+        QTimer::singleShot(ThrottleInterval, this, [this, index]() {
+            m_chunks[index].throttled = false;
+            chunkDataReceived(index);
+        });
+    }
+
+    QByteArray data = reply->read(size);
+    if (chunk.end != -1)
+        data.truncate(int(qMin<qint64>(data.size(), chunk.end - chunk.start - chunk.received)));
+    if (data.isEmpty()) {
+        if (chunk.finishDeferred && !m_finished && !reply->bytesAvailable())
+            chunkFinished(index);
+        return;
+    }
+
+    m_file.seek(chunk.start + chunk.received);
+    if (m_file.write(data) != data.size()) {
+        finish(QNetworkReply::UnknownContentError, m_file.errorString());
+        return;
+    }
+    chunk.received += data.size();
+    m_transferred += data.size();
+
+    if (m_stateSaveTimer.elapsed() >= StateSaveInterval) {
+        saveState();
+        m_stateSaveTimer.restart();
+    }
+
+    emit progress(receivedBytes(), m_size);
+    deliver();
+
+    if (chunk.finishDeferred && !m_finished && !reply->bytesAvailable())
+        chunkFinished(index);
+}
+
+void Download::chunkFinished(int index)
+{
+    Chunk &chunk = m_chunks[index];
+    QNetworkReply *reply = chunk.reply;
+
+    // Throttled data is still to be read, see chunkDataReceived()
+    if (!m_finished && reply->error() == QNetworkReply::NoError && reply->bytesAvailable()) {
+        chunk.finishDeferred = true;
+        return;
+    }
+
+    chunk.reply = nullptr;
+    reply->deleteLater();
+
+    if (m_finished)
+        return;
+
+    QNetworkReply::NetworkError error = reply->error();
+    QString errorString = reply->errorString();
+    if (error == QNetworkReply::NoError) {
+        // Without a known size the file ends where the data did
+        if (chunk.end == -1) {
+            chunk.end = chunk.start + chunk.received;
+            m_size = chunk.end;
+        }
+
+        if (chunk.isComplete()) {
+            for (const Chunk &other : m_chunks) {
+                if (!other.isComplete())
+                    return;
+            }
+
+            if (m_file.size() != m_size) {
+                finish(QNetworkReply::UnknownContentError, tr("Downloaded file has a wrong size"));
+                return;
+            }
+
+            m_complete = true;
+            deliver();
+            return;
+        }
+
+        error = QNetworkReply::RemoteHostClosedError;
+        errorString = tr("Connection closed before the transfer completed");
+    }
+
+    // Resume where the transfer stopped. Without ranges it would start over, which
+    // is only possible if none of its data was handed out yet.
+    if (chunk.retries < MaxRetries && (m_acceptsRanges || m_delivered == 0)) {
+        ++chunk.retries;
+        saveState();
+        QTimer::singleShot(RetryDelay * chunk.retries, this, [this, index]() {
+            if (!m_finished)
+                startChunk(index);
+        });
+        return;
+    }
+
+    finish(error, errorString);
+}
+
+void Download::abortChunks()
+{
+    for (Chunk &chunk : m_chunks) {
+        if (!chunk.reply)
+            continue;
+
+        // Replies which already finished, with throttled data left, do not finish again
+        if (chunk.finishDeferred) {
+            chunk.reply->deleteLater();
+            chunk.reply = nullptr;
+        } else {
+            chunk.reply->abort();
+        }
+    }
+}
+
+qint64 Download::availableBytes() const
+{
+    // Chunks are ordered, data is contiguous up to the first incomplete one
+    qint64 available = 0;
+    for (const Chunk &chunk : m_chunks) {
+        if (chunk.start > available)
+            break;
+        available = chunk.start + chunk.received;
+        if (!chunk.isComplete())
+            break;
+    }
+    return available;
+}
+
+qint64 Download::receivedBytes() const
+{
+    qint64 received = 0;
+    for (const Chunk &chunk : m_chunks)
+        received += chunk.received;
+    return received;
+}
+
+void Download::finish(QNetworkReply::NetworkError error, const QString &errorString)
+{
+    if (m_finished)
+        return;
+
+    m_finished = true;
+    m_error = error;
+    m_errorString = errorString;
+
+    if (m_headReply)
+        m_headReply->abort();
+    abortChunks();
+
+    // Kept for the next attempt
+    if (error != QNetworkReply::NoError)
+        saveState();
+    m_file.close();
+
+    emit finished();
+}
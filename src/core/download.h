@@ -0,0 +1,116 @@
+#ifndef DOWNLOAD_H
+#define DOWNLOAD_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QNetworkReply>
+#include <QObject>
+#include <QUrl>
+#include <QVector>
+
+class QNetworkAccessManager;
+
+namespace Zeal {
+namespace Core {
+
+class BandwidthLimiter;
+
+// Downloads a file into fileName(), in parallel HTTP Range requests when the server
+// supports them. Progress is saved next to the file, so a later Download of the same
+// file only fetches what is missing. Transfers interrupted by network errors are
+// retried from where they stopped.
+class Download : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Download(QNetworkAccessManager *networkManager, const QUrl &url,
+                      const QString &fileName, QObject *parent = nullptr);
+    ~Download() override;
+
+    QUrl url() const;
+    QString fileName() const;
+    // Bytes received from the network by this download, without those resumed from disk
+    qint64 transferredBytes() const;
+
+    QNetworkReply::NetworkError error() const;
+    QString errorString() const;
+
+    // Reads no faster than \a limiter allows, which has to outlive the download.
+    // Has to be set before start().
+    void setBandwidthLimiter(BandwidthLimiter *limiter);
+
+    // While paused, dataAvailable() is not emitted and finished() waits for the rest of the
+    // data to be handed out. Transfers go on into the file in the meantime.
+    bool isDeliveryPaused() const;
+    void setDeliveryPaused(bool paused);
+
+public slots:
+    void start();
+    void abort();
+
+signals:
+    void started();
+    // Data from the start of the file, in order, as it becomes available
+    void dataAvailable(const QByteArray &data);
+    void progress(qint64 received, qint64 total);
+    // Emitted once, on success or failure
+    void finished();
+
+private slots:
+    void headFinished();
+    void deliver();
+
+private:
+    struct Chunk
+    {
+        qint64 start = 0;
+        qint64 end = -1; // exclusive, -1 if the size is unknown
+        qint64 received = 0;
+        int retries = 0;
+        QNetworkReply *reply = nullptr;
+        // Data waits for the bandwidth limiter, see chunkDataReceived()
+        bool throttled = false;
+        bool finishDeferred = false;
+
+        bool isComplete() const { return end != -1 && start + received >= end; }
+    };
+
+    QNetworkRequest request(const QUrl &url) const;
+    bool loadState();
+    void saveState() const;
+    void startChunk(int index);
+    void chunkDataReceived(int index);
+    void chunkFinished(int index);
+    void abortChunks();
+    qint64 availableBytes() const;
+    qint64 receivedBytes() const;
+    void finish(QNetworkReply::NetworkError error, const QString &errorString = QString());
+
+    QNetworkAccessManager *m_networkManager = nullptr;
+    BandwidthLimiter *m_bandwidthLimiter = nullptr;
+    QUrl m_url;
+    QUrl m_resolvedUrl; // after redirects
+    int m_redirects = 0;
+    QString m_fileName;
+    QFile m_file;
+
+    qint64 m_size = -1;
+    QByteArray m_validator; // ETag or Last-Modified of the file
+    bool m_acceptsRanges = false;
+    QVector<Chunk> m_chunks;
+    qint64 m_delivered = 0;
+    bool m_deliveryPaused = false;
+    qint64 m_transferred = 0;
+    bool m_complete = false; // all chunks received
+    QElapsedTimer m_stateSaveTimer;
+
+    QNetworkReply *m_headReply = nullptr;
+    bool m_finished = false;
+    QNetworkReply::NetworkError m_error = QNetworkReply::NoError;
+    QString m_errorString;
+};
+
+} // namespace Core
+} // namespace Zeal
+
+#endif // DOWNLOAD_H
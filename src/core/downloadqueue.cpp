@@ -0,0 +1,93 @@
+#include "downloadqueue.h"
+
+#include "download.h"
+
+using namespace Zeal::Core;
+
+DownloadQueue::DownloadQueue(QObject *parent) :
+    QObject(parent)
+{
+}
+
+int DownloadQueue::maxActiveDownloads() const
+{
+    return m_maxActiveDownloads;
+}
+
+void DownloadQueue::setMaxActiveDownloads(int count)
+{
+    m_maxActiveDownloads = qMax(count, 1);
+    startDownloads();
+}
+
+int DownloadQueue::maxDownloadsPerHost() const
+{
+    return m_maxDownloadsPerHost;
+}
+
+void DownloadQueue::setMaxDownloadsPerHost(int count)
+{
+    m_maxDownloadsPerHost = qMax(count, 1);
+    startDownloads();
+}
+
+void DownloadQueue::setBandwidthLimit(qint64 limit)
+{
+    m_bandwidthLimiter.setLimit(limit);
+}
+
+void DownloadQueue::enqueue(Download *download, int priority)
+{
+    download->setBandwidthLimiter(&m_bandwidthLimiter);
+
+    // Queued and running downloads leave the same way
+    connect(download, &Download::finished, this, [this, download]() {
+        downloadFinished(download);
+    });
+    connect(download, &QObject::destroyed, this, &DownloadQueue::downloadFinished);
+
+    int i = m_queued.size();
+    while (i > 0 && m_queued.at(i - 1).priority < priority)
+        --i;
+    m_queued.insert(i, {download, priority});
+
+    startDownloads();
+}
+
+// Called with a destroyed object, too
+void DownloadQueue::downloadFinished(QObject *download)
+{
+    const auto it = m_active.find(download);
+    if (it != m_active.end()) {
+        if (--m_activeByHost[it.value()] == 0)
+            m_activeByHost.remove(it.value());
+        m_active.erase(it);
+        startDownloads();
+        return;
+    }
+
+    for (int i = 0; i < m_queued.size(); ++i) {
+        if (m_queued.at(i).download == download) {
+            m_queued.removeAt(i);
+            return;
+        }
+    }
+}
+
+void DownloadQueue::startDownloads()
+{
+    // Downloads from busy hosts are passed over for queued ones from other hosts
+    for (int i = 0; i < m_queued.size() && m_active.size() < m_maxActiveDownloads;) {
+        Download *download = m_queued.at(i).download;
+        const QString host = download->url().host();
+        if (m_activeByHost.value(host) >= m_maxDownloadsPerHost) {
+            ++i;
+            continue;
+        }
+
+        m_queued.removeAt(i);
+        m_active.insert(download, host);
+        ++m_activeByHost[host];
+        download->start();
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef DOWNLOADQUEUE_H
+#define DOWNLOADQUEUE_H
+
+#include "bandwidthlimiter.h"
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+
+namespace Zeal {
+namespace Core {
+
+class Download;
+
+/**
+ * @short Starts downloads a few at a time.
+ *
+ * Queued downloads start once fewer than maxActiveDownloads() are running, and fewer than
+ * maxDownloadsPerHost() from their host. Higher priorities start first, otherwise they
+ * start in the order they were queued. All downloads share an optional bandwidth limit.
+ */
+class DownloadQueue : public QObject
+{
+    Q_OBJECT
+public:
+    enum Priority {
+        BackgroundPriority = 0,
+        // Downloads the user asked for, ahead of updates
+        UserPriority = 1
+    };
+
+    explicit DownloadQueue(QObject *parent = nullptr);
+
+    int maxActiveDownloads() const;
+    void setMaxActiveDownloads(int count);
+    int maxDownloadsPerHost() const;
+    void setMaxDownloadsPerHost(int count);
+    // In bytes per second, 0 for no limit
+    void setBandwidthLimit(qint64 limit);
+
+    // Starts \a download when its turn comes. Aborting a download before that takes it
+    // out of the queue.
+    void enqueue(Download *download, int priority = BackgroundPriority);
+
+private slots:
+    void downloadFinished(QObject *download);
+
+private:
+    struct Entry
+    {
+        Download *download;
+        int priority;
+    };
+
+    void startDownloads();
+
+    int m_maxActiveDownloads = 3;
+    int m_maxDownloadsPerHost = 2;
+    BandwidthLimiter m_bandwidthLimiter;
+
+    // By priority, then in order of enqueue()
+    QList<Entry> m_queued;
+    // Hosts of running downloads
+    QHash<QObject *, QString> m_active;
+    QHash<QString, int> m_activeByHost;
+};
+
+} // namespace Core
+} // namespace Zeal
+
+#endif // DOWNLOADQUEUE_H
@@ -1,44 +1,412 @@
 #include "extractor.h"
 
+#include "metrics.h"
+#include "task.h"
+
+#include <QCryptographicHash>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QQueue>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QWaitCondition>
 
 #include <archive.h>
 #include <archive_entry.h>
 
+#include <cerrno>
+#include <cstring>
+#include <functional>
+
 using namespace Zeal::Core;
 
-Extractor::Extractor(QObject *parent) :
-    QObject(parent)
+namespace {
+// Bounds the number of archives being written to disk at the same time
+const int MaxConcurrentExtractions = 3;
+// Bytes handed to libarchive per read, docsets are large and mostly compressed HTML
+const int ReadBlockSize = 1024 * 1024;
+// Streams queue at most this much received data before appendData() asks for a pause,
+// and take more again once half of it has been extracted
+const qint64 MaxQueuedBytes = 16 * 1024 * 1024;
+// Minimum time between two progress() signals of an archive
+const int ProgressInterval = 100; // ms
+// Entries are written as they are, without restoring owners, ACLs or extended attributes.
+// Archives come from mirrors and feeds, none of their entries may leave the destination.
+const int DiskWriteFlags = ARCHIVE_EXTRACT_SECURE_NODOTDOT | ARCHIVE_EXTRACT_SECURE_SYMLINKS
+        | ARCHIVE_EXTRACT_SECURE_NOABSOLUTEPATHS;
+// Written into docsets, see Manifest
+const char ManifestFileName[] = ".zeal-manifest";
+// Files up to this size are compared with the manifest before being written
+const qint64 MaxComparedSize = 4 * 1024 * 1024;
+}
+
+namespace Zeal {
+namespace Core {
+// Chunks received but not yet consumed by libarchive
+struct ExtractionStream
+{
+    QMutex mutex;
+    QWaitCondition dataAvailable;
+    QQueue<QByteArray> chunks;
+    QByteArray current; // handed to libarchive, must stay alive until the next read
+    qint64 queuedBytes = 0;
+    // Set once appendData() asked for a pause, see Extractor::streamDrained()
+    bool full = false;
+    bool finished = false;
+    bool aborted = false;
+    // Called from the extraction thread once a full queue has been drained
+    std::function<void()> drained;
+};
+} // namespace Core
+} // namespace Zeal
+
+namespace {
+la_ssize_t readStream(archive *a, void *clientData, const void **buffer)
 {
+    auto stream = static_cast<ExtractionStream *>(clientData);
+
+    QMutexLocker locker(&stream->mutex);
+    while (stream->chunks.isEmpty() && !stream->finished && !stream->aborted)
+        stream->dataAvailable.wait(&stream->mutex);
+
+    if (stream->aborted) {
+        archive_set_error(a, ECANCELED, "Download was aborted");
+        return ARCHIVE_FATAL;
+    }
+
+    if (stream->chunks.isEmpty())
+        return 0;
+
+    // Network chunks are small, hand over whatever has arrived in one block
+    stream->current = stream->chunks.dequeue();
+    while (!stream->chunks.isEmpty() && stream->current.size() < ReadBlockSize)
+        stream->current += stream->chunks.dequeue();
+    *buffer = stream->current.constData();
+
+    stream->queuedBytes -= stream->current.size();
+    const bool drained = stream->full && stream->queuedBytes <= MaxQueuedBytes / 2;
+    if (drained)
+        stream->full = false;
+    locker.unlock();
+
+    if (drained)
+        stream->drained();
+    return stream->current.size();
+}
+
+// Path of an entry relative to the destination, without the root directory of the archive
+const char *relativePath(const char *pathname, bool stripRoot)
+{
+    if (stripRoot) {
+        if (const char *separator = strchr(pathname, '/'))
+            return separator + 1;
+    }
+    return pathname;
 }
 
-void Extractor::extract(const QString &filePath, const QString &destination, const QString &root)
+// Prefixes \a relativePath with \a prefix, reusing the allocation of \a path
+const char *absolutePath(QByteArray &path, const QByteArray &prefix, const char *relativePath)
+{
+    path.resize(prefix.size());
+    path.append(relativePath);
+    return path.constData();
+}
+
+// Files of a docset written by the last extraction, by relative path. Lets updates
+// leave unchanged files alone, and remove those no longer in the archive.
+struct ManifestEntry
+{
+    QByteArray hash; // SHA-1
+    qint64 size;
+};
+
+typedef QHash<QByteArray, ManifestEntry> Manifest;
+
+Manifest readManifest(const QString &fileName)
 {
-    archive *a = archive_read_new();
-    archive_read_support_filter_all(a);
-    archive_read_support_format_all(a);
+    Manifest manifest;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return manifest;
+
+    // Lines of "<hash> <size> <path>"
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine();
+        if (line.endsWith('\n'))
+            line.chop(1);
+
+        const int hashEnd = line.indexOf(' ');
+        const int sizeEnd = line.indexOf(' ', hashEnd + 1);
+        if (hashEnd == -1 || sizeEnd == -1)
+            continue;
+
+        ManifestEntry entry;
+        entry.hash = QByteArray::fromHex(line.left(hashEnd));
+        entry.size = line.mid(hashEnd + 1, sizeEnd - hashEnd - 1).toLongLong();
+        manifest.insert(line.mid(sizeEnd + 1), entry);
+    }
 
-    int r = archive_read_open_filename(a, qPrintable(filePath), 10240);
-    if (r) {
-        emit error(filePath, QString::fromLocal8Bit(archive_error_string(a)));
+    return manifest;
+}
+
+void writeManifest(const QString &fileName, const Manifest &manifest)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
         return;
+
+    for (auto it = manifest.cbegin(); it != manifest.cend(); ++it) {
+        file.write(it.value().hash.toHex() + ' ' + QByteArray::number(it.value().size) + ' '
+                   + it.key() + '\n');
+    }
+    file.commit();
+}
+
+int readData(archive *a, qint64 size, QByteArray *data)
+{
+    data->resize(int(size));
+
+    qint64 offset = 0;
+    while (offset < size) {
+        const la_ssize_t read = archive_read_data(a, data->data() + offset, size_t(size - offset));
+        if (read < 0)
+            return int(read);
+        if (read == 0)
+            break;
+        offset += read;
+    }
+
+    data->resize(int(offset));
+    return ARCHIVE_OK;
+}
+
+int copyData(archive *in, archive *out, qint64 *bytes, QCryptographicHash *hash = nullptr)
+{
+    const void *buffer;
+    size_t size;
+    la_int64_t offset;
+
+    forever {
+        int r = archive_read_data_block(in, &buffer, &size, &offset);
+        if (r == ARCHIVE_EOF)
+            return ARCHIVE_OK;
+        if (r < ARCHIVE_WARN)
+            return r;
+
+        r = archive_write_data_block(out, buffer, size, offset);
+        if (r < ARCHIVE_WARN)
+            return r;
+        if (hash)
+            hash->addData(static_cast<const char *>(buffer), int(size));
+        *bytes += size;
+    }
+}
+}
+
+Extractor::Extractor(QObject *parent) :
+    QObject(parent),
+    m_pool(new QThreadPool(this))
+{
+    m_pool->setMaxThreadCount(MaxConcurrentExtractions);
+}
+
+Extractor::~Extractor()
+{
+    for (const QString &name : m_streams.keys())
+        abortStream(name);
+    m_pool->waitForDone();
+}
+
+void Extractor::startStream(const QString &name, const QString &destination, const QString &root)
+{
+    if (m_streams.contains(name))
+        abortStream(name);
+
+    QSharedPointer<ExtractionStream> stream(new ExtractionStream());
+    stream->drained = [this, name]() {
+        emit streamDrained(name);
+    };
+    m_streams.insert(name, stream);
+
+    m_pool->start(new Task([this, stream, name, destination, root]() {
+        archive *a = archive_read_new();
+        archive_read_support_filter_all(a);
+        archive_read_support_format_all(a);
+
+        if (archive_read_open(a, stream.data(), nullptr, readStream, nullptr) != ARCHIVE_OK) {
+            emit error(name, QString::fromLocal8Bit(archive_error_string(a)));
+            archive_read_free(a);
+            return;
+        }
+
+        extractArchive(a, name, destination, root);
+    }));
+}
+
+bool Extractor::appendData(const QString &name, const QByteArray &data)
+{
+    const QSharedPointer<ExtractionStream> stream = m_streams.value(name);
+    if (!stream)
+        return true;
+
+    QMutexLocker locker(&stream->mutex);
+    if (!data.isEmpty()) {
+        stream->chunks.enqueue(data);
+        stream->queuedBytes += data.size();
+        stream->dataAvailable.wakeOne();
     }
 
+    if (stream->queuedBytes >= MaxQueuedBytes)
+        stream->full = true;
+    return !stream->full;
+}
+
+void Extractor::finishStream(const QString &name)
+{
+    const QSharedPointer<ExtractionStream> stream = m_streams.take(name);
+    if (!stream)
+        return;
+
+    QMutexLocker locker(&stream->mutex);
+    stream->finished = true;
+    stream->dataAvailable.wakeOne();
+}
+
+void Extractor::abortStream(const QString &name)
+{
+    const QSharedPointer<ExtractionStream> stream = m_streams.take(name);
+    if (!stream)
+        return;
+
+    QMutexLocker locker(&stream->mutex);
+    stream->aborted = true;
+    stream->chunks.clear();
+    stream->queuedBytes = 0;
+    stream->dataAvailable.wakeOne();
+}
+
+void Extractor::extractArchive(archive *a, const QString &name, const QString &destination,
+                               const QString &root)
+{
     QDir destinationDir(destination);
     if (!root.isEmpty())
         destinationDir = destinationDir.absoluteFilePath(root);
+    const bool stripRoot = !root.isEmpty();
+
+    // Paths are built from the raw bytes of entries, instead of going through QDir for each
+    const QByteArray prefix = QFile::encodeName(destinationDir.absolutePath()) + '/';
+    QByteArray path;
+    QByteArray linkPath;
+
+    // Only docsets, which are extracted into their own root, keep a manifest
+    const QString manifestFileName = destinationDir.absoluteFilePath(QLatin1String(ManifestFileName));
+    const Manifest oldManifest = stripRoot ? readManifest(manifestFileName) : Manifest();
+    Manifest manifest;
+
+    archive *disk = archive_write_disk_new();
+    archive_write_disk_set_options(disk, DiskWriteFlags);
+
+    qint64 extractedBytes = 0;
+    int extractedEntries = 0;
+    QElapsedTimer extractionTimer;
+    extractionTimer.start();
+    QElapsedTimer progressTimer;
+    progressTimer.start();
 
     // TODO: Do not strip root directory in archive if it equals to 'root'
     archive_entry *entry;
-    while (archive_read_next_header(a, &entry) == ARCHIVE_OK) {
-        QString pathname = archive_entry_pathname(entry);
-        if (!root.isEmpty())
-            pathname.remove(0, pathname.indexOf(QLatin1String("/")) + 1);
-        archive_entry_set_pathname(entry, qPrintable(destinationDir.absoluteFilePath(pathname)));
-        archive_read_extract(a, entry, 0);
+    QByteArray data;
+    int r;
+    while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
+        const QByteArray relative = relativePath(archive_entry_pathname(entry), stripRoot);
+        archive_entry_set_pathname(entry, absolutePath(path, prefix, relative.constData()));
+        const char *hardlink = archive_entry_hardlink(entry);
+        if (hardlink) {
+            archive_entry_set_hardlink(entry, absolutePath(linkPath, prefix,
+                                                           relativePath(hardlink, stripRoot)));
+        }
+
+        const bool isFile = stripRoot && !hardlink && archive_entry_filetype(entry) == AE_IFREG;
+        // Some formats only tell the size once the data has been read
+        const bool sizeKnown = archive_entry_size_is_set(entry);
+        const qint64 size = archive_entry_size(entry);
+
+        if (isFile && sizeKnown && size <= MaxComparedSize) {
+            // Updates mostly consist of files which did not change
+            r = readData(a, size, &data);
+            if (r < ARCHIVE_WARN)
+                break;
+
+            const ManifestEntry written = {QCryptographicHash::hash(data, QCryptographicHash::Sha1),
+                                           data.size()};
+            manifest.insert(relative, written);
+            extractedBytes += data.size();
+
+            const auto previous = oldManifest.constFind(relative);
+            const bool unchanged = previous != oldManifest.cend()
+                    && previous->hash == written.hash && previous->size == written.size
+                    && QFileInfo(QFile::decodeName(path)).size() == written.size;
+            if (!unchanged) {
+                r = archive_write_header(disk, entry);
+                if (r >= ARCHIVE_WARN && !data.isEmpty()
+                        && archive_write_data(disk, data.constData(), size_t(data.size())) < 0) {
+                    r = ARCHIVE_FATAL;
+                }
+                if (r >= ARCHIVE_WARN)
+                    r = archive_write_finish_entry(disk);
+            }
+        } else {
+            QCryptographicHash hash(QCryptographicHash::Sha1);
+            qint64 written = 0;
+            r = archive_write_header(disk, entry);
+            if (r >= ARCHIVE_WARN && (!sizeKnown || size > 0))
+                r = copyData(a, disk, &written, isFile ? &hash : nullptr);
+            if (r >= ARCHIVE_WARN)
+                r = archive_write_finish_entry(disk);
+            extractedBytes += written;
+            if (isFile)
+                manifest.insert(relative, {hash.result(), written});
+        }
+        if (r < ARCHIVE_WARN)
+            break;
+
+        ++extractedEntries;
+        if (progressTimer.elapsed() >= ProgressInterval) {
+            emit progress(name, archive_filter_bytes(a, -1), extractedBytes, extractedEntries);
+            progressTimer.restart();
+        }
     }
 
-    emit completed(filePath);
+    // Truncated or aborted downloads end early
+    if (r != ARCHIVE_EOF) {
+        const char *message = archive_error_string(a);
+        if (!message)
+            message = archive_error_string(disk);
+        emit error(name, QString::fromLocal8Bit(message));
+    } else {
+        if (stripRoot) {
+            // Pages dropped by an update
+            for (auto it = oldManifest.cbegin(); it != oldManifest.cend(); ++it) {
+                if (!manifest.contains(it.key()))
+                    QFile::remove(QFile::decodeName(prefix + it.key()));
+            }
+            writeManifest(manifestFileName, manifest);
+        }
+
+        const qint64 elapsed = extractionTimer.nsecsElapsed() / 1000; // us
+        if (elapsed > 0) {
+            Metrics::record(Metrics::ExtractionThroughput,
+                            quint64(extractedBytes * 1000000.0 / elapsed));
+        }
+
+        emit progress(name, archive_filter_bytes(a, -1), extractedBytes, extractedEntries);
+        emit completed(name);
+    }
+
+    archive_write_free(disk);
     archive_read_free(a);
 }
-
@@ -1,23 +1,55 @@
 #ifndef EXTRACTOR_H
 #define EXTRACTOR_H
 
+#include <QHash>
 #include <QObject>
+#include <QSharedPointer>
+
+struct archive;
+
+class QThreadPool;
 
 namespace Zeal {
 namespace Core {
 
+struct ExtractionStream;
+
+// Extracts archives on a bounded pool of threads. Signals are emitted from those threads.
 class Extractor : public QObject
 {
     Q_OBJECT
 public:
     explicit Extractor(QObject *parent = 0);
+    ~Extractor() override;
 
-public slots:
-    void extract(const QString &filePath, const QString &destination, const QString &root = QString());
+    // Extracts an archive while it is still being received. Data is passed with
+    // appendData() and the end of the archive marked with finishStream().
+    // \a name identifies the stream, and is what completed() and error() report.
+    void startStream(const QString &name, const QString &destination, const QString &root = QString());
+    // Returns false once extraction falls behind, after which no more data should be passed
+    // until streamDrained() is emitted. \a data is queued either way.
+    bool appendData(const QString &name, const QByteArray &data);
+    void finishStream(const QString &name);
+    void abortStream(const QString &name);
 
 signals:
-    void error(const QString &filePath, const QString &message);
-    void completed(const QString &filePath);
+    // Report the name of the stream
+    void error(const QString &name, const QString &message);
+    void completed(const QString &name);
+    // Emitted periodically while extracting. \a readBytes counts compressed input,
+    // \a extractedBytes the data written to disk.
+    void progress(const QString &name, qint64 readBytes, qint64 extractedBytes,
+                  int extractedEntries);
+    // The stream \a name takes data again, after appendData() returned false
+    void streamDrained(const QString &name);
+
+private:
+    void extractArchive(archive *a, const QString &name, const QString &destination,
+                        const QString &root);
+
+    QThreadPool *m_pool = nullptr;
+    // Streams still receiving data, only accessed from the thread of the extractor
+    QHash<QString, QSharedPointer<ExtractionStream>> m_streams;
 };
 
 } // namespace Core
@@ -0,0 +1,123 @@
+#include "histogram.h"
+
+#include <QtMath>
+
+using namespace Zeal::Core;
+
+namespace {
+// Each power of two is split into 2^SubBucketBits buckets
+const int SubBucketBits = 3;
+const int SubBuckets = 1 << SubBucketBits;
+// Values from 2^MaxBits on share the last bucket
+const int MaxBits = 40;
+
+static_assert(Histogram::BucketCount == SubBuckets + (MaxBits - SubBucketBits) * SubBuckets,
+              "BucketCount does not match the bucket layout");
+
+// Position of the highest bit set in \a value, which must not be 0
+int highestBit(quint64 value)
+{
+    int bit = 0;
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        if (value >> shift) {
+            value >>= shift;
+            bit += shift;
+        }
+    }
+    return bit;
+}
+}
+
+Histogram::Histogram() :
+    m_buckets(BucketCount, 0)
+{
+}
+
+int Histogram::bucketOf(quint64 value)
+{
+    if (value < quint64(SubBuckets))
+        return int(value);
+
+    const int bits = highestBit(value);
+    if (bits >= MaxBits)
+        return BucketCount - 1;
+
+    // The bits below the highest one select the bucket within its power of two
+    const int subBucket = int(value >> (bits - SubBucketBits)) - SubBuckets;
+    return SubBuckets + (bits - SubBucketBits) * SubBuckets + subBucket;
+}
+
+quint64 Histogram::lowerBound(int bucket)
+{
+    if (bucket < SubBuckets)
+        return quint64(bucket);
+
+    const int octave = (bucket - SubBuckets) / SubBuckets;
+    const int subBucket = (bucket - SubBuckets) % SubBuckets;
+    return quint64(SubBuckets + subBucket) << octave;
+}
+
+bool Histogram::isEmpty() const
+{
+    return m_count == 0;
+}
+
+quint64 Histogram::count() const
+{
+    return m_count;
+}
+
+quint64 Histogram::sum() const
+{
+    return m_sum;
+}
+
+quint64 Histogram::max() const
+{
+    return m_max;
+}
+
+quint64 Histogram::bucket(int index) const
+{
+    return m_buckets.at(index);
+}
+
+void Histogram::add(int bucket, quint64 count)
+{
+    m_buckets[bucket] += count;
+    m_count += count;
+}
+
+void Histogram::addSum(quint64 sum)
+{
+    m_sum += sum;
+}
+
+void Histogram::addMax(quint64 max)
+{
+    m_max = qMax(m_max, max);
+}
+
+quint64 Histogram::countBelow(quint64 bound) const
+{
+    const int end = bucketOf(bound);
+    quint64 count = 0;
+    for (int i = 0; i < end; ++i)
+        count += m_buckets.at(i);
+    return count;
+}
+
+quint64 Histogram::percentile(double quantile) const
+{
+    if (m_count == 0)
+        return 0;
+
+    const quint64 rank = qMax(quint64(1), quint64(qCeil(qBound(0.0, quantile, 1.0) * m_count)));
+    quint64 count = 0;
+    for (int i = 0; i < BucketCount - 1; ++i) {
+        count += m_buckets.at(i);
+        if (count >= rank)
+            return qMin(lowerBound(i + 1) - 1, m_max);
+    }
+    return m_max;
+}
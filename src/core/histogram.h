@@ -0,0 +1,58 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <QtGlobal>
+#include <QVector>
+
+namespace Zeal {
+namespace Core {
+
+/**
+ * @short Distribution of non-negative integer values, with a bounded relative error.
+ *
+ * Values below 8 have a bucket each. Every further power of two is split into 8 buckets
+ * of equal width, so a bucket is at most 12.5% wide relative to the values in it, however
+ * large they are. Values of 2^40 and above share the last bucket.
+ *
+ * Histograms are plain values. Metrics records into atomic buckets of the same layout,
+ * and merges them into a Histogram when exporting.
+ */
+class Histogram
+{
+public:
+    static const int BucketCount = 304;
+
+    explicit Histogram();
+
+    static int bucketOf(quint64 value);
+    // Smallest value falling into \a bucket
+    static quint64 lowerBound(int bucket);
+
+    bool isEmpty() const;
+    quint64 count() const;
+    quint64 sum() const;
+    quint64 max() const;
+    quint64 bucket(int index) const;
+
+    // Adds \a count values falling into \a bucket. Their sum and maximum are added apart.
+    void add(int bucket, quint64 count);
+    void addSum(quint64 sum);
+    void addMax(quint64 max);
+
+    // Number of values below \a bound, which is rounded down to the edge of its bucket
+    quint64 countBelow(quint64 bound) const;
+    // Value below which \a quantile of all values fall, between 0 and 1. Accurate to
+    // the width of a bucket, never larger than the largest value.
+    quint64 percentile(double quantile) const;
+
+private:
+    QVector<quint64> m_buckets;
+    quint64 m_count = 0;
+    quint64 m_sum = 0;
+    quint64 m_max = 0;
+};
+
+} // namespace Core
+} // namespace Zeal
+
+#endif // HISTOGRAM_H
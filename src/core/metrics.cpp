@@ -0,0 +1,421 @@
+#include "metrics.h"
+
+#include "application.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QHostInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+#include <QUrl>
+
+#include <atomic>
+
+#if defined(Q_OS_LINUX)
+    #include <QFile>
+    #include <unistd.h>
+#elif defined(Q_OS_MAC)
+    #include <mach/mach.h>
+#elif defined(Q_OS_WIN32)
+    #include <windows.h>
+    #include <psapi.h>
+#endif
+
+using namespace Zeal::Core;
+
+namespace {
+// Memory use changes slowly, and is sampled apart from exports to see its peaks
+const int SampleInterval = 10000; // ms
+const int MinExportInterval = 10; // s
+
+struct SeriesInfo
+{
+    const char *family; // Prometheus metric name
+    const char *help;
+    const char *label; // name="value", or nullptr
+    // Prometheus buckets are exported for the powers of two in between
+    int minBits;
+    int maxBits;
+};
+
+// By Metrics::Series. Series of a family are next to each other.
+const SeriesInfo SeriesInfos[Metrics::SeriesCount] = {
+    {"zeal_query_latency_microseconds", "Time until all results of a query were delivered.",
+     "docsets=\"1\"", 6, 24},
+    {"zeal_query_latency_microseconds", nullptr, "docsets=\"2-4\"", 6, 24},
+    {"zeal_query_latency_microseconds", nullptr, "docsets=\"5-16\"", 6, 24},
+    {"zeal_query_latency_microseconds", nullptr, "docsets=\"17-64\"", 6, 24},
+    {"zeal_query_latency_microseconds", nullptr, "docsets=\"65+\"", 6, 24},
+    {"zeal_startup_phase_microseconds", "Time spent in each phase of starting the application.",
+     "phase=\"settings\"", 8, 26},
+    {"zeal_startup_phase_microseconds", nullptr, "phase=\"main_window\"", 8, 26},
+    {"zeal_startup_phase_microseconds", nullptr, "phase=\"query_server\"", 8, 26},
+    {"zeal_startup_phase_microseconds", nullptr, "phase=\"total\"", 8, 26},
+    {"zeal_docset_loading_microseconds", "Time spent in each phase of loading docsets.",
+     "phase=\"walk_roots\"", 8, 26},
+    {"zeal_docset_loading_microseconds", nullptr, "phase=\"read_manifests\"", 8, 26},
+    {"zeal_docset_loading_microseconds", nullptr, "phase=\"add_docsets\"", 8, 26},
+    {"zeal_docset_loading_microseconds", nullptr, "phase=\"total\"", 8, 26},
+    {"zeal_extraction_throughput_bytes_per_second", "Extraction rate of each docset archive.",
+     nullptr, 16, 32},
+    {"zeal_resident_memory_bytes", "Resident memory of the process, sampled every 10 seconds.",
+     nullptr, 22, 36}
+};
+
+// Same layout as Histogram. The count is the sum of the buckets.
+struct AtomicHistogram
+{
+    std::atomic<quint64> buckets[Histogram::BucketCount];
+    std::atomic<quint64> sum;
+    std::atomic<quint64> max;
+};
+
+// Histograms of a single thread, created on its first value of each series. Only that
+// thread writes them, the exporter reads them concurrently.
+struct Shard
+{
+    std::atomic<AtomicHistogram *> histograms[Metrics::SeriesCount];
+};
+
+// Shards of finished threads are kept, as their values still count. Threads of pools
+// live for long, so they are few.
+struct ShardList
+{
+    QMutex mutex;
+    QVector<Shard *> shards;
+};
+
+ShardList &shardList()
+{
+    static ShardList list;
+    return list;
+}
+
+thread_local Shard *currentShard = nullptr;
+QAtomicInt enabled = 0;
+
+// Only the owning thread writes, so a relaxed read and write stand in for an atomic add
+inline void add(std::atomic<quint64> &counter, quint64 value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+}
+
+Metrics::Metrics(QObject *parent) :
+    QObject(parent),
+    m_exportTimer(new QTimer(this)),
+    m_sampleTimer(new QTimer(this))
+{
+    connect(m_exportTimer, &QTimer::timeout, this, &Metrics::exportMetrics);
+    connect(m_sampleTimer, &QTimer::timeout, this, &Metrics::sampleMemory);
+}
+
+// Posting needs the event loop, which is gone by now. Files get the last values.
+Metrics::~Metrics()
+{
+    if (!m_target.isEmpty() && !isUrlTarget())
+        writeFile(serialize());
+}
+
+bool Metrics::isEnabled()
+{
+    return enabled.load();
+}
+
+void Metrics::setEnabled(bool enable)
+{
+    enabled.store(enable);
+}
+
+void Metrics::record(Series series, quint64 value)
+{
+    if (!enabled.load())
+        return;
+
+    Shard *shard = currentShard;
+    if (!shard) {
+        // Value-initialized, all histograms are nullptr
+        shard = new Shard();
+        ShardList &list = shardList();
+        QMutexLocker locker(&list.mutex);
+        list.shards.append(shard);
+        currentShard = shard;
+    }
+
+    AtomicHistogram *histogram = shard->histograms[series].load(std::memory_order_relaxed);
+    if (!histogram) {
+        // Value-initialized, all counters are 0
+        histogram = new AtomicHistogram();
+        shard->histograms[series].store(histogram, std::memory_order_release);
+    }
+
+    add(histogram->buckets[Histogram::bucketOf(value)], 1);
+    add(histogram->sum, value);
+    if (value > histogram->max.load(std::memory_order_relaxed))
+        histogram->max.store(value, std::memory_order_relaxed);
+}
+
+Metrics::Series Metrics::queryLatencySeries(int docsetCount)
+{
+    if (docsetCount <= 1)
+        return QueryLatency1Docset;
+    if (docsetCount <= 4)
+        return QueryLatency2To4Docsets;
+    if (docsetCount <= 16)
+        return QueryLatency5To16Docsets;
+    if (docsetCount <= 64)
+        return QueryLatency17To64Docsets;
+    return QueryLatencyMoreDocsets;
+}
+
+QVector<Histogram> Metrics::snapshot()
+{
+    QVector<Histogram> histograms(SeriesCount);
+
+    ShardList &list = shardList();
+    QMutexLocker locker(&list.mutex);
+    for (const Shard *shard : list.shards) {
+        for (int i = 0; i < SeriesCount; ++i) {
+            const AtomicHistogram *histogram
+                    = shard->histograms[i].load(std::memory_order_acquire);
+            if (!histogram)
+                continue;
+
+            Histogram &merged = histograms[i];
+            for (int bucket = 0; bucket < Histogram::BucketCount; ++bucket) {
+                const quint64 count = histogram->buckets[bucket].load(std::memory_order_relaxed);
+                if (count)
+                    merged.add(bucket, count);
+            }
+            merged.addSum(histogram->sum.load(std::memory_order_relaxed));
+            merged.addMax(histogram->max.load(std::memory_order_relaxed));
+        }
+    }
+
+    return histograms;
+}
+
+QByteArray Metrics::toPrometheus(const QVector<Histogram> &histograms, quint64 residentMemory)
+{
+    QByteArray text;
+    text += "# HELP zeal_build_info Version of the running Zeal.\n"
+            "# TYPE zeal_build_info gauge\n"
+            "zeal_build_info{version=\"" ZEAL_VERSION "\"} 1\n";
+    if (residentMemory) {
+        text += "# HELP zeal_process_resident_memory_bytes Resident memory of the process.\n"
+                "# TYPE zeal_process_resident_memory_bytes gauge\n"
+                "zeal_process_resident_memory_bytes " + QByteArray::number(residentMemory) + '\n';
+    }
+
+    for (int i = 0; i < SeriesCount; ++i) {
+        const SeriesInfo &info = SeriesInfos[i];
+        if (info.help) {
+            text += QByteArray("# HELP ") + info.family + ' ' + info.help + '\n';
+            text += QByteArray("# TYPE ") + info.family + " histogram\n";
+        }
+
+        const QByteArray labels = info.label ? QByteArray(info.label) + ',' : QByteArray();
+        const Histogram &histogram = histograms.at(i);
+
+        // Values are integers, so the edges of buckets are exact
+        for (int bits = info.minBits; bits <= info.maxBits; ++bits) {
+            const quint64 bound = quint64(1) << bits;
+            text += info.family + QByteArray("_bucket{") + labels + "le=\""
+                    + QByteArray::number(bound) + "\"} "
+                    + QByteArray::number(histogram.countBelow(bound)) + '\n';
+        }
+        text += info.family + QByteArray("_bucket{") + labels + "le=\"+Inf\"} "
+                + QByteArray::number(histogram.count()) + '\n';
+
+        const QByteArray suffix = info.label ? '{' + QByteArray(info.label) + "} "
+                                             : QByteArray(" ");
+        text += info.family + QByteArray("_sum") + suffix
+                + QByteArray::number(histogram.sum()) + '\n';
+        text += info.family + QByteArray("_count") + suffix
+                + QByteArray::number(histogram.count()) + '\n';
+    }
+
+    return text;
+}
+
+QByteArray Metrics::toJson(const QVector<Histogram> &histograms, quint64 residentMemory)
+{
+    QJsonArray series;
+    for (int i = 0; i < SeriesCount; ++i) {
+        const SeriesInfo &info = SeriesInfos[i];
+        const Histogram &histogram = histograms.at(i);
+
+        QJsonObject object;
+        object.insert(QStringLiteral("name"), QLatin1String(info.family));
+        if (info.label) {
+            // name="value"
+            const QString label = QLatin1String(info.label);
+            const int separator = label.indexOf(QLatin1Char('='));
+            QJsonObject labels;
+            labels.insert(label.left(separator),
+                          label.mid(separator + 2, label.size() - separator - 3));
+            object.insert(QStringLiteral("labels"), labels);
+        }
+        object.insert(QStringLiteral("count"), double(histogram.count()));
+        object.insert(QStringLiteral("sum"), double(histogram.sum()));
+        object.insert(QStringLiteral("max"), double(histogram.max()));
+        object.insert(QStringLiteral("p50"), double(histogram.percentile(0.5)));
+        object.insert(QStringLiteral("p90"), double(histogram.percentile(0.9)));
+        object.insert(QStringLiteral("p99"), double(histogram.percentile(0.99)));
+        object.insert(QStringLiteral("p999"), double(histogram.percentile(0.999)));
+
+        // All buckets, as [lower bound, count] of the non-empty ones
+        QJsonArray buckets;
+        for (int bucket = 0; bucket < Histogram::BucketCount; ++bucket) {
+            if (!histogram.bucket(bucket))
+                continue;
+            QJsonArray entry;
+            entry.append(double(Histogram::lowerBound(bucket)));
+            entry.append(double(histogram.bucket(bucket)));
+            buckets.append(entry);
+        }
+        object.insert(QStringLiteral("buckets"), buckets);
+
+        series.append(object);
+    }
+
+    QJsonObject document;
+    document.insert(QStringLiteral("version"), QStringLiteral(ZEAL_VERSION));
+    document.insert(QStringLiteral("host"), QHostInfo::localHostName());
+    document.insert(QStringLiteral("timestamp"), double(QDateTime::currentMSecsSinceEpoch()));
+    document.insert(QStringLiteral("resident_memory_bytes"), double(residentMemory));
+    document.insert(QStringLiteral("histograms"), series);
+    return QJsonDocument(document).toJson(QJsonDocument::Compact) + '\n';
+}
+
+quint64 Metrics::residentMemory()
+{
+#if defined(Q_OS_LINUX)
+    // Total and resident pages
+    QFile file(QStringLiteral("/proc/self/statm"));
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+    const QList<QByteArray> fields = file.readAll().split(' ');
+    if (fields.size() < 2)
+        return 0;
+    return fields.at(1).toULongLong() * quint64(sysconf(_SC_PAGESIZE));
+#elif defined(Q_OS_MAC)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info),
+                  &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.resident_size;
+#elif defined(Q_OS_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.WorkingSetSize;
+#else
+    return 0;
+#endif
+}
+
+void Metrics::configure(const QString &target, const QString &format, int interval)
+{
+    m_json = format == QLatin1String("json");
+    if (!m_json && format != QLatin1String("prometheus"))
+        qWarning("Unknown metrics format '%s', using 'prometheus'", qPrintable(format));
+
+    if (target.isEmpty()) {
+        const QString dataPath = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+        QDir().mkpath(dataPath);
+        m_target = dataPath + (m_json ? QLatin1String("/metrics.json")
+                                      : QLatin1String("/metrics.prom"));
+    } else {
+        m_target = target;
+    }
+    m_failing = false;
+
+    sampleMemory();
+    m_sampleTimer->start(SampleInterval);
+    m_exportTimer->start(qMax(interval, MinExportInterval) * 1000);
+}
+
+void Metrics::exportMetrics()
+{
+    if (m_target.isEmpty())
+        return;
+
+    sampleMemory();
+    if (isUrlTarget())
+        post(serialize());
+    else
+        writeFile(serialize());
+}
+
+void Metrics::sampleMemory()
+{
+    if (const quint64 memory = residentMemory())
+        record(ResidentMemory, memory);
+}
+
+bool Metrics::isUrlTarget() const
+{
+    return m_target.startsWith(QLatin1String("http://"))
+            || m_target.startsWith(QLatin1String("https://"));
+}
+
+QByteArray Metrics::serialize() const
+{
+    const QVector<Histogram> histograms = snapshot();
+    const quint64 memory = residentMemory();
+    return m_json ? toJson(histograms, memory) : toPrometheus(histograms, memory);
+}
+
+// Replaced at once, collectors never read a partial file
+void Metrics::writeFile(const QByteArray &data)
+{
+    QSaveFile file(m_target);
+    if (file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit()) {
+        m_failing = false;
+        return;
+    }
+
+    if (!m_failing) {
+        qWarning("Cannot write metrics to '%s': %s", qPrintable(m_target),
+                 qPrintable(file.errorString()));
+    }
+    m_failing = true;
+}
+
+void Metrics::post(const QByteArray &data)
+{
+    if (!m_networkManager)
+        m_networkManager = new QNetworkAccessManager(this);
+
+    QNetworkRequest request(QUrl(m_target));
+    request.setHeader(QNetworkRequest::UserAgentHeader, Application::userAgent());
+    request.setHeader(QNetworkRequest::ContentTypeHeader,
+                      m_json ? QByteArray("application/json")
+                             : QByteArray("text/plain; version=0.0.4"));
+
+    QNetworkReply *reply = m_networkManager->post(request, data);
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        reply->deleteLater();
+        if (reply->error() == QNetworkReply::NoError) {
+            m_failing = false;
+            return;
+        }
+
+        if (!m_failing) {
+            qWarning("Cannot post metrics to '%s': %s", qPrintable(m_target),
+                     qPrintable(reply->errorString()));
+        }
+        m_failing = true;
+    });
+}
@@ -0,0 +1,102 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "histogram.h"
+
+#include <QObject>
+#include <QVector>
+
+class QNetworkAccessManager;
+class QTimer;
+
+namespace Zeal {
+namespace Core {
+
+/**
+ * @short Opt-in performance telemetry, exported as Prometheus text or JSON.
+ *
+ * Any thread records values into histograms of its own, which only that thread ever
+ * writes, so recording takes no lock and shares no cache line with other threads. The
+ * exporter merges the histograms of all threads on a thread of its own whenever it
+ * exports them. Histograms count from the start of the process, as Prometheus expects.
+ *
+ * Exports are written to a file, e.g. for the textfile collector of the node exporter,
+ * or posted to an http(s) URL, e.g. of a Pushgateway.
+ */
+class Metrics : public QObject
+{
+    Q_OBJECT
+public:
+    enum Series {
+        // Query latency in microseconds, by number of docsets searched
+        QueryLatency1Docset,
+        QueryLatency2To4Docsets,
+        QueryLatency5To16Docsets,
+        QueryLatency17To64Docsets,
+        QueryLatencyMoreDocsets,
+        // Startup phases of Application in microseconds
+        StartupSettings,
+        StartupMainWindow, // includes loading docsets
+        StartupQueryServer,
+        StartupTotal,
+        // Phases of DocsetRegistry::initialiseDocsets() in microseconds
+        DocsetWalk,
+        DocsetManifests,
+        DocsetPublish,
+        DocsetTotal,
+        // Bytes per second of each extracted archive, including waits for streamed data
+        ExtractionThroughput,
+        // Resident memory of the process in bytes, sampled periodically
+        ResidentMemory,
+        SeriesCount
+    };
+
+    explicit Metrics(QObject *parent = nullptr);
+    ~Metrics() override;
+
+    // Recording is off until enabled. Thread-safe.
+    static bool isEnabled();
+    static void setEnabled(bool enabled);
+    // Adds \a value to \a series. Costs a handful of writes to memory of the calling
+    // thread, and nothing while disabled. Thread-safe.
+    static void record(Series series, quint64 value);
+    static Series queryLatencySeries(int docsetCount);
+
+    // Merges the histograms of all threads, by series. Thread-safe.
+    static QVector<Histogram> snapshot();
+    static QByteArray toPrometheus(const QVector<Histogram> &histograms,
+                                   quint64 residentMemory);
+    static QByteArray toJson(const QVector<Histogram> &histograms, quint64 residentMemory);
+
+    // In bytes, or 0 where unknown
+    static quint64 residentMemory();
+
+public slots:
+    // Exports to \a target every \a interval seconds, as "prometheus" or "json" \a format.
+    // \a target is a file name or an http(s) URL, a file in the data directory if empty.
+    void configure(const QString &target, const QString &format, int interval);
+    void exportMetrics();
+
+private slots:
+    void sampleMemory();
+
+private:
+    bool isUrlTarget() const;
+    QByteArray serialize() const;
+    void writeFile(const QByteArray &data);
+    void post(const QByteArray &data);
+
+    QString m_target;
+    bool m_json = false;
+    QTimer *m_exportTimer = nullptr;
+    QTimer *m_sampleTimer = nullptr;
+    // Created on the thread of the exporter, when first posting
+    QNetworkAccessManager *m_networkManager = nullptr;
+    // Failures are only reported when exports start failing
+    bool m_failing = false;
+};
+
+} // namespace Core
+} // namespace Zeal
+
+#endif // METRICS_H
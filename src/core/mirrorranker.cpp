@@ -0,0 +1,108 @@
+#include "mirrorranker.h"
+
+#include "settings.h"
+
+#include <QElapsedTimer>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTimer>
+
+#include <algorithm>
+
+using namespace Zeal::Core;
+
+namespace {
+// Mirrors which did not answer in time are ranked as if they took this long
+const int ProbeTimeout = 5000; // ms
+// Mirrors whose transfer failed rank behind those which did not answer a probe in time
+const int FailureLatency = 2 * ProbeTimeout; // ms
+// Throughput is averaged with previous transfers, giving this weight to the new one
+const double ThroughputWeight = 0.5;
+}
+
+MirrorRanker::MirrorRanker(QNetworkAccessManager *networkManager, Settings *settings,
+                           QObject *parent) :
+    QObject(parent),
+    m_networkManager(networkManager),
+    m_settings(settings)
+{
+}
+
+void MirrorRanker::probe(const QList<QUrl> &urls)
+{
+    for (const QUrl &url : urls) {
+        const QString host = url.host();
+        if (host.isEmpty() || m_probing.contains(host))
+            continue;
+        m_probing.insert(host);
+
+        QNetworkReply *reply = m_networkManager->head(QNetworkRequest(url));
+        QElapsedTimer timer;
+        timer.start();
+
+        QTimer::singleShot(ProbeTimeout, reply, &QNetworkReply::abort);
+        connect(reply, &QNetworkReply::finished, this, [this, reply, host, timer]() {
+            reply->deleteLater();
+            m_probing.remove(host);
+
+            if (reply->error() == QNetworkReply::NoError)
+                m_settings->mirrorLatency[host] = int(timer.elapsed());
+            else
+                m_settings->mirrorLatency[host] = ProbeTimeout;
+
+            if (m_probing.isEmpty())
+                emit probeFinished();
+        });
+    }
+}
+
+QList<QUrl> MirrorRanker::rank(const QList<QUrl> &urls) const
+{
+    QList<QUrl> known;
+    QList<QUrl> unknown;
+    for (const QUrl &url : urls) {
+        const QString host = url.host();
+        if (m_settings->mirrorThroughput.contains(host) || m_settings->mirrorLatency.contains(host))
+            known.append(url);
+        else
+            unknown.insert(unknown.isEmpty() ? 0 : qrand() % (unknown.size() + 1), url);
+    }
+
+    // Measured throughput says more about a mirror than the latency of a HEAD request
+    const QHash<QString, int> &throughput = m_settings->mirrorThroughput;
+    const QHash<QString, int> &latency = m_settings->mirrorLatency;
+    std::stable_sort(known.begin(), known.end(), [&](const QUrl &a, const QUrl &b) {
+        const int throughputA = throughput.value(a.host(), -1);
+        const int throughputB = throughput.value(b.host(), -1);
+        if (throughputA != throughputB)
+            return throughputA > throughputB;
+        return latency.value(a.host(), ProbeTimeout) < latency.value(b.host(), ProbeTimeout);
+    });
+
+    return known + unknown;
+}
+
+void MirrorRanker::recordTransfer(const QUrl &url, qint64 bytes, qint64 elapsed)
+{
+    if (url.host().isEmpty() || elapsed <= 0)
+        return;
+
+    // KiB/s
+    const int measured = int(bytes * 1000 / 1024 / elapsed);
+    int &throughput = m_settings->mirrorThroughput[url.host()];
+    if (throughput > 0)
+        throughput = int(ThroughputWeight * measured + (1 - ThroughputWeight) * throughput);
+    else
+        throughput = measured;
+}
+
+void MirrorRanker::recordFailure(const QUrl &url)
+{
+    if (url.host().isEmpty())
+        return;
+
+    // Mirrors without a measured throughput rank by latency, behind all measured ones
+    m_settings->mirrorThroughput.remove(url.host());
+    m_settings->mirrorLatency[url.host()] = FailureLatency;
+}
@@ -0,0 +1,48 @@
+#ifndef MIRRORRANKER_H
+#define MIRRORRANKER_H
+
+#include <QObject>
+#include <QSet>
+#include <QUrl>
+
+class QNetworkAccessManager;
+
+namespace Zeal {
+namespace Core {
+
+class Settings;
+
+// Orders download mirrors by how fast they responded and transferred before.
+// Measurements are kept per host in Settings, so they survive restarts.
+class MirrorRanker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MirrorRanker(QNetworkAccessManager *networkManager, Settings *settings,
+                          QObject *parent = nullptr);
+
+    // Sends concurrent HEAD requests to \a urls and records their round-trip times.
+    void probe(const QList<QUrl> &urls);
+    // Returns \a urls with the fastest known mirrors first. Mirrors never
+    // measured come last, in random order, to spread the load between them.
+    QList<QUrl> rank(const QList<QUrl> &urls) const;
+
+    void recordTransfer(const QUrl &url, qint64 bytes, qint64 elapsed);
+    // Marks the mirror of \a url as the slowest known one, e.g. after a transfer stalled.
+    // Its next successful probe or transfer ranks it anew.
+    void recordFailure(const QUrl &url);
+
+signals:
+    void probeFinished();
+
+private:
+    QNetworkAccessManager *m_networkManager = nullptr;
+    Settings *m_settings = nullptr;
+    // Hosts with a probe in flight
+    QSet<QString> m_probing;
+};
+
+} // namespace Core
+} // namespace Zeal
+
+#endif // MIRRORRANKER_H
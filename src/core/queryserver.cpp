@@ -0,0 +1,195 @@
+#include "queryserver.h"
+
+#include "task.h"
+#include "registry/docsetregistry.h"
+
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QThreadPool>
+
+#include <functional>
+
+using namespace Zeal;
+using namespace Zeal::Core;
+
+namespace {
+// Requests are short, clients sending longer lines are disconnected
+const int MaxRequestSize = 64 * 1024; // bytes
+
+QByteArray response(const QJsonValue &id, const QString &key, const QJsonValue &value)
+{
+    QJsonObject object;
+    if (!id.isUndefined())
+        object.insert(QStringLiteral("id"), id);
+    if (!key.isEmpty())
+        object.insert(key, value);
+    return QJsonDocument(object).toJson(QJsonDocument::Compact);
+}
+}
+
+QueryServer::QueryServer(DocsetRegistry *docsetRegistry, QObject *parent) :
+    QObject(parent),
+    m_docsetRegistry(docsetRegistry),
+    m_server(new QLocalServer(this)),
+    m_pool(new QThreadPool(this))
+{
+    // Docsets keep per-thread database connections, so search threads should never expire
+    m_pool->setExpiryTimeout(-1);
+
+    connect(m_server, &QLocalServer::newConnection, this, &QueryServer::acceptConnections);
+}
+
+QueryServer::~QueryServer()
+{
+    // Searches in flight post their responses to the server
+    m_pool->clear();
+    m_pool->waitForDone();
+}
+
+QJsonObject QueryServer::toJson(const SearchResult &result, const Docset &docset)
+{
+    QJsonObject object;
+    object.insert(QStringLiteral("name"), result.name());
+    object.insert(QStringLiteral("parent"), result.parentName());
+    object.insert(QStringLiteral("docset"), result.docsetName());
+    object.insert(QStringLiteral("path"), QDir(docset.documentPath()).absoluteFilePath(result.path()));
+    object.insert(QStringLiteral("score"), result.sortKey().score);
+    return object;
+}
+
+void QueryServer::listen(const QString &name)
+{
+    /// TODO: Verify if removeServer() is needed
+    QLocalServer::removeServer(name);  // remove in case previous instance crashed
+    if (!m_server->listen(name))
+        qWarning("Cannot listen on '%s': %s", qPrintable(name), qPrintable(m_server->errorString()));
+}
+
+void QueryServer::acceptConnections()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        const quint64 clientId = m_nextClientId++;
+        m_clients[clientId].socket = socket;
+
+        connect(socket, &QLocalSocket::readyRead, this, [this, clientId]() {
+            readRequests(clientId);
+        });
+        connect(socket, &QLocalSocket::disconnected, this, [this, clientId]() {
+            closeConnection(clientId);
+        });
+    }
+}
+
+void QueryServer::readRequests(quint64 clientId)
+{
+    const auto it = m_clients.find(clientId);
+    if (it == m_clients.end())
+        return;
+
+    Client &client = it.value();
+    client.buffer += client.socket->readAll();
+
+    int start = 0;
+    int end;
+    while ((end = client.buffer.indexOf('\n', start)) != -1) {
+        handleRequest(clientId, client, client.buffer.mid(start, end - start));
+        start = end + 1;
+    }
+    client.buffer.remove(0, start);
+
+    if (client.buffer.size() > MaxRequestSize) {
+        client.buffer.clear();
+        client.hasRequests = true;
+        client.socket->abort();
+    }
+}
+
+void QueryServer::closeConnection(quint64 clientId)
+{
+    // Clients handing over a single request disconnect right after writing it
+    readRequests(clientId);
+
+    const auto it = m_clients.find(clientId);
+    if (it == m_clients.end())
+        return;
+
+    Client &client = it.value();
+
+    // Older instances write the bare query, or nothing, and disconnect
+    if (!client.hasRequests && !client.buffer.startsWith('{'))
+        emit showRequested(QString::fromLocal8Bit(client.buffer));
+
+    client.socket->deleteLater();
+    m_clients.erase(it);
+}
+
+void QueryServer::handleRequest(quint64 clientId, Client &client, const QByteArray &line)
+{
+    const quint64 sequence = client.nextSequence++;
+    client.hasRequests = true;
+
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(line, &error);
+    if (!document.isObject()) {
+        const QString message = error.error != QJsonParseError::NoError
+                ? error.errorString() : QStringLiteral("Request is not an object");
+        sendResponse(clientId, sequence, response(QJsonValue::Undefined, QStringLiteral("error"),
+                                                  message));
+        return;
+    }
+
+    const QJsonObject request = document.object();
+    const QJsonValue id = request.value(QStringLiteral("id"));
+    const QString method = request.value(QStringLiteral("method")).toString(QStringLiteral("search"));
+    const QString query = request.value(QStringLiteral("query")).toString();
+
+    if (method == QLatin1String("show")) {
+        emit showRequested(query);
+        sendResponse(clientId, sequence, response(id, QString(), QJsonValue()));
+        return;
+    }
+
+    if (method != QLatin1String("search")) {
+        sendResponse(clientId, sequence, response(id, QStringLiteral("error"),
+                                                  QStringLiteral("Unknown method: ") + method));
+        return;
+    }
+
+    const int limit = request.value(QStringLiteral("limit")).toInt();
+    DocsetRegistry *docsetRegistry = m_docsetRegistry;
+    m_pool->start(new Task([this, docsetRegistry, clientId, sequence, id, query, limit]() {
+        QJsonArray results;
+        for (const SearchResult &result : docsetRegistry->search(query, limit)) {
+            const Docset docset = docsetRegistry->entry(result.docsetName());
+            if (!docset.isValid())
+                continue;
+
+            results.append(toJson(result, docset));
+        }
+
+        QMetaObject::invokeMethod(this, "sendResponse", Qt::QueuedConnection,
+                                  Q_ARG(quint64, clientId), Q_ARG(quint64, sequence),
+                                  Q_ARG(QByteArray, response(id, QStringLiteral("results"),
+                                                             results)));
+    }));
+}
+
+// Searches finish in any order, responses are held back until the earlier ones are sent
+void QueryServer::sendResponse(quint64 clientId, quint64 sequence, const QByteArray &response)
+{
+    const auto it = m_clients.find(clientId);
+    if (it == m_clients.end())
+        return;
+
+    Client &client = it.value();
+    client.pendingResponses.insert(sequence, response);
+    while (!client.pendingResponses.isEmpty()
+           && client.pendingResponses.firstKey() == client.nextResponse) {
+        client.socket->write(client.pendingResponses.take(client.nextResponse) + '\n');
+        ++client.nextResponse;
+    }
+}
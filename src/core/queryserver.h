@@ -0,0 +1,83 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QMap>
+#include <QObject>
+
+class QLocalServer;
+class QLocalSocket;
+class QThreadPool;
+
+namespace Zeal {
+
+class Docset;
+class DocsetRegistry;
+class SearchResult;
+
+namespace Core {
+
+/**
+ * @short Answers search requests of other processes on the local server socket.
+ *
+ * Requests and responses are single-line JSON objects, each terminated by a newline:
+ *
+ *   {"id": 1, "query": "qt:qstring", "limit": 20}
+ *   {"id": 1, "results": [{"name": ..., "parent": ..., "docset": ..., "path": ..., "score": ...}]}
+ *
+ * A request with "method": "show" brings up the window with "query" instead. Clients may
+ * send further requests without waiting, responses come back in request order. A client
+ * sending a bare query and closing the connection, like older Zeal instances do, is treated
+ * as a "show" request.
+ *
+ * The server runs on its own thread and searches on a pool of its own, so the user
+ * interface is never involved in answering searches.
+ */
+class QueryServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QueryServer(DocsetRegistry *docsetRegistry, QObject *parent = nullptr);
+    ~QueryServer() override;
+
+    // Returns \a result of \a docset as sent in responses
+    static QJsonObject toJson(const SearchResult &result, const Docset &docset);
+
+public slots:
+    void listen(const QString &name);
+
+signals:
+    void showRequested(const QString &query);
+
+private slots:
+    void acceptConnections();
+    void sendResponse(quint64 clientId, quint64 sequence, const QByteArray &response);
+
+private:
+    struct Client
+    {
+        QLocalSocket *socket = nullptr;
+        QByteArray buffer;
+        quint64 nextSequence = 0;
+        quint64 nextResponse = 0;
+        // Responses finished ahead of earlier ones, by sequence
+        QMap<quint64, QByteArray> pendingResponses;
+        bool hasRequests = false;
+    };
+
+    void readRequests(quint64 clientId);
+    void closeConnection(quint64 clientId);
+    void handleRequest(quint64 clientId, Client &client, const QByteArray &line);
+
+    DocsetRegistry *m_docsetRegistry = nullptr;
+    QLocalServer *m_server = nullptr;
+    QThreadPool *m_pool = nullptr;
+    QHash<quint64, Client> m_clients;
+    quint64 m_nextClientId = 0;
+};
+
+} // namespace Core
+} // namespace Zeal
+
+#endif // QUERYSERVER_H
@@ -1,5 +1,6 @@
 #include "settings.h"
 
+#include <QApplication>
 #include <QDir>
 #include <QSettings>
 #include <QStandardPaths>
@@ -36,8 +37,19 @@ void Settings::load()
 #endif
     m_settings->endGroup();
 
+    m_settings->beginGroup(QStringLiteral("search"));
+    searchResultLimit = m_settings->value("result_limit", 200).toInt();
+    fuzzySearch = m_settings->value("fuzzy", true).toBool();
+    m_settings->endGroup();
+
     m_settings->beginGroup(QStringLiteral("browser"));
-    minimumFontSize = m_settings->value("minimum_font_size", QWebSettings::globalSettings()->fontSize(QWebSettings::MinimumFontSize)).toInt();
+    // Batch searches run without widgets, which the web settings need
+    if (qobject_cast<QApplication *>(QCoreApplication::instance()))
+        minimumFontSize = m_settings->value("minimum_font_size", QWebSettings::globalSettings()->fontSize(QWebSettings::MinimumFontSize)).toInt();
+    else
+        minimumFontSize = m_settings->value("minimum_font_size", -1).toInt();
+    speculativeLoading = m_settings->value("speculative_loading", false).toBool();
+    pageCacheSize = m_settings->value("page_cache_size", 64).toInt();
     m_settings->endGroup();
 
     m_settings->beginGroup(QStringLiteral("proxy"));
@@ -49,6 +61,31 @@ void Settings::load()
     proxyPassword = m_settings->value("password").toString();
     m_settings->endGroup();
 
+    m_settings->beginGroup(QStringLiteral("mirror_latency"));
+    mirrorLatency.clear();
+    for (const QString &key : m_settings->childKeys())
+        mirrorLatency.insert(key, m_settings->value(key).toInt());
+    m_settings->endGroup();
+
+    m_settings->beginGroup(QStringLiteral("mirror_throughput"));
+    mirrorThroughput.clear();
+    for (const QString &key : m_settings->childKeys())
+        mirrorThroughput.insert(key, m_settings->value(key).toInt());
+    m_settings->endGroup();
+
+    m_settings->beginGroup(QStringLiteral("downloads"));
+    maxParallelDownloads = m_settings->value("max_parallel", 3).toInt();
+    maxDownloadsPerHost = m_settings->value("max_per_host", 2).toInt();
+    downloadRateLimit = m_settings->value("rate_limit", 0).toInt();
+    m_settings->endGroup();
+
+    m_settings->beginGroup(QStringLiteral("metrics"));
+    metricsEnabled = m_settings->value("enabled", false).toBool();
+    metricsTarget = m_settings->value("target").toString();
+    metricsFormat = m_settings->value("format", QStringLiteral("prometheus")).toString();
+    metricsInterval = m_settings->value("interval", 60).toInt();
+    m_settings->endGroup();
+
     m_settings->beginGroup(QStringLiteral("docsets"));
     if (m_settings->contains("path")) {
         docsetPath = m_settings->value("path").toString();
@@ -57,11 +94,20 @@ void Settings::load()
                 + QLatin1String("/docsets");
         QDir().mkpath(docsetPath);
     }
+    extraDocsetPaths = m_settings->value("extra_paths").toStringList();
+    remoteDocsetPaths = m_settings->value("remote_paths").toStringList();
     m_settings->endGroup();
 
     m_settings->beginGroup(QStringLiteral("state"));
     windowGeometry = m_settings->value("window_geometry").toByteArray();
     splitterGeometry = m_settings->value("splitter_geometry").toByteArray();
+    tabSession = m_settings->value("tabs").toByteArray();
+    m_settings->endGroup();
+
+    m_settings->beginGroup(QStringLiteral("docset_usage"));
+    docsetUsage.clear();
+    for (const QString &key : m_settings->childKeys())
+        docsetUsage.insert(key, m_settings->value(key).toInt());
     m_settings->endGroup();
 }
 
@@ -78,8 +124,16 @@ void Settings::save()
     m_settings->setValue(QStringLiteral("show"), showShortcut);
     m_settings->endGroup();
 
+    m_settings->beginGroup(QStringLiteral("search"));
+    m_settings->setValue("result_limit", searchResultLimit);
+    m_settings->setValue("fuzzy", fuzzySearch);
+    m_settings->endGroup();
+
     m_settings->beginGroup(QStringLiteral("browser"));
-    m_settings->setValue("minimum_font_size", minimumFontSize);
+    if (minimumFontSize >= 0)
+        m_settings->setValue("minimum_font_size", minimumFontSize);
+    m_settings->setValue("speculative_loading", speculativeLoading);
+    m_settings->setValue("page_cache_size", pageCacheSize);
     m_settings->endGroup();
 
     m_settings->beginGroup(QStringLiteral("proxy"));
@@ -91,13 +145,47 @@ void Settings::save()
     m_settings->setValue("password", proxyPassword);
     m_settings->endGroup();
 
+    m_settings->beginGroup(QStringLiteral("mirror_latency"));
+    m_settings->remove(QString());
+    for (auto it = mirrorLatency.cbegin(); it != mirrorLatency.cend(); ++it)
+        m_settings->setValue(it.key(), it.value());
+    m_settings->endGroup();
+
+    m_settings->beginGroup(QStringLiteral("mirror_throughput"));
+    m_settings->remove(QString());
+    for (auto it = mirrorThroughput.cbegin(); it != mirrorThroughput.cend(); ++it)
+        m_settings->setValue(it.key(), it.value());
+    m_settings->endGroup();
+
+    m_settings->beginGroup(QStringLiteral("downloads"));
+    m_settings->setValue("max_parallel", maxParallelDownloads);
+    m_settings->setValue("max_per_host", maxDownloadsPerHost);
+    m_settings->setValue("rate_limit", downloadRateLimit);
+    m_settings->endGroup();
+
+    m_settings->beginGroup(QStringLiteral("metrics"));
+    m_settings->setValue("enabled", metricsEnabled);
+    m_settings->setValue("target", metricsTarget);
+    m_settings->setValue("format", metricsFormat);
+    m_settings->setValue("interval", metricsInterval);
+    m_settings->endGroup();
+
     m_settings->beginGroup(QStringLiteral("docsets"));
     m_settings->setValue("path", docsetPath);
+    m_settings->setValue("extra_paths", extraDocsetPaths);
+    m_settings->setValue("remote_paths", remoteDocsetPaths);
     m_settings->endGroup();
 
     m_settings->beginGroup(QStringLiteral("state"));
     m_settings->setValue("window_geometry", windowGeometry);
     m_settings->setValue("splitter_geometry", splitterGeometry);
+    m_settings->setValue("tabs", tabSession);
+    m_settings->endGroup();
+
+    m_settings->beginGroup(QStringLiteral("docset_usage"));
+    m_settings->remove(QString());
+    for (auto it = docsetUsage.cbegin(); it != docsetUsage.cend(); ++it)
+        m_settings->setValue(it.key(), it.value());
     m_settings->endGroup();
 
     m_settings->sync();
@@ -105,3 +193,7 @@ void Settings::save()
     emit updated();
 }
 
+QStringList Settings::localDocsetPaths() const
+{
+    return QStringList(docsetPath) + extraDocsetPaths;
+}
@@ -1,8 +1,10 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
+#include <QHash>
 #include <QObject>
 #include <QKeySequence>
+#include <QStringList>
 
 class QSettings;
 
@@ -29,8 +31,16 @@ public:
     QKeySequence showShortcut;
     /// TODO: QKeySequence searchSelectedTextShortcut;
 
+    // Search
+    int searchResultLimit;
+    bool fuzzySearch;
+
     // Browser
-    int minimumFontSize;
+    int minimumFontSize; // -1 if unknown, see load()
+    // Top search results are rendered in the background, and only shown when opened
+    bool speculativeLoading;
+    // Memory for pages of tabs in the background and of back and forward navigation
+    int pageCacheSize; // MiB
     /// TODO: bool askOnExternalLink;
     /// TODO: QString customCss;
 
@@ -48,13 +58,38 @@ public:
     QString proxyUserName;
     QString proxyPassword;
 
+    // Download mirrors, by host. See MirrorRanker.
+    QHash<QString, int> mirrorLatency; // ms
+    QHash<QString, int> mirrorThroughput; // KiB/s
+
+    // Downloads, see DownloadQueue
+    int maxParallelDownloads;
+    int maxDownloadsPerHost;
+    int downloadRateLimit; // KiB/s, 0 for none
+
+    // Performance telemetry, see Metrics. Nothing is recorded unless enabled.
+    bool metricsEnabled;
+    // File name or http(s) URL, a file in the data directory if empty
+    QString metricsTarget;
+    QString metricsFormat; // "prometheus" or "json"
+    int metricsInterval; // s
+
     // Other
-    /// TODO: Convert into list
+    // Where docsets are installed to, searched first
     QString docsetPath;
+    // Further roots searched for docsets, e.g. a shared read-only store
+    QStringList extraDocsetPaths;
+    // Roots on slow file systems, like network home directories. They are walked once,
+    // later starts reuse the docsets found until a file system watcher reports a change.
+    QStringList remoteDocsetPaths;
 
     // State
     QByteArray windowGeometry;
     QByteArray splitterGeometry;
+    // Open tabs, see MainWindow::saveSession()
+    QByteArray tabSession;
+    // Number of pages opened from each docset, by docset name
+    QHash<QString, int> docsetUsage;
 
     explicit Settings(QObject *parent = nullptr);
     ~Settings() override;
@@ -63,6 +98,9 @@ public slots:
     void load();
     void save();
 
+    // docsetPath, followed by extraDocsetPaths
+    QStringList localDocsetPaths() const;
+
 signals:
     void updated();
 
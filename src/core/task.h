@@ -0,0 +1,33 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <QRunnable>
+
+#include <functional>
+
+namespace Zeal {
+namespace Core {
+
+// Runs a function on a QThreadPool
+/// TODO: [Qt 5.4] Replace with QtConcurrent::run(QThreadPool *, ...)
+class Task : public QRunnable
+{
+public:
+    explicit Task(const std::function<void()> &function) :
+        m_function(function)
+    {
+    }
+
+    void run() override
+    {
+        m_function();
+    }
+
+private:
+    std::function<void()> m_function;
+};
+
+} // namespace Core
+} // namespace Zeal
+
+#endif // TASK_H
@@ -1,8 +1,12 @@
 #include "core/application.h"
+#include "core/batchsearch.h"
 
 #include <QApplication>
 #include <QCommandLineParser>
 #include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QLocalSocket>
 #include <QStandardPaths>
 #include <QTextStream>
@@ -12,15 +16,35 @@
 #include <QStyleOption>
 #endif
 
+namespace {
+// A running instance accepts connections at once, unless it is busy
+const int ConnectTimeout = 50; // ms
+const int BusyConnectTimeout = 500; // ms
+}
+
 struct CommandLineParameters
 {
     bool force;
+    bool headless;
     QString query;
+    QString perfLog;
+    QString batch;
+    QString format;
+    int limit;
 };
 
-CommandLineParameters parseCommandLine(const QCoreApplication &app)
+// Batch searches run without widgets, which has to be known before creating the application
+bool isBatchSearch(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--batch") == 0 || qstrncmp(argv[i], "--batch=", 8) == 0)
+            return true;
+    }
+    return false;
+}
+
+void addOptions(QCommandLineParser &parser)
 {
-    QCommandLineParser parser;
     parser.setApplicationDescription(QObject::tr("Zeal - Offline documentation browser."));
     parser.addHelpOption();
     parser.addVersionOption();
@@ -28,17 +52,124 @@ CommandLineParameters parseCommandLine(const QCoreApplication &app)
     /// TODO: [Qt 5.4] parser.addOption({{"f", "force"}, "Force the application run."});
     parser.addOption(QCommandLineOption({QStringLiteral("f"), QStringLiteral("force")},
                                         QObject::tr("Force the application run.")));
+    parser.addOption(QCommandLineOption(QStringLiteral("headless"),
+                                        QObject::tr("Answer search requests of other "
+                                                    "applications without showing a window.")));
     parser.addOption(QCommandLineOption({QStringLiteral("q"), QStringLiteral("query")},
                                         QObject::tr("Query <search term>."),
                                         QStringLiteral("term")));
+    parser.addOption(QCommandLineOption(QStringLiteral("perf-log"),
+                                        QObject::tr("Log timings of each search to <file>, "
+                                                    "or to the standard error for '-'."),
+                                        QStringLiteral("file")));
+    parser.addOption(QCommandLineOption(QStringLiteral("batch"),
+                                        QObject::tr("Search for each line of <file>, or of the "
+                                                    "standard input for '-', print the results "
+                                                    "and exit."),
+                                        QStringLiteral("file")));
+    parser.addOption(QCommandLineOption(QStringLiteral("format"),
+                                        QObject::tr("Print batch results as 'tsv' or 'json'."),
+                                        QStringLiteral("format"), QStringLiteral("tsv")));
+    parser.addOption(QCommandLineOption(QStringLiteral("limit"),
+                                        QObject::tr("Print at most <count> results per batch "
+                                                    "query."),
+                                        QStringLiteral("count")));
+}
+
+CommandLineParameters parseCommandLine(const QCoreApplication &app)
+{
+    QCommandLineParser parser;
+    addOptions(parser);
     parser.process(app);
 
     return {
         parser.isSet(QStringLiteral("force")),
-        parser.value(QStringLiteral("query"))
+        parser.isSet(QStringLiteral("headless")),
+        parser.value(QStringLiteral("query")),
+        parser.value(QStringLiteral("perf-log")),
+        parser.value(QStringLiteral("batch")),
+        parser.value(QStringLiteral("format")),
+        parser.value(QStringLiteral("limit")).toInt()
     };
 }
 
+// Returns whether \a arguments only pass \a query to a running instance. Anything else,
+// including options of Qt itself, is left to the full command line parsing.
+bool isForwardOnly(const QStringList &arguments, QString *query)
+{
+    QCommandLineParser parser;
+    addOptions(parser);
+    if (!parser.parse(arguments))
+        return false;
+
+    for (const QString &option : parser.optionNames()) {
+        if (option != QLatin1String("q") && option != QLatin1String("query"))
+            return false;
+    }
+
+    *query = parser.value(QStringLiteral("query"));
+    return true;
+}
+
+// Detects an already running instance and passes a search query to it
+bool forwardQuery(const QString &query)
+{
+    QLocalSocket socket;
+    socket.connectToServer(Zeal::Core::Application::localServerName());
+
+    // Without a running instance the connection fails immediately, a longer wait only
+    // pays off when the server exists but has not accepted the connection yet.
+    if (!socket.waitForConnected(ConnectTimeout)) {
+        if (socket.state() != QLocalSocket::ConnectingState
+                || !socket.waitForConnected(BusyConnectTimeout - ConnectTimeout)) {
+            return false;
+        }
+    }
+
+    QJsonObject request;
+    request.insert(QStringLiteral("method"), QStringLiteral("show"));
+    request.insert(QStringLiteral("query"), query);
+    socket.write(QJsonDocument(request).toJson(QJsonDocument::Compact) + '\n');
+    socket.waitForBytesWritten(BusyConnectTimeout);
+    socket.disconnectFromServer();
+    return true;
+}
+
+int runBatchSearch(const CommandLineParameters &clParams)
+{
+    Zeal::Core::BatchSearch::Format format;
+    if (clParams.format == QLatin1String("tsv")) {
+        format = Zeal::Core::BatchSearch::Format::Tsv;
+    } else if (clParams.format == QLatin1String("json")) {
+        format = Zeal::Core::BatchSearch::Format::Json;
+    } else {
+        qWarning("Unknown format '%s'", qPrintable(clParams.format));
+        return 2;
+    }
+
+    QFile input;
+    bool opened;
+    if (clParams.batch == QLatin1String("-")) {
+        opened = input.open(stdin, QIODevice::ReadOnly);
+    } else {
+        input.setFileName(clParams.batch);
+        opened = input.open(QIODevice::ReadOnly | QIODevice::Text);
+    }
+
+    if (!opened) {
+        qWarning("Cannot open '%s': %s", qPrintable(clParams.batch),
+                 qPrintable(input.errorString()));
+        return 2;
+    }
+
+    // Results are written as they come
+    QFile output;
+    output.open(stdout, QIODevice::WriteOnly | QIODevice::Unbuffered);
+
+    Zeal::Core::BatchSearch search(format, clParams.limit);
+    return search.run(&input, &output);
+}
+
 /// TODO: Verify if this bug still exists in Qt 5.2+
 #ifdef Q_OS_WIN32
 class ZealProxyStyle : public QProxyStyle
@@ -66,6 +197,24 @@ int main(int argc, char *argv[])
     QCoreApplication::setOrganizationDomain(QStringLiteral("zealdocs.org"));
     QCoreApplication::setOrganizationName(QStringLiteral("Zeal"));
 
+    if (isBatchSearch(argc, argv)) {
+        QCoreApplication qapp(argc, argv);
+        return runBatchSearch(parseCommandLine(qapp));
+    }
+
+    // Setting up widgets takes most of the time of a launch that only passes on a query,
+    // so the common "zeal -q <term>" is handled before that.
+    bool forwardTried = false;
+    {
+        QCoreApplication qapp(argc, argv);
+        QString query;
+        if (isForwardOnly(qapp.arguments(), &query)) {
+            if (forwardQuery(query))
+                return 0;
+            forwardTried = true;
+        }
+    }
+
     QApplication qapp(argc, argv);
 
 #ifdef Q_OS_WIN32
@@ -74,17 +223,8 @@ int main(int argc, char *argv[])
 
     const CommandLineParameters clParams = parseCommandLine(qapp);
 
-    // Detect already running instance and optionally pass a search query to it.
-    if (!clParams.force) {
-        QScopedPointer<QLocalSocket> socket(new QLocalSocket());
-        socket->connectToServer(Zeal::Core::Application::localServerName());
-
-        if (socket->waitForConnected(500)) {
-            socket->write(clParams.query.toLocal8Bit());
-            socket->flush();
-            return 0;
-        }
-    }
+    if (!clParams.force && !forwardTried && forwardQuery(clParams.query))
+        return 0;
 
     // look for icons in:
     // 1. user's data directory (same as docsets dir, but in icons/)
@@ -102,7 +242,11 @@ int main(int argc, char *argv[])
     searchPaths << QStringLiteral("./icons");
     QDir::setSearchPaths(QStringLiteral("icons"), searchPaths);
 
-    QScopedPointer<Zeal::Core::Application> app(new Zeal::Core::Application(clParams.query));
+    const Zeal::Core::Application::Mode mode = clParams.headless
+            ? Zeal::Core::Application::Mode::Headless : Zeal::Core::Application::Mode::Desktop;
+    QScopedPointer<Zeal::Core::Application> app(new Zeal::Core::Application(clParams.query, mode));
+    if (!clParams.perfLog.isEmpty())
+        app->startPerformanceLog(clParams.perfLog);
 
     return qapp.exec();
 }
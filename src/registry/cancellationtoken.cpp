@@ -0,0 +1,18 @@
+#include "cancellationtoken.h"
+
+using namespace Zeal;
+
+CancellationToken::CancellationToken()
+{
+}
+
+CancellationToken::CancellationToken(const QAtomicInt *generation, int value) :
+    m_generation(generation),
+    m_value(value)
+{
+}
+
+bool CancellationToken::isCancelled() const
+{
+    return m_generation && m_generation->load() != m_value;
+}
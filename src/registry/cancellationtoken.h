@@ -0,0 +1,30 @@
+#ifndef CANCELLATIONTOKEN_H
+#define CANCELLATIONTOKEN_H
+
+#include <QAtomicInt>
+
+namespace Zeal {
+
+/**
+ * @short Lets long running work notice that its result is no longer needed.
+ *
+ * A token is bound to a generation counter and the value it had when the work
+ * started. Once the counter moves on, the token reports cancellation.
+ */
+class CancellationToken
+{
+public:
+    /// Creates a token which is never cancelled.
+    CancellationToken();
+    CancellationToken(const QAtomicInt *generation, int value);
+
+    bool isCancelled() const;
+
+private:
+    const QAtomicInt *m_generation = nullptr;
+    int m_value = 0;
+};
+
+} // namespace Zeal
+
+#endif // CANCELLATIONTOKEN_H
@@ -1,69 +1,436 @@
 #include "docset.h"
 
+#include "fulltextindex.h"
+#include "manifestcache.h"
+#include "stringpool.h"
+#include "symbolindex.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QDir>
-#include <QSqlQuery>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QHash>
+#include <QMutex>
+#include <QSqlDriver>
+#include <QStringList>
+#include <QThreadStorage>
 #include <QVariant>
+#include <QVector>
+
+#include <cstring>
+#include <memory>
+
+#ifdef USE_SQLITE3
+#include <sqlite3.h>
+#endif
 
 using namespace Zeal;
 
+namespace {
+const int StatementCount = 3;
+
+// Flat copy of the docset index, created by Docset::buildSidecar()
+const char SidecarFileName[] = "docSet.zeal.dsidx";
+// Binary copy of the symbol index, see SymbolIndex::save()
+const char SymbolCacheFileName[] = "docSet.zeal.symbols";
+// Inverted index over the page contents, see FullTextIndex
+const char FullTextFileName[] = "docSet.zeal.fulltext";
+// Bump to invalidate all symbol caches, e.g. when symbols get loaded differently
+const int SymbolCacheRevision = 1;
+// Bump whenever the layout of the sidecar changes
+const int SidecarVersion = 1;
+
+// How many symbols are written between cancellation checks
+const int CancellationCheckInterval = 4096;
+
+// Returns -1 for missing files
+qint64 modificationTime(const QString &fileName)
+{
+    const QFileInfo fileInfo(fileName);
+    return fileInfo.exists() ? fileInfo.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+QString statementSql(Docset::Type type, bool flat, Docset::Statement statement)
+{
+    // A single denormalized table, where paths already include anchors
+    if (flat) {
+        switch (statement) {
+        case Docset::Statement::Symbols:
+            return QStringLiteral("select name, type, path from symbols");
+        case Docset::Statement::TypeCounts:
+            return QStringLiteral("select type, count(*) from symbols group by type");
+        case Docset::Statement::TypeSymbols:
+            return QStringLiteral("select name, path from symbols where type = :type "
+                                  "order by name asc limit :limit offset :offset");
+        }
+        return QString();
+    }
+
+    switch (type) {
+    case Docset::Type::Dash:
+        switch (statement) {
+        case Docset::Statement::Symbols:
+            return QStringLiteral("select name, type, path from searchIndex");
+        case Docset::Statement::TypeCounts:
+            return QStringLiteral("select type, count(*) from searchIndex group by type");
+        case Docset::Statement::TypeSymbols:
+            return QStringLiteral("select name, path from searchIndex where type = :type "
+                                  "order by name asc limit :limit offset :offset");
+        }
+        break;
+    case Docset::Type::ZDash:
+        switch (statement) {
+        case Docset::Statement::Symbols:
+            return QStringLiteral("select ztokenname, ztypename, zpath, zanchor from ztoken "
+                                  "join ztokenmetainformation on ztoken.zmetainformation = ztokenmetainformation.z_pk "
+                                  "join zfilepath on ztokenmetainformation.zfile = zfilepath.z_pk "
+                                  "left join ztokentype on ztoken.ztokentype = ztokentype.z_pk");
+        case Docset::Statement::TypeCounts:
+            return QStringLiteral("select ztypename, count(*) from ztoken join ztokentype "
+                                  "on ztoken.ztokentype = ztokentype.z_pk group by ztypename");
+        case Docset::Statement::TypeSymbols:
+            return QStringLiteral("select ztokenname, zpath, zanchor from ztoken "
+                                  "join ztokenmetainformation on ztoken.zmetainformation = ztokenmetainformation.z_pk "
+                                  "join zfilepath on ztokenmetainformation.zfile = zfilepath.z_pk "
+                                  "join ztokentype on ztoken.ztokentype = ztokentype.z_pk "
+                                  "where ztypename = :type order by ztokenname asc "
+                                  "limit :limit offset :offset");
+        }
+        break;
+    }
+
+    return QString();
+}
+
+// Page cache of each connection, in KiB
+const int ConnectionCacheSize = 8192;
+// How much of the index file SQLite reads through a memory mapping instead of read()
+const qint64 ConnectionMmapSize = 256 * 1024 * 1024;
+
+void configureConnection(const QSqlDatabase &db)
+{
+    db.exec(QStringLiteral("pragma cache_size = -%1").arg(ConnectionCacheSize));
+    db.exec(QStringLiteral("pragma mmap_size = %1").arg(ConnectionMmapSize));
+}
+
+int userVersion(const QSqlDatabase &db)
+{
+    QSqlQuery query = db.exec(QStringLiteral("pragma user_version"));
+    return query.next() ? query.value(0).toInt() : 0;
+}
+
+bool writeSidecar(QSqlDatabase &db, const SymbolIndex &index, const CancellationToken &token)
+{
+    QSqlQuery query(db);
+    // The file is only moved into place once complete, so durability does not matter
+    query.exec(QStringLiteral("pragma journal_mode = off"));
+    query.exec(QStringLiteral("pragma synchronous = off"));
+
+    if (!query.exec(QStringLiteral("create table symbols (name text not null, "
+                                   "type text not null, path text not null)"))) {
+        return false;
+    }
+
+    db.transaction();
+    query.prepare(QStringLiteral("insert into symbols (name, type, path) values (?, ?, ?)"));
+    for (int id = 0; id < index.size(); ++id) {
+        const SymbolIndex::Symbol &symbol = index.symbol(id);
+        query.addBindValue(symbol.name);
+        query.addBindValue(index.typeName(symbol.type));
+        query.addBindValue(symbol.path);
+
+        if ((id % CancellationCheckInterval == 0 && token.isCancelled()) || !query.exec()) {
+            db.rollback();
+            return false;
+        }
+    }
+
+    if (!db.commit())
+        return false;
+
+    // Serves type counts and listings in the docset tree
+    if (!query.exec(QStringLiteral("create index symbols_type_name on symbols (type, name)")))
+        return false;
+
+    return query.exec(QStringLiteral("pragma user_version = %1").arg(SidecarVersion));
+}
+
+#ifdef USE_SQLITE3
+// How many SQLite VM instructions are run between cancellation checks
+const int ProgressHandlerInterval = 1000;
+
+int progressHandler(void *data)
+{
+    // A non-zero value interrupts the running statement
+    return static_cast<const CancellationToken *>(data)->isCancelled();
+}
+
+sqlite3 *sqliteHandle(const QSqlDatabase &db)
+{
+    const QVariant handle = db.driver()->handle();
+    if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0)
+        return nullptr;
+    return *static_cast<sqlite3 * const *>(handle.data());
+}
+#endif
+
+// Serials of the docsets whose connections a thread has yet to close
+struct ReleasedConnections
+{
+    QMutex mutex;
+    QVector<int> serials;
+};
+
+// Connections of one thread to docset indexes, by the serial of their docset. Qt only lets
+// the thread which opened a connection use and close it, so every thread closes its own:
+// on its next use of any docset after theirs was released, or when the thread finishes.
+struct ThreadConnections
+{
+    struct Connection
+    {
+        QSqlDatabase db;
+        // Prepared statements, indexed by Statement
+        QVector<QSqlQuery> statements;
+    };
+
+    ~ThreadConnections()
+    {
+        while (!connections.isEmpty())
+            close(connections.begin());
+    }
+
+    void closeReleased()
+    {
+        QVector<int> serials;
+        {
+            QMutexLocker locker(&released->mutex);
+            serials.swap(released->serials);
+        }
+
+        for (int serial : serials) {
+            const auto it = connections.find(serial);
+            if (it != connections.end())
+                close(it);
+        }
+    }
+
+    void close(QHash<int, Connection>::iterator it)
+    {
+        const QString connectionName = it->db.connectionName();
+        // Statements keep their connection in use
+        it->statements.clear();
+        it->db.close();
+        connections.erase(it);
+        QSqlDatabase::removeDatabase(connectionName);
+    }
+
+    QHash<int, Connection> connections;
+    // Shared with the docsets, which may be released after the thread finished
+    std::shared_ptr<ReleasedConnections> released = std::make_shared<ReleasedConnections>();
+};
+
+// Deleted by each thread as it finishes
+QThreadStorage<ThreadConnections *> threadConnections;
+
+ThreadConnections *localConnections()
+{
+    if (!threadConnections.hasLocalData())
+        threadConnections.setLocalData(new ThreadConnections());
+    return threadConnections.localData();
+}
+
+QAtomicInt nextSerial = 0;
+}
+
+// Everything about a docset, shared by all handles to it
+struct Docset::Data
+{
+    Data() = default;
+    ~Data();
+
+    bool isValid = false;
+
+    QString name;
+    int id = -1;
+    QString path;
+    QString prefix;
+    QIcon icon;
+    DocsetMetadata metadata;
+    DocsetInfo info;
+
+    QMutex mutex;
+
+    // Set by Docset::open()
+    bool opened = false;
+    // Index or sidecar the connections read, empty if neither could be opened
+    QString databaseName;
+    Docset::Type type = Docset::Type::Dash;
+    bool hasSidecar = false;
+
+    // Tells connections of this docset apart from those of replaced ones of the same name
+    const int serial = nextSerial.fetchAndAddRelaxed(1);
+    // Threads which opened a connection to the index
+    QVector<std::shared_ptr<ReleasedConnections>> connectionOwners;
+
+    QScopedPointer<SymbolIndex> symbolIndex;
+    QScopedPointer<FullTextIndex> fullTextIndex;
+
+    ThreadConnections::Connection &localConnection();
+    bool probe(QSqlDatabase &db, const QString &indexPath, const QString &sidecarPath);
+
+private:
+    Q_DISABLE_COPY(Data)
+};
+
+// Released with the last handle, so no search or fetch can be using the connections. Those
+// of other threads are left to them to close, see ThreadConnections.
+Docset::Data::~Data()
+{
+    for (const std::shared_ptr<ReleasedConnections> &owner : connectionOwners) {
+        QMutexLocker locker(&owner->mutex);
+        owner->serials.append(serial);
+    }
+
+    if (threadConnections.hasLocalData())
+        threadConnections.localData()->closeReleased();
+}
+
+// Returns the connection of the calling thread, which is opened on first use. Expects
+// Docset::open() to have succeeded.
+ThreadConnections::Connection &Docset::Data::localConnection()
+{
+    ThreadConnections *local = localConnections();
+    local->closeReleased();
+
+    const auto it = local->connections.find(serial);
+    if (it != local->connections.end())
+        return it.value();
+
+    ThreadConnections::Connection connection;
+    // Replaced docsets of the same name may still be open
+    connection.db = QSqlDatabase::addDatabase("QSQLITE", QStringLiteral("%1#%2#%3").arg(name)
+                                              .arg(serial).arg(reinterpret_cast<quintptr>(local)));
+    connection.db.setDatabaseName(databaseName);
+    if (connection.db.open())
+        configureConnection(connection.db);
+    connection.statements.resize(StatementCount);
+
+    {
+        QMutexLocker locker(&mutex);
+        connectionOwners.append(local->released);
+    }
+
+    return local->connections.insert(serial, connection).value();
+}
+
+// Finds the type of the index on \a db, and whether its sidecar is usable. Returns false if
+// neither can be opened.
+bool Docset::Data::probe(QSqlDatabase &db, const QString &indexPath, const QString &sidecarPath)
+{
+    db.setDatabaseName(indexPath);
+    if (!db.open())
+        return false;
+
+    {
+        QSqlQuery q = db.exec("select name from sqlite_master where type='table'");
+
+        type = Docset::Type::ZDash;
+        while (q.next()) {
+            if (q.value(0).toString() == QStringLiteral("searchIndex")) {
+                type = Docset::Type::Dash;
+                break;
+            }
+        }
+    }
+
+    // Prefer the flat copy of the index, unless the docset has been updated since
+    const QFileInfo sidecarInfo(sidecarPath);
+    if (sidecarInfo.exists() && sidecarInfo.lastModified() >= QFileInfo(indexPath).lastModified()) {
+        db.close();
+        db.setDatabaseName(sidecarInfo.absoluteFilePath());
+        hasSidecar = db.open() && userVersion(db) == SidecarVersion;
+        if (!hasSidecar) {
+            db.close();
+            db.setDatabaseName(indexPath);
+            if (!db.open())
+                return false;
+        }
+    }
+
+    return true;
+}
+
 Docset::Docset()
 {
 }
 
-Docset::Docset(const QString &path) :
-    m_path(path)
+Docset::Docset(const QString &path, ManifestCache *manifestCache) :
+    m_data(new Data())
 {
-    QDir dir(m_path);
+    m_data->path = path;
+
+    QDir dir(m_data->path);
     if (!dir.exists())
         return;
 
     /// TODO: Use metadata
-    m_name = dir.dirName().replace(QStringLiteral(".docset"), QString());
+    m_data->name = dir.dirName().replace(QStringLiteral(".docset"), QString());
 
     /// TODO: Report errors here and below
     if (!dir.cd("Contents"))
         return;
 
+    QString plistPath;
     if (dir.exists(QStringLiteral("Info.plist")))
-        info = DocsetInfo::fromPlist(dir.absoluteFilePath(QStringLiteral("Info.plist")));
+        plistPath = dir.absoluteFilePath(QStringLiteral("Info.plist"));
     else if (dir.exists(QStringLiteral("info.plist")))
-        info = DocsetInfo::fromPlist(dir.absoluteFilePath(QStringLiteral("info.plist")));
+        plistPath = dir.absoluteFilePath(QStringLiteral("info.plist"));
     else
         return;
 
-    // Read metadata
-    metadata = DocsetMetadata::fromFile(path + QStringLiteral("/meta.json"));
+    // Unchanged docsets are loaded without parsing their manifests
+    const QString metadataPath = path + QStringLiteral("/meta.json");
+    ManifestCache::Manifest manifest;
+    manifest.infoModified = modificationTime(plistPath);
+    manifest.metadataModified = modificationTime(metadataPath);
+    manifest.folderModified = modificationTime(path);
+    const bool cached = manifestCache && manifestCache->find(path, &manifest);
+    if (!cached) {
+        manifest.info = DocsetInfo::fromPlist(plistPath);
+        manifest.metadata = DocsetMetadata::fromFile(metadataPath);
+    }
 
-    if (info.family == QStringLiteral("cheatsheet"))
-        m_name = QString("%1_cheats").arg(m_name);
+    m_data->info = manifest.info;
+    m_data->metadata = manifest.metadata;
 
-    if (!dir.cd("Resources"))
-        return;
+    if (m_data->info.family == QStringLiteral("cheatsheet"))
+        m_data->name = QString("%1_cheats").arg(m_data->name);
 
-    db = QSqlDatabase::addDatabase("QSQLITE", m_name);
-    db.setDatabaseName(dir.absoluteFilePath("docSet.dsidx"));
+    m_data->id = StringPool::intern(m_data->name);
 
-    if (!db.open())
+    // The index itself is only opened on first use, see open()
+    if (!dir.cd("Resources") || !dir.exists(QStringLiteral("docSet.dsidx")))
         return;
 
-    QSqlQuery q = db.exec("select name from sqlite_master where type='table'");
-
-    type = Docset::Type::ZDash;
-    while (q.next()) {
-        if (q.value(0).toString() == QStringLiteral("searchIndex")) {
-            type = Docset::Type::Dash;
-            break;
-        }
-    }
-
     if (!dir.cd("Documents"))
         return;
 
-    prefix = info.bundleName.isEmpty() ? m_name : info.bundleName;
+    m_data->prefix = m_data->info.bundleName.isEmpty() ? m_data->name : m_data->info.bundleName;
 
-    findIcon();
+    // Batch searches run without a GUI and show no icons, which leaves them unresolved
+    if (qobject_cast<QGuiApplication *>(QCoreApplication::instance())) {
+        if (!cached) {
+            manifest.iconPath = findIcon();
+            if (manifestCache)
+                manifestCache->insert(path, manifest);
+        }
+        if (!manifest.iconPath.isEmpty())
+            m_data->icon = QIcon(manifest.iconPath);
+    }
 
-    m_isValid = true;
+    m_data->isValid = true;
 }
 
 Docset::~Docset()
@@ -72,51 +439,348 @@ Docset::~Docset()
 
 bool Docset::isValid() const
 {
-    return m_isValid;
+    return m_data && m_data->isValid;
+}
+
+bool Docset::isSameDocset(const Docset &other) const
+{
+    return m_data == other.m_data;
 }
 
 QString Docset::name() const
 {
-    return m_name;
+    return m_data ? m_data->name : QString();
+}
+
+int Docset::id() const
+{
+    return m_data ? m_data->id : -1;
+}
+
+Docset::Type Docset::type() const
+{
+    return open() ? m_data->type : Type::Dash;
+}
+
+bool Docset::hasSidecar() const
+{
+    return open() && m_data->hasSidecar;
 }
 
 QString Docset::path() const
 {
-    return m_path;
+    return m_data ? m_data->path : QString();
 }
 
 QString Docset::documentPath() const
 {
-    return QDir(m_path).absoluteFilePath(QStringLiteral("Contents/Resources/Documents"));
+    return QDir(path()).absoluteFilePath(QStringLiteral("Contents/Resources/Documents"));
+}
+
+QString Docset::prefix() const
+{
+    return m_data ? m_data->prefix : QString();
 }
 
 QIcon Docset::icon() const
 {
-    return m_icon;
+    return m_data ? m_data->icon : QIcon();
+}
+
+const DocsetMetadata &Docset::metadata() const
+{
+    static const DocsetMetadata empty;
+    return m_data ? m_data->metadata : empty;
+}
+
+const DocsetInfo &Docset::info() const
+{
+    static const DocsetInfo empty;
+    return m_data ? m_data->info : empty;
+}
+
+QSqlDatabase Docset::database() const
+{
+    if (!open())
+        return QSqlDatabase();
+
+    return m_data->localConnection().db;
+}
+
+QSqlQuery Docset::statement(Statement statement) const
+{
+    if (!open())
+        return QSqlQuery();
+
+    ThreadConnections::Connection &connection = m_data->localConnection();
+
+    // Copies of QSqlQuery share the prepared statement
+    QSqlQuery &query = connection.statements[static_cast<int>(statement)];
+    if (query.lastQuery().isEmpty()) {
+        query = QSqlQuery(connection.db);
+        query.setForwardOnly(true);
+        query.prepare(statementSql(m_data->type, m_data->hasSidecar, statement));
+    }
+
+    return query;
+}
+
+QString Docset::symbolPath(const QSqlQuery &query, int column) const
+{
+    QString path = query.value(column).toString();
+    if (m_data->type == Type::ZDash && !m_data->hasSidecar)
+        path += QLatin1Char('#') + query.value(column + 1).toString();
+    return path;
+}
+
+void Docset::warmUp(const CancellationToken &token) const
+{
+    if (!symbolIndex(token) || token.isCancelled())
+        return;
+
+    // A full scan pulls the index pages into the page cache, and it answers with the
+    // type counts the docset tree asks for first
+    QSqlQuery query = statement(Statement::TypeCounts);
+    query.exec();
+    while (query.next() && !token.isCancelled()) {
+    }
+    query.finish();
+}
+
+bool Docset::buildSidecar(const CancellationToken &token) const
+{
+    if (!isValid() || hasSidecar())
+        return false;
+
+    // Writing from the symbol index avoids running the ZDash joins once more
+    const SymbolIndex *index = symbolIndex(token);
+    if (!index)
+        return false;
+
+    const QString sidecarPath = resourcePath(QLatin1String(SidecarFileName));
+    const QString tempPath = sidecarPath + QStringLiteral(".part");
+    QFile::remove(tempPath);
+
+    const QString connectionName = QStringLiteral("%1#sidecar").arg(m_data->name);
+    bool ok;
+    {
+        QSqlDatabase sidecar = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"),
+                                                         connectionName);
+        sidecar.setDatabaseName(tempPath);
+        ok = sidecar.open() && writeSidecar(sidecar, *index, token);
+        sidecar.close();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    if (!ok) {
+        QFile::remove(tempPath);
+        return false;
+    }
+
+    QFile::remove(sidecarPath);
+    return QFile::rename(tempPath, sidecarPath);
+}
+
+const SymbolIndex *Docset::symbolIndex(const CancellationToken &token) const
+{
+    if (!isValid())
+        return nullptr;
+
+    {
+        QMutexLocker locker(&m_data->mutex);
+        if (m_data->symbolIndex)
+            return m_data->symbolIndex.data();
+    }
+
+    SymbolIndex *index = loadSymbols(token);
+    if (!index)
+        return nullptr;
+    return setSymbolIndex(index);
 }
 
-void Docset::findIcon()
+const SymbolIndex *Docset::cachedSymbolIndex() const
 {
-    const QDir dir(m_path);
+    if (!isValid())
+        return nullptr;
+
+    {
+        QMutexLocker locker(&m_data->mutex);
+        if (m_data->symbolIndex)
+            return m_data->symbolIndex.data();
+    }
+
+    SymbolIndex *index = SymbolIndex::load(resourcePath(QLatin1String(SymbolCacheFileName)),
+                                           cacheStamp());
+    if (!index)
+        return nullptr;
+    return setSymbolIndex(index);
+}
+
+const FullTextIndex *Docset::fullTextIndex() const
+{
+    if (!isValid())
+        return nullptr;
+
+    {
+        QMutexLocker locker(&m_data->mutex);
+        if (m_data->fullTextIndex)
+            return m_data->fullTextIndex.data();
+    }
+
+    FullTextIndex *index = FullTextIndex::load(resourcePath(QLatin1String(FullTextFileName)),
+                                               cacheStamp());
+    if (!index)
+        return nullptr;
+
+    // Takes ownership of index, unless another thread was faster
+    QMutexLocker locker(&m_data->mutex);
+    if (!m_data->fullTextIndex)
+        m_data->fullTextIndex.reset(index);
+    else
+        delete index;
+    return m_data->fullTextIndex.data();
+}
+
+bool Docset::buildFullTextIndex(const CancellationToken &token) const
+{
+    if (!isValid())
+        return false;
+
+    const QString fileName = resourcePath(QLatin1String(FullTextFileName));
+    const quint64 stamp = cacheStamp();
+    if (FullTextIndex::exists(fileName, stamp))
+        return false;
+
+    // Not kept loaded, most docsets never get a full-text query
+    const QScopedPointer<FullTextIndex> index(FullTextIndex::build(documentPath(), token));
+    return index && index->save(fileName, stamp);
+}
+
+// Returns the first of the icon locations which holds an image
+QString Docset::findIcon() const
+{
+    const QDir dir(m_data->path);
     for (const QString &iconFile : dir.entryList({QStringLiteral("icon.*")}, QDir::Files)) {
-        m_icon = QIcon(dir.absoluteFilePath(iconFile));
-        if (!m_icon.availableSizes().isEmpty())
-            return;
+        const QString iconPath = dir.absoluteFilePath(iconFile);
+        if (!QIcon(iconPath).availableSizes().isEmpty())
+            return iconPath;
     }
 
-    QString bundleName = info.bundleName;
+    QString bundleName = m_data->info.bundleName;
     bundleName.replace(" ", "_");
-    m_icon = QIcon(QString("icons:%1.png").arg(bundleName));
-    if (!m_icon.availableSizes().isEmpty())
-        return;
 
     // Fallback to identifier and docset file name.
-    m_icon = QIcon(QString("icons:%1.png").arg(info.bundleIdentifier));
-    if (!m_icon.availableSizes().isEmpty())
-        return;
+    const QStringList iconPaths = {
+        QString("icons:%1.png").arg(bundleName),
+        QString("icons:%1.png").arg(m_data->info.bundleIdentifier),
+        QString("icons:%1.png").arg(m_data->name)
+    };
+    for (const QString &iconPath : iconPaths) {
+        if (!QIcon(iconPath).availableSizes().isEmpty())
+            return iconPath;
+    }
 
-    m_icon = QIcon(QString("icons:%1.png").arg(m_name));
-    if (!m_icon.availableSizes().isEmpty())
-        return;
+    return QString();
 }
 
+// Opens the docset index on first use. Thread-safe.
+bool Docset::open() const
+{
+    if (!isValid())
+        return false;
+
+    QMutexLocker locker(&m_data->mutex);
+    if (m_data->opened)
+        return !m_data->databaseName.isEmpty();
+    m_data->opened = true;
+
+    // Every thread opens a connection of its own, see Data::localConnection()
+    const QString connectionName = QStringLiteral("%1#%2#open").arg(m_data->name)
+            .arg(m_data->serial);
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        if (m_data->probe(db, resourcePath(QStringLiteral("docSet.dsidx")),
+                          resourcePath(QLatin1String(SidecarFileName)))) {
+            m_data->databaseName = db.databaseName();
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    return !m_data->databaseName.isEmpty();
+}
+
+QString Docset::resourcePath(const QString &fileName) const
+{
+    return QDir(m_data->path).absoluteFilePath(QStringLiteral("Contents/Resources/") + fileName);
+}
+
+// Changes whenever the docset index does
+quint64 Docset::cacheStamp() const
+{
+    const QFileInfo fileInfo(resourcePath(QLatin1String("docSet.dsidx")));
+    const QByteArray key = QByteArray::number(SymbolCacheRevision) + '\0'
+            + QByteArray::number(fileInfo.size()) + '\0'
+            + QByteArray::number(fileInfo.lastModified().toMSecsSinceEpoch()) + '\0'
+            + m_data->metadata.revision().toUtf8();
+
+    const QByteArray hash = QCryptographicHash::hash(key, QCryptographicHash::Md5);
+    quint64 stamp;
+    memcpy(&stamp, hash.constData(), sizeof(stamp));
+    return stamp;
+}
+
+// Takes ownership of index, unless another thread was faster
+const SymbolIndex *Docset::setSymbolIndex(SymbolIndex *index) const
+{
+    QMutexLocker locker(&m_data->mutex);
+    if (!m_data->symbolIndex)
+        m_data->symbolIndex.reset(index);
+    else
+        delete index;
+    return m_data->symbolIndex.data();
+}
+
+SymbolIndex *Docset::loadSymbols(const CancellationToken &token) const
+{
+    const QString cachePath = resourcePath(QLatin1String(SymbolCacheFileName));
+    const quint64 stamp = cacheStamp();
+    if (SymbolIndex *index = SymbolIndex::load(cachePath, stamp))
+        return index;
+
+    const QSqlDatabase connection = database();
+#ifdef USE_SQLITE3
+    sqlite3 *handle = sqliteHandle(connection);
+    if (handle) {
+        sqlite3_progress_handler(handle, ProgressHandlerInterval, &progressHandler,
+                                 const_cast<CancellationToken *>(&token));
+    }
+#endif
+
+    QScopedPointer<SymbolIndex> index(new SymbolIndex());
+
+    QSqlQuery query = statement(Statement::Symbols);
+    query.exec();
+
+    while (query.next()) {
+        index->addSymbol(query.value(0).toString(), query.value(1).toString(),
+                         symbolPath(query, 2));
+    }
+    query.finish();
+
+#ifdef USE_SQLITE3
+    if (handle)
+        sqlite3_progress_handler(handle, 0, nullptr, nullptr);
+#endif
+
+    // An interrupted statement looks like a short result set
+    if (token.isCancelled())
+        return nullptr;
+
+    index->finalize();
+
+    // Failing to write the cache only means loading from SQL again next time
+    index->save(cachePath, stamp);
+
+    return index.take();
+}
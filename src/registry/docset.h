@@ -1,15 +1,24 @@
 #ifndef DOCSET_H
 #define DOCSET_H
 
+#include "cancellationtoken.h"
 #include "docsetinfo.h"
 #include "docsetmetadata.h"
 
 #include <QIcon>
+#include <QSharedPointer>
 #include <QString>
 #include <QSqlDatabase>
+#include <QSqlQuery>
 
 namespace Zeal {
 
+class FullTextIndex;
+class ManifestCache;
+class SymbolIndex;
+
+// A handle to a docset. Copies are cheap and share the manifest, the connections to the
+// index and the symbol and full-text indexes, which are released along with the last copy.
 class Docset
 {
 public:
@@ -18,33 +27,85 @@ public:
         ZDash
     };
 
+    // Statements prepared once per connection, see statement().
+    enum class Statement {
+        Symbols, // name, type, path[, anchor] of all symbols
+        TypeCounts, // type, count
+        TypeSymbols // :type, :limit, :offset -> name, path[, anchor]
+    };
+
     explicit Docset();
-    explicit Docset(const QString &path);
+    // Takes the manifest from \a manifestCache when the docset is unchanged, and adds it otherwise
+    explicit Docset(const QString &path, ManifestCache *manifestCache = nullptr);
     ~Docset();
 
     bool isValid() const;
+    // Whether \a other is a copy of this handle, rather than a docset loaded again from
+    // the same path, e.g. after an update
+    bool isSameDocset(const Docset &other) const;
 
     QString name() const;
+    // Interned name, see StringPool
+    int id() const;
     QString path() const;
     QString documentPath() const;
+    QString prefix() const;
     QIcon icon() const;
+    const DocsetMetadata &metadata() const;
+    const DocsetInfo &info() const;
+    // Opens the index, if not done yet
+    Type type() const;
+
+    // Returns the connection to the docset index owned by the calling thread. The index
+    // is opened on first use, only reading the manifest is done up front.
+    QSqlDatabase database() const;
+
+    // Returns a prepared, forward-only \a statement on the connection owned by the calling
+    // thread. Placeholders have to be bound before each exec(). Columns in brackets are only
+    // present when reading a ZDash index directly, use symbolPath() to combine them.
+    QSqlQuery statement(Statement statement) const;
+    // Returns the path in \a column of the current row of a statement(), including the anchor.
+    QString symbolPath(const QSqlQuery &query, int column) const;
 
-    QString prefix;
-    Type type;
-    QSqlDatabase db;
-    DocsetMetadata metadata;
-    DocsetInfo info;
+    // Loads the symbol index and reads the index file, so that the first search and
+    // browsing of the docset do not wait for the disk.
+    void warmUp(const CancellationToken &token = CancellationToken()) const;
+
+    // Whether the flat copy of the index is used, see buildSidecar().
+    bool hasSidecar() const;
+    // Writes a flat copy of the index next to it, which is used from the next start on.
+    // Returns false if the docset already uses one, or if writing fails or gets cancelled.
+    bool buildSidecar(const CancellationToken &token = CancellationToken()) const;
+
+    // Returns the symbol index, loading it on first use. Thread-safe.
+    // Returns nullptr if loading gets cancelled through \a token.
+    const SymbolIndex *symbolIndex(const CancellationToken &token = CancellationToken()) const;
+    // Same as symbolIndex(), but returns nullptr instead of loading the index from SQL,
+    // when it is neither loaded yet nor available from the on-disk symbol cache.
+    const SymbolIndex *cachedSymbolIndex() const;
+
+    // Returns the full-text index, loading it on first use, or nullptr if it has not been
+    // built yet. Thread-safe.
+    const FullTextIndex *fullTextIndex() const;
+    // Reads all pages into a full-text index, which is written next to the index.
+    // Returns false if it already exists, or if writing fails or gets cancelled.
+    bool buildFullTextIndex(const CancellationToken &token = CancellationToken()) const;
 
 private:
-    void findIcon();
+    struct Data;
 
-    bool m_isValid = false;
+    QString findIcon() const;
+    bool open() const;
+    QString resourcePath(const QString &fileName) const;
+    quint64 cacheStamp() const;
+    const SymbolIndex *setSymbolIndex(SymbolIndex *index) const;
+    SymbolIndex *loadSymbols(const CancellationToken &token) const;
 
-    QString m_name;
-    QString m_path;
-    QIcon m_icon;
+    QSharedPointer<Data> m_data;
 };
 
 } // namespace Zeal
 
+Q_DECLARE_METATYPE(Zeal::Docset)
+
 #endif // DOCSET_H
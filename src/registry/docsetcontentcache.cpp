@@ -0,0 +1,127 @@
+#include "docsetcontentcache.h"
+
+#include "docsetregistry.h"
+
+#include <QDir>
+#include <QMimeDatabase>
+
+using namespace Zeal;
+
+namespace {
+const char *Host = "docset";
+// Total size of the files kept mapped
+const int MaxCacheCost = 32 * 1024; // KiB
+// Larger files are mapped for each request
+const qint64 MaxCachedSize = 4 * 1024 * 1024; // bytes
+}
+
+const char *DocsetContentCache::Scheme = "zeal";
+
+DocsetContentCache::DocsetContentCache(DocsetRegistry *docsetRegistry, QObject *parent) :
+    QObject(parent),
+    m_docsetRegistry(docsetRegistry)
+{
+    m_files.setMaxCost(MaxCacheCost);
+
+    // Updates replace the files, which cannot be done while they are mapped on Windows
+    connect(m_docsetRegistry, &DocsetRegistry::docsetAdded,
+            this, &DocsetContentCache::invalidate, Qt::QueuedConnection);
+    connect(m_docsetRegistry, &DocsetRegistry::docsetRemoved,
+            this, &DocsetContentCache::invalidate, Qt::QueuedConnection);
+}
+
+QUrl DocsetContentCache::url(const QString &docsetName, const QString &path)
+{
+    const int fragmentPosition = path.indexOf(QLatin1Char('#'));
+
+    QUrl url;
+    url.setScheme(QLatin1String(Scheme));
+    url.setHost(QLatin1String(Host));
+    url.setPath(QLatin1Char('/') + docsetName + QLatin1Char('/') + path.left(fragmentPosition));
+    if (fragmentPosition != -1)
+        url.setFragment(path.mid(fragmentPosition + 1));
+    return url;
+}
+
+bool DocsetContentCache::isDocsetUrl(const QUrl &url)
+{
+    return url.scheme() == QLatin1String(Scheme) && url.host() == QLatin1String(Host);
+}
+
+QString DocsetContentCache::docsetName(const QUrl &url)
+{
+    if (!isDocsetUrl(url))
+        return QString();
+    return url.path().section(QLatin1Char('/'), 1, 1);
+}
+
+QString DocsetContentCache::documentPath(const QUrl &url)
+{
+    if (!isDocsetUrl(url))
+        return QString();
+    return url.path().section(QLatin1Char('/'), 2);
+}
+
+QString DocsetContentCache::localFile(const QUrl &url) const
+{
+    const Docset docset = m_docsetRegistry->entry(docsetName(url));
+    if (!docset.isValid())
+        return QString();
+
+    QString path = documentPath(url);
+#ifdef Q_OS_WIN32
+    // Fix for AngularJS docset - Windows doesn't allow ':'s in filenames,
+    // and bsdtar.exe replaces them with '_'s. The path is relative, so there
+    // is no drive letter to keep.
+    path.replace(QLatin1Char(':'), QLatin1Char('_'));
+#endif
+
+    const QString root = QDir::cleanPath(docset.documentPath()) + QLatin1Char('/');
+    const QString filePath = QDir::cleanPath(root + path);
+    // Keeps ../ from leaving the docset
+    if (!filePath.startsWith(root))
+        return QString();
+    return filePath;
+}
+
+QSharedPointer<const DocsetContentCache::File> DocsetContentCache::file(const QUrl &url)
+{
+    const QString key = url.path();
+    if (const QSharedPointer<const File> *cached = m_files.object(key))
+        return *cached;
+
+    const QString fileName = localFile(url);
+    if (fileName.isEmpty())
+        return QSharedPointer<const File>();
+
+    QSharedPointer<File> file(new File());
+    file->file.setFileName(fileName);
+    if (!file->file.open(QIODevice::ReadOnly))
+        return QSharedPointer<const File>();
+
+    file->size = file->file.size();
+    if (file->size > 0) {
+        file->data = file->file.map(0, file->size);
+        if (!file->data)
+            return QSharedPointer<const File>();
+    }
+
+    // Docset files come with proper extensions, reading them to tell the type is not needed
+    file->mimeType = QMimeDatabase().mimeTypeForFile(fileName, QMimeDatabase::MatchExtension)
+            .name().toLatin1();
+
+    if (file->size <= MaxCachedSize) {
+        m_files.insert(key, new QSharedPointer<const File>(file),
+                       qMax(1, static_cast<int>(file->size / 1024)));
+    }
+    return file;
+}
+
+void DocsetContentCache::invalidate(const QString &docsetName)
+{
+    const QString prefix = QLatin1Char('/') + docsetName + QLatin1Char('/');
+    for (const QString &key : m_files.keys()) {
+        if (key.startsWith(prefix))
+            m_files.remove(key);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef DOCSETCONTENTCACHE_H
+#define DOCSETCONTENTCACHE_H
+
+#include <QCache>
+#include <QFile>
+#include <QObject>
+#include <QSharedPointer>
+#include <QUrl>
+
+namespace Zeal {
+
+class DocsetRegistry;
+
+/**
+ * @short Docset pages and assets served through zeal://docset/<name>/<path> URLs.
+ *
+ * Files are memory-mapped on first request and the most recently requested ones are
+ * kept mapped, so loading a page with many images and stylesheets does not go to the
+ * file system for each of them. Must be used from the GUI thread.
+ */
+class DocsetContentCache : public QObject
+{
+    Q_OBJECT
+public:
+    // A mapped file, which stays valid as long as a reference to it is held
+    struct File
+    {
+        File() = default;
+
+        QFile file;
+        // nullptr for empty files
+        const uchar *data = nullptr;
+        qint64 size = 0;
+        QByteArray mimeType;
+
+    private:
+        Q_DISABLE_COPY(File)
+    };
+
+    static const char *Scheme;
+
+    explicit DocsetContentCache(DocsetRegistry *docsetRegistry, QObject *parent = nullptr);
+
+    /// Returns the URL of \a path in docset \a docsetName, \a path may contain a fragment.
+    static QUrl url(const QString &docsetName, const QString &path);
+    static bool isDocsetUrl(const QUrl &url);
+    /// Returns the name of the docset \a url points into, or an empty string.
+    static QString docsetName(const QUrl &url);
+    /// Returns the path of \a url relative to the documents of its docset.
+    static QString documentPath(const QUrl &url);
+
+    /// Returns the local file \a url points to, or an empty string if it is outside
+    /// of the documents of its docset.
+    QString localFile(const QUrl &url) const;
+    /// Returns the file \a url points to, or nullptr if it cannot be read.
+    QSharedPointer<const File> file(const QUrl &url);
+
+public slots:
+    void invalidate(const QString &docsetName);
+
+private:
+    DocsetRegistry *m_docsetRegistry = nullptr;
+    // By docset name and document path, cost in KiB
+    QCache<QString, QSharedPointer<const File>> m_files;
+};
+
+} // namespace Zeal
+
+#endif // DOCSETCONTENTCACHE_H
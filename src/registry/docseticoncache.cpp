@@ -0,0 +1,61 @@
+#include "docseticoncache.h"
+
+#include "docsetregistry.h"
+#include "stringpool.h"
+
+#include <QApplication>
+#include <QStyle>
+
+using namespace Zeal;
+
+DocsetIconCache::DocsetIconCache(DocsetRegistry *docsetRegistry, QObject *parent) :
+    QObject(parent),
+    m_docsetRegistry(docsetRegistry),
+    m_smallExtent(QApplication::style()->pixelMetric(QStyle::PM_SmallIconSize)),
+    m_devicePixelRatio(qApp->devicePixelRatio())
+{
+    // Reinstalled docsets may come with a different icon
+    connect(m_docsetRegistry, &DocsetRegistry::docsetAdded,
+            this, &DocsetIconCache::invalidate, Qt::QueuedConnection);
+    connect(m_docsetRegistry, &DocsetRegistry::docsetRemoved,
+            this, &DocsetIconCache::invalidate, Qt::QueuedConnection);
+}
+
+QPixmap DocsetIconCache::pixmap(int docsetId)
+{
+    return pixmap(docsetId, m_smallExtent);
+}
+
+QPixmap DocsetIconCache::pixmap(int docsetId, int extent)
+{
+    // Moving the window to a screen with another scale factor
+    const qreal devicePixelRatio = qApp->devicePixelRatio();
+    if (devicePixelRatio != m_devicePixelRatio) {
+        m_pixmaps.clear();
+        m_devicePixelRatio = devicePixelRatio;
+    }
+
+    QHash<int, QPixmap> &pixmaps = m_pixmaps[docsetId];
+    const auto it = pixmaps.constFind(extent);
+    if (it != pixmaps.cend())
+        return it.value();
+
+    const Docset docset = m_docsetRegistry->entry(StringPool::string(docsetId));
+    if (!docset.isValid())
+        return QPixmap();
+
+    // Follows the device pixel ratio of the application
+    const QPixmap pixmap = docset.icon().pixmap(extent, extent);
+    pixmaps.insert(extent, pixmap);
+    return pixmap;
+}
+
+QPixmap DocsetIconCache::pixmap(const QString &docsetName, int extent)
+{
+    return pixmap(StringPool::intern(docsetName), extent);
+}
+
+void DocsetIconCache::invalidate(const QString &docsetName)
+{
+    m_pixmaps.remove(StringPool::intern(docsetName));
+}
@@ -0,0 +1,45 @@
+#ifndef DOCSETICONCACHE_H
+#define DOCSETICONCACHE_H
+
+#include <QHash>
+#include <QObject>
+#include <QPixmap>
+
+namespace Zeal {
+
+class DocsetRegistry;
+
+/**
+ * @short Docset icons rasterized once for the sizes views paint them at.
+ *
+ * Pixmaps are kept by docset ID (see StringPool) and size, and only rebuilt when
+ * a docset is installed or removed, or the device pixel ratio changes. Must be
+ * used from the GUI thread.
+ */
+class DocsetIconCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DocsetIconCache(DocsetRegistry *docsetRegistry, QObject *parent = nullptr);
+
+    /// Returns the icon of the docset with \a docsetId at the small icon size of the style.
+    QPixmap pixmap(int docsetId);
+    /// Returns the icon at \a extent device-independent pixels, or a null pixmap for
+    /// unknown docsets.
+    QPixmap pixmap(int docsetId, int extent);
+    QPixmap pixmap(const QString &docsetName, int extent);
+
+private slots:
+    void invalidate(const QString &docsetName);
+
+private:
+    DocsetRegistry *m_docsetRegistry = nullptr;
+    int m_smallExtent;
+    qreal m_devicePixelRatio;
+    // By docset ID, then extent
+    QHash<int, QHash<int, QPixmap>> m_pixmaps;
+};
+
+} // namespace Zeal
+
+#endif // DOCSETICONCACHE_H
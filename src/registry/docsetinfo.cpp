@@ -1,5 +1,6 @@
 #include "docsetinfo.h"
 
+#include <QDataStream>
 #include <QFile>
 #include <QVariant>
 #include <QXmlStreamReader>
@@ -64,3 +65,15 @@ DocsetInfo DocsetInfo::fromPlist(const QString &filePath)
 
     return docsetInfo;
 }
+
+QDataStream &Zeal::operator<<(QDataStream &stream, const DocsetInfo &info)
+{
+    return stream << info.bundleName << info.bundleIdentifier << info.indexPath << info.family
+                  << info.keyword << info.isDashDocset << info.isJavaScriptEnabled;
+}
+
+QDataStream &Zeal::operator>>(QDataStream &stream, DocsetInfo &info)
+{
+    return stream >> info.bundleName >> info.bundleIdentifier >> info.indexPath >> info.family
+                  >> info.keyword >> info.isDashDocset >> info.isJavaScriptEnabled;
+}
@@ -3,6 +3,8 @@
 
 #include <QString>
 
+class QDataStream;
+
 namespace Zeal {
 
 struct DocsetInfo
@@ -20,6 +22,10 @@ struct DocsetInfo
     bool isJavaScriptEnabled = false;
 };
 
+// Used by ManifestCache
+QDataStream &operator<<(QDataStream &stream, const DocsetInfo &info);
+QDataStream &operator>>(QDataStream &stream, DocsetInfo &info);
+
 } // namespace Zeal
 
 #endif // DOCSETINFO_H
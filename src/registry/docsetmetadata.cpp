@@ -1,5 +1,6 @@
 #include "docsetmetadata.h"
 
+#include <QDataStream>
 #include <QFile>
 #include <QJsonArray>
 #include <QJsonDocument>
@@ -164,7 +165,12 @@ DocsetMetadata DocsetMetadata::fromDashFeed(const QUrl &feedUrl, const QByteArra
         if (xml.name() == QStringLiteral("version")) {
             if (xml.readNext() != QXmlStreamReader::Characters)
                 continue;
-            metadata.m_version = xml.text().toString();
+            // Feeds can append a revision, as in "1.2.0/3"
+            const QString version = xml.text().toString();
+            const int separator = version.indexOf(QLatin1Char('/'));
+            metadata.m_version = version.left(separator);
+            if (separator != -1)
+                metadata.m_revision = version.mid(separator + 1);
         } else if (xml.name() == QStringLiteral("url")) {
             if (xml.readNext() != QXmlStreamReader::Characters)
                 continue;
@@ -174,3 +180,17 @@ DocsetMetadata DocsetMetadata::fromDashFeed(const QUrl &feedUrl, const QByteArra
 
     return metadata;
 }
+
+QDataStream &Zeal::operator<<(QDataStream &stream, const DocsetMetadata &metadata)
+{
+    return stream << metadata.m_source << metadata.m_name << metadata.m_icon << metadata.m_title
+                  << metadata.m_aliases << metadata.m_version << metadata.m_revision
+                  << metadata.m_oldVersions << metadata.m_feedUrl << metadata.m_urls;
+}
+
+QDataStream &Zeal::operator>>(QDataStream &stream, DocsetMetadata &metadata)
+{
+    return stream >> metadata.m_source >> metadata.m_name >> metadata.m_icon >> metadata.m_title
+                  >> metadata.m_aliases >> metadata.m_version >> metadata.m_revision
+                  >> metadata.m_oldVersions >> metadata.m_feedUrl >> metadata.m_urls;
+}
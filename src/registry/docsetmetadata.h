@@ -4,6 +4,7 @@
 #include <QStringList>
 #include <QUrl>
 
+class QDataStream;
 class QJsonObject;
 
 namespace Zeal {
@@ -37,6 +38,10 @@ public:
     static DocsetMetadata fromDashFeed(const QUrl &feedUrl, const QByteArray &data);
 
 private:
+    // Used by ManifestCache
+    friend QDataStream &operator<<(QDataStream &stream, const DocsetMetadata &metadata);
+    friend QDataStream &operator>>(QDataStream &stream, DocsetMetadata &metadata);
+
     QString m_source;
 
     QString m_name;
@@ -51,6 +56,9 @@ private:
     QList<QUrl> m_urls;
 };
 
+QDataStream &operator<<(QDataStream &stream, const DocsetMetadata &metadata);
+QDataStream &operator>>(QDataStream &stream, DocsetMetadata &metadata);
+
 } // namespace Zeal
 
 Q_DECLARE_METATYPE(Zeal::DocsetMetadata)
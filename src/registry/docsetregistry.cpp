@@ -1,260 +1,1061 @@
 #include "docsetregistry.h"
 
+#include "fulltextindex.h"
+#include "fuzzymatcher.h"
 #include "searchquery.h"
 #include "searchresult.h"
+#include "symbolindex.h"
+
+#include "core/metrics.h"
+#include "core/task.h"
 
 #include <QCoreApplication>
+#include <QDateTime>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QMutex>
+#include <QSemaphore>
 #include <QSqlQuery>
+#include <QStandardPaths>
 #include <QThread>
+#include <QThreadPool>
+#include <QTimer>
 #include <QUrl>
 #include <QVariant>
 
+#include <algorithm>
+#include <functional>
+#include <queue>
+
 using namespace Zeal;
+using Zeal::Core::Task;
+
+namespace {
+// Larger candidate sets are not kept, recomputing them is about as cheap
+const int MaxCachedCandidates = 10000;
+
+// Results of docsets finishing within this many milliseconds are delivered together
+const int ResultBatchInterval = 15;
+
+// A single docset used to return up to 100 prefix and 100 substring matches
+const int DefaultResultLimit = 200;
+
+// Total number of results kept in the result cache
+const int MaxCachedResults = 20000;
+
+// Priority of warm-up tasks in the background pool
+const int WarmUpPriority = 1;
+// Building a full-text index reads every page, it comes after all other maintenance work
+const int FullTextPriority = -1;
+
+// Each full-text hit reads its page for the snippet
+const int FullTextResultLimit = 50;
+// Length of full-text snippets, in characters
+const int SnippetLength = 120;
+// BM25 scores are fractional, sort keys hold integers
+const int FullTextScoreScale = 1000;
+
+// Weight of the latest query in the moving average of query latencies, in percent
+const int LatencyWeight = 25;
+
+// Changes to remote roots usually come in bursts, like while a docset gets copied
+const int RescanDelay = 2000; // ms
+}
 
 DocsetRegistry::DocsetRegistry(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    m_searchPool(new QThreadPool(this)),
+    m_backgroundPool(new QThreadPool(this)),
+    m_snapshot(std::make_shared<const QMap<QString, Docset>>()),
+    m_filterTable(std::make_shared<const FilterTable>()),
+    m_resultCache(MaxCachedResults),
+    m_usageStore(QStandardPaths::writableLocation(QStandardPaths::DataLocation)
+                 + QLatin1String("/usage.dat")),
+    m_manifestCache(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+                    + QLatin1String("/manifests.dat")),
+    m_resultLimit(DefaultResultLimit)
 {
+    qRegisterMetaType<QList<Docset>>("QList<Zeal::Docset>");
+    qRegisterMetaType<SearchResultBlock::Shared>("Zeal::SearchResultBlock::Shared");
+    qRegisterMetaType<QueryProfile>("Zeal::QueryProfile");
+
+    // Docsets keep per-thread database connections, so search threads should never expire
+    m_searchPool->setExpiryTimeout(-1);
+    m_backgroundPool->setExpiryTimeout(-1);
+    m_backgroundPool->setMaxThreadCount(1);
+
+    // Created ahead of moving to the registry thread, which they move along to
+    m_remoteWatcher = new QFileSystemWatcher(this);
+    connect(m_remoteWatcher, &QFileSystemWatcher::directoryChanged,
+            this, &DocsetRegistry::remoteFolderChanged);
+    m_rescanTimer = new QTimer(this);
+    m_rescanTimer->setSingleShot(true);
+    m_rescanTimer->setInterval(RescanDelay);
+    connect(m_rescanTimer, &QTimer::timeout, this, &DocsetRegistry::rescanRemoteRoots);
+
     /// FIXME: Only search should be performed in a separate thread
     QThread *thread = new QThread(this);
     moveToThread(thread);
     thread->start();
 }
 
+DocsetRegistry::~DocsetRegistry()
+{
+    // The registry thread is a child, which must not be destroyed while running
+    QThread *registryThread = thread();
+    if (registryThread != QThread::currentThread()) {
+        registryThread->quit();
+        registryThread->wait();
+    }
+
+    // Do not wait for maintenance work to finish
+    m_backgroundGeneration.ref();
+    m_backgroundPool->clear();
+    m_backgroundPool->waitForDone();
+
+    // Related links are delivered from the pool
+    m_searchPool->waitForDone();
+}
+
+DocsetRegistry::Snapshot DocsetRegistry::snapshot() const
+{
+    return std::atomic_load(&m_snapshot);
+}
+
 int DocsetRegistry::count() const
 {
-    return m_docs.count();
+    return snapshot()->count();
 }
 
 bool DocsetRegistry::contains(const QString &name) const
 {
-    return m_docs.contains(name);
+    return snapshot()->contains(name);
 }
 
 QStringList DocsetRegistry::names() const
 {
-    return m_docs.keys();
+    return snapshot()->keys();
+}
+
+Docset DocsetRegistry::entry(const QString &name) const
+{
+    return snapshot()->value(name);
 }
 
 void DocsetRegistry::remove(const QString &name)
 {
-    /// TODO: db close should be in ~Docset(), when it stop being a value type
-    m_docs[name].db.close();
-    m_docs.remove(name);
+    {
+        QMutexLocker locker(&m_mutex);
+        QMap<QString, Docset> docs = *snapshot();
+        if (!docs.contains(name))
+            return;
+
+        docs.remove(name);
+        m_candidateSets.remove(name);
+        publish(docs);
+    }
+
+    // Connections are closed once running searches release the docset
+    emit docsetRemoved(name);
 }
 
 void DocsetRegistry::clear()
 {
-    for (const QString &key : m_docs.keys())
-        remove(key);
+    Snapshot docs;
+    {
+        QMutexLocker locker(&m_mutex);
+        docs = snapshot();
+        m_candidateSets.clear();
+        publish(QMap<QString, Docset>());
+    }
+
+    for (const QString &name : docs->keys())
+        emit docsetRemoved(name);
 }
 
-QList<Docset> DocsetRegistry::docsets()
+// Readers holding the previous snapshot keep using it until they are done
+void DocsetRegistry::publish(const QMap<QString, Docset> &docs)
 {
-    return m_docs.values();
+    std::shared_ptr<FilterTable> filters = std::make_shared<FilterTable>();
+    for (const Docset &docset : docs) {
+        QStringList terms = docset.metadata().aliases();
+        terms << docset.prefix() << docset.info().keyword;
+        for (const QString &term : terms) {
+            if (term.isEmpty())
+                continue;
+
+            QVector<int> &ids = (*filters)[term.toCaseFolded()];
+            if (!ids.contains(docset.id()))
+                ids.append(docset.id());
+        }
+    }
+
+    std::atomic_store(&m_snapshot, std::make_shared<const QMap<QString, Docset>>(docs));
+    std::atomic_store(&m_filterTable, std::shared_ptr<const FilterTable>(filters));
+    m_generation.ref();
+}
+
+QSet<int> DocsetRegistry::docsetFilter(const SearchQuery &query) const
+{
+    const std::shared_ptr<const FilterTable> filters = std::atomic_load(&m_filterTable);
+
+    QSet<int> ids;
+    for (const QString &term : query.docsetFilters()) {
+        const QString key = term.trimmed().toCaseFolded();
+
+        const auto it = filters->constFind(key);
+        if (it != filters->cend()) {
+            for (int id : it.value())
+                ids.insert(id);
+            continue;
+        }
+
+        // Partial names keep working, like "pyth" for Python
+        for (auto filter = filters->cbegin(); filter != filters->cend(); ++filter) {
+            if (filter.key().contains(key)) {
+                for (int id : filter.value())
+                    ids.insert(id);
+            }
+        }
+    }
+    return ids;
 }
 
 void DocsetRegistry::addDocset(const QString &path)
 {
-    Docset docset(path);
+    Docset docset(path, &m_manifestCache);
 
     /// TODO: Emit error
     if (!docset.isValid())
         return;
 
-    if (m_docs.contains(docset.name()))
-        remove(docset.name());
+    insertDocset(docset);
 
-    m_docs[docset.name()] = docset;
+    startBackgroundTask([this](const CancellationToken &) {
+        m_manifestCache.save();
+    });
 }
 
-const Docset &DocsetRegistry::entry(const QString &name)
+void DocsetRegistry::addDocsets(const QList<Docset> &docsets)
 {
-    return m_docs[name];
+    for (const Docset &docset : docsets)
+        insertDocset(docset);
 }
 
-void DocsetRegistry::runQuery(const QString &query)
+void DocsetRegistry::insertDocset(const Docset &docset)
 {
-    m_lastQuery += 1;
+    const QString name = docset.name();
+    Docset replaced;
+    {
+        QMutexLocker locker(&m_mutex);
+        QMap<QString, Docset> docs = *snapshot();
+        replaced = docs.value(name);
+        docs.insert(name, docset);
+        m_candidateSets.remove(name);
+        publish(docs);
+    }
+
+    if (replaced.isValid())
+        emit docsetRemoved(name);
+    emit docsetAdded(name);
+
+    // Speeds up loading the docset from the next start on. Returns early if the
+    // flat copy of the index already exists.
+    startBackgroundTask([docset](const CancellationToken &token) {
+        docset.buildSidecar(token);
+    });
+
+    // Returns early as well, if the index already exists. Results cached before it was
+    // built lack the hits in this docset.
+    startBackgroundTask([this, docset](const CancellationToken &token) {
+        if (docset.buildFullTextIndex(token))
+            m_generation.ref();
+    }, FullTextPriority);
+}
+
+void DocsetRegistry::warmUp(const QStringList &names)
+{
+    const Snapshot docs = snapshot();
+    for (const QString &name : names) {
+        if (!docs->contains(name))
+            continue;
+
+        // Ahead of sidecar builds, which can wait
+        const Docset docset = docs->value(name);
+        startBackgroundTask([docset](const CancellationToken &token) {
+            docset.warmUp(token);
+        }, WarmUpPriority);
+    }
+}
+
+void DocsetRegistry::startBackgroundTask(
+        const std::function<void(const CancellationToken &)> &function, int priority)
+{
+    const CancellationToken token(&m_backgroundGeneration, m_backgroundGeneration.load());
+    m_backgroundPool->start(new Task([function, token]() {
+        if (token.isCancelled())
+            return;
+
+        // Typing should not compete with maintenance work
+        QThread::currentThread()->setPriority(QThread::LowPriority);
+        function(token);
+    }), priority);
+}
+
+int DocsetRegistry::resultLimit() const
+{
+    return m_resultLimit.load();
+}
+
+void DocsetRegistry::setResultLimit(int limit)
+{
+    m_resultLimit.store(limit > 0 ? limit : DefaultResultLimit);
+}
+
+int DocsetRegistry::queryLatency() const
+{
+    return m_queryLatency.load();
+}
+
+bool DocsetRegistry::isFuzzySearchEnabled() const
+{
+    return m_fuzzySearch.load();
+}
+
+void DocsetRegistry::setFuzzySearchEnabled(bool enabled)
+{
+    m_fuzzySearch.store(enabled);
+}
+
+int DocsetRegistry::runQuery(const QString &query)
+{
+    // Also cancels the query in progress, if any
+    const int queryNum = m_lastQuery.fetchAndAddOrdered(1) + 1;
     QMetaObject::invokeMethod(this, "_runQuery", Qt::QueuedConnection, Q_ARG(QString, query),
-                              Q_ARG(int, m_lastQuery));
+                              Q_ARG(int, queryNum));
+    return queryNum;
 }
 
 void DocsetRegistry::invalidateQueries()
 {
-    m_lastQuery += 1;
+    m_lastQuery.ref();
+}
+
+void DocsetRegistry::recordOpen(const QString &name, const QString &path)
+{
+    m_usageStore.recordOpen(name, path);
+    m_generation.ref();
+
+    // Saves nothing if an earlier task already wrote this change
+    startBackgroundTask([this](const CancellationToken &) {
+        m_usageStore.save();
+    });
+}
+
+QList<SearchResult> DocsetRegistry::search(const QString &rawQuery, int limit,
+                                           const CancellationToken &token) const
+{
+    const SearchQuery query(rawQuery);
+    const QString coreQuery = query.coreQuery();
+    if (limit <= 0)
+        limit = resultLimit();
+    const bool fuzzy = isFuzzySearchEnabled();
+
+    // Docsets are searched one after another, callers spread their lookups over threads
+    const QSet<int> filteredDocsets = query.hasDocsetFilter() ? docsetFilter(query) : QSet<int>();
+    const Snapshot docs = snapshot();
+    QVector<QList<SearchResult>> docsetResults;
+    QAtomicInt leadingMatches = 0;
+    const UsageStore::Snapshot usage = m_usageStore.snapshot();
+    for (const Docset &docset : *docs) {
+        if (query.hasDocsetFilter() && !filteredDocsets.contains(docset.id()))
+            continue;
+        if (token.isCancelled())
+            return QList<SearchResult>();
+
+        // Candidates of the interactive query are left alone
+        CandidateSet candidates;
+        QueryProfile::DocsetTiming timing;
+        if (query.isFullTextQuery()) {
+            docsetResults.append(searchFullText(docset, coreQuery, limit, token, &timing));
+        } else {
+            docsetResults.append(searchDocset(docset, coreQuery, limit, fuzzy, token, &candidates,
+                                              &leadingMatches, usage, &timing));
+        }
+    }
+
+    return mergeResults(docsetResults, limit);
 }
 
 void DocsetRegistry::_runQuery(const QString &rawQuery, int queryNum)
 {
+    QElapsedTimer latencyTimer;
+    latencyTimer.start();
+
+    const CancellationToken token(&m_lastQuery, queryNum);
+
     // If some other queries pending, ignore this one.
-    if (queryNum != m_lastQuery)
+    if (token.isCancelled())
         return;
 
-    QList<SearchResult> results;
+    QueryProfile profile;
+    profile.queryNum = queryNum;
+    profile.query = rawQuery;
+    profile.startedAt = QDateTime::currentMSecsSinceEpoch();
+
     SearchQuery query(rawQuery);
 
-    QString preparedQuery = query.sanitizedQuery();
+    const QString coreQuery = query.coreQuery();
+    const bool fullText = query.isFullTextQuery();
     bool hasDocsetFilter = query.hasDocsetFilter();
+    const int limit = resultLimit();
+    const bool fuzzy = isFuzzySearchEnabled();
 
-    for (const Docset &docset : docsets()) {
-        // Filter out this docset as the names don't match the docset prefix
-        if (hasDocsetFilter && !query.docsetPrefixMatch(docset.prefix))
+    // Resolved once, each docset is a lookup then
+    const QSet<int> filteredDocsets = hasDocsetFilter ? docsetFilter(query) : QSet<int>();
+    const Snapshot docs = snapshot();
+    QList<Docset> matchingDocsets;
+    for (const Docset &docset : *docs) {
+        if (hasDocsetFilter && !filteredDocsets.contains(docset.id()))
             continue;
+        matchingDocsets.append(docset);
+    }
 
-        QString qstr;
-        QSqlQuery q;
-        QList<QList<QVariant>> found;
-        bool withSubStrings = false;
-        // %.%1% for long Django docset values like django.utils.http
-        // %::%1% for long C++ docset values like std::set
-        // %/%1% for long Go docset values like archive/tar
-        QString subNames = QStringLiteral(" or %1 like '%.%2%' escape '\\'");
-        subNames += QStringLiteral(" or %1 like '%::%2%' escape '\\'");
-        subNames += QStringLiteral(" or %1 like '%/%2%' escape '\\'");
-        while (found.size() < 100) {
-            QString curQuery = preparedQuery;
-            QString notQuery; // don't return the same result twice
-            if (withSubStrings) {
-                // if less than 100 found starting with query, search all substrings
-                curQuery = "%" + preparedQuery;
-                // don't return 'starting with' results twice
-                if (docset.type == Docset::Type::ZDash)
-                    notQuery = QString(" and not (ztokenname like '%1%' escape '\\' %2) ").arg(preparedQuery, subNames.arg("ztokenname", preparedQuery));
-                else
-                    notQuery = QString(" and not (t.name like '%1%' escape '\\' %2) ").arg(preparedQuery, subNames.arg("t.name", preparedQuery));
-            }
-            int cols = 3;
-            if (docset.type == Docset::Type::Dash) {
-                qstr = QString("select t.name, null, t.path from searchIndex t where (t.name "
-                               "like '%1%' escape '\\' %3)  %2 order by length(t.name), lower(t.name) asc, t.path asc limit 100").arg(curQuery, notQuery, subNames.arg("t.name", curQuery));
-            } else if (docset.type == Docset::Type::ZDash) {
-                cols = 4;
-                qstr = QString("select ztokenname, null, zpath, zanchor from ztoken "
-                               "join ztokenmetainformation on ztoken.zmetainformation = ztokenmetainformation.z_pk "
-                               "join zfilepath on ztokenmetainformation.zfile = zfilepath.z_pk where (ztokenname "
-                               "like '%1%' escape '\\' %3) %2 order by length(ztokenname), lower(ztokenname) asc, zpath asc, "
-                               "zanchor asc limit 100").arg(curQuery, notQuery,
-                                                            subNames.arg("ztokenname", curQuery));
-            }
-            q = docset.db.exec(qstr);
-            while (q.next()) {
-                QList<QVariant> values;
-                for (int i = 0; i < cols; ++i)
-                    values.append(q.value(i));
-                found.append(values);
+    // Repeated queries, e.g. after deleting characters, are answered right away
+    const QString cacheKey = resultCacheKey(fullText ? QLatin1Char('?') + coreQuery : coreQuery,
+                                            matchingDocsets, limit, fuzzy);
+    if (const QList<SearchResult> *cachedResults = m_resultCache.object(cacheKey)) {
+        // Shares the cached list, nothing is copied
+        profile.results = cachedResults->size();
+        recordLatency(latencyTimer.elapsed());
+        Core::Metrics::record(Core::Metrics::queryLatencySeries(matchingDocsets.size()),
+                              quint64(latencyTimer.nsecsElapsed() / 1000));
+        emit queryCompleted(SearchResultBlock::create(queryNum,
+                                                      QList<SearchResult>(*cachedResults)));
+
+        profile.cached = true;
+        profile.total = latencyTimer.nsecsElapsed() / 1000;
+        recordProfile(profile);
+        return;
+    }
+
+    // Each docset is searched by its own task. Results are delivered in batches as
+    // tasks finish, and merged into the complete list once all are done.
+    QVector<QList<SearchResult>> docsetResults(matchingDocsets.size());
+    QVector<CandidateSet> candidateSets(matchingDocsets.size());
+    QVector<QueryProfile::DocsetTiming> timings(matchingDocsets.size());
+    QAtomicInt leadingMatches = 0;
+    const UsageStore::Snapshot usage = m_usageStore.snapshot();
+    QVector<int> finishedOrder;
+    QMutex finishedMutex;
+    QSemaphore finishedTasks;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (int i = 0; i < matchingDocsets.size(); ++i)
+            candidateSets[i] = m_candidateSets.value(matchingDocsets.at(i).name());
+    }
+    for (int i = 0; i < matchingDocsets.size(); ++i) {
+        const Docset docset = matchingDocsets.at(i);
+        QList<SearchResult> *results = &docsetResults[i];
+        CandidateSet *candidates = &candidateSets[i];
+        QueryProfile::DocsetTiming *timing = &timings[i];
+        m_searchPool->start(new Task([i, docset, coreQuery, fullText, limit, fuzzy, token,
+                                     results, candidates, timing, usage, &leadingMatches,
+                                     &finishedOrder, &finishedMutex, &finishedTasks]() {
+            // Tasks of a cancelled query still queued in the pool return immediately
+            if (!token.isCancelled()) {
+                *results = fullText
+                        ? searchFullText(docset, coreQuery, limit, token, timing)
+                        : searchDocset(docset, coreQuery, limit, fuzzy, token, candidates,
+                                       &leadingMatches, usage, timing);
             }
 
-            if (withSubStrings)
-                break;
-            withSubStrings = true;  // try again searching for substrings
-        }
+            QMutexLocker locker(&finishedMutex);
+            finishedOrder.append(i);
+            finishedTasks.release();
+        }));
+    }
 
-        for (const QList<QVariant> &row : found) {
-            QString parentName;
-            if (!row[1].isNull())
-                parentName = row[1].toString();
+    QVector<QList<SearchResult>> batch;
+    QElapsedTimer batchTimer;
+    batchTimer.start();
+    bool firstBatch = true;
 
-            QString path = row[2].toString();
-            // FIXME: refactoring to use common code in ZealListModel and DocsetRegistry
-            if (docset.type == Docset::Type::ZDash)
-                path += "#" + row[3].toString();
+    // All tasks must be waited for, even when cancelled, as they reference this frame
+    for (int finished = 0; finished < matchingDocsets.size(); ++finished) {
+        finishedTasks.acquire();
+        if (token.isCancelled())
+            continue;
+
+        QMutexLocker locker(&finishedMutex);
+        const QList<SearchResult> &results = docsetResults.at(finishedOrder.at(finished));
+        locker.unlock();
+
+        if (results.isEmpty())
+            continue;
 
-            QString itemName = row[0].toString();
-            normalizeName(itemName, parentName, row[1].toString());
-            results.append(SearchResult(itemName, parentName, path, docset.name(),
-                                        preparedQuery));
+        batch.append(results);
+        if (firstBatch || batchTimer.elapsed() >= ResultBatchInterval) {
+            emit queryResultsReady(SearchResultBlock::create(queryNum,
+                                                             mergeResults(batch, limit)));
+            batch.clear();
+            batchTimer.restart();
+            firstBatch = false;
         }
     }
-    qSort(results);
-    if (queryNum != m_lastQuery)
+
+    if (token.isCancelled())
         return; // some other queries pending - ignore this one
 
-    m_queryResults = results;
-    emit queryCompleted();
+    if (!batch.isEmpty())
+        emit queryResultsReady(SearchResultBlock::create(queryNum, mergeResults(batch, limit)));
+
+    {
+        // Docsets removed or replaced meanwhile must not leave their candidates behind
+        QMutexLocker locker(&m_mutex);
+        const Snapshot current = snapshot();
+        for (int i = 0; i < matchingDocsets.size(); ++i) {
+            const Docset &docset = matchingDocsets.at(i);
+            if (current->value(docset.name()).isSameDocset(docset))
+                m_candidateSets.insert(docset.name(), candidateSets.at(i));
+        }
+    }
+
+    QElapsedTimer mergeTimer;
+    mergeTimer.start();
+    QList<SearchResult> results = mergeResults(docsetResults, limit);
+    profile.merging = mergeTimer.nsecsElapsed() / 1000;
+
+    // The cache and the block share the list
+    profile.results = results.size();
+    m_resultCache.insert(cacheKey, new QList<SearchResult>(results), results.size() + 1);
+    recordLatency(latencyTimer.elapsed());
+    Core::Metrics::record(Core::Metrics::queryLatencySeries(matchingDocsets.size()),
+                          quint64(latencyTimer.nsecsElapsed() / 1000));
+    emit queryCompleted(SearchResultBlock::create(queryNum, std::move(results)));
+
+    profile.total = latencyTimer.nsecsElapsed() / 1000;
+    profile.docsets = timings;
+    recordProfile(profile);
 }
 
-void DocsetRegistry::normalizeName(QString &itemName, QString &parentName,
-                                    const QString &initialParent)
+void DocsetRegistry::recordProfile(const QueryProfile &profile)
 {
-    QRegExp matchMethodName("^([^\\(]+)(?:\\(.*\\))?$");
-    if (matchMethodName.indexIn(itemName) != -1)
-        itemName = matchMethodName.cap(1);
+    const int count = m_profileCount.load();
+    std::atomic_store(&m_profiles[count % ProfileCount],
+                      std::make_shared<const QueryProfile>(profile));
+    m_profileCount.storeRelease(count + 1);
 
-    QString separators[] = {".", "::", "/"};
-    for (unsigned i = 0; i < sizeof separators / sizeof *separators; ++i) {
-        QString sep = separators[i];
-        if (itemName.indexOf(sep) != -1 && itemName.indexOf(sep) != 0 && initialParent.isNull()) {
-            const QStringList splitted = itemName.split(sep);
-            itemName = splitted.at(splitted.size()-1);
-            parentName = splitted.at(splitted.size()-2);
-        }
+    emit queryProfiled(profile);
+}
+
+QList<QueryProfile> DocsetRegistry::queryProfiles() const
+{
+    const int count = m_profileCount.loadAcquire();
+
+    QList<QueryProfile> profiles;
+    for (int i = qMax(0, count - ProfileCount); i < count; ++i) {
+        // The oldest slots may already have been replaced by newer profiles
+        const std::shared_ptr<const QueryProfile> profile
+                = std::atomic_load(&m_profiles[i % ProfileCount]);
+        if (profile && (profiles.isEmpty() || profile->queryNum > profiles.last().queryNum))
+            profiles.append(*profile);
     }
+    return profiles;
+}
+
+// Cancelled queries are not recorded, they say little about how long a query takes
+void DocsetRegistry::recordLatency(qint64 elapsed)
+{
+    const int latency = m_queryLatency.load();
+    if (latency == 0)
+        m_queryLatency.store(int(elapsed));
+    else
+        m_queryLatency.store((latency * (100 - LatencyWeight) + int(elapsed) * LatencyWeight) / 100);
 }
 
-const QList<SearchResult> &DocsetRegistry::queryResults()
+// Results only depend on the case folded query, the searched docsets and search settings.
+// The registry generation keeps results of removed or replaced docsets from being reused.
+QString DocsetRegistry::resultCacheKey(const QString &query, const QList<Docset> &docsets,
+                                       int limit, bool fuzzy) const
 {
-    return m_queryResults;
+    QStringList names;
+    names.reserve(docsets.size());
+    for (const Docset &docset : docsets)
+        names.append(docset.name());
+    names.sort();
+
+    const QChar separator(0x1f); // unit separator, does not appear in names or queries
+    return QString::number(m_generation.load()) + separator + QString::number(limit)
+            + separator + QString::number(fuzzy) + separator + names.join(separator)
+            + separator + query.toLower();
 }
 
-QList<SearchResult> DocsetRegistry::relatedLinks(const QString &name, const QString &path)
+QList<SearchResult> DocsetRegistry::searchDocset(const Docset &docset, const QString &query,
+                                                 int limit, bool fuzzy,
+                                                 const CancellationToken &token,
+                                                 CandidateSet *candidates,
+                                                 QAtomicInt *leadingMatches,
+                                                 const UsageStore::Snapshot &usage,
+                                                 QueryProfile::DocsetTiming *timing)
 {
     QList<SearchResult> results;
-    // Get the url without the #anchor.
-    QUrl mainUrl(path);
-    mainUrl.setFragment(NULL);
-    QString pageUrl(mainUrl.toString());
-    Docset entry = m_docs[name];
-
-    // Prepare the query to look up all pages with the same url.
-    QString query;
-    if (entry.type == Docset::Type::Dash) {
-        query = QString("SELECT name, type, path FROM searchIndex WHERE path LIKE \"%1%%\"").arg(pageUrl);
-    } else if (entry.type == Docset::Type::ZDash) {
-        query = QString("SELECT ztoken.ztokenname, ztokentype.ztypename, zfilepath.zpath, ztokenmetainformation.zanchor "
-                        "FROM ztoken "
-                        "JOIN ztokenmetainformation ON ztoken.zmetainformation = ztokenmetainformation.z_pk "
-                        "JOIN zfilepath ON ztokenmetainformation.zfile = zfilepath.z_pk "
-                        "JOIN ztokentype ON ztoken.ztokentype = ztokentype.z_pk "
-                        "WHERE zfilepath.zpath = \"%1\"").arg(pageUrl);
-    }
-
-    QSqlQuery result = entry.db.exec(query);
-    while (result.next()) {
-        QString sectionName = result.value(0).toString();
-        QString sectionPath = result.value(2).toString();
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 phaseStart = 0;
+    // Returns the time since the previous call, in microseconds
+    auto phaseTime = [&timer, &phaseStart]() {
+        const qint64 now = timer.nsecsElapsed() / 1000;
+        const qint64 elapsed = now - phaseStart;
+        phaseStart = now;
+        return elapsed;
+    };
+
+    timing->docsetId = docset.id();
+
+    const SymbolIndex *index = docset.symbolIndex(token);
+    timing->loading = phaseTime();
+    if (!index)
+        return results;
+
+    // Appending characters can only narrow down the previous matches
+    const QString lowerQuery = query.toLower();
+    const bool canNarrow = candidates->docset.isSameDocset(docset)
+            && candidates->index == index && !candidates->query.isEmpty()
+            && lowerQuery.startsWith(candidates->query);
+
+    CandidateSet next;
+    next.docset = docset;
+    next.index = index;
+    next.query = lowerQuery;
+
+    if (canNarrow && candidates->prefixComplete)
+        next.prefixMatches = index->filterPrefixMatches(candidates->prefixMatches, query);
+    else
+        next.prefixMatches = index->prefixMatches(query, token);
+    next.prefixComplete = true;
+
+    // Often and recently opened symbols rank first among equally good matches
+    const auto docsetUsage = usage->constFind(docset.id());
+    const bool hasUsage = docsetUsage != usage->cend();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch() / 1000;
+
+    QVector<int> found = next.prefixMatches;
+    index->sortAndTruncate(found, 100);
+
+    // Opened symbols stay candidates when there are many shorter matches
+    if (hasUsage && found.size() < next.prefixMatches.size()) {
+        for (int id : next.prefixMatches) {
+            if (docsetUsage->contains(index->symbol(id).path) && !found.contains(id))
+                found.append(id);
+        }
+    }
+
+    // Results whose name starts with the query rank before all substring and fuzzy matches.
+    // Once all docsets together return enough of them, the merged results cannot contain
+    // any of the latter, and scanning for those is skipped.
+    int leading = 0;
+    for (int id : found) {
+        if (index->displayName(id).startsWith(query, Qt::CaseInsensitive))
+            ++leading;
+    }
+    leading = qMin(leading, limit);
+    const bool enoughLeading = leadingMatches->fetchAndAddOrdered(leading) + leading >= limit;
+
+    // if less than 100 found starting with query, search all substrings
+    if (found.size() < 100 && !enoughLeading && !token.isCancelled()) {
+        if (canNarrow && candidates->prefixComplete && candidates->substringComplete) {
+            next.substringMatches = index->filterSubstringMatches(
+                        candidates->prefixMatches + candidates->substringMatches, query);
+        } else {
+            next.substringMatches = index->substringMatches(query, token);
+        }
+        next.substringComplete = true;
+    }
+
+    if (token.isCancelled())
+        return results;
+
+    if (next.substringComplete) {
+        QVector<int> substringMatches = next.substringMatches;
+        index->sortAndTruncate(substringMatches, 100);
+        found += substringMatches;
+    }
+
+    // Fuzzy matches fill up what is left, they rank after all contiguous matches
+    const int contiguousCount = found.size();
+    if (fuzzy && found.size() < 100 && !enoughLeading && !token.isCancelled())
+        found += index->fuzzyMatches(query, 100 - found.size(), token);
+
+    if (token.isCancelled())
+        return results;
+
+    if (next.prefixMatches.size() + next.substringMatches.size() > MaxCachedCandidates) {
+        next.prefixMatches.clear();
+        next.substringMatches.clear();
+        next.prefixComplete = false;
+        next.substringComplete = false;
+    }
+    *candidates = next;
+    timing->matching = phaseTime();
+
+    // Rank candidates first, so that a SearchResult is only built for those in the top
+    // results. Sort keys are computed once and moved into the results afterwards.
+    struct Candidate
+    {
+        int id;
+        QString name;
         QString parentName;
-        if (entry.type == Docset::Type::ZDash) {
-            sectionPath.append("#");
-            sectionPath.append(result.value(3).toString());
+        SearchResult::SortKey sortKey;
+    };
+
+    QVector<Candidate> ranked;
+    ranked.reserve(found.size());
+    for (int i = 0; i < found.size(); ++i) {
+        Candidate candidate;
+        candidate.id = found.at(i);
+        // Split when the index was built
+        candidate.name = index->displayName(candidate.id);
+        candidate.parentName = index->parentName(candidate.id);
+        candidate.sortKey = SearchResult::SortKey(candidate.name, candidate.parentName, query);
+        if (hasUsage) {
+            const auto it = docsetUsage->constFind(index->symbol(candidate.id).path);
+            if (it != docsetUsage->cend())
+                candidate.sortKey.frecency = UsageStore::frecency(it.value(), now);
         }
+        if (i >= contiguousCount) {
+            candidate.sortKey.contiguous = false;
+            candidate.sortKey.score = FuzzyMatcher::match(query, index->symbol(candidate.id).name);
+        }
+        ranked.append(candidate);
+    }
 
-        normalizeName(sectionName, parentName);
+    auto lessThan = [](const Candidate &lhs, const Candidate &rhs) {
+        return lhs.sortKey < rhs.sortKey;
+    };
 
-        results.append(SearchResult(sectionName, QString(), sectionPath, name, QString()));
+    if (ranked.size() > limit) {
+        std::nth_element(ranked.begin(), ranked.begin() + limit, ranked.end(), lessThan);
+        ranked.resize(limit);
     }
+    std::sort(ranked.begin(), ranked.end(), lessThan);
 
+    results.reserve(ranked.size());
+    for (const Candidate &candidate : ranked) {
+        results.append(SearchResult(candidate.name, candidate.parentName,
+                                    index->symbol(candidate.id).path, docset.id(),
+                                    candidate.sortKey));
+    }
+
+    timing->ranking = phaseTime();
+    timing->total = timing->loading + timing->matching + timing->ranking;
+    timing->results = results.size();
     return results;
 }
 
-// Recursively finds and adds all docsets in a given directory.
-void DocsetRegistry::addDocsetsFromFolder(const QDir &folder)
+// Only the pages ranked highest are read for their snippets
+QList<SearchResult> DocsetRegistry::searchFullText(const Docset &docset, const QString &query,
+                                                   int limit, const CancellationToken &token,
+                                                   QueryProfile::DocsetTiming *timing)
 {
-    for (const QFileInfo &subdir : folder.entryInfoList(QDir::NoDotAndDotDot | QDir::AllDirs)) {
-        if (subdir.suffix() == "docset") {
-            QMetaObject::invokeMethod(this, "addDocset", Qt::BlockingQueuedConnection,
-                                      Q_ARG(QString, subdir.absoluteFilePath()));
-        } else {
-            addDocsetsFromFolder(QDir(subdir.absoluteFilePath()));
+    QList<SearchResult> results;
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 phaseStart = 0;
+    // Returns the time since the previous call, in microseconds
+    auto phaseTime = [&timer, &phaseStart]() {
+        const qint64 now = timer.nsecsElapsed() / 1000;
+        const qint64 elapsed = now - phaseStart;
+        phaseStart = now;
+        return elapsed;
+    };
+
+    timing->docsetId = docset.id();
+
+    // Not there until built in the background, symbol search works meanwhile
+    const FullTextIndex *index = docset.fullTextIndex();
+    timing->loading = phaseTime();
+    if (!index)
+        return results;
+
+    const QVector<FullTextIndex::Hit> hits
+            = index->search(query, qMin(limit, FullTextResultLimit), token);
+    timing->matching = phaseTime();
+
+    const QStringList terms = FullTextIndex::terms(query);
+    const QDir dir(docset.documentPath());
+    results.reserve(hits.size());
+    for (const FullTextIndex::Hit &hit : hits) {
+        if (token.isCancelled())
+            return QList<SearchResult>();
+
+        const FullTextIndex::Page &page = index->page(hit.page);
+        SearchResult::SortKey sortKey(page.title, QString(), QString());
+        sortKey.score = qRound(hit.score * FullTextScoreScale);
+        const QString snippet = FullTextIndex::snippet(dir.absoluteFilePath(page.path), terms,
+                                                       SnippetLength);
+        results.append(SearchResult(page.title, snippet, page.path, docset.id(), sortKey));
+    }
+
+    // Equally scored pages are ordered by title, as expected by mergeResults()
+    std::sort(results.begin(), results.end());
+
+    timing->ranking = phaseTime();
+    timing->total = timing->loading + timing->matching + timing->ranking;
+    timing->results = results.size();
+    return results;
+}
+
+// Merges already sorted per-docset lists into a single sorted list of at most limit results.
+QList<SearchResult> DocsetRegistry::mergeResults(const QVector<QList<SearchResult>> &lists,
+                                                 int limit)
+{
+    typedef QPair<int, int> Cursor; // list, position
+
+    // Min-heap on the result each cursor points at
+    auto greater = [&lists](const Cursor &a, const Cursor &b) {
+        return lists.at(b.first).at(b.second) < lists.at(a.first).at(a.second);
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(greater)> heap(greater);
+
+    int total = 0;
+    for (int i = 0; i < lists.size(); ++i) {
+        total += lists.at(i).size();
+        if (!lists.at(i).isEmpty())
+            heap.push(Cursor(i, 0));
+    }
+
+    QList<SearchResult> results;
+    results.reserve(qMin(total, limit));
+    while (!heap.empty() && results.size() < limit) {
+        Cursor cursor = heap.top();
+        heap.pop();
+
+        results.append(lists.at(cursor.first).at(cursor.second));
+        if (++cursor.second < lists.at(cursor.first).size())
+            heap.push(cursor);
+    }
+
+    return results;
+}
+
+int DocsetRegistry::requestRelatedLinks(const QString &name, const QString &path)
+{
+    const int requestNum = m_lastRelatedLinksRequest.fetchAndAddOrdered(1) + 1;
+    const Docset docset = entry(name);
+
+    // Get the url without the #anchor.
+    QUrl mainUrl(path);
+    mainUrl.setFragment(QString());
+    const QString page = mainUrl.toString();
+
+    m_searchPool->start(new Task([this, docset, page, requestNum]() {
+        QList<SearchResult> results;
+        if (const SymbolIndex *index = docset.symbolIndex()) {
+            for (int id : index->symbolsOnPage(page)) {
+                results.append(SearchResult(index->displayName(id), QString(),
+                                            index->symbol(id).path, docset.id(), QString()));
+            }
         }
+        emit relatedLinksReady(SearchResultBlock::create(requestNum, std::move(results)));
+    }));
+
+    return requestNum;
+}
+
+// Recursively finds all docsets in a given directory.
+void DocsetRegistry::findDocsets(const QDir &folder, QStringList *paths, QStringList *folders)
+{
+    if (folders)
+        folders->append(folder.absolutePath());
+
+    for (const QFileInfo &subdir : folder.entryInfoList(QDir::NoDotAndDotDot | QDir::AllDirs)) {
+        if (subdir.suffix() == "docset")
+            paths->append(subdir.absoluteFilePath());
+        else
+            findDocsets(QDir(subdir.absoluteFilePath()), paths, folders);
     }
 }
 
-void DocsetRegistry::initialiseDocsets(const QString &path)
+void DocsetRegistry::initialiseDocsets(const QStringList &roots, const QStringList &remoteRoots)
 {
+    QElapsedTimer timer;
+    timer.start();
+    QElapsedTimer phaseTimer;
+    phaseTimer.start();
+
     clear();
-    addDocsetsFromFolder(path);
+
+    QStringList allRoots = roots;
     QDir appDir(QCoreApplication::applicationDirPath());
     if (appDir.cd("docsets"))
-        addDocsetsFromFolder(appDir);
+        allRoots.append(appDir.absolutePath());
+    allRoots += remoteRoots;
+
+    // Roots are often on different disks, or on the network, so one slow root does not
+    // hold up the others. Remote roots are only walked if not listed before.
+    QVector<ManifestCache::Listing> listings(allRoots.size());
+    QSemaphore walkedRoots;
+    int walks = 0;
+    for (int i = 0; i < allRoots.size(); ++i) {
+        const bool remote = i >= allRoots.size() - remoteRoots.size();
+        if (remote && m_manifestCache.findListing(allRoots.at(i), &listings[i]))
+            continue;
+
+        const QString root = allRoots.at(i);
+        ManifestCache::Listing *listing = &listings[i];
+        ManifestCache *manifestCache = remote ? &m_manifestCache : nullptr;
+        m_searchPool->start(new Task([root, listing, manifestCache, &walkedRoots]() {
+            findDocsets(QDir(root), &listing->docsetPaths, &listing->folders);
+            if (manifestCache)
+                manifestCache->setListing(root, *listing);
+            walkedRoots.release();
+        }));
+        ++walks;
+    }
+    walkedRoots.acquire(walks);
+    Core::Metrics::record(Core::Metrics::DocsetWalk, quint64(phaseTimer.nsecsElapsed() / 1000));
+    phaseTimer.restart();
+
+    QStringList paths;
+    for (const ManifestCache::Listing &listing : listings) {
+        for (const QString &path : listing.docsetPaths) {
+            if (!paths.contains(path))
+                paths.append(path);
+        }
+    }
+
+    // Only manifests and icons are read here, which is independent for each docset.
+    // Indexes are opened once a docset is first searched or browsed. Unchanged docsets
+    // only cost a few stat() calls, see ManifestCache.
+    QVector<Docset> docsets(paths.size());
+    QSemaphore finishedTasks;
+    ManifestCache *manifestCache = &m_manifestCache;
+    for (int i = 0; i < paths.size(); ++i) {
+        const QString docsetPath = paths.at(i);
+        Docset *docset = &docsets[i];
+        m_searchPool->start(new Task([docsetPath, docset, manifestCache, &finishedTasks]() {
+            *docset = Docset(docsetPath, manifestCache);
+            finishedTasks.release();
+        }));
+    }
+    finishedTasks.acquire(paths.size());
+    Core::Metrics::record(Core::Metrics::DocsetManifests,
+                          quint64(phaseTimer.nsecsElapsed() / 1000));
+    phaseTimer.restart();
+
+    // Saves nothing if no docset changed
+    m_manifestCache.retain(paths);
+    m_manifestCache.retainListings(remoteRoots);
+    startBackgroundTask([this](const CancellationToken &) {
+        m_manifestCache.save();
+    });
+
+    QList<Docset> validDocsets;
+    for (const Docset &docset : docsets) {
+        /// TODO: Emit error
+        if (docset.isValid())
+            validDocsets.append(docset);
+    }
+
+    QMetaObject::invokeMethod(this, "addDocsets", Qt::BlockingQueuedConnection,
+                              Q_ARG(QList<Zeal::Docset>, validDocsets));
+    QMetaObject::invokeMethod(this, "watchRemoteRoots", Qt::QueuedConnection,
+                              Q_ARG(QStringList, remoteRoots));
+    Core::Metrics::record(Core::Metrics::DocsetPublish, quint64(phaseTimer.nsecsElapsed() / 1000));
+
+    m_initialisationTime = timer.elapsed();
+    Core::Metrics::record(Core::Metrics::DocsetTotal, quint64(timer.nsecsElapsed() / 1000));
+}
+
+void DocsetRegistry::watchRemoteRoots(const QStringList &roots)
+{
+    m_remoteRoots = roots;
+    m_pendingRescans.clear();
+
+    const QStringList watched = m_remoteWatcher->directories();
+    if (!watched.isEmpty())
+        m_remoteWatcher->removePaths(watched);
+
+    for (const QString &root : roots) {
+        ManifestCache::Listing listing;
+        if (m_manifestCache.findListing(root, &listing) && !listing.folders.isEmpty())
+            m_remoteWatcher->addPaths(listing.folders);
+    }
+}
+
+void DocsetRegistry::remoteFolderChanged(const QString &folder)
+{
+    // Folders may be in more than one root, if roots are nested
+    const QString path = QDir(folder).absolutePath();
+    for (const QString &root : m_remoteRoots) {
+        const QString rootPath = QDir(root).absolutePath();
+        if (path == rootPath || path.startsWith(rootPath + QLatin1Char('/')))
+            m_pendingRescans.insert(root);
+    }
+
+    m_rescanTimer->start();
+}
+
+void DocsetRegistry::rescanRemoteRoots()
+{
+    for (const QString &root : m_pendingRescans) {
+        startBackgroundTask([this, root](const CancellationToken &) {
+            QStringList docsetPaths;
+            QStringList folders;
+            findDocsets(QDir(root), &docsetPaths, &folders);
+            QMetaObject::invokeMethod(this, "applyListing", Qt::QueuedConnection,
+                                      Q_ARG(QString, root), Q_ARG(QStringList, docsetPaths),
+                                      Q_ARG(QStringList, folders));
+        });
+    }
+    m_pendingRescans.clear();
+}
+
+void DocsetRegistry::applyListing(const QString &root, const QStringList &docsetPaths,
+                                  const QStringList &folders)
+{
+    // Roots may have changed meanwhile
+    if (!m_remoteRoots.contains(root))
+        return;
+
+    ManifestCache::Listing previous;
+    m_manifestCache.findListing(root, &previous);
+    m_manifestCache.setListing(root, {docsetPaths, folders});
+
+    const QSet<QString> previousFolders = previous.folders.toSet();
+    const QSet<QString> currentFolders = folders.toSet();
+    const QStringList removedFolders = (previousFolders - currentFolders).toList();
+    const QStringList addedFolders = (currentFolders - previousFolders).toList();
+    if (!removedFolders.isEmpty())
+        m_remoteWatcher->removePaths(removedFolders);
+    if (!addedFolders.isEmpty())
+        m_remoteWatcher->addPaths(addedFolders);
+
+    const QSet<QString> previousPaths = previous.docsetPaths.toSet();
+    const QSet<QString> currentPaths = docsetPaths.toSet();
+    const QSet<QString> removedPaths = previousPaths - currentPaths;
+    if (!removedPaths.isEmpty()) {
+        // Each removal publishes a new snapshot, this one has to outlive the loop
+        const Snapshot docs = snapshot();
+        for (const Docset &docset : *docs) {
+            if (removedPaths.contains(docset.path()))
+                remove(docset.name());
+        }
+    }
+
+    for (const QString &path : currentPaths - previousPaths)
+        addDocset(path);
+
+    startBackgroundTask([this](const CancellationToken &) {
+        m_manifestCache.save();
+    });
+}
+
+qint64 DocsetRegistry::initialisationTime() const
+{
+    return m_initialisationTime;
 }
@@ -1,56 +1,203 @@
 #ifndef DOCSETREGISTRY_H
 #define DOCSETREGISTRY_H
 
+#include "cancellationtoken.h"
 #include "docset.h"
+#include "manifestcache.h"
+#include "queryprofile.h"
 #include "searchresult.h"
+#include "usagestore.h"
 
+#include <QCache>
+#include <QHash>
 #include <QMap>
+#include <QMutex>
+#include <QSet>
+#include <QVector>
+
+#include <functional>
+#include <memory>
 
 class QDir;
+class QFileSystemWatcher;
+class QThreadPool;
+class QTimer;
 
 namespace Zeal {
 
+class SearchQuery;
+
 class DocsetRegistry : public QObject
 {
     Q_OBJECT
 public:
+    // Docsets by name at one point in time. Published snapshots are never modified,
+    // changes to the registry publish a new one instead.
+    typedef std::shared_ptr<const QMap<QString, Docset>> Snapshot;
+
     DocsetRegistry(QObject *parent = nullptr);
+    ~DocsetRegistry() override;
 
+    // Readers are lock-free and may be called from any thread
+    Snapshot snapshot() const;
     int count() const;
     bool contains(const QString &name) const;
     QStringList names() const;
+    Docset entry(const QString &name) const;
+
     void remove(const QString &name);
     void clear();
 
-    const Docset &entry(const QString &name);
-    // Returns the list of links available in a given webpage.
-    // Scans the list of related links for a given page. This lets you view the methods of a given object.
-    QList<SearchResult> relatedLinks(const QString &name, const QString &path);
+    // Looks up the symbols on the page at \a path of docset \a name, which lets you view
+    // the methods of a given object. Returns the number identifying the request in
+    // the block of relatedLinksReady().
+    int requestRelatedLinks(const QString &name, const QString &path);
     QString prepareQuery(const QString &rawQuery);
-    void runQuery(const QString &query);
+    // Returns the IDs of the docsets the filter of \a query selects. A filter term matches
+    // docset prefixes, Dash keywords and feed aliases exactly, or if nothing does, the
+    // ones containing it. Thread-safe.
+    QSet<int> docsetFilter(const SearchQuery &query) const;
+    // Returns the number identifying the query in the blocks of queryResultsReady() and
+    // queryCompleted()
+    int runQuery(const QString &query);
     void invalidateQueries();
-    const QList<SearchResult> &queryResults();
-    QList<Docset> docsets();
+    // Records that \a path of docset \a name was opened, which ranks it higher in later
+    // results. Thread-safe.
+    void recordOpen(const QString &name, const QString &path);
+    // Runs \a query on the calling thread and returns up to \a limit merged results, or
+    // resultLimit() for a limit of 0. Unlike runQuery(), other queries are neither cancelled
+    // nor delivered to. Thread-safe, so independent lookups may run concurrently.
+    QList<SearchResult> search(const QString &query, int limit = 0,
+                               const CancellationToken &token = CancellationToken()) const;
+
+    // Maximum number of results a query returns. Thread-safe.
+    int resultLimit() const;
+    void setResultLimit(int limit);
+    // Moving average of how long queries took to complete, in milliseconds. Thread-safe.
+    int queryLatency() const;
+    // Profiles of the most recent completed queries, oldest first. Thread-safe.
+    QList<QueryProfile> queryProfiles() const;
+    // Whether queries also match as subsequences of symbol names. Thread-safe.
+    bool isFuzzySearchEnabled() const;
+    void setFuzzySearchEnabled(bool enabled);
 
-    void initialiseDocsets(const QString &path);
+    // Loads the docsets found in \a roots and \a remoteRoots, each root is walked on a
+    // thread of its own. Docsets found in remote roots are remembered, later calls skip
+    // walking them, and changes to them are picked up as they happen.
+    void initialiseDocsets(const QStringList &roots,
+                           const QStringList &remoteRoots = QStringList());
+    // How long the last initialiseDocsets() took, in milliseconds, or -1
+    qint64 initialisationTime() const;
+    // Prepares docsets with \a names for their first query in the background, at low priority.
+    void warmUp(const QStringList &names);
 
 public slots:
     void addDocset(const QString &path);
 
 signals:
-    void queryCompleted();
+    // Emitted from the thread making the change
+    void docsetAdded(const QString &name);
+    void docsetRemoved(const QString &name);
+    // Emitted as docsets finish, each batch is sorted. Batches of a cached query are
+    // skipped, its results only come with queryCompleted().
+    void queryResultsReady(const Zeal::SearchResultBlock::Shared &batch);
+    // Carries all results of the query
+    void queryCompleted(const Zeal::SearchResultBlock::Shared &results);
+    // Emitted from a search thread, the block is tagged with the request number
+    void relatedLinksReady(const Zeal::SearchResultBlock::Shared &results);
+    // Emitted from the registry thread, after queryCompleted()
+    void queryProfiled(const Zeal::QueryProfile &profile);
 
 private slots:
+    void addDocsets(const QList<Zeal::Docset> &docsets);
+    void watchRemoteRoots(const QStringList &roots);
+    void remoteFolderChanged(const QString &folder);
+    void rescanRemoteRoots();
+    void applyListing(const QString &root, const QStringList &docsetPaths,
+                      const QStringList &folders);
     void _runQuery(const QString &query, int queryNum);
 
 private:
-    void addDocsetsFromFolder(const QDir &folder);
-    void normalizeName(QString &itemName, QString &parentName,
-                       const QString &initialParent = QString());
+    // All matches of the previous query in a docset. Queries extending it can only
+    // match a subset, so they are answered by narrowing these down.
+    struct CandidateSet
+    {
+        // The docset searched, which keeps the index alive. Symbol IDs only apply to it,
+        // not to a docset replacing it under the same name.
+        Docset docset;
+        const SymbolIndex *index = nullptr;
+        QString query; // lowercase
+        QVector<int> prefixMatches;
+        QVector<int> substringMatches;
+        // False if the matches were not collected or were too many to keep
+        bool prefixComplete = false;
+        bool substringComplete = false;
+    };
+
+    // Also adds the walked \a folders, if given
+    static void findDocsets(const QDir &folder, QStringList *paths,
+                            QStringList *folders = nullptr);
+    void insertDocset(const Docset &docset);
+    void publish(const QMap<QString, Docset> &docs);
+    void startBackgroundTask(const std::function<void(const CancellationToken &)> &function,
+                             int priority = 0);
+    static QList<SearchResult> searchDocset(const Docset &docset, const QString &query,
+                                            int limit, bool fuzzy,
+                                            const CancellationToken &token,
+                                            CandidateSet *candidates,
+                                            QAtomicInt *leadingMatches,
+                                            const UsageStore::Snapshot &usage,
+                                            QueryProfile::DocsetTiming *timing);
+    static QList<SearchResult> searchFullText(const Docset &docset, const QString &query,
+                                              int limit, const CancellationToken &token,
+                                              QueryProfile::DocsetTiming *timing);
+    QString resultCacheKey(const QString &query, const QList<Docset> &docsets, int limit,
+                           bool fuzzy) const;
+    static QList<SearchResult> mergeResults(const QVector<QList<SearchResult>> &lists,
+                                            int limit);
+    void recordLatency(qint64 elapsed);
+    void recordProfile(const QueryProfile &profile);
+
+    QThreadPool *m_searchPool = nullptr;
+    // Maintenance work which must not hold up searches, like writing index sidecars
+    QThreadPool *m_backgroundPool = nullptr;
+    QAtomicInt m_backgroundGeneration = 0;
+
+    // Docset IDs by case folded prefix, keyword and alias, see docsetFilter()
+    typedef QHash<QString, QVector<int>> FilterTable;
+
+    // Only accessed through std::atomic_load() and std::atomic_store()
+    Snapshot m_snapshot;
+    std::shared_ptr<const FilterTable> m_filterTable;
+    // Serializes changes to the snapshot, and guards m_candidateSets
+    QMutex m_mutex;
+    QHash<QString, CandidateSet> m_candidateSets;
+    // Complete results of recent queries, see resultCacheKey()
+    QCache<QString, QList<SearchResult>> m_resultCache;
+    // Bumped whenever docsets are added or removed, or usage changes, which outdates
+    // cached results
+    QAtomicInt m_generation = 0;
+    UsageStore m_usageStore;
+    ManifestCache m_manifestCache;
+
+    // Remote roots and the folders in them, owned by the registry thread
+    QStringList m_remoteRoots;
+    QFileSystemWatcher *m_remoteWatcher = nullptr;
+    QSet<QString> m_pendingRescans;
+    QTimer *m_rescanTimer = nullptr;
+    // Written by the GUI thread, read by the registry and search threads
+    QAtomicInt m_lastQuery = -1;
+    QAtomicInt m_lastRelatedLinksRequest = 0;
+    QAtomicInt m_resultLimit;
+    QAtomicInt m_fuzzySearch = 1;
+    QAtomicInt m_queryLatency = 0; // ms
+    qint64 m_initialisationTime = -1; // ms
 
-    QMap<QString, Docset> m_docs;
-    QList<SearchResult> m_queryResults;
-    int m_lastQuery = -1;
+    // Ring buffer of recent profiles, written by the registry thread only. Slots are
+    // replaced through std::atomic_store(), so readers never wait for the writer.
+    static const int ProfileCount = 64;
+    std::shared_ptr<const QueryProfile> m_profiles[ProfileCount];
+    QAtomicInt m_profileCount = 0;
 };
 
 } // namespace Zeal
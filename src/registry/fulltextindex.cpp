@@ -0,0 +1,628 @@
+#include "fulltextindex.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QScopedPointer>
+#include <QTextCodec>
+#include <QTextDecoder>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+using namespace Zeal;
+
+namespace {
+const quint32 IndexMagic = 0x5a465449; // ZFTI
+// Bump whenever the format changes, or pages get tokenized differently
+const quint32 IndexVersion = 1;
+
+// Pages are read in chunks of this size, markup is never held as a whole
+const int ReadBufferSize = 64 * 1024; // bytes
+
+// Longer terms are mostly encoded data, like inline images
+const int MaxTermLength = 32;
+
+// A term in the title counts as this many occurrences in the text
+const int TitleWeight = 5;
+
+// At most this many terms are looked up for the prefix a query ends with
+const int MaxPrefixTerms = 64;
+
+// How many postings are read between cancellation checks
+const int CancellationCheckInterval = 4096;
+
+// BM25 parameters, the commonly used defaults
+const float K1 = 1.2f;
+const float B = 0.75f;
+
+bool isTermCharacter(QChar c)
+{
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+// Tags which do not separate words, as in "<b>Qt</b>Widgets"
+bool isInlineTag(const QString &name)
+{
+    static const QStringList names = {
+        QStringLiteral("a"), QStringLiteral("abbr"), QStringLiteral("b"),
+        QStringLiteral("code"), QStringLiteral("em"), QStringLiteral("i"),
+        QStringLiteral("kbd"), QStringLiteral("samp"), QStringLiteral("small"),
+        QStringLiteral("span"), QStringLiteral("strong"), QStringLiteral("sub"),
+        QStringLiteral("sup"), QStringLiteral("tt"), QStringLiteral("u"), QStringLiteral("var")
+    };
+    const QString tag = name.startsWith(QLatin1Char('/')) ? name.mid(1) : name;
+    return names.contains(tag);
+}
+
+// Turns HTML into the terms and, optionally, the text it shows. Markup is fed in chunks of
+// any size, only the tag or entity being read is kept across them.
+class HtmlTokenizer
+{
+public:
+    typedef std::function<void(const QString &term, bool inTitle)> TermHandler;
+
+    explicit HtmlTokenizer(const TermHandler &termHandler, QString *text = nullptr) :
+        m_termHandler(termHandler),
+        m_text(text)
+    {
+    }
+
+    void feed(const QString &html)
+    {
+        for (const QChar c : html)
+            process(c);
+    }
+
+    void finish()
+    {
+        endTerm();
+    }
+
+    QString title() const
+    {
+        return m_title.simplified();
+    }
+
+private:
+    enum class State {
+        Text,
+        Entity,
+        Tag,
+        Comment,
+        RawText // contents of scripts and styles
+    };
+
+    void process(QChar c)
+    {
+        switch (m_state) {
+        case State::Text:
+            if (c == QLatin1Char('<')) {
+                startTag();
+            } else if (c == QLatin1Char('&')) {
+                m_state = State::Entity;
+                m_entity.clear();
+            } else {
+                appendCharacter(c);
+            }
+            break;
+
+        case State::Entity:
+            if (c == QLatin1Char(';')) {
+                appendCharacter(decodeEntity(m_entity));
+                m_state = State::Text;
+            } else if (m_entity.size() < 8 && (c.isLetterOrNumber() || c == QLatin1Char('#'))) {
+                m_entity += c;
+            } else {
+                // A plain ampersand
+                m_state = State::Text;
+                appendCharacter(QLatin1Char('&'));
+                for (const QChar e : m_entity)
+                    appendCharacter(e);
+                process(c);
+            }
+            break;
+
+        case State::Tag:
+            if (m_quote.isNull() && c == QLatin1Char('>')) {
+                endTag();
+                break;
+            }
+
+            if (!m_tagNameComplete) {
+                if (c.isSpace() || (c == QLatin1Char('/') && !m_tagName.isEmpty())
+                        || m_tagName.size() > MaxTermLength) {
+                    m_tagNameComplete = true;
+                } else {
+                    m_tagName += c.toLower();
+                    if (m_tagName == QLatin1String("!--")) {
+                        m_state = State::Comment;
+                        m_commentDashes = 0;
+                    }
+                }
+            } else if (m_rawTag.isEmpty() && (c == QLatin1Char('"') || c == QLatin1Char('\''))) {
+                // Attribute values may contain '>'
+                if (m_quote.isNull())
+                    m_quote = c;
+                else if (m_quote == c)
+                    m_quote = QChar();
+            }
+            break;
+
+        case State::Comment:
+            if (c == QLatin1Char('>') && m_commentDashes >= 2)
+                m_state = State::Text;
+            m_commentDashes = c == QLatin1Char('-') ? m_commentDashes + 1 : 0;
+            break;
+
+        case State::RawText:
+            if (c == QLatin1Char('<'))
+                startTag();
+            break;
+        }
+    }
+
+    void startTag()
+    {
+        m_state = State::Tag;
+        m_tagName.clear();
+        m_tagNameComplete = false;
+        m_quote = QChar();
+    }
+
+    void endTag()
+    {
+        // Only the closing tag ends a script or style, anything else is part of it
+        if (!m_rawTag.isEmpty()) {
+            if (m_tagName == QLatin1Char('/') + m_rawTag) {
+                m_rawTag.clear();
+                m_state = State::Text;
+            } else {
+                m_state = State::RawText;
+            }
+            return;
+        }
+
+        m_state = State::Text;
+
+        if (m_tagName == QLatin1String("script") || m_tagName == QLatin1String("style")) {
+            m_rawTag = m_tagName;
+            m_state = State::RawText;
+        } else if (m_tagName == QLatin1String("title")) {
+            endTerm();
+            m_inTitle = true;
+        } else if (m_tagName == QLatin1String("/title")) {
+            endTerm();
+            m_inTitle = false;
+        } else if (!isInlineTag(m_tagName)) {
+            appendCharacter(QLatin1Char(' '));
+        }
+    }
+
+    static QChar decodeEntity(const QString &entity)
+    {
+        if (entity.startsWith(QLatin1Char('#'))) {
+            bool ok;
+            const uint code = entity.startsWith(QLatin1String("#x"), Qt::CaseInsensitive)
+                    ? entity.mid(2).toUInt(&ok, 16) : entity.mid(1).toUInt(&ok);
+            // Characters outside of the BMP do not make up terms anyway
+            return ok && code > 0 && code <= 0xffff ? QChar(code) : QChar(QLatin1Char(' '));
+        }
+
+        if (entity == QLatin1String("amp"))
+            return QLatin1Char('&');
+        if (entity == QLatin1String("lt"))
+            return QLatin1Char('<');
+        if (entity == QLatin1String("gt"))
+            return QLatin1Char('>');
+        if (entity == QLatin1String("quot"))
+            return QLatin1Char('"');
+        if (entity == QLatin1String("apos"))
+            return QLatin1Char('\'');
+        return QLatin1Char(' ');
+    }
+
+    void appendCharacter(QChar c)
+    {
+        if (isTermCharacter(c)) {
+            if (m_term.size() <= MaxTermLength)
+                m_term += c.toLower();
+            else
+                m_termTooLong = true;
+        } else {
+            endTerm();
+        }
+
+        if (m_inTitle) {
+            m_title += c;
+        } else if (m_text) {
+            // Whitespace is collapsed, like it is shown
+            if (!c.isSpace())
+                m_text->append(c);
+            else if (!m_text->isEmpty() && !m_text->endsWith(QLatin1Char(' ')))
+                m_text->append(QLatin1Char(' '));
+        }
+    }
+
+    void endTerm()
+    {
+        if (!m_term.isEmpty() && !m_termTooLong)
+            m_termHandler(m_term, m_inTitle);
+        m_term.clear();
+        m_termTooLong = false;
+    }
+
+    TermHandler m_termHandler;
+    QString *m_text = nullptr;
+
+    State m_state = State::Text;
+    QString m_entity;
+    QString m_tagName;
+    bool m_tagNameComplete = false;
+    QChar m_quote;
+    int m_commentDashes = 0;
+    QString m_rawTag;
+
+    bool m_inTitle = false;
+    QString m_title;
+    QString m_term;
+    bool m_termTooLong = false;
+};
+
+// Feeds the page in fileName to tokenizer, in the encoding it declares or UTF-8
+bool readPage(const QString &fileName, HtmlTokenizer *tokenizer)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray chunk = file.read(ReadBufferSize);
+    QTextCodec *codec = QTextCodec::codecForHtml(chunk, QTextCodec::codecForName("UTF-8"));
+    QScopedPointer<QTextDecoder> decoder(codec->makeDecoder());
+    while (!chunk.isEmpty()) {
+        tokenizer->feed(decoder->toUnicode(chunk));
+        chunk = file.read(ReadBufferSize);
+    }
+    tokenizer->finish();
+    return true;
+}
+
+void writeNumber(QByteArray *data, quint32 value)
+{
+    while (value >= 0x80) {
+        data->append(char(value | 0x80));
+        value >>= 7;
+    }
+    data->append(char(value));
+}
+
+bool readNumber(const char **pos, const char *end, quint32 *value)
+{
+    *value = 0;
+    for (int shift = 0; *pos < end && shift < 32; shift += 7) {
+        const uchar byte = uchar(*(*pos)++);
+        *value |= quint32(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Postings of a term while the index is built
+struct PostingList
+{
+    QByteArray data;
+    int lastPage = 0;
+    int pageCount = 0;
+};
+}
+
+FullTextIndex::FullTextIndex()
+{
+}
+
+FullTextIndex *FullTextIndex::build(const QString &documentPath, const CancellationToken &token)
+{
+    QScopedPointer<FullTextIndex> index(new FullTextIndex());
+    const QDir root(documentPath);
+
+    QHash<QString, PostingList> postings;
+    QHash<QString, int> frequencies;
+    int length = 0;
+    const HtmlTokenizer::TermHandler addTerm = [&frequencies, &length](const QString &term,
+            bool inTitle) {
+        frequencies[term] += inTitle ? TitleWeight : 1;
+        ++length;
+    };
+
+    QDirIterator it(documentPath, {QStringLiteral("*.html"), QStringLiteral("*.htm")},
+                    QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        if (token.isCancelled())
+            return nullptr;
+
+        const QString fileName = it.next();
+        frequencies.clear();
+        length = 0;
+
+        HtmlTokenizer tokenizer(addTerm);
+        if (!readPage(fileName, &tokenizer) || frequencies.isEmpty())
+            continue;
+
+        const int pageId = index->m_pages.size();
+        const QString path = root.relativeFilePath(fileName);
+        const QString title = tokenizer.title();
+        index->m_pages.append({path, title.isEmpty() ? QFileInfo(path).baseName() : title,
+                               length});
+
+        // Pages are added in ID order, so deltas are never negative
+        for (auto termIt = frequencies.cbegin(); termIt != frequencies.cend(); ++termIt) {
+            PostingList &list = postings[termIt.key()];
+            writeNumber(&list.data, quint32(pageId - list.lastPage));
+            writeNumber(&list.data, quint32(termIt.value()));
+            list.lastPage = pageId;
+            ++list.pageCount;
+        }
+    }
+
+    QStringList terms = postings.keys();
+    std::sort(terms.begin(), terms.end());
+
+    index->m_terms.reserve(terms.size());
+    index->m_pageCounts.reserve(terms.size());
+    index->m_offsets.reserve(terms.size() + 1);
+    for (const QString &term : terms) {
+        const PostingList &list = postings[term];
+        index->m_terms.append(term);
+        index->m_pageCounts.append(list.pageCount);
+        index->m_offsets.append(quint32(index->m_postings.size()));
+        index->m_postings += list.data;
+    }
+    index->m_offsets.append(quint32(index->m_postings.size()));
+
+    index->computeAverageLength();
+    return index.take();
+}
+
+bool FullTextIndex::save(const QString &fileName, quint64 stamp) const
+{
+    // Only replaces the previous file once completely written
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream << IndexMagic << IndexVersion << stamp << quint32(m_pages.size());
+    for (const Page &page : m_pages)
+        stream << page.path << page.title << qint32(page.length);
+    stream << m_terms << m_pageCounts << m_offsets << m_postings;
+
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+FullTextIndex *FullTextIndex::load(const QString &fileName, quint64 stamp)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return nullptr;
+
+    QDataStream stream(&file);
+    quint32 magic;
+    quint32 version;
+    quint64 fileStamp;
+    quint32 count;
+    stream >> magic >> version >> fileStamp >> count;
+    if (stream.status() != QDataStream::Ok || magic != IndexMagic || version != IndexVersion
+            || fileStamp != stamp) {
+        return nullptr;
+    }
+
+    QScopedPointer<FullTextIndex> index(new FullTextIndex());
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        Page page;
+        qint32 length;
+        stream >> page.path >> page.title >> length;
+        page.length = length;
+        index->m_pages.append(page);
+    }
+    stream >> index->m_terms >> index->m_pageCounts >> index->m_offsets >> index->m_postings;
+    if (stream.status() != QDataStream::Ok)
+        return nullptr;
+
+    // Offsets are trusted by search(), and must stay within the postings
+    const int termCount = index->m_terms.size();
+    if (index->m_pageCounts.size() != termCount || index->m_offsets.size() != termCount + 1
+            || index->m_offsets.last() != quint32(index->m_postings.size())) {
+        return nullptr;
+    }
+    for (int i = 0; i < termCount; ++i) {
+        if (index->m_offsets.at(i) > index->m_offsets.at(i + 1))
+            return nullptr;
+    }
+
+    index->computeAverageLength();
+    return index.take();
+}
+
+bool FullTextIndex::exists(const QString &fileName, quint64 stamp)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    quint32 magic;
+    quint32 version;
+    quint64 fileStamp;
+    stream >> magic >> version >> fileStamp;
+    return stream.status() == QDataStream::Ok && magic == IndexMagic
+            && version == IndexVersion && fileStamp == stamp;
+}
+
+QStringList FullTextIndex::terms(const QString &text)
+{
+    QStringList terms;
+    HtmlTokenizer tokenizer([&terms](const QString &term, bool) {
+        terms.append(term);
+    });
+
+    // Text typed into a query is not markup
+    QString escaped = text;
+    escaped.replace(QLatin1Char('&'), QLatin1Char(' ')).replace(QLatin1Char('<'), QLatin1Char(' '));
+    tokenizer.feed(escaped);
+    tokenizer.finish();
+    return terms;
+}
+
+QString FullTextIndex::snippet(const QString &fileName, const QStringList &terms, int length)
+{
+    QString text;
+    HtmlTokenizer tokenizer([](const QString &, bool) {}, &text);
+    if (!readPage(fileName, &tokenizer))
+        return QString();
+
+    // The first occurrence of any term at the start of a word
+    int match = -1;
+    for (const QString &term : terms) {
+        int pos = text.indexOf(term, 0, Qt::CaseInsensitive);
+        while (pos > 0 && isTermCharacter(text.at(pos - 1)))
+            pos = text.indexOf(term, pos + 1, Qt::CaseInsensitive);
+        if (pos != -1 && (match == -1 || pos < match))
+            match = pos;
+    }
+
+    // Some context ahead of the match, cut at word boundaries
+    int start = qMax(0, match - length / 3);
+    if (start > 0) {
+        const int space = text.indexOf(QLatin1Char(' '), start);
+        start = space != -1 && space < match ? space + 1 : start;
+    }
+    int end = qMin(text.size(), start + length);
+    if (end < text.size()) {
+        const int space = text.lastIndexOf(QLatin1Char(' '), end);
+        end = space > qMax(start, match) ? space : end;
+    }
+
+    QString snippet = text.mid(start, end - start).trimmed();
+    if (start > 0)
+        snippet.prepend(QChar(0x2026)); // horizontal ellipsis
+    if (end < text.size())
+        snippet.append(QChar(0x2026));
+    return snippet;
+}
+
+int FullTextIndex::pageCount() const
+{
+    return m_pages.size();
+}
+
+const FullTextIndex::Page &FullTextIndex::page(int id) const
+{
+    return m_pages.at(id);
+}
+
+QVector<FullTextIndex::Hit> FullTextIndex::search(const QString &query, int limit,
+                                                  const CancellationToken &token) const
+{
+    QVector<Hit> hits;
+
+    QStringList queryTerms = terms(query);
+    queryTerms.removeDuplicates();
+    if (queryTerms.isEmpty() || m_pages.isEmpty())
+        return hits;
+
+    // Scores of the pages containing all terms processed so far
+    QHash<int, float> scores;
+    int checkCountdown = CancellationCheckInterval;
+    for (int i = 0; i < queryTerms.size(); ++i) {
+        const QPair<int, int> range = termRange(queryTerms.at(i), i == queryTerms.size() - 1);
+        if (range.first == range.second)
+            return hits;
+
+        QHash<int, float> termScores;
+        for (int termId = range.first; termId < range.second; ++termId) {
+            const float pageCount = m_pageCounts.at(termId);
+            const float idf = std::log(1 + (m_pages.size() - pageCount + 0.5f)
+                                       / (pageCount + 0.5f));
+
+            const char *pos = m_postings.constData() + m_offsets.at(termId);
+            const char *end = m_postings.constData() + m_offsets.at(termId + 1);
+            quint32 page = 0;
+            while (pos < end) {
+                quint32 delta;
+                quint32 frequency;
+                if (!readNumber(&pos, end, &delta) || !readNumber(&pos, end, &frequency))
+                    break;
+                page += delta;
+                if (page >= quint32(m_pages.size()))
+                    break;
+
+                if (--checkCountdown == 0) {
+                    if (token.isCancelled())
+                        return hits;
+                    checkCountdown = CancellationCheckInterval;
+                }
+
+                // Pages not containing the previous terms cannot match anymore
+                if (i > 0 && !scores.contains(int(page)))
+                    continue;
+
+                const float lengthRatio = m_pages.at(int(page)).length / m_averageLength;
+                termScores[int(page)] += idf * frequency * (K1 + 1)
+                        / (frequency + K1 * (1 - B + B * lengthRatio));
+            }
+        }
+
+        if (i > 0) {
+            for (auto it = termScores.begin(); it != termScores.end(); ++it)
+                it.value() += scores.value(it.key());
+        }
+        scores = termScores;
+        if (scores.isEmpty())
+            return hits;
+    }
+
+    hits.reserve(scores.size());
+    for (auto it = scores.cbegin(); it != scores.cend(); ++it)
+        hits.append({it.key(), it.value()});
+
+    auto better = [](const Hit &lhs, const Hit &rhs) {
+        return lhs.score > rhs.score || (lhs.score == rhs.score && lhs.page < rhs.page);
+    };
+    if (hits.size() > limit) {
+        std::nth_element(hits.begin(), hits.begin() + limit, hits.end(), better);
+        hits.resize(limit);
+    }
+    std::sort(hits.begin(), hits.end(), better);
+    return hits;
+}
+
+QPair<int, int> FullTextIndex::termRange(const QString &term, bool prefix) const
+{
+    const auto first = std::lower_bound(m_terms.cbegin(), m_terms.cend(), term);
+    auto last = first;
+    if (!prefix) {
+        if (last != m_terms.cend() && *last == term)
+            ++last;
+    } else {
+        while (last != m_terms.cend() && last->startsWith(term)
+               && last - first < MaxPrefixTerms) {
+            ++last;
+        }
+    }
+    return qMakePair(int(first - m_terms.cbegin()), int(last - m_terms.cbegin()));
+}
+
+void FullTextIndex::computeAverageLength()
+{
+    qint64 total = 0;
+    for (const Page &page : m_pages)
+        total += page.length;
+    // Keeps length ratios finite for empty indexes
+    m_averageLength = m_pages.isEmpty() ? 1 : qMax(1.0f, float(total) / m_pages.size());
+}
@@ -0,0 +1,84 @@
+#ifndef FULLTEXTINDEX_H
+#define FULLTEXTINDEX_H
+
+#include "cancellationtoken.h"
+
+#include <QByteArray>
+#include <QPair>
+#include <QStringList>
+#include <QVector>
+
+namespace Zeal {
+
+/**
+ * @short Inverted index over the text of all pages of a single docset.
+ *
+ * Pages are read by a streaming HTML tokenizer, which skips markup, scripts and styles.
+ * Every term maps to the list of pages containing it, stored as variable-length page ID
+ * deltas and term frequencies. Queries match the pages containing all of their terms,
+ * the last one also as a prefix since it may still be typed, and rank them with BM25.
+ */
+class FullTextIndex
+{
+public:
+    struct Page
+    {
+        QString path; // relative to the documents of the docset
+        QString title;
+        int length; // in terms
+    };
+
+    struct Hit
+    {
+        int page;
+        float score; // higher ranks first
+    };
+
+    explicit FullTextIndex();
+
+    /// Reads all pages below \a documentPath. Returns nullptr if \a token gets cancelled.
+    static FullTextIndex *build(const QString &documentPath,
+                                const CancellationToken &token = CancellationToken());
+
+    /// Writes the index to \a fileName, tagged with \a stamp.
+    bool save(const QString &fileName, quint64 stamp) const;
+    /// Reads an index written by save(). Returns nullptr if the file is missing,
+    /// corrupted, or has another \a stamp.
+    static FullTextIndex *load(const QString &fileName, quint64 stamp);
+    /// Whether \a fileName holds an index with \a stamp. Only reads the header.
+    static bool exists(const QString &fileName, quint64 stamp);
+
+    /// Splits \a text into lowercase terms, the same way page text is split.
+    static QStringList terms(const QString &text);
+    /// Returns up to about \a length characters of the text of the page in \a fileName,
+    /// around the first occurrence of any of \a terms.
+    static QString snippet(const QString &fileName, const QStringList &terms, int length);
+
+    int pageCount() const;
+    const Page &page(int id) const;
+
+    /// Returns up to \a limit pages containing all terms of \a query, best first.
+    /// Returns an empty list if \a token gets cancelled.
+    QVector<Hit> search(const QString &query, int limit,
+                        const CancellationToken &token = CancellationToken()) const;
+
+private:
+    // IDs of the terms equal to \a term, or starting with it for a \a prefix
+    QPair<int, int> termRange(const QString &term, bool prefix) const;
+    void computeAverageLength();
+
+    QVector<Page> m_pages;
+    float m_averageLength = 0;
+
+    // Sorted, so that prefixes are looked up through binary search
+    QVector<QString> m_terms;
+    // Number of pages containing each term
+    QVector<int> m_pageCounts;
+    // Postings of term i are m_postings[m_offsets[i]..m_offsets[i + 1]]
+    QVector<quint32> m_offsets;
+    QByteArray m_postings;
+};
+
+} // namespace Zeal
+
+#endif // FULLTEXTINDEX_H
@@ -0,0 +1,126 @@
+#include "fuzzymatcher.h"
+
+using namespace Zeal;
+
+namespace {
+const int MatchScore = 16;
+const int FirstCharacterBonus = 8;
+const int BoundaryBonus = 8;
+const int CamelCaseBonus = 7;
+const int ConsecutiveBonus = 4;
+// Per character skipped between two matched characters
+const int GapPenalty = 1;
+const int MaxGapPenalty = 8;
+// Per character before the first matched one
+const int MaxLeadingPenalty = 16;
+
+inline bool equals(QChar a, QChar b)
+{
+    return a == b || a.toLower() == b.toLower();
+}
+
+inline bool isSeparator(QChar c)
+{
+    switch (c.unicode()) {
+    case '.':
+    case ':':
+    case '/':
+    case '_':
+    case '-':
+    case ' ':
+    case '(':
+        return true;
+    default:
+        return false;
+    }
+}
+
+int bonusAt(const QString &text, int pos)
+{
+    if (pos == 0)
+        return FirstCharacterBonus;
+
+    const QChar previous = text.at(pos - 1);
+    const QChar current = text.at(pos);
+    if (isSeparator(previous))
+        return BoundaryBonus;
+    if ((previous.isLower() && current.isUpper()) || (previous.isLetter() && current.isDigit()))
+        return CamelCaseBonus;
+    return 0;
+}
+
+inline quint64 characterBit(QChar c)
+{
+    const ushort u = c.unicode();
+    if (u >= 'a' && u <= 'z')
+        return Q_UINT64_C(1) << (u - 'a');
+    if (u >= '0' && u <= '9')
+        return Q_UINT64_C(1) << (26 + u - '0');
+    // Everything else shares the remaining 28 bits
+    return Q_UINT64_C(1) << (36 + u % 28);
+}
+}
+
+int FuzzyMatcher::match(const QString &query, const QString &text, QVector<int> *positions)
+{
+    const int queryLength = query.size();
+    const int textLength = text.size();
+    if (queryLength == 0 || queryLength > textLength)
+        return -1;
+
+    // Find where the first complete match ends...
+    int end = -1;
+    for (int i = 0, j = 0; i < textLength; ++i) {
+        if (equals(text.at(i), query.at(j)) && ++j == queryLength) {
+            end = i;
+            break;
+        }
+    }
+
+    if (end == -1)
+        return -1;
+
+    // ...and walk back to the shortest match ending there.
+    int start = end;
+    for (int i = end, j = queryLength - 1; i >= 0; --i) {
+        if (equals(text.at(i), query.at(j))) {
+            start = i;
+            if (--j < 0)
+                break;
+        }
+    }
+
+    if (positions)
+        positions->clear();
+
+    int score = -qMin(start, MaxLeadingPenalty);
+    int previous = -1;
+    for (int i = start, j = 0; i <= end && j < queryLength; ++i) {
+        if (!equals(text.at(i), query.at(j)))
+            continue;
+
+        score += MatchScore + bonusAt(text, i);
+        if (previous != -1) {
+            if (previous == i - 1)
+                score += ConsecutiveBonus;
+            else
+                score -= qMin(GapPenalty * (i - previous - 1), MaxGapPenalty);
+        }
+
+        if (positions)
+            positions->append(i);
+
+        previous = i;
+        ++j;
+    }
+
+    return qMax(score, 0);
+}
+
+quint64 FuzzyMatcher::characterMask(const QString &lowerText)
+{
+    quint64 mask = 0;
+    for (const QChar c : lowerText)
+        mask |= characterBit(c);
+    return mask;
+}
@@ -0,0 +1,31 @@
+#ifndef FUZZYMATCHER_H
+#define FUZZYMATCHER_H
+
+#include <QString>
+#include <QVector>
+
+namespace Zeal {
+
+/**
+ * @short Matches queries as subsequences of symbol names.
+ *
+ * Every query character has to appear in the name in the same order, but not
+ * necessarily next to each other, so that "qstrlst" finds QStringList. Matches
+ * at the start of the name, after a separator, on a camel case boundary, and
+ * runs of consecutive characters score higher.
+ */
+class FuzzyMatcher
+{
+public:
+    /// Returns the score of \a query matching \a text case-insensitively, or -1 if it
+    /// does not match. Positions of matched characters are stored in \a positions.
+    static int match(const QString &query, const QString &text, QVector<int> *positions = nullptr);
+
+    /// Returns a bit set of characters found in \a lowerText. A text can only match
+    /// a query if its mask contains all bits of the query mask.
+    static quint64 characterMask(const QString &lowerText);
+};
+
+} // namespace Zeal
+
+#endif // FUZZYMATCHER_H
@@ -1,18 +1,54 @@
 #include "listmodel.h"
 
+#include "docseticoncache.h"
 #include "docsetregistry.h"
+#include "core/application.h"
+#include "core/task.h"
+#include "symbolindex.h"
 
 #include <QDir>
+#include <QMutexLocker>
 #include <QSqlQuery>
+#include <QThread>
+#include <QThreadPool>
 
-using namespace Zeal;
+#include <algorithm>
 
-/// TODO: Get rid of const_casts
+using namespace Zeal;
+using Zeal::Core::Task;
+
+namespace {
+// Number of symbols fetched at once when a type is expanded or scrolled to its end
+const int PageSize = 500;
+// Rows shown while a page of symbols is loading
+const int PlaceholderRows = 1;
+const int FetchThreadCount = 2;
+// Marks internal ids of leaf rows (symbols and placeholders), the rest of the id is
+// the node of their parent
+const quintptr LeafFlag = quintptr(1) << (sizeof(quintptr) * 8 - 1);
+}
 
 ListModel::ListModel(DocsetRegistry *docsetRegistry, QObject *parent) :
     QAbstractItemModel(parent),
-    m_docsetRegistry(docsetRegistry)
+    m_docsetRegistry(docsetRegistry),
+    m_fetchPool(new QThreadPool(this))
+{
+    m_fetchPool->setMaxThreadCount(FetchThreadCount);
+    // Docsets keep per-thread database connections, so fetch threads should never expire
+    m_fetchPool->setExpiryTimeout(-1);
+
+    // Queued even when the registry is changed from this thread, as removeRows() does
+    connect(m_docsetRegistry, &DocsetRegistry::docsetAdded,
+            this, &ListModel::addDocset, Qt::QueuedConnection);
+    connect(m_docsetRegistry, &DocsetRegistry::docsetRemoved,
+            this, &ListModel::removeDocset, Qt::QueuedConnection);
+}
+
+ListModel::~ListModel()
 {
+    // Running fetches post their results to this object
+    m_fetchPool->clear();
+    m_fetchPool->waitForDone();
 }
 
 QVariant ListModel::data(const QModelIndex &index, int role) const
@@ -20,155 +56,211 @@ QVariant ListModel::data(const QModelIndex &index, int role) const
     if ((role != Qt::DisplayRole && role != Qt::DecorationRole && role != DocsetNameRole)
             || !index.isValid())
         return QVariant();
-    if (role == Qt::DecorationRole) {
-        if (i2s(index)->indexOf('/') == -1)
-            return QVariant(m_docsetRegistry->entry(*i2s(index)).icon());
-        else
+
+    if (isLeaf(index)) {
+        const Node &parent = m_nodes.at(int(index.internalId() & ~LeafFlag));
+        if (role == DocsetNameRole)
+            return parent.docsetName;
+        if (role != Qt::DisplayRole)
             return QVariant();
+        if (parent.parent == -1 || index.row() >= parent.symbols.size())
+            return index.column() == 0 ? tr("Loading...") : QVariant();
+        const Symbol &symbol = parent.symbols.at(index.row());
+        return index.column() == 0 ? symbol.name : symbol.path;
     }
-    if (index.column() == 0) {
-        QStringList retlist = i2s(index)->split('/');
-        QString retval = retlist.last();
-        if (retlist.size() == 1) { // docset name
-            if (role == Qt::DisplayRole)
-                retval = m_docsetRegistry->entry(retval).info.bundleName;
-        } else if (retlist.size() > 2) {  // name with slashes - trim only "docset/type"
-            for (int i = retlist.length() - 2; i > 1; --i)
-                retval = retlist[i] + "/" + retval;
-        }
-        return QVariant(retval);
-    } else {
-        return QVariant(*i2s(index));
+
+    const Node *n = node(index);
+    if (role == DocsetNameRole)
+        return n->docsetName;
+
+    if (n->parent == -1) {
+        if (role == Qt::DecorationRole)
+            return index.column() == 0 ? Core::Application::docsetIconCache()->pixmap(n->docsetId)
+                                       : QVariant();
+        if (index.column() == 0)
+            return m_docsetRegistry->entry(n->docsetName).info().bundleName;
+        return n->path;
     }
+
+    if (role == Qt::DisplayRole && index.column() == 0)
+        return pluralize(n->type);
+    return QVariant();
 }
 
 QModelIndex ListModel::index(int row, int column, const QModelIndex &parent) const
 {
-    DocsetRegistry * const docsetRegistry = m_docsetRegistry;
+    if (row < 0 || column < 0 || column >= columnCount(parent))
+        return QModelIndex();
+
     if (!parent.isValid()) {
-        if (row >= docsetRegistry->count() || row == -1)
+        if (row >= m_docsetNodes.size())
             return QModelIndex();
+        return createIndex(row, column, quintptr(m_docsetNodes.at(row)));
+    }
 
-        if (column == 0) {
-            return createIndex(row, column, (void *)string(docsetRegistry->names().at(row)));
-        } else if (column == 1) {
-            const Docset &entry = docsetRegistry->entry(docsetRegistry->names().at(row));
-            QDir dir(entry.documentPath());
-
-            if (!entry.info.indexPath.isEmpty()) {
-                QStringList path = entry.info.indexPath.split("/");
-                const QString filename = path.last();
-                path.removeLast();
-                for (const QString &directory : path) {
-                    if (!dir.cd(directory))
-                        return createIndex(row, column, (void *)string());
-                }
-                return createIndex(row, column, (void *)string(dir.absoluteFilePath(filename)));
-            }
-            return createIndex(row, column, (void *)string(dir.absoluteFilePath("index.html")));
-        }
-
+    if (isLeaf(parent) || row >= rowCount(parent))
         return QModelIndex();
-    } else {
-        QString docsetName;
-        for (const QString &name : docsetRegistry->names()) {
-            if (i2s(parent)->startsWith(name + "/"))
-                docsetName = name;
-        }
-        if (docsetName.isEmpty()) {
-            // i2s(parent) == docsetName
-            if (column == 0) {
-                QList<QString> types;
-                for (const QPair<QString, QString> &pair : modulesCounts().keys()) {
-                    if (pair.first == *i2s(parent))
-                        types.append(pair.second);
-                }
-                qSort(types);
-                return createIndex(row, column,
-                                   (void *)string(*i2s(parent) + "/" + pluralize(types[row])));
-            }
-        } else {
-            const QString type = singularize(i2s(parent)->split('/')[1]);
-            if (row >= modulesCounts()[QPair<QString, QString>(docsetName, type)])
-                return QModelIndex();
-            if (column == 0) {
-                return createIndex(row, column,
-                                   (void *)string(
-                                       QString("%1/%2/%3").arg(docsetName, pluralize(type),
-                                                               item(*i2s(parent), row).first)));
-            } else if (column == 1) {
-                return createIndex(row, column, (void *)string(item(*i2s(parent), row).second));
-            }
-        }
-        return QModelIndex();
-    }
+
+    const int parentId = int(parent.internalId());
+    const Node &n = m_nodes.at(parentId);
+    if (n.parent == -1 && row < n.children.size())
+        return createIndex(row, column, quintptr(n.children.at(row)));
+    return createIndex(row, column, quintptr(parentId) | LeafFlag);
 }
 
 QModelIndex ListModel::parent(const QModelIndex &child) const
 {
-    if (child.isValid() && i2s(child)->count("/") == 1) {  // docset/type
-        return createIndex(0, 0, (void *)string(i2s(child)->split('/')[0]));
-    } else if (child.isValid() && i2s(child)->count("/") >= 2) {    // docset/type/item (item can contain slashes)
-        return createIndex(0, 0, (void *)string(i2s(child)->split('/')[0] + "/"
-                           + i2s(child)->split('/')[1]));
-    } else {
+    if (!child.isValid())
         return QModelIndex();
-    }
+
+    int parentId;
+    if (isLeaf(child))
+        parentId = int(child.internalId() & ~LeafFlag);
+    else
+        parentId = m_nodes.at(int(child.internalId())).parent;
+
+    return nodeIndex(parentId);
 }
 
 int ListModel::columnCount(const QModelIndex &parent) const
 {
-    if (!parent.isValid() || i2s(parent)->count("/") == 1) // child of docset/type
-        return 2;
-    else
-        return 1;
+    Q_UNUSED(parent)
+    return 2;
 }
 
 int ListModel::rowCount(const QModelIndex &parent) const
 {
-    if (parent.column() > 0 && !i2s(parent)->endsWith("/Modules"))
-        return 0;
+    if (!parent.isValid())
+        return m_docsetNodes.size();
 
-    if (!parent.isValid()) {
-        // root
-        return m_docsetRegistry->count();
-    } else {
-        const QString *parentStr = i2s(parent);
-        if (parentStr->indexOf("/") == -1) {
-            // docset - show types
-            int numTypes = 0;
-            const QList<QPair<QString, QString>> keys = modulesCounts().keys();
-            for (const QPair<QString, QString> &key : keys) {
-                if (parentStr == key.first)
-                    numTypes += 1;
-            }
-            return numTypes;
-        } else if (parentStr->count("/") == 1) { // parent is docset/type
-            // type count
-            QString type = singularize(parentStr->split("/")[1]);
-            return modulesCounts()[QPair<QString, QString>(parentStr->split('/')[0], type)];
-        }
-        // module - no sub items
+    if (parent.column() > 0 || isLeaf(parent))
         return 0;
-    }
+
+    // Only what has been fetched so far, see fetchMore()
+    const Node *n = node(parent);
+    return (n->parent == -1 ? n->children.size() : n->symbols.size()) + n->placeholderRows;
+}
+
+bool ListModel::hasChildren(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return !m_docsetNodes.isEmpty();
+
+    if (parent.column() > 0 || isLeaf(parent))
+        return false;
+
+    // Docsets are assumed not to be empty until their types are fetched
+    const Node *n = node(parent);
+    if (n->parent == -1)
+        return !n->typesFetched || !n->children.isEmpty() || n->placeholderRows > 0;
+    return n->symbolCount > 0;
+}
+
+bool ListModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!parent.isValid() || parent.column() > 0 || isLeaf(parent))
+        return false;
+
+    const Node *n = node(parent);
+    if (n->placeholderRows > 0)
+        return false;
+    if (n->parent == -1)
+        return !n->typesFetched;
+    return n->symbols.size() < n->symbolCount;
+}
+
+void ListModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent))
+        return;
+
+    const int nodeId = int(parent.internalId());
+    if (m_nodes.at(nodeId).parent == -1)
+        fetchTypes(nodeId);
+    else
+        fetchSymbols(nodeId);
 }
 
 bool ListModel::removeRows(int row, int count, const QModelIndex &parent)
 {
-    if (parent.isValid())
+    if (parent.isValid() || row < 0 || count <= 0 || row + count > m_docsetNodes.size())
         return false;
 
-    beginRemoveRows(parent, row, row + count - 1);
-    for (int i = 0; i < count; ++i)
-        m_docsetRegistry->remove(m_docsetRegistry->names()[row + i]);
-    endRemoveRows();
+    for (int i = row; i < row + count; ++i)
+        m_docsetRegistry->remove(m_nodes.at(m_docsetNodes.at(i)).docsetName);
+    removeDocsetRows(row, count);
 
     return true;
 }
 
-void ListModel::resetModulesCounts()
+void ListModel::reload()
+{
+    beginResetModel();
+    ++m_generation;
+    m_nodes.clear();
+    m_freeNodes.clear();
+    m_docsetNodes.clear();
+
+    for (const QString &name : m_docsetRegistry->names()) {
+        Node n = docsetNode(name);
+        n.row = m_docsetNodes.size();
+        m_docsetNodes.append(allocateNode(n));
+    }
+
+    endResetModel();
+}
+
+void ListModel::addDocset(const QString &name)
 {
-    m_modulesCounts.clear();
+    // Already shown after reload(), or removed again in the meantime
+    if (docsetRow(name) != -1 || !m_docsetRegistry->contains(name))
+        return;
+
+    // Rows are kept in the order of the registry, which is sorted by name
+    const auto it = std::lower_bound(m_docsetNodes.cbegin(), m_docsetNodes.cend(), name,
+                                     [this](int nodeId, const QString &name) {
+        return m_nodes.at(nodeId).docsetName < name;
+    });
+    const int row = int(it - m_docsetNodes.cbegin());
+
+    beginInsertRows(QModelIndex(), row, row);
+    Node n = docsetNode(name);
+    n.row = row;
+    m_docsetNodes.insert(row, allocateNode(n));
+    for (int i = row + 1; i < m_docsetNodes.size(); ++i)
+        m_nodes[m_docsetNodes.at(i)].row = i;
+    endInsertRows();
+}
+
+void ListModel::removeDocset(const QString &name)
+{
+    // Already gone if removed through removeRows()
+    const int row = docsetRow(name);
+    if (row != -1)
+        removeDocsetRows(row, 1);
+}
+
+void ListModel::processFetchResults()
+{
+    QVector<FetchResult> results;
+    {
+        QMutexLocker locker(&m_fetchResultsMutex);
+        results.swap(m_fetchResults);
+    }
+
+    for (const FetchResult &result : results) {
+        // Outdated by reload() or removal of the docset
+        if (result.generation != m_generation || result.nodeId >= m_nodes.size())
+            continue;
+        const Node &n = m_nodes.at(result.nodeId);
+        if (n.serial != result.serial || n.placeholderRows == 0)
+            continue;
+
+        if (n.parent == -1)
+            applyTypes(result);
+        else
+            applySymbols(result);
+    }
 }
 
 QString ListModel::pluralize(const QString &s)
@@ -176,89 +268,264 @@ QString ListModel::pluralize(const QString &s)
     return s + (s.endsWith('s') ? QStringLiteral("es") : QStringLiteral("s"));
 }
 
-QString ListModel::singularize(const QString &s)
+const ListModel::Node *ListModel::node(const QModelIndex &index) const
 {
-    return s.left(s.length() - (s.endsWith(QStringLiteral("ses")) ? 2 : 1));
+    Q_ASSERT(index.isValid() && !isLeaf(index));
+    return &m_nodes.at(int(index.internalId()));
 }
 
-const QString *ListModel::i2s(const QModelIndex &index) const
+bool ListModel::isLeaf(const QModelIndex &index)
 {
-    return static_cast<const QString *>(index.internalPointer());
+    return index.internalId() & LeafFlag;
 }
 
-const QHash<QPair<QString, QString>, int> ListModel::modulesCounts() const
+QModelIndex ListModel::nodeIndex(int nodeId) const
 {
-    if (!m_modulesCounts.isEmpty())
-        return m_modulesCounts;
-
-    for (const Docset &docset : m_docsetRegistry->docsets()) {
-        QSqlQuery q;
-        if (docset.type == Docset::Type::Dash) {
-            q = docset.db.exec("select type, count(*) from searchIndex group by type");
-        } else if (docset.type == Docset::Type::ZDash) {
-            q = docset.db.exec("select ztypename, count(*) from ztoken join ztokentype"
-                               " on ztoken.ztokentype = ztokentype.z_pk group by ztypename");
-        }
+    if (nodeId == -1)
+        return QModelIndex();
+    return createIndex(m_nodes.at(nodeId).row, 0, quintptr(nodeId));
+}
 
-        while (q.next()) {
-            int count = q.value(1).toInt();
-            QString typeName = q.value(0).toString();
-            const_cast<QHash<QPair<QString, QString>, int> &>(m_modulesCounts)
-                    [QPair<QString, QString>(docset.name(), typeName)] = count;
+ListModel::Node ListModel::docsetNode(const QString &name) const
+{
+    const Docset &docset = m_docsetRegistry->entry(name);
+
+    Node n;
+    n.docsetName = name;
+    n.docsetId = docset.id();
+
+    QDir dir(docset.documentPath());
+    if (!docset.info().indexPath.isEmpty()) {
+        QStringList path = docset.info().indexPath.split(QLatin1Char('/'));
+        const QString fileName = path.takeLast();
+        for (const QString &directory : path) {
+            if (!dir.cd(directory))
+                return n;
         }
+        n.path = dir.absoluteFilePath(fileName);
+    } else {
+        n.path = dir.absoluteFilePath(QStringLiteral("index.html"));
     }
-    return m_modulesCounts;
+
+    return n;
 }
 
-const QPair<QString, QString> ListModel::item(const QString &path, int index) const
+int ListModel::docsetRow(const QString &name) const
 {
-    QPair<QString, int> pair(path, index);
-    if (m_items.contains(pair))
-        return m_items[pair];
-
-    const QString docsetName = path.split('/')[0];
-    const Docset &docset = m_docsetRegistry->entry(docsetName);
-
-    const QString type = singularize(path.split('/')[1]);
-
-    QString queryStr;
-    switch (docset.type) {
-    case Docset::Type::Dash:
-        queryStr = QString("select name, path from searchIndex where type='%1' order by name asc")
-                .arg(type);
-        break;
-    case Docset::Type::ZDash:
-        queryStr = QString("select ztokenname, zpath, zanchor from ztoken "
-                           "join ztokenmetainformation on ztoken.zmetainformation = ztokenmetainformation.z_pk "
-                           "join zfilepath on ztokenmetainformation.zfile = zfilepath.z_pk "
-                           "join ztokentype on ztoken.ztokentype = ztokentype.z_pk where ztypename='%1' "
-                           "order by ztokenname asc").arg(type);
-        break;
+    for (int i = 0; i < m_docsetNodes.size(); ++i) {
+        if (m_nodes.at(m_docsetNodes.at(i)).docsetName == name)
+            return i;
     }
+    return -1;
+}
 
-    QSqlQuery query = docset.db.exec(queryStr);
-
-    int i = 0;
-    while (query.next()) {
-        QPair<QString, QString> item;
-        item.first = query.value(0).toString();
-        QString filePath = query.value(1).toString();
-
-        /// FIXME: refactoring to use common code in ZealListModel and DocsetRegistry
-        /// TODO: parent name, splitting by '.', as in DocsetRegistry
-        if (docset.type == Docset::Type::ZDash)
-            filePath += QStringLiteral("#") + query.value(2).toString();
-        item.second = QDir(docset.documentPath()).absoluteFilePath(filePath);
-        const_cast<QHash<QPair<QString, int>, QPair<QString, QString>> &>(m_items)
-                [QPair<QString, int>(path, i)] = item;
-        ++i;
+void ListModel::removeDocsetRows(int row, int count)
+{
+    beginRemoveRows(QModelIndex(), row, row + count - 1);
+    for (int i = row; i < row + count; ++i) {
+        // Fetches still running for the nodes are dropped, as their serial no longer
+        // matches once the nodes are reused
+        const int nodeId = m_docsetNodes.at(i);
+        for (int child : m_nodes.at(nodeId).children)
+            freeNode(child);
+        freeNode(nodeId);
     }
-    return m_items[pair];
+    m_docsetNodes.remove(row, count);
+    for (int i = row; i < m_docsetNodes.size(); ++i)
+        m_nodes[m_docsetNodes.at(i)].row = i;
+    endRemoveRows();
 }
 
-const QString *ListModel::string(const QString &str) const
+// Returns the id of \a n, which takes the place of a removed node if there is one
+int ListModel::allocateNode(const Node &n)
 {
-    if (m_strings.find(str) == m_strings.end())
-        const_cast<QSet<QString> &>(m_strings).insert(str);
-    return &*m_strings.find(str);
+    int nodeId;
+    if (m_freeNodes.isEmpty()) {
+        nodeId = m_nodes.size();
+        m_nodes.append(n);
+    } else {
+        nodeId = m_freeNodes.takeLast();
+        m_nodes[nodeId] = n;
+    }
+    m_nodes[nodeId].serial = m_nextSerial++;
+    return nodeId;
+}
+
+void ListModel::freeNode(int nodeId)
+{
+    m_nodes[nodeId] = Node();
+    m_freeNodes.append(nodeId);
+}
+
+void ListModel::fetchTypes(int nodeId)
+{
+    Node &n = m_nodes[nodeId];
+    const Docset docset = m_docsetRegistry->entry(n.docsetName);
+
+    beginInsertRows(nodeIndex(nodeId), 0, PlaceholderRows - 1);
+    n.typesFetched = true;
+    n.placeholderRows = PlaceholderRows;
+    endInsertRows();
+
+    const int generation = m_generation;
+    const int serial = n.serial;
+    startFetch([docset, nodeId, serial, generation]() {
+        FetchResult result;
+        result.generation = generation;
+        result.nodeId = nodeId;
+        result.serial = serial;
+        result.docsetName = docset.name();
+
+        // The symbol cache answers without running SQL
+        if (const SymbolIndex *symbols = docset.cachedSymbolIndex()) {
+            for (int typeId = 0; typeId < symbols->typeCount(); ++typeId) {
+                const QString typeName = symbols->typeName(typeId);
+                if (!typeName.isEmpty() && symbols->symbolCount(typeId) > 0)
+                    result.types.append(qMakePair(typeName, symbols->symbolCount(typeId)));
+            }
+        } else {
+            QSqlQuery query = docset.statement(Docset::Statement::TypeCounts);
+            query.exec();
+            while (query.next()) {
+                const QString typeName = query.value(0).toString();
+                const int count = query.value(1).toInt();
+                if (!typeName.isEmpty() && count > 0)
+                    result.types.append(qMakePair(typeName, count));
+            }
+        }
+        std::sort(result.types.begin(), result.types.end());
+        return result;
+    });
+}
+
+void ListModel::fetchSymbols(int nodeId)
+{
+    Node &n = m_nodes[nodeId];
+    const Docset docset = m_docsetRegistry->entry(n.docsetName);
+    const int offset = n.symbols.size();
+
+    beginInsertRows(nodeIndex(nodeId), offset, offset + PlaceholderRows - 1);
+    n.placeholderRows = PlaceholderRows;
+    endInsertRows();
+
+    const int generation = m_generation;
+    const int serial = n.serial;
+    const QString type = n.type;
+    const QVector<int> symbolIds = n.symbolIds;
+    startFetch([docset, nodeId, serial, generation, type, symbolIds, offset]() {
+        FetchResult result;
+        result.generation = generation;
+        result.nodeId = nodeId;
+        result.serial = serial;
+        result.docsetName = docset.name();
+        result.symbols.reserve(PageSize);
+
+        const QDir dir(docset.documentPath());
+        if (const SymbolIndex *symbols = docset.cachedSymbolIndex()) {
+            // Sorting ids is cheap, strings are only copied for the rows being shown
+            result.symbolIds = symbolIds.isEmpty() ? symbols->symbolsOfType(type) : symbolIds;
+            for (int i = offset; i < result.symbolIds.size() && result.symbols.size() < PageSize; ++i) {
+                const SymbolIndex::Symbol &symbol = symbols->symbol(result.symbolIds.at(i));
+                result.symbols.append({symbol.name, dir.absoluteFilePath(symbol.path)});
+            }
+        } else {
+            QSqlQuery query = docset.statement(Docset::Statement::TypeSymbols);
+            query.bindValue(QStringLiteral(":type"), type);
+            query.bindValue(QStringLiteral(":limit"), PageSize);
+            query.bindValue(QStringLiteral(":offset"), offset);
+            query.exec();
+            while (query.next()) {
+                /// TODO: parent name, splitting by '.', as in DocsetRegistry
+                result.symbols.append({query.value(0).toString(),
+                                       dir.absoluteFilePath(docset.symbolPath(query, 1))});
+            }
+        }
+        return result;
+    });
+}
+
+void ListModel::startFetch(const std::function<FetchResult()> &function)
+{
+    Task *task = new Task([this, function]() {
+        QThread::currentThread()->setPriority(QThread::LowPriority);
+        const FetchResult result = function();
+        {
+            QMutexLocker locker(&m_fetchResultsMutex);
+            m_fetchResults.append(result);
+        }
+        QMetaObject::invokeMethod(this, "processFetchResults", Qt::QueuedConnection);
+    });
+    m_fetchPool->start(task);
+}
+
+void ListModel::applyTypes(const FetchResult &result)
+{
+    const int nodeId = result.nodeId;
+    const QModelIndex parent = nodeIndex(nodeId);
+    const int count = result.types.size();
+
+    // Placeholders turn into the first types, the rest are inserted or removed
+    const int reused = qMin(count, m_nodes.at(nodeId).placeholderRows);
+    if (reused < m_nodes.at(nodeId).placeholderRows) {
+        beginRemoveRows(parent, reused, m_nodes.at(nodeId).placeholderRows - 1);
+        m_nodes[nodeId].placeholderRows = reused;
+        endRemoveRows();
+    }
+
+    auto addType = [this, &result, nodeId](int i) {
+        Node n;
+        n.parent = nodeId;
+        n.row = i;
+        n.docsetName = result.docsetName;
+        n.type = result.types.at(i).first;
+        n.symbolCount = result.types.at(i).second;
+        const int childId = allocateNode(n);
+        m_nodes[nodeId].children.append(childId);
+    };
+
+    for (int i = 0; i < reused; ++i)
+        addType(i);
+    m_nodes[nodeId].placeholderRows = 0;
+    if (reused > 0)
+        emit dataChanged(index(0, 0, parent), index(reused - 1, 1, parent));
+
+    if (reused < count) {
+        beginInsertRows(parent, reused, count - 1);
+        for (int i = reused; i < count; ++i)
+            addType(i);
+        endInsertRows();
+    }
+}
+
+void ListModel::applySymbols(const FetchResult &result)
+{
+    const int nodeId = result.nodeId;
+    const QModelIndex parent = nodeIndex(nodeId);
+    const int offset = m_nodes.at(nodeId).symbols.size();
+    const int count = result.symbols.size();
+
+    const int reused = qMin(count, m_nodes.at(nodeId).placeholderRows);
+    if (reused < m_nodes.at(nodeId).placeholderRows) {
+        beginRemoveRows(parent, offset + reused, offset + m_nodes.at(nodeId).placeholderRows - 1);
+        m_nodes[nodeId].placeholderRows = reused;
+        endRemoveRows();
+    }
+
+    Node &n = m_nodes[nodeId];
+    if (n.symbolIds.isEmpty())
+        n.symbolIds = result.symbolIds;
+    // The docset may have fewer symbols than it claimed
+    if (count == 0 || (count < PageSize && offset + count < n.symbolCount))
+        n.symbolCount = offset + count;
+
+    n.symbols += result.symbols.mid(0, reused);
+    n.placeholderRows = 0;
+    if (reused > 0)
+        emit dataChanged(index(offset, 0, parent), index(offset + reused - 1, 1, parent));
+
+    if (reused < count) {
+        beginInsertRows(parent, offset + reused, offset + count - 1);
+        m_nodes[nodeId].symbols += result.symbols.mid(reused);
+        endInsertRows();
+    }
 }
@@ -1,9 +1,13 @@
 #ifndef LISTMODEL_H
 #define LISTMODEL_H
 
-#include <QAbstractListModel>
-#include <QHash>
-#include <QSet>
+#include <QAbstractItemModel>
+#include <QMutex>
+#include <QVector>
+
+#include <functional>
+
+class QThreadPool;
 
 namespace Zeal {
 
@@ -18,29 +22,100 @@ public:
     };
 
     explicit ListModel(DocsetRegistry *docsetRegistry, QObject *parent = nullptr);
+    ~ListModel() override;
 
-    QVariant data(const QModelIndex &index, int role) const;
-    QModelIndex index(int row, int column, const QModelIndex &parent) const;
-    QModelIndex parent(const QModelIndex &child) const;
-    int columnCount(const QModelIndex &parent) const;
-    int rowCount(const QModelIndex &parent) const;
-    bool removeRows(int row, int count, const QModelIndex &parent);
+    QVariant data(const QModelIndex &index, int role) const override;
+    QModelIndex index(int row, int column, const QModelIndex &parent) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int columnCount(const QModelIndex &parent) const override;
+    int rowCount(const QModelIndex &parent) const override;
+    bool hasChildren(const QModelIndex &parent) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    bool removeRows(int row, int count, const QModelIndex &parent) override;
 
-    void resetModulesCounts();
+    // Rebuilds the tree from the docsets in the registry.
+    void reload();
+
+private slots:
+    // Insert or remove the row of a single docset, leaving the rest of the tree alone
+    void addDocset(const QString &name);
+    void removeDocset(const QString &name);
+    void processFetchResults();
 
 private:
+    struct Symbol
+    {
+        QString name;
+        QString path; // absolute
+    };
+
+    // Docsets and their symbol types are nodes, identified by their position in m_nodes.
+    // Symbols are rows of their type node, fetched in pages as the view asks for them.
+    // Positions of removed nodes are reused.
+    struct Node
+    {
+        int serial = -1; // unique among all nodes ever allocated, -1 for free ones
+        int parent = -1; // -1 for docsets
+        int row = 0;
+        QString docsetName;
+        int docsetId = -1; // docsets only, see StringPool
+        QString type; // empty for docsets
+        QString path; // index page of docsets
+
+        // Rows shown as loading after the fetched ones, while a fetch is running
+        int placeholderRows = 0;
+
+        // Docsets
+        QVector<int> children;
+        bool typesFetched = false;
+
+        // Types
+        int symbolCount = 0;
+        QVector<Symbol> symbols;
+        QVector<int> symbolIds; // from the symbol index, if available
+    };
+
+    // Produced by a worker thread, applied in processFetchResults()
+    struct FetchResult
+    {
+        int generation;
+        int nodeId;
+        int serial; // of the node, which may have been freed and reused since
+        QString docsetName;
+        QVector<QPair<QString, int>> types;
+        QVector<Symbol> symbols;
+        QVector<int> symbolIds;
+    };
+
     inline static QString pluralize(const QString &s);
-    inline static QString singularize(const QString &s);
 
-    const QString *i2s(const QModelIndex &index) const;
-    const QHash<QPair<QString, QString>, int> modulesCounts() const;
-    const QPair<QString, QString> item(const QString &path, int index) const;
-    const QString *string(const QString &str = QString()) const;
+    const Node *node(const QModelIndex &index) const;
+    static bool isLeaf(const QModelIndex &index);
+    QModelIndex nodeIndex(int nodeId) const;
+    Node docsetNode(const QString &name) const;
+    int docsetRow(const QString &name) const;
+    void removeDocsetRows(int row, int count);
+    int allocateNode(const Node &n);
+    void freeNode(int nodeId);
+
+    void fetchTypes(int nodeId);
+    void fetchSymbols(int nodeId);
+    void startFetch(const std::function<FetchResult()> &function);
+    void applyTypes(const FetchResult &result);
+    void applySymbols(const FetchResult &result);
 
     DocsetRegistry *m_docsetRegistry;
-    QHash<QPair<QString, QString>, int> m_modulesCounts;
-    QHash<QPair<QString, int>, QPair<QString, QString>> m_items;
-    QSet<QString> m_strings;
+    QVector<Node> m_nodes;
+    QVector<int> m_freeNodes;
+    int m_nextSerial = 0;
+    QVector<int> m_docsetNodes; // top level rows
+    // Bumped on reload(), which outdates running fetches
+    int m_generation = 0;
+
+    QThreadPool *m_fetchPool;
+    QMutex m_fetchResultsMutex;
+    QVector<FetchResult> m_fetchResults;
 };
 
 } // namespace Zeal
@@ -0,0 +1,173 @@
+#include "manifestcache.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+
+using namespace Zeal;
+
+namespace {
+const quint32 CacheMagic = 0x5a4d4143; // ZMAC
+// Bump whenever the format changes, or docsets get loaded differently
+const quint32 CacheVersion = 2;
+}
+
+ManifestCache::ManifestCache(const QString &fileName) :
+    m_fileName(fileName)
+{
+    load();
+}
+
+ManifestCache::~ManifestCache()
+{
+    save();
+}
+
+bool ManifestCache::find(const QString &path, Manifest *manifest) const
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_manifests.constFind(path);
+    if (it == m_manifests.cend())
+        return false;
+
+    const Manifest &cached = it.value();
+    if (cached.infoModified != manifest->infoModified
+            || cached.metadataModified != manifest->metadataModified
+            || cached.folderModified != manifest->folderModified) {
+        return false;
+    }
+
+    *manifest = cached;
+    return true;
+}
+
+void ManifestCache::insert(const QString &path, const Manifest &manifest)
+{
+    QMutexLocker locker(&m_mutex);
+    m_manifests.insert(path, manifest);
+    m_dirty = true;
+}
+
+void ManifestCache::retain(const QStringList &paths)
+{
+    const QSet<QString> retained = paths.toSet();
+
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_manifests.begin(); it != m_manifests.end();) {
+        if (retained.contains(it.key())) {
+            ++it;
+        } else {
+            it = m_manifests.erase(it);
+            m_dirty = true;
+        }
+    }
+}
+
+bool ManifestCache::findListing(const QString &root, Listing *listing) const
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_listings.constFind(root);
+    if (it == m_listings.cend())
+        return false;
+
+    *listing = it.value();
+    return true;
+}
+
+void ManifestCache::setListing(const QString &root, const Listing &listing)
+{
+    QMutexLocker locker(&m_mutex);
+    m_listings.insert(root, listing);
+    m_dirty = true;
+}
+
+void ManifestCache::retainListings(const QStringList &roots)
+{
+    const QSet<QString> retained = roots.toSet();
+
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_listings.begin(); it != m_listings.end();) {
+        if (retained.contains(it.key())) {
+            ++it;
+        } else {
+            it = m_listings.erase(it);
+            m_dirty = true;
+        }
+    }
+}
+
+bool ManifestCache::save()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_dirty)
+        return true;
+
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+
+    // Only replaces the previous file once completely written
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream << CacheMagic << CacheVersion << quint32(m_manifests.size());
+    for (auto it = m_manifests.cbegin(); it != m_manifests.cend(); ++it) {
+        const Manifest &manifest = it.value();
+        stream << it.key() << manifest.infoModified << manifest.metadataModified
+               << manifest.folderModified << manifest.info << manifest.metadata
+               << manifest.iconPath;
+    }
+
+    stream << quint32(m_listings.size());
+    for (auto it = m_listings.cbegin(); it != m_listings.cend(); ++it)
+        stream << it.key() << it.value().docsetPaths << it.value().folders;
+
+    if (stream.status() != QDataStream::Ok || !file.commit())
+        return false;
+
+    m_dirty = false;
+    return true;
+}
+
+void ManifestCache::load()
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    quint32 magic;
+    quint32 version;
+    quint32 count;
+    stream >> magic >> version >> count;
+    if (stream.status() != QDataStream::Ok || magic != CacheMagic || version != CacheVersion)
+        return;
+
+    QHash<QString, Manifest> manifests;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString path;
+        Manifest manifest;
+        stream >> path >> manifest.infoModified >> manifest.metadataModified
+               >> manifest.folderModified >> manifest.info >> manifest.metadata
+               >> manifest.iconPath;
+        manifests.insert(path, manifest);
+    }
+
+    QHash<QString, Listing> listings;
+    stream >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString root;
+        Listing listing;
+        stream >> root >> listing.docsetPaths >> listing.folders;
+        listings.insert(root, listing);
+    }
+
+    // A truncated file is dropped as a whole
+    if (stream.status() != QDataStream::Ok)
+        return;
+
+    m_manifests = manifests;
+    m_listings = listings;
+}
@@ -0,0 +1,80 @@
+#ifndef MANIFESTCACHE_H
+#define MANIFESTCACHE_H
+
+#include "docsetinfo.h"
+#include "docsetmetadata.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+namespace Zeal {
+
+/**
+ * @short Parsed manifests of all docsets, kept across restarts.
+ *
+ * Holds what the Docset constructor reads from Info.plist and meta.json, and where it
+ * found the icon, by docset path. Entries are validated against modification times of
+ * the files they come from, so an unchanged docset is loaded without parsing anything.
+ * Also remembers the docsets found in storage roots which are too slow to walk on every
+ * start. Thread-safe.
+ */
+class ManifestCache
+{
+public:
+    struct Manifest
+    {
+        // ms since epoch, -1 for missing files
+        qint64 infoModified = -1;
+        qint64 metadataModified = -1;
+        // Of the docset folder, which changes along with its icon files
+        qint64 folderModified = -1;
+
+        DocsetInfo info;
+        DocsetMetadata metadata;
+        // Empty if the docset has no icon
+        QString iconPath;
+    };
+
+    // What walking a storage root found
+    struct Listing
+    {
+        QStringList docsetPaths;
+        // Folders walked through to find them, including the root
+        QStringList folders;
+    };
+
+    /// Loads the cache from \a fileName, if it exists.
+    explicit ManifestCache(const QString &fileName);
+    /// Writes changes not saved yet.
+    ~ManifestCache();
+
+    /// Returns whether an entry of \a path exists and is stamped like \a manifest, and if
+    /// so, copies the cached contents into \a manifest.
+    bool find(const QString &path, Manifest *manifest) const;
+    void insert(const QString &path, const Manifest &manifest);
+    /// Drops entries of docsets other than \a paths, e.g. of removed ones.
+    void retain(const QStringList &paths);
+
+    bool findListing(const QString &root, Listing *listing) const;
+    void setListing(const QString &root, const Listing &listing);
+    /// Drops listings of roots other than \a roots.
+    void retainListings(const QStringList &roots);
+
+    /// Writes the cache if it changed since it was last written. Returns false on errors.
+    bool save();
+
+private:
+    void load();
+
+    QString m_fileName;
+    mutable QMutex m_mutex;
+    QHash<QString, Manifest> m_manifests;
+    QHash<QString, Listing> m_listings; // by root
+    bool m_dirty = false;
+};
+
+} // namespace Zeal
+
+#endif // MANIFESTCACHE_H
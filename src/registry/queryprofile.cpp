@@ -0,0 +1,53 @@
+#include "queryprofile.h"
+
+#include "stringpool.h"
+
+#include <QDateTime>
+#include <QStringList>
+
+#include <algorithm>
+
+using namespace Zeal;
+
+namespace {
+// Docsets listed by toString()
+const int ReportedDocsetCount = 5;
+
+QString milliseconds(qint64 microseconds)
+{
+    return QString::number(microseconds / 1000.0, 'f', 1);
+}
+}
+
+QVector<QueryProfile::DocsetTiming> QueryProfile::slowestDocsets(int count) const
+{
+    QVector<DocsetTiming> slowest = docsets;
+    std::sort(slowest.begin(), slowest.end(), [](const DocsetTiming &a, const DocsetTiming &b) {
+        return a.total > b.total;
+    });
+    if (slowest.size() > count)
+        slowest.resize(count);
+    return slowest;
+}
+
+QString QueryProfile::toString() const
+{
+    QString line = QStringLiteral("%1 query #%2 \"%3\": %4 ms, %5 results")
+            .arg(QDateTime::fromMSecsSinceEpoch(startedAt).toString(Qt::ISODate))
+            .arg(queryNum).arg(query).arg(milliseconds(total)).arg(results);
+    if (cached)
+        return line + QStringLiteral(" (cached)");
+
+    line += QStringLiteral(", merge %1 ms").arg(milliseconds(merging));
+
+    QStringList parts;
+    for (const DocsetTiming &timing : slowestDocsets(ReportedDocsetCount)) {
+        parts.append(QStringLiteral("%1 %2 ms (load %3, match %4, rank %5, %6 results)")
+                     .arg(StringPool::string(timing.docsetId)).arg(milliseconds(timing.total))
+                     .arg(milliseconds(timing.loading)).arg(milliseconds(timing.matching))
+                     .arg(milliseconds(timing.ranking)).arg(timing.results));
+    }
+    if (!parts.isEmpty())
+        line += QStringLiteral("; slowest: ") + parts.join(QStringLiteral(", "));
+    return line;
+}
@@ -0,0 +1,47 @@
+#ifndef QUERYPROFILE_H
+#define QUERYPROFILE_H
+
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+
+namespace Zeal {
+
+/**
+ * @short Where the time of a completed query went.
+ *
+ * Recorded by DocsetRegistry for each query which was not cancelled. All
+ * durations are in microseconds.
+ */
+struct QueryProfile
+{
+    struct DocsetTiming
+    {
+        int docsetId = -1; // see StringPool
+        qint64 loading = 0; // symbol index, only on first use
+        qint64 matching = 0; // prefix, substring and fuzzy matches
+        qint64 ranking = 0; // display names, sort keys and sorting
+        qint64 total = 0;
+        int results = 0;
+    };
+
+    int queryNum = -1;
+    QString query;
+    qint64 startedAt = 0; // ms since epoch
+    bool cached = false; // answered from the result cache
+    qint64 merging = 0;
+    qint64 total = 0;
+    int results = 0;
+    QVector<DocsetTiming> docsets;
+
+    /// Returns the docsets which took longest, at most \a count of them.
+    QVector<DocsetTiming> slowestDocsets(int count) const;
+    /// Returns a single line summary, as written by --perf-log.
+    QString toString() const;
+};
+
+} // namespace Zeal
+
+Q_DECLARE_METATYPE(Zeal::QueryProfile)
+
+#endif // QUERYPROFILE_H
@@ -3,3 +3,12 @@ HEADERS += \
 
 SOURCES += \
     $$files($$PWD/*.cpp)
+
+# Allows interrupting running statements. The handle obtained from the Qt SQLite driver
+# is only safe to use when the driver is built against the system SQLite (-system-sqlite),
+# which qmake cannot tell, so it has to be asked for with "qmake CONFIG+=system_sqlite".
+system_sqlite {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += sqlite3
+    DEFINES += USE_SQLITE3
+}
@@ -1,15 +1,29 @@
 #include "searchmodel.h"
 
 #include "core/application.h"
+#include "registry/docseticoncache.h"
 #include "registry/docsetregistry.h"
 
 #include <QDir>
+#include <QTimer>
+
+#include <algorithm>
 
 using namespace Zeal;
 
+namespace {
+// Queries completing faster than this on average are run on every keystroke
+const int ImmediateDispatchLatency = 30; // ms
+// Longest a query is held back while typing
+const int MaxDispatchDelay = 150; // ms
+}
+
 SearchModel::SearchModel(QObject *parent) :
-    QAbstractItemModel(parent)
+    QAbstractItemModel(parent),
+    m_dispatchTimer(new QTimer(this))
 {
+    m_dispatchTimer->setSingleShot(true);
+    connect(m_dispatchTimer, &QTimer::timeout, this, &SearchModel::populateData);
 }
 
 QVariant SearchModel::data(const QModelIndex &index, int role) const
@@ -17,11 +31,11 @@ QVariant SearchModel::data(const QModelIndex &index, int role) const
     if ((role != Qt::DisplayRole && role != Qt::DecorationRole) || !index.isValid())
         return QVariant();
 
-    SearchResult *item = static_cast<SearchResult *>(index.internalPointer());
+    const SearchResult *item = static_cast<const SearchResult *>(index.internalPointer());
 
     if (role == Qt::DecorationRole) {
         if (index.column() == 0)
-            return QVariant(Core::Application::docsetRegistry()->entry(item->docsetName()).icon());
+            return Core::Application::docsetIconCache()->pixmap(item->docsetId());
         return QVariant();
     }
 
@@ -42,10 +56,10 @@ QModelIndex SearchModel::index(int row, int column, const QModelIndex &parent) c
 {
     if (!parent.isValid()) {
         if (dataList.count() <= row) return QModelIndex();
-        const SearchResult &item = dataList.at(row);
+        const SearchResult *item = dataList.at(row);
 
         if (column == 0 || column == 1)
-            return createIndex(row, column, (void *)&item);
+            return createIndex(row, column, const_cast<SearchResult *>(item));
     }
     return QModelIndex();
 }
@@ -72,21 +86,111 @@ int SearchModel::columnCount(const QModelIndex &parent) const
 void SearchModel::setQuery(const QString &q)
 {
     query = q;
-    populateData();
+
+    // When queries are slow, keystrokes arriving in quick succession are coalesced and
+    // only the last query is run. The ones in between would be cancelled anyway.
+    const int latency = Core::Application::docsetRegistry()->queryLatency();
+    if (query.isEmpty() || latency <= ImmediateDispatchLatency) {
+        m_dispatchTimer->stop();
+        populateData();
+    } else {
+        m_dispatchTimer->start(qMin(latency, MaxDispatchDelay));
+    }
 }
 
 void SearchModel::populateData()
 {
-    if (query.isEmpty())
+    if (query.isEmpty()) {
         Core::Application::docsetRegistry()->invalidateQueries();
-    else
-        Core::Application::docsetRegistry()->runQuery(query);
+        m_queryNum = -1;
+    } else {
+        m_queryNum = Core::Application::docsetRegistry()->runQuery(query);
+        m_resetPending = true;
+    }
+}
+
+void SearchModel::onQueryCompleted(const SearchResultBlock::Shared &results)
+{
+    adopt(results);
+    emit queryCompleted();
+}
+
+void SearchModel::onQueryResultsReady(const SearchResultBlock::Shared &batch)
+{
+    if (batch->queryNum != m_queryNum || batch->results.isEmpty())
+        return;
+
+    if (m_resetPending) {
+        m_resetPending = false;
+        adopt(batch);
+        emit resultsAvailable();
+        return;
+    }
+
+    const QList<SearchResult> &results = batch->results;
+    m_blocks.append(batch);
+    auto lessThan = [](const SearchResult &result, const SearchResult *row) {
+        return result < *row;
+    };
+
+    const int limit = Core::Application::docsetRegistry()->resultLimit();
+
+    // Insert each run of results falling between two existing rows at once
+    int row = 0;
+    int i = 0;
+    while (i < results.size()) {
+        row = std::upper_bound(dataList.begin() + row, dataList.end(), results.at(i), lessThan)
+                - dataList.begin();
+        if (row >= limit)
+            break;
+
+        // Results tying with the row go after it, as upper_bound() places them
+        int end = i + 1;
+        while (end < results.size()
+               && (row == dataList.size() || results.at(end) < *dataList.at(row))) {
+            ++end;
+        }
+
+        beginInsertRows(QModelIndex(), row, row + end - i - 1);
+        for (int j = i; j < end; ++j)
+            dataList.insert(row + j - i, &results.at(j));
+        endInsertRows();
+
+        row += end - i;
+        i = end;
+    }
+
+    // Keep only the top results, as the complete result list does
+    if (dataList.size() > limit) {
+        beginRemoveRows(QModelIndex(), limit, dataList.size() - 1);
+        dataList.resize(limit);
+        endRemoveRows();
+    }
 }
 
-void SearchModel::onQueryCompleted(const QList<SearchResult> &results)
+void SearchModel::onQueryFinished(const SearchResultBlock::Shared &results)
+{
+    if (results->queryNum != m_queryNum)
+        return;
+
+    // Nothing was found, or the results were cached and came without batches
+    if (m_resetPending) {
+        m_resetPending = false;
+        adopt(results);
+    }
+
+    emit queryCompleted();
+}
+
+// Replaces all rows by the ones of \a results, without copying them
+void SearchModel::adopt(const SearchResultBlock::Shared &results)
 {
     beginResetModel();
-    dataList = results;
+    dataList.clear();
+    dataList.reserve(results->results.size());
+    for (const SearchResult &result : results->results)
+        dataList.append(&result);
+    m_blocks.clear();
+    m_blocks.append(results);
     endResetModel();
-    emit queryCompleted();
 }
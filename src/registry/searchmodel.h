@@ -4,6 +4,9 @@
 #include "searchresult.h"
 
 #include <QAbstractItemModel>
+#include <QVector>
+
+class QTimer;
 
 namespace Zeal {
 
@@ -20,15 +23,35 @@ public:
     void setQuery(const QString &q);
 
 signals:
+    // Emitted when the first results of a query have been merged in
+    void resultsAvailable();
     void queryCompleted();
 
 public slots:
-    void onQueryCompleted(const QList<SearchResult> &results);
+    // Shows \a results, whatever query they belong to
+    void onQueryCompleted(const Zeal::SearchResultBlock::Shared &results);
+
+    // Merge a sorted batch of results of the running query
+    void onQueryResultsReady(const Zeal::SearchResultBlock::Shared &batch);
+    // Shows all \a results of the running query, unless batches did already
+    void onQueryFinished(const Zeal::SearchResultBlock::Shared &results);
+
+private slots:
+    void populateData();
 
 private:
+    void adopt(const SearchResultBlock::Shared &results);
+
     QString query;
-    QList<SearchResult> dataList;
-    void populateData();
+    // Rows point into the blocks, which are kept for as long as the rows are, so that the
+    // internal pointers of indices stay valid
+    QVector<const SearchResult *> dataList;
+    QVector<SearchResultBlock::Shared> m_blocks;
+    int m_queryNum = -1;
+    // Results of the previous query are kept until the first batch arrives
+    bool m_resetPending = false;
+    // Delays running queries while typing, see setQuery()
+    QTimer *m_dispatchTimer = nullptr;
 };
 
 } // namespace Zeal
@@ -5,6 +5,7 @@ using namespace Zeal;
 namespace {
 const char DOCSET_FILTER_SEPARATOR = ':';
 const char MULTIPLE_DOCSET_SEPARATOR = ',';
+const char FULL_TEXT_PREFIX = '?';
 }
 
 SearchQuery::SearchQuery(const QString &rawQuery)
@@ -21,6 +22,11 @@ SearchQuery::SearchQuery(const QString &rawQuery)
         m_coreQuery = rawQuery.trimmed();
         m_docsetFilters.clear();
     }
+
+    if (m_coreQuery.startsWith(FULL_TEXT_PREFIX)) {
+        m_fullText = true;
+        m_coreQuery = m_coreQuery.mid(1).trimmed();
+    }
 }
 
 bool SearchQuery::hasDocsetFilter() const
@@ -28,14 +34,14 @@ bool SearchQuery::hasDocsetFilter() const
     return !m_rawDocsetFilter.isEmpty();
 }
 
-bool SearchQuery::docsetPrefixMatch(const QString &docsetPrefix) const
+QStringList SearchQuery::docsetFilters() const
 {
-    for (const QString &docsetPrefixFilter : m_docsetFilters) {
-        if (docsetPrefix.contains(docsetPrefixFilter, Qt::CaseInsensitive))
-            return true;
-    }
+    return m_docsetFilters;
+}
 
-    return false;
+bool SearchQuery::isFullTextQuery() const
+{
+    return m_fullText;
 }
 
 int SearchQuery::docsetFilterSize() const
@@ -26,13 +26,19 @@ public:
     ///
     /// Multiple docsets are supported using the ',' character:
     ///   "java,android:setTypeFa #=> docsetFilters = ["java", "android"], coreQuery = "setTypeFa"
+    ///
+    /// A '?' in front of the core query searches the page contents instead of symbols:
+    ///   "qt:?signal mapper" #=> docsetFilters = ["qt"], coreQuery = "signal mapper"
     explicit SearchQuery(const QString &coreQuery);
 
     /// Returns true if there's a docset filter for the given query
     bool hasDocsetFilter() const;
 
-    /// Returns true if the docset prefix match the ones given on query
-    bool docsetPrefixMatch(const QString &docsetPrefix) const;
+    /// Returns the terms of the docset filter, see DocsetRegistry::docsetFilter()
+    QStringList docsetFilters() const;
+
+    /// Returns true if the contents of pages are searched, see FullTextIndex
+    bool isFullTextQuery() const;
 
     /// Returns the docset filter raw size for the given query
     int docsetFilterSize() const;
@@ -47,6 +53,7 @@ private:
     QString m_rawDocsetFilter;
     QStringList m_docsetFilters;
     QString m_coreQuery;
+    bool m_fullText = false;
 };
 
 } // namespace Zeal
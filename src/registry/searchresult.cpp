@@ -1,18 +1,61 @@
 #include "searchresult.h"
 
+#include "stringpool.h"
+
 using namespace Zeal;
 
+SearchResult::SortKey::SortKey()
+{
+}
+
+SearchResult::SortKey::SortKey(const QString &name, const QString &parentName,
+                               const QString &query) :
+    prefixMatch(name.startsWith(query, Qt::CaseInsensitive)),
+    // Shares the data with the original string if there is nothing to fold
+    name(name.toCaseFolded()),
+    parentName(parentName.toCaseFolded())
+{
+}
+
+bool SearchResult::SortKey::operator<(const SortKey &other) const
+{
+    if (prefixMatch != other.prefixMatch)
+        return prefixMatch > other.prefixMatch;
+
+    if (contiguous != other.contiguous)
+        return contiguous > other.contiguous;
+
+    if (frecency != other.frecency)
+        return frecency > other.frecency;
+
+    if (score != other.score)
+        return score > other.score;
+
+    // Case folded strings compare like QString::compare() with Qt::CaseInsensitive
+    const int namesCmp = QString::compare(name, other.name);
+    if (namesCmp)
+        return namesCmp < 0;
+
+    return QString::compare(parentName, other.parentName) < 0;
+}
+
 SearchResult::SearchResult()
 {
 }
 
 SearchResult::SearchResult(const QString &name, const QString &parentName, const QString &path,
-                           const QString &docset, const QString &query) :
+                           int docsetId, const QString &query) :
+    SearchResult(name, parentName, path, docsetId, SortKey(name, parentName, query))
+{
+}
+
+SearchResult::SearchResult(const QString &name, const QString &parentName, const QString &path,
+                           int docsetId, const SortKey &sortKey) :
     m_name(name),
     m_parentName(parentName),
     m_path(path),
-    m_docset(docset),
-    m_query(query)
+    m_docsetId(docsetId),
+    m_sortKey(sortKey)
 {
 }
 
@@ -31,22 +74,22 @@ QString SearchResult::path() const
     return m_path;
 }
 
-QString SearchResult::docsetName() const
+int SearchResult::docsetId() const
 {
-    return m_docset;
+    return m_docsetId;
 }
 
-bool SearchResult::operator<(const SearchResult &r) const
+QString SearchResult::docsetName() const
 {
-    const bool lhsStartsWithQuery = m_name.startsWith(m_query, Qt::CaseInsensitive);
-    const bool rhsStartsWithQuery = r.m_name.startsWith(m_query, Qt::CaseInsensitive);
-
-    if (lhsStartsWithQuery != rhsStartsWithQuery)
-        return lhsStartsWithQuery > rhsStartsWithQuery;
+    return StringPool::string(m_docsetId);
+}
 
-    const int namesCmp = QString::compare(m_name, r.m_name, Qt::CaseInsensitive);
-    if (namesCmp)
-        return namesCmp < 0;
+const SearchResult::SortKey &SearchResult::sortKey() const
+{
+    return m_sortKey;
+}
 
-    return QString::compare(m_parentName, r.m_parentName, Qt::CaseInsensitive) < 0;
+bool SearchResult::operator<(const SearchResult &r) const
+{
+    return m_sortKey < r.m_sortKey;
 }
@@ -1,21 +1,45 @@
 #ifndef SEARCHRESULT_H
 #define SEARCHRESULT_H
 
+#include <QList>
+#include <QMetaType>
 #include <QString>
 
+#include <memory>
+
 namespace Zeal {
 
 class SearchResult
 {
 public:
+    // Ranking of a result, computed once so that comparisons do not allocate.
+    struct SortKey
+    {
+        SortKey();
+        SortKey(const QString &name, const QString &parentName, const QString &query);
+
+        bool operator<(const SortKey &other) const;
+
+        bool prefixMatch = false;
+        bool contiguous = true; // false for fuzzy matches
+        int frecency = 0; // higher ranks first, see UsageStore
+        int score = 0; // higher ranks first
+        QString name; // case folded
+        QString parentName; // case folded
+    };
+
     SearchResult();
     SearchResult(const QString &name, const QString &parentName, const QString &path,
-                     const QString &docset, const QString &query);
+                 int docsetId, const QString &query);
+    SearchResult(const QString &name, const QString &parentName, const QString &path,
+                 int docsetId, const SortKey &sortKey);
 
     QString name() const;
     QString parentName() const;
     QString path() const;
+    int docsetId() const;
     QString docsetName() const;
+    const SortKey &sortKey() const;
 
     bool operator<(const SearchResult &r) const;
 
@@ -23,10 +47,39 @@ private:
     QString m_name;
     QString m_parentName;
     QString m_path;
-    QString m_docset;
-    QString m_query;
+    int m_docsetId = -1; // see StringPool
+    SortKey m_sortKey;
+};
+
+/**
+ * @short Sorted results of a query, or of a batch of it, tagged with the query number.
+ *
+ * Blocks are never modified once created, so they are handed from the registry thread to
+ * models by reference count alone. Models point into the blocks they hold.
+ */
+struct SearchResultBlock
+{
+    typedef std::shared_ptr<const SearchResultBlock> Shared;
+
+    SearchResultBlock(int queryNum, QList<SearchResult> &&results) :
+        queryNum(queryNum), results(std::move(results))
+    {
+    }
+
+    static Shared create(int queryNum, QList<SearchResult> &&results)
+    {
+        return std::make_shared<const SearchResultBlock>(queryNum, std::move(results));
+    }
+
+    const int queryNum;
+    const QList<SearchResult> results;
 };
 
 } // namespace Zeal
 
+Q_DECLARE_TYPEINFO(Zeal::SearchResult::SortKey, Q_MOVABLE_TYPE);
+Q_DECLARE_TYPEINFO(Zeal::SearchResult, Q_MOVABLE_TYPE);
+Q_DECLARE_METATYPE(Zeal::SearchResult)
+Q_DECLARE_METATYPE(Zeal::SearchResultBlock::Shared)
+
 #endif // SEARCHRESULT_H
@@ -0,0 +1,45 @@
+#include "stringpool.h"
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QVector>
+
+using namespace Zeal;
+
+namespace {
+struct Pool
+{
+    QReadWriteLock lock;
+    QHash<QString, int> ids;
+    QVector<QString> strings;
+};
+
+Q_GLOBAL_STATIC(Pool, pool)
+}
+
+int StringPool::intern(const QString &string)
+{
+    {
+        QReadLocker locker(&pool->lock);
+        const auto it = pool->ids.constFind(string);
+        if (it != pool->ids.constEnd())
+            return it.value();
+    }
+
+    QWriteLocker locker(&pool->lock);
+    // Another thread could have added the string in the meantime
+    const auto it = pool->ids.constFind(string);
+    if (it != pool->ids.constEnd())
+        return it.value();
+
+    const int id = pool->strings.size();
+    pool->strings.append(string);
+    pool->ids.insert(string, id);
+    return id;
+}
+
+QString StringPool::string(int id)
+{
+    QReadLocker locker(&pool->lock);
+    return pool->strings.value(id);
+}
@@ -0,0 +1,26 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QString>
+
+namespace Zeal {
+
+/**
+ * @short Process-wide table of interned strings.
+ *
+ * Maps frequently repeated strings, such as docset names, to small integer IDs,
+ * so that records referring to them do not have to carry a QString each. IDs
+ * are never reused. Thread-safe.
+ */
+class StringPool
+{
+public:
+    /// Returns the ID of \a string, adding it to the pool if needed.
+    static int intern(const QString &string);
+    /// Returns the string with \a id, or a null string for an unknown ID.
+    static QString string(int id);
+};
+
+} // namespace Zeal
+
+#endif // STRINGPOOL_H
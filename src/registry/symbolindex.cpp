@@ -0,0 +1,639 @@
+#include "symbolindex.h"
+
+#include "fuzzymatcher.h"
+
+#include <QFile>
+#include <QPair>
+#include <QSaveFile>
+#include <QSet>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Zeal;
+
+namespace {
+// '.' for long Django docset values like django.utils.http
+// '::' for long C++ docset values like std::set
+// '/' for long Go docset values like archive/tar
+const char *Separators[] = {".", "::", "/"};
+
+// How many candidates are examined between cancellation checks
+const int CancellationCheckInterval = 4096;
+
+// Layout of files written by SymbolIndex::save(), in native byte order. Sections follow
+// the header in this order: character masks, symbols, keys, types and UTF-16 strings.
+const quint32 CacheMagic = 0x5a53594d; // ZSYM
+// Bump whenever the layout changes
+const quint32 CacheVersion = 2;
+
+struct CacheHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint64 stamp;
+    quint32 symbolCount;
+    quint32 keyCount;
+    quint32 typeCount;
+    quint32 stringLength;
+};
+
+struct CacheString
+{
+    quint32 offset;
+    quint32 length;
+};
+
+struct CacheSymbol
+{
+    CacheString name;
+    CacheString lowerName;
+    CacheString path;
+    qint32 type;
+    // See SymbolIndex::NameParts
+    quint32 displayStart;
+    quint32 displayLength;
+    quint32 parentStart;
+    quint32 parentLength;
+};
+
+struct CacheKey
+{
+    qint32 symbol;
+    qint32 offset;
+};
+
+// Appends strings to a single buffer, reusing the previous one if repeated
+class CacheStringWriter
+{
+public:
+    CacheString add(const QString &string)
+    {
+        if (string == m_last)
+            return m_lastEntry;
+
+        m_lastEntry = {quint32(m_buffer.size()), quint32(string.size())};
+        m_last = string;
+        m_buffer += string;
+        return m_lastEntry;
+    }
+
+    const QString &buffer() const
+    {
+        return m_buffer;
+    }
+
+private:
+    QString m_buffer;
+    QString m_last;
+    CacheString m_lastEntry = {0, 0};
+};
+}
+
+SymbolIndex::SymbolIndex()
+{
+}
+
+SymbolIndex::NameParts SymbolIndex::splitName(const QString &name)
+{
+    // Arguments of methods, as in "foo(int, int)"
+    int start = 0;
+    int end = name.size();
+    const int arguments = name.indexOf(QLatin1Char('('));
+    if (arguments > 0 && name.endsWith(QLatin1Char(')')))
+        end = arguments;
+
+    NameParts parts = {0, end, 0, 0};
+
+    // Each separator narrows down what the previous one left
+    for (const char *separator : Separators) {
+        const QLatin1String sep(separator);
+        const int first = name.indexOf(sep, start);
+        if (first == -1 || first == start || first + sep.size() > end)
+            continue;
+
+        const int last = name.lastIndexOf(sep, end - sep.size());
+        int previous = last - sep.size() >= start ? name.lastIndexOf(sep, last - sep.size()) : -1;
+        previous = previous >= start ? previous + sep.size() : start;
+
+        parts.parentStart = previous;
+        parts.parentLength = last - previous;
+        start = last + sep.size();
+    }
+
+    parts.displayStart = start;
+    parts.displayLength = end - start;
+    return parts;
+}
+
+void SymbolIndex::addSymbol(const QString &name, const QString &type, const QString &path)
+{
+    int typeId = m_typeIds.value(type, -1);
+    if (typeId == -1) {
+        typeId = m_types.size();
+        m_types.append(type);
+        m_typeIds.insert(type, typeId);
+        m_typeCounts.append(0);
+    }
+    ++m_typeCounts[typeId];
+
+    m_symbols.append({name, path, typeId});
+    m_lowerNames.append(name.toLower());
+}
+
+void SymbolIndex::finalize()
+{
+    m_keys.clear();
+    m_characterMasks.clear();
+    m_characterMasks.reserve(m_lowerNames.size());
+    m_nameParts.clear();
+    m_nameParts.reserve(m_lowerNames.size());
+
+    for (int id = 0; id < m_lowerNames.size(); ++id) {
+        const QString &lowerName = m_lowerNames.at(id);
+
+        m_characterMasks.append(FuzzyMatcher::characterMask(lowerName));
+        m_nameParts.append(splitName(m_symbols.at(id).name));
+
+        m_keys.append({id, 0});
+        for (const char *separator : Separators) {
+            const QLatin1String sep(separator);
+            int pos = lowerName.indexOf(sep);
+            while (pos != -1) {
+                const int offset = pos + sep.size();
+                if (offset < lowerName.size())
+                    m_keys.append({id, offset});
+                pos = lowerName.indexOf(sep, offset);
+            }
+        }
+    }
+
+    std::sort(m_keys.begin(), m_keys.end(), [this](const Key &a, const Key &b) {
+        return QStringRef::compare(keyRef(a), keyRef(b)) < 0;
+    });
+
+    buildTrigrams();
+    buildPages();
+}
+
+bool SymbolIndex::save(const QString &fileName, quint64 stamp) const
+{
+    CacheStringWriter strings;
+
+    QVector<CacheSymbol> symbols;
+    symbols.reserve(m_symbols.size());
+    for (int id = 0; id < m_symbols.size(); ++id) {
+        const Symbol &symbol = m_symbols.at(id);
+        CacheSymbol cacheSymbol;
+        cacheSymbol.name = strings.add(symbol.name);
+        cacheSymbol.lowerName = strings.add(m_lowerNames.at(id));
+        cacheSymbol.path = strings.add(symbol.path);
+        cacheSymbol.type = symbol.type;
+        const NameParts &parts = m_nameParts.at(id);
+        cacheSymbol.displayStart = parts.displayStart;
+        cacheSymbol.displayLength = parts.displayLength;
+        cacheSymbol.parentStart = parts.parentStart;
+        cacheSymbol.parentLength = parts.parentLength;
+        symbols.append(cacheSymbol);
+    }
+
+    QVector<CacheString> types;
+    for (const QString &type : m_types)
+        types.append(strings.add(type));
+
+    QVector<CacheKey> keys;
+    keys.reserve(m_keys.size());
+    for (const Key &key : m_keys)
+        keys.append({key.symbol, key.offset});
+
+    CacheHeader header;
+    header.magic = CacheMagic;
+    header.version = CacheVersion;
+    header.stamp = stamp;
+    header.symbolCount = symbols.size();
+    header.keyCount = keys.size();
+    header.typeCount = types.size();
+    header.stringLength = strings.buffer().size();
+
+    // Only replaces the previous file once completely written
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(m_characterMasks.constData()),
+               m_characterMasks.size() * sizeof(quint64));
+    file.write(reinterpret_cast<const char *>(symbols.constData()),
+               symbols.size() * sizeof(CacheSymbol));
+    file.write(reinterpret_cast<const char *>(keys.constData()), keys.size() * sizeof(CacheKey));
+    file.write(reinterpret_cast<const char *>(types.constData()),
+               types.size() * sizeof(CacheString));
+    file.write(reinterpret_cast<const char *>(strings.buffer().constData()),
+               strings.buffer().size() * sizeof(QChar));
+
+    return file.commit();
+}
+
+SymbolIndex *SymbolIndex::load(const QString &fileName, quint64 stamp)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(CacheHeader)))
+        return nullptr;
+
+    // Mapping spares reading the whole file into a temporary buffer first
+    const uchar *data = file.map(0, file.size());
+    if (!data)
+        return nullptr;
+
+    CacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != CacheMagic || header.version != CacheVersion || header.stamp != stamp)
+        return nullptr;
+
+    const qint64 expectedSize = sizeof(CacheHeader)
+            + qint64(header.symbolCount) * (sizeof(quint64) + sizeof(CacheSymbol))
+            + qint64(header.keyCount) * sizeof(CacheKey)
+            + qint64(header.typeCount) * sizeof(CacheString)
+            + qint64(header.stringLength) * sizeof(QChar);
+    if (file.size() != expectedSize)
+        return nullptr;
+
+    const uchar *pos = data + sizeof(CacheHeader);
+    const quint64 *masks = reinterpret_cast<const quint64 *>(pos);
+    pos += header.symbolCount * sizeof(quint64);
+    const CacheSymbol *symbols = reinterpret_cast<const CacheSymbol *>(pos);
+    pos += header.symbolCount * sizeof(CacheSymbol);
+    const CacheKey *keys = reinterpret_cast<const CacheKey *>(pos);
+    pos += header.keyCount * sizeof(CacheKey);
+    const CacheString *types = reinterpret_cast<const CacheString *>(pos);
+    pos += header.typeCount * sizeof(CacheString);
+    const QChar *strings = reinterpret_cast<const QChar *>(pos);
+
+    auto isValid = [&header](const CacheString &string) {
+        return string.offset <= header.stringLength
+                && string.length <= header.stringLength - string.offset;
+    };
+    auto toString = [strings](const CacheString &string) {
+        return QString(strings + string.offset, string.length);
+    };
+
+    QScopedPointer<SymbolIndex> index(new SymbolIndex());
+
+    for (quint32 i = 0; i < header.typeCount; ++i) {
+        if (!isValid(types[i]))
+            return nullptr;
+        const QString type = toString(types[i]);
+        index->m_typeIds.insert(type, index->m_types.size());
+        index->m_types.append(type);
+    }
+    index->m_typeCounts.fill(0, index->m_types.size());
+
+    index->m_symbols.reserve(header.symbolCount);
+    index->m_lowerNames.reserve(header.symbolCount);
+    index->m_nameParts.reserve(header.symbolCount);
+    for (quint32 i = 0; i < header.symbolCount; ++i) {
+        const CacheSymbol &symbol = symbols[i];
+        if (!isValid(symbol.name) || !isValid(symbol.lowerName) || !isValid(symbol.path)
+                || symbol.type < 0 || symbol.type >= index->m_types.size()
+                || symbol.displayStart > symbol.name.length
+                || symbol.displayLength > symbol.name.length - symbol.displayStart
+                || symbol.parentStart > symbol.name.length
+                || symbol.parentLength > symbol.name.length - symbol.parentStart) {
+            return nullptr;
+        }
+
+        const QString name = toString(symbol.name);
+        index->m_symbols.append({name, toString(symbol.path), symbol.type});
+        // Most names are lowercase already
+        index->m_lowerNames.append(symbol.lowerName.offset == symbol.name.offset
+                                   ? name : toString(symbol.lowerName));
+        index->m_nameParts.append({int(symbol.displayStart), int(symbol.displayLength),
+                                   int(symbol.parentStart), int(symbol.parentLength)});
+        ++index->m_typeCounts[symbol.type];
+    }
+
+    index->m_keys.reserve(header.keyCount);
+    for (quint32 i = 0; i < header.keyCount; ++i) {
+        const CacheKey &key = keys[i];
+        if (key.symbol < 0 || quint32(key.symbol) >= header.symbolCount || key.offset < 0
+                || key.offset > index->m_lowerNames.at(key.symbol).size()) {
+            return nullptr;
+        }
+        index->m_keys.append({key.symbol, key.offset});
+    }
+
+    index->m_characterMasks.resize(header.symbolCount);
+    memcpy(index->m_characterMasks.data(), masks, header.symbolCount * sizeof(quint64));
+
+    index->buildTrigrams();
+    index->buildPages();
+    return index.take();
+}
+
+int SymbolIndex::size() const
+{
+    return m_symbols.size();
+}
+
+const SymbolIndex::Symbol &SymbolIndex::symbol(int id) const
+{
+    return m_symbols.at(id);
+}
+
+QString SymbolIndex::displayName(int id) const
+{
+    const NameParts &parts = m_nameParts.at(id);
+    return m_symbols.at(id).name.mid(parts.displayStart, parts.displayLength);
+}
+
+QString SymbolIndex::parentName(int id) const
+{
+    const NameParts &parts = m_nameParts.at(id);
+    return m_symbols.at(id).name.mid(parts.parentStart, parts.parentLength);
+}
+
+QString SymbolIndex::typeName(int id) const
+{
+    return m_types.value(id);
+}
+
+int SymbolIndex::typeCount() const
+{
+    return m_types.size();
+}
+
+int SymbolIndex::symbolCount(int typeId) const
+{
+    return m_typeCounts.value(typeId);
+}
+
+QVector<int> SymbolIndex::symbolsOfType(const QString &type) const
+{
+    QVector<int> ids;
+
+    const int typeId = m_typeIds.value(type, -1);
+    if (typeId == -1)
+        return ids;
+
+    ids.reserve(m_typeCounts.at(typeId));
+    for (int id = 0; id < m_symbols.size(); ++id) {
+        if (m_symbols.at(id).type == typeId)
+            ids.append(id);
+    }
+
+    std::sort(ids.begin(), ids.end(), [this](int a, int b) {
+        return m_symbols.at(a).name < m_symbols.at(b).name;
+    });
+
+    return ids;
+}
+
+QVector<int> SymbolIndex::symbolsOnPage(const QString &page) const
+{
+    auto range = std::equal_range(m_pages.constBegin(), m_pages.constEnd(), -1,
+                                  [this, &page](int a, int b) {
+        // -1 stands for the page looked up
+        const QStringRef lhs = a == -1 ? QStringRef(&page) : pageRef(a);
+        const QStringRef rhs = b == -1 ? QStringRef(&page) : pageRef(b);
+        return QStringRef::compare(lhs, rhs) < 0;
+    });
+
+    // Ordered by id within the page already
+    QVector<int> ids;
+    ids.reserve(int(range.second - range.first));
+    for (auto it = range.first; it != range.second; ++it)
+        ids.append(*it);
+    return ids;
+}
+
+QVector<int> SymbolIndex::prefixMatches(const QString &query,
+                                        const CancellationToken &token) const
+{
+    QVector<int> ids;
+
+    const QString lowerQuery = query.toLower();
+    if (lowerQuery.isEmpty())
+        return ids;
+
+    auto it = std::lower_bound(m_keys.constBegin(), m_keys.constEnd(), lowerQuery,
+                               [this](const Key &key, const QString &value) {
+        return QStringRef::compare(keyRef(key), value) < 0;
+    });
+
+    for (int i = 1; it != m_keys.constEnd() && keyRef(*it).startsWith(lowerQuery); ++it, ++i) {
+        if (i % CancellationCheckInterval == 0 && token.isCancelled())
+            return QVector<int>();
+        ids.append(it->symbol);
+    }
+
+    // The same symbol can match through several of its segments
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    return ids;
+}
+
+QVector<int> SymbolIndex::substringMatches(const QString &query,
+                                           const CancellationToken &token) const
+{
+    QVector<int> ids;
+
+    const QString lowerQuery = query.toLower();
+    if (lowerQuery.isEmpty())
+        return ids;
+
+    if (lowerQuery.size() < 3) {
+        for (int id = 0; id < m_lowerNames.size(); ++id) {
+            if (id % CancellationCheckInterval == 0 && token.isCancelled())
+                return QVector<int>();
+            if (m_lowerNames.at(id).contains(lowerQuery) && !isPrefixMatch(id, lowerQuery))
+                ids.append(id);
+        }
+    } else {
+        // Only candidates from the rarest trigram need to be verified
+        const QVector<int> *candidates = nullptr;
+        for (int i = 0; i + 3 <= lowerQuery.size(); ++i) {
+            auto it = m_trigrams.constFind(trigram(lowerQuery.constData() + i));
+            if (it == m_trigrams.constEnd())
+                return ids;
+            if (!candidates || it->size() < candidates->size())
+                candidates = &*it;
+        }
+
+        for (int i = 0; i < candidates->size(); ++i) {
+            if (i % CancellationCheckInterval == 0 && token.isCancelled())
+                return QVector<int>();
+            const int id = candidates->at(i);
+            if (m_lowerNames.at(id).contains(lowerQuery) && !isPrefixMatch(id, lowerQuery))
+                ids.append(id);
+        }
+    }
+
+    return ids;
+}
+
+QVector<int> SymbolIndex::fuzzyMatches(const QString &query, int limit,
+                                       const CancellationToken &token) const
+{
+    QVector<int> ids;
+
+    // Single characters are fully covered by substring matches
+    const QString lowerQuery = query.toLower();
+    if (lowerQuery.size() < 2 || limit <= 0)
+        return ids;
+
+    // Sorts by score first, higher is better
+    typedef QPair<int, int> ScoredId; // -score, id
+    QVector<ScoredId> scored;
+
+    // Most symbols are ruled out by the mask test, which is a tight loop over a flat array
+    const quint64 queryMask = FuzzyMatcher::characterMask(lowerQuery);
+    const quint64 *masks = m_characterMasks.constData();
+    for (int id = 0; id < m_characterMasks.size(); ++id) {
+        if (id % CancellationCheckInterval == 0 && token.isCancelled())
+            return QVector<int>();
+
+        if ((masks[id] & queryMask) != queryMask || m_lowerNames.at(id).contains(lowerQuery))
+            continue;
+
+        // Camel case boundaries need the original name
+        const int score = FuzzyMatcher::match(lowerQuery, m_symbols.at(id).name);
+        if (score >= 0)
+            scored.append(qMakePair(-score, id));
+    }
+
+    if (scored.size() > limit) {
+        std::partial_sort(scored.begin(), scored.begin() + limit, scored.end());
+        scored.resize(limit);
+    } else {
+        std::sort(scored.begin(), scored.end());
+    }
+
+    ids.reserve(scored.size());
+    for (const ScoredId &scoredId : scored)
+        ids.append(scoredId.second);
+
+    return ids;
+}
+
+QVector<int> SymbolIndex::filterPrefixMatches(const QVector<int> &candidates,
+                                              const QString &query) const
+{
+    QVector<int> ids;
+
+    const QString lowerQuery = query.toLower();
+    for (int id : candidates) {
+        if (isPrefixMatch(id, lowerQuery))
+            ids.append(id);
+    }
+
+    return ids;
+}
+
+QVector<int> SymbolIndex::filterSubstringMatches(const QVector<int> &candidates,
+                                                 const QString &query) const
+{
+    QVector<int> ids;
+
+    const QString lowerQuery = query.toLower();
+    for (int id : candidates) {
+        if (m_lowerNames.at(id).contains(lowerQuery) && !isPrefixMatch(id, lowerQuery))
+            ids.append(id);
+    }
+
+    return ids;
+}
+
+void SymbolIndex::buildTrigrams()
+{
+    m_trigrams.clear();
+
+    for (int id = 0; id < m_lowerNames.size(); ++id) {
+        const QString &lowerName = m_lowerNames.at(id);
+
+        QSet<quint64> seen;
+        for (int i = 0; i + 3 <= lowerName.size(); ++i) {
+            const quint64 key = trigram(lowerName.constData() + i);
+            if (seen.contains(key))
+                continue;
+            seen.insert(key);
+            m_trigrams[key].append(id);
+        }
+    }
+}
+
+// Pages of symbols opened in the viewer are looked up by binary search
+void SymbolIndex::buildPages()
+{
+    QVector<int> pageLengths(m_symbols.size());
+    m_pages.resize(m_symbols.size());
+    for (int id = 0; id < m_symbols.size(); ++id) {
+        pageLengths[id] = pageRef(id).size();
+        m_pages[id] = id;
+    }
+
+    std::sort(m_pages.begin(), m_pages.end(), [this, &pageLengths](int a, int b) {
+        const int result = QStringRef::compare(m_symbols.at(a).path.leftRef(pageLengths.at(a)),
+                                               m_symbols.at(b).path.leftRef(pageLengths.at(b)));
+        return result < 0 || (result == 0 && a < b);
+    });
+}
+
+QStringRef SymbolIndex::pageRef(int id) const
+{
+    const QString &path = m_symbols.at(id).path;
+    return path.leftRef(path.indexOf(QLatin1Char('#')));
+}
+
+quint64 SymbolIndex::trigram(const QChar *s)
+{
+    return (quint64(s[0].unicode()) << 32) | (quint64(s[1].unicode()) << 16) | s[2].unicode();
+}
+
+bool SymbolIndex::isPrefixMatch(int id, const QString &lowerQuery) const
+{
+    const QString &lowerName = m_lowerNames.at(id);
+    if (lowerName.startsWith(lowerQuery))
+        return true;
+
+    for (const char *separator : Separators) {
+        const QLatin1String sep(separator);
+        int pos = lowerName.indexOf(sep);
+        while (pos != -1) {
+            const int offset = pos + sep.size();
+            if (lowerName.midRef(offset).startsWith(lowerQuery))
+                return true;
+            pos = lowerName.indexOf(sep, offset);
+        }
+    }
+
+    return false;
+}
+
+QStringRef SymbolIndex::keyRef(const Key &key) const
+{
+    return m_lowerNames.at(key.symbol).midRef(key.offset);
+}
+
+void SymbolIndex::sortAndTruncate(QVector<int> &ids, int limit) const
+{
+    auto lessThan = [this](int a, int b) {
+        const Symbol &lhs = m_symbols.at(a);
+        const Symbol &rhs = m_symbols.at(b);
+        if (lhs.name.size() != rhs.name.size())
+            return lhs.name.size() < rhs.name.size();
+
+        const int namesCmp = QString::compare(m_lowerNames.at(a), m_lowerNames.at(b));
+        if (namesCmp)
+            return namesCmp < 0;
+
+        return lhs.path < rhs.path;
+    };
+
+    if (ids.size() > limit) {
+        std::partial_sort(ids.begin(), ids.begin() + limit, ids.end(), lessThan);
+        ids.resize(limit);
+    } else {
+        std::sort(ids.begin(), ids.end(), lessThan);
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef SYMBOLINDEX_H
+#define SYMBOLINDEX_H
+
+#include "cancellationtoken.h"
+
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+namespace Zeal {
+
+/**
+ * @short In-memory index over all symbols of a single docset.
+ *
+ * Answers prefix and substring lookups without touching SQLite. Prefix lookups
+ * go through a sorted array of keys, where every symbol contributes its full
+ * name and every segment following a '.', '::' or '/' separator. Substring
+ * lookups are narrowed down with a trigram index, and fuzzy lookups with a
+ * per-symbol character mask.
+ */
+class SymbolIndex
+{
+public:
+    struct Symbol
+    {
+        QString name;
+        QString path;
+        int type;
+    };
+
+    // Ranges in a symbol name, see splitName()
+    struct NameParts
+    {
+        int displayStart;
+        int displayLength;
+        int parentStart;
+        int parentLength; // 0 if there is no parent
+    };
+
+    explicit SymbolIndex();
+
+    /// Splits \a name into the part shown in results, without arguments and enclosing
+    /// scopes, and the scope directly enclosing it. For example, "foo" and "Bar" for
+    /// "Bar::foo(int)". Scopes are separated by '.', '::' or '/'.
+    static NameParts splitName(const QString &name);
+
+    /// Adds a symbol. \a path should already contain the anchor, if any.
+    void addSymbol(const QString &name, const QString &type, const QString &path);
+    /// Builds lookup tables. Must be called once after all symbols are added.
+    void finalize();
+
+    /// Writes the finalized index to \a fileName, tagged with \a stamp.
+    bool save(const QString &fileName, quint64 stamp) const;
+    /// Reads an index written by save(). Returns nullptr if the file is missing,
+    /// corrupted, or has another \a stamp.
+    static SymbolIndex *load(const QString &fileName, quint64 stamp);
+
+    int size() const;
+    const Symbol &symbol(int id) const;
+    /// Returns the parts of the name of symbol \a id, as computed by splitName() when
+    /// the index was built.
+    QString displayName(int id) const;
+    QString parentName(int id) const;
+    QString typeName(int id) const;
+    int typeCount() const;
+    /// Returns the number of symbols with type \a id.
+    int symbolCount(int typeId) const;
+    /// Returns all symbols of \a type, ordered by name.
+    QVector<int> symbolsOfType(const QString &type) const;
+    /// Returns all symbols on \a page, a path without anchor, in index order.
+    QVector<int> symbolsOnPage(const QString &page) const;
+
+    /// Returns all symbols whose name, or any name segment following a
+    /// separator, starts with \a query. Returns an empty list if \a token
+    /// gets cancelled.
+    QVector<int> prefixMatches(const QString &query,
+                               const CancellationToken &token = CancellationToken()) const;
+
+    /// Returns all symbols containing \a query, excluding those returned by
+    /// prefixMatches().
+    QVector<int> substringMatches(const QString &query,
+                                  const CancellationToken &token = CancellationToken()) const;
+
+    /// Returns up to \a limit symbols matching \a query as a subsequence, but not
+    /// containing it, best scoring first. See FuzzyMatcher.
+    QVector<int> fuzzyMatches(const QString &query, int limit,
+                              const CancellationToken &token = CancellationToken()) const;
+
+    /// Same as prefixMatches() and substringMatches(), but only \a candidates
+    /// are considered. Used to narrow down results of a shorter query.
+    QVector<int> filterPrefixMatches(const QVector<int> &candidates, const QString &query) const;
+    QVector<int> filterSubstringMatches(const QVector<int> &candidates, const QString &query) const;
+
+    /// Orders \a ids by name length, name and path, keeping the first \a limit.
+    void sortAndTruncate(QVector<int> &ids, int limit) const;
+
+private:
+    struct Key
+    {
+        int symbol;
+        int offset;
+    };
+
+    static quint64 trigram(const QChar *s);
+
+    void buildTrigrams();
+    void buildPages();
+    QStringRef pageRef(int id) const;
+    bool isPrefixMatch(int id, const QString &lowerQuery) const;
+    QStringRef keyRef(const Key &key) const;
+
+    QVector<Symbol> m_symbols;
+    QVector<QString> m_lowerNames;
+    QVector<NameParts> m_nameParts;
+    QVector<quint64> m_characterMasks;
+    QStringList m_types;
+    QHash<QString, int> m_typeIds;
+    QVector<int> m_typeCounts;
+
+    QVector<Key> m_keys;
+    QHash<quint64, QVector<int>> m_trigrams;
+    // All symbols ordered by page, then id
+    QVector<int> m_pages;
+};
+
+} // namespace Zeal
+
+#endif // SYMBOLINDEX_H
@@ -0,0 +1,160 @@
+#include "usagestore.h"
+
+#include "stringpool.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QVector>
+
+#include <algorithm>
+#include <limits>
+
+using namespace Zeal;
+
+namespace {
+const quint32 StoreMagic = 0x5a555345; // ZUSE
+// Bump whenever the format changes
+const quint32 StoreVersion = 1;
+
+// Least recently opened symbols are dropped beyond this many
+const int MaxEntries = 10000;
+
+// Weight of an open by its age, like the frecency of browser history
+const struct {
+    qint64 maxAge; // s
+    int weight;
+} AgeWeights[] = {
+    {4 * 24 * 3600, 100},
+    {14 * 24 * 3600, 70},
+    {31 * 24 * 3600, 50},
+    {90 * 24 * 3600, 30}
+};
+const int OldWeight = 10;
+}
+
+UsageStore::UsageStore(const QString &fileName) :
+    m_fileName(fileName),
+    m_snapshot(std::make_shared<const QHash<int, DocsetUsage>>())
+{
+    load();
+}
+
+UsageStore::~UsageStore()
+{
+    save();
+}
+
+UsageStore::Snapshot UsageStore::snapshot() const
+{
+    return std::atomic_load(&m_snapshot);
+}
+
+void UsageStore::recordOpen(const QString &docsetName, const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // The hashes are implicitly shared, only the docset changed gets copied
+    QHash<int, DocsetUsage> usage = *snapshot();
+    Usage &entry = usage[StringPool::intern(docsetName)][path];
+    ++entry.count;
+    entry.lastOpened = QDateTime::currentMSecsSinceEpoch() / 1000;
+
+    std::atomic_store(&m_snapshot, std::make_shared<const QHash<int, DocsetUsage>>(usage));
+    m_dirty.store(1);
+}
+
+int UsageStore::frecency(const Usage &usage, qint64 now)
+{
+    const qint64 age = now - usage.lastOpened;
+    int weight = OldWeight;
+    for (const auto &ageWeight : AgeWeights) {
+        if (age < ageWeight.maxAge) {
+            weight = ageWeight.weight;
+            break;
+        }
+    }
+    return int(qMin<qint64>(qint64(usage.count) * weight, std::numeric_limits<int>::max()));
+}
+
+bool UsageStore::save()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_dirty.load())
+        return true;
+
+    struct Entry
+    {
+        int docsetId;
+        QString path;
+        Usage usage;
+    };
+
+    const Snapshot usage = snapshot();
+    QVector<Entry> entries;
+    for (auto docset = usage->cbegin(); docset != usage->cend(); ++docset) {
+        for (auto it = docset->cbegin(); it != docset->cend(); ++it)
+            entries.append({docset.key(), it.key(), it.value()});
+    }
+
+    if (entries.size() > MaxEntries) {
+        std::nth_element(entries.begin(), entries.begin() + MaxEntries, entries.end(),
+                         [](const Entry &lhs, const Entry &rhs) {
+            return lhs.usage.lastOpened > rhs.usage.lastOpened;
+        });
+        entries.resize(MaxEntries);
+    }
+
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+
+    // Only replaces the previous file once completely written
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream << StoreMagic << StoreVersion << quint32(entries.size());
+    for (const Entry &entry : entries) {
+        stream << StringPool::string(entry.docsetId) << entry.path << entry.usage.count
+               << entry.usage.lastOpened;
+    }
+
+    if (stream.status() != QDataStream::Ok || !file.commit())
+        return false;
+
+    m_dirty.store(0);
+    return true;
+}
+
+void UsageStore::load()
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    quint32 magic;
+    quint32 version;
+    quint32 count;
+    stream >> magic >> version >> count;
+    if (stream.status() != QDataStream::Ok || magic != StoreMagic || version != StoreVersion)
+        return;
+
+    QHash<int, DocsetUsage> usage;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString docsetName;
+        QString path;
+        Usage entry;
+        stream >> docsetName >> path >> entry.count >> entry.lastOpened;
+        usage[StringPool::intern(docsetName)].insert(path, entry);
+    }
+
+    // A truncated file is dropped as a whole
+    if (stream.status() != QDataStream::Ok)
+        return;
+
+    std::atomic_store(&m_snapshot, std::make_shared<const QHash<int, DocsetUsage>>(usage));
+}
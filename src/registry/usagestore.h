@@ -0,0 +1,61 @@
+#ifndef USAGESTORE_H
+#define USAGESTORE_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include <memory>
+
+namespace Zeal {
+
+/**
+ * @short How often and how recently symbols were opened, kept across restarts.
+ *
+ * Usage is recorded per docset and symbol path, and turned into a frecency score
+ * which ranks frequently and recently opened symbols first. The whole store is kept
+ * in memory and written to a small binary file. Thread-safe.
+ */
+class UsageStore
+{
+public:
+    struct Usage
+    {
+        quint32 count = 0;
+        qint64 lastOpened = 0; // s since epoch
+    };
+
+    // Usage by symbol path, including the anchor
+    typedef QHash<QString, Usage> DocsetUsage;
+    // Usage by docset ID (see StringPool). Published snapshots are never modified.
+    typedef std::shared_ptr<const QHash<int, DocsetUsage>> Snapshot;
+
+    /// Loads the store from \a fileName, if it exists.
+    explicit UsageStore(const QString &fileName);
+    /// Writes changes not saved yet.
+    ~UsageStore();
+
+    Snapshot snapshot() const;
+    void recordOpen(const QString &docsetName, const QString &path);
+
+    /// Writes the store if it changed since it was last written. Returns false on errors.
+    bool save();
+
+    /// Returns the ranking score of \a usage at \a now (s since epoch), higher is better.
+    static int frecency(const Usage &usage, qint64 now);
+
+private:
+    void load();
+
+    QString m_fileName;
+    // Serializes changes and saving
+    QMutex m_mutex;
+    // Only accessed through std::atomic_load() and std::atomic_store()
+    Snapshot m_snapshot;
+    QAtomicInt m_dirty = 0;
+};
+
+} // namespace Zeal
+
+#endif // USAGESTORE_H
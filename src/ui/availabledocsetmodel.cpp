@@ -0,0 +1,120 @@
+#include "availabledocsetmodel.h"
+
+#include "registry/listmodel.h"
+
+#include <algorithm>
+
+using namespace Zeal;
+
+AvailableDocsetModel::AvailableDocsetModel(QObject *parent) :
+    QAbstractListModel(parent)
+{
+}
+
+QVariant AvailableDocsetModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_items.size())
+        return QVariant();
+
+    const Item &item = m_items.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+        return item.metadata.title();
+    case Qt::DecorationRole:
+        // Views only ask for the rows they paint
+        if (!item.iconLoaded) {
+            item.icon = QIcon(QString(QStringLiteral("icons:%1.png")).arg(item.metadata.icon()));
+            item.iconLoaded = true;
+        }
+        return item.icon;
+    case Qt::CheckStateRole:
+        return item.checkState;
+    case ListModel::DocsetNameRole:
+        return item.metadata.name();
+    default:
+        return item.data.value(role);
+    }
+}
+
+bool AvailableDocsetModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || index.row() >= m_items.size())
+        return false;
+
+    Item &item = m_items[index.row()];
+    switch (role) {
+    case Qt::DisplayRole:
+    case Qt::DecorationRole:
+    case ListModel::DocsetNameRole:
+        return false;
+    case Qt::CheckStateRole:
+        item.checkState = static_cast<Qt::CheckState>(value.toInt());
+        item.checkOrder = m_nextCheckOrder++;
+        break;
+    default:
+        if (value.isValid())
+            item.data.insert(role, value);
+        else
+            item.data.remove(role);
+        break;
+    }
+
+    emit dataChanged(index, index, {role});
+    return true;
+}
+
+Qt::ItemFlags AvailableDocsetModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return Qt::NoItemFlags;
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsUserCheckable;
+}
+
+int AvailableDocsetModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_items.size();
+}
+
+void AvailableDocsetModel::setDocsets(const QList<DocsetMetadata> &docsets)
+{
+    beginResetModel();
+    m_items.clear();
+    m_rows.clear();
+    m_items.reserve(docsets.size());
+    for (const DocsetMetadata &metadata : docsets) {
+        m_rows.insert(metadata.name(), m_items.size());
+        Item item;
+        item.metadata = metadata;
+        m_items.append(item);
+    }
+    endResetModel();
+}
+
+void AvailableDocsetModel::clear()
+{
+    setDocsets(QList<DocsetMetadata>());
+}
+
+DocsetMetadata AvailableDocsetModel::metadata(int row) const
+{
+    return row >= 0 && row < m_items.size() ? m_items.at(row).metadata : DocsetMetadata();
+}
+
+int AvailableDocsetModel::row(const QString &name) const
+{
+    return m_rows.value(name, -1);
+}
+
+QList<int> AvailableDocsetModel::checkedRows() const
+{
+    QList<int> rows;
+    for (int i = 0; i < m_items.size(); ++i) {
+        if (m_items.at(i).checkState == Qt::Checked)
+            rows.append(i);
+    }
+
+    std::sort(rows.begin(), rows.end(), [this](int lhs, int rhs) {
+        return m_items.at(lhs).checkOrder < m_items.at(rhs).checkOrder;
+    });
+    return rows;
+}
@@ -0,0 +1,55 @@
+#ifndef AVAILABLEDOCSETMODEL_H
+#define AVAILABLEDOCSETMODEL_H
+
+#include "registry/docsetmetadata.h"
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QIcon>
+#include <QVector>
+
+namespace Zeal {
+
+// Docsets offered for download. Icons are only loaded once a row gets painted, and
+// further roles, like the progress of the ProgressItemDelegate, can be set on any row.
+class AvailableDocsetModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    explicit AvailableDocsetModel(QObject *parent = nullptr);
+
+    QVariant data(const QModelIndex &index, int role) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role) override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+
+    // Replaces all rows, which are expected in display order
+    void setDocsets(const QList<DocsetMetadata> &docsets);
+    void clear();
+
+    DocsetMetadata metadata(int row) const;
+    // Returns the row of docset \a name, or -1
+    int row(const QString &name) const;
+    // Returns the checked rows, in the order they were checked
+    QList<int> checkedRows() const;
+
+private:
+    struct Item
+    {
+        DocsetMetadata metadata;
+        Qt::CheckState checkState = Qt::Unchecked;
+        quint64 checkOrder = 0;
+        // Other roles set through setData()
+        QHash<int, QVariant> data;
+        mutable QIcon icon;
+        mutable bool iconLoaded = false;
+    };
+
+    QVector<Item> m_items;
+    QHash<QString, int> m_rows; // by docset name
+    quint64 m_nextCheckOrder = 0;
+};
+
+} // namespace Zeal
+
+#endif // AVAILABLEDOCSETMODEL_H
@@ -0,0 +1,78 @@
+#include "docsetreply.h"
+
+#include <QTimer>
+
+#include <cstring>
+
+using namespace Zeal;
+
+DocsetReply::DocsetReply(const QNetworkRequest &request,
+                         const QSharedPointer<const DocsetContentCache::File> &file,
+                         QObject *parent) :
+    QNetworkReply(parent),
+    m_file(file)
+{
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(QNetworkAccessManager::GetOperation);
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+
+    if (m_file) {
+        setHeader(QNetworkRequest::ContentTypeHeader, m_file->mimeType);
+        setHeader(QNetworkRequest::ContentLengthHeader, m_file->size);
+    } else {
+        setError(QNetworkReply::ContentNotFoundError,
+                 tr("Cannot open %1").arg(request.url().toString()));
+    }
+    setFinished(true);
+
+    // Receivers connect after the reply is returned from the network access manager
+    /// TODO: [Qt 5.4] QTimer::singleShot(0, this, &DocsetReply::emitSignals);
+    QTimer::singleShot(0, this, SLOT(emitSignals()));
+}
+
+void DocsetReply::abort()
+{
+    m_file.clear();
+    m_position = 0;
+}
+
+qint64 DocsetReply::bytesAvailable() const
+{
+    const qint64 remaining = m_file ? m_file->size - m_position : 0;
+    return QNetworkReply::bytesAvailable() + remaining;
+}
+
+bool DocsetReply::isSequential() const
+{
+    return true;
+}
+
+qint64 DocsetReply::size() const
+{
+    return m_file ? m_file->size : 0;
+}
+
+qint64 DocsetReply::readData(char *data, qint64 maxSize)
+{
+    if (!m_file || m_position >= m_file->size)
+        return -1;
+
+    const qint64 length = qMin(maxSize, m_file->size - m_position);
+    std::memcpy(data, m_file->data + m_position, static_cast<size_t>(length));
+    m_position += length;
+    return length;
+}
+
+void DocsetReply::emitSignals()
+{
+    if (error() != QNetworkReply::NoError) {
+        emit error(error());
+    } else {
+        emit metaDataChanged();
+        emit downloadProgress(m_file->size, m_file->size);
+        if (m_file->size > 0)
+            emit readyRead();
+    }
+    emit finished();
+}
@@ -0,0 +1,37 @@
+#ifndef DOCSETREPLY_H
+#define DOCSETREPLY_H
+
+#include "registry/docsetcontentcache.h"
+
+#include <QNetworkReply>
+
+namespace Zeal {
+
+// Serves a zeal:// docset URL from a DocsetContentCache file, without copying it
+class DocsetReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    explicit DocsetReply(const QNetworkRequest &request,
+                         const QSharedPointer<const DocsetContentCache::File> &file,
+                         QObject *parent = nullptr);
+
+    void abort() override;
+    qint64 bytesAvailable() const override;
+    bool isSequential() const override;
+    qint64 size() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+
+private slots:
+    void emitSignals();
+
+private:
+    QSharedPointer<const DocsetContentCache::File> m_file;
+    qint64 m_position = 0;
+};
+
+} // namespace Zeal
+
+#endif // DOCSETREPLY_H
@@ -0,0 +1,37 @@
+#include "docsetschemehandler.h"
+
+#ifdef USE_WEBENGINE
+
+#include "core/application.h"
+#include "registry/docsetcontentcache.h"
+
+#include <QBuffer>
+#include <QWebEngineUrlRequestJob>
+
+using namespace Zeal;
+
+DocsetSchemeHandler::DocsetSchemeHandler(QObject *parent) :
+    QWebEngineUrlSchemeHandler(parent)
+{
+}
+
+void DocsetSchemeHandler::requestStarted(QWebEngineUrlRequestJob *job)
+{
+    const QSharedPointer<const DocsetContentCache::File> file
+            = Core::Application::docsetContentCache()->file(job->requestUrl());
+    if (!file) {
+        job->fail(QWebEngineUrlRequestJob::UrlNotFound);
+        return;
+    }
+
+    // Reads straight from the mapping, which the connection keeps alive along with the buffer
+    QBuffer *buffer = new QBuffer(job);
+    buffer->setData(QByteArray::fromRawData(reinterpret_cast<const char *>(file->data),
+                                            static_cast<int>(file->size)));
+    connect(buffer, &QObject::destroyed, [file]() {});
+    buffer->open(QIODevice::ReadOnly);
+
+    job->reply(file->mimeType, buffer);
+}
+
+#endif // USE_WEBENGINE
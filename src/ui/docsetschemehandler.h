@@ -0,0 +1,24 @@
+#ifndef DOCSETSCHEMEHANDLER_H
+#define DOCSETSCHEMEHANDLER_H
+
+#ifdef USE_WEBENGINE
+
+#include <QWebEngineUrlSchemeHandler>
+
+namespace Zeal {
+
+// Serves zeal:// docset URLs to Qt WebEngine, see DocsetContentCache
+class DocsetSchemeHandler : public QWebEngineUrlSchemeHandler
+{
+    Q_OBJECT
+public:
+    explicit DocsetSchemeHandler(QObject *parent = nullptr);
+
+    void requestStarted(QWebEngineUrlRequestJob *job) override;
+};
+
+} // namespace Zeal
+
+#endif // USE_WEBENGINE
+
+#endif // DOCSETSCHEMEHANDLER_H
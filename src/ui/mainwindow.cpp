@@ -2,27 +2,36 @@
 #include "ui_mainwindow.h"
 
 #include "networkaccessmanager.h"
+#include "pagecache.h"
 #include "searchitemdelegate.h"
 #include "settingsdialog.h"
 #include "core/application.h"
 #include "core/settings.h"
+#include "registry/docsetcontentcache.h"
+#include "registry/docseticoncache.h"
 #include "registry/docsetregistry.h"
 #include "registry/listmodel.h"
 #include "registry/searchquery.h"
 
 #include <QAbstractEventDispatcher>
 #include <QCloseEvent>
+#include <QDataStream>
 #include <QDesktopServices>
+#include <QDir>
 #include <QKeyEvent>
 #include <QMenu>
 #include <QMessageBox>
 #include <QScrollBar>
+#include <QSharedPointer>
 #include <QShortcut>
 #include <QSystemTrayIcon>
 #include <QTabBar>
 #include <QTimer>
 
 #ifdef USE_WEBENGINE
+    #include "docsetschemehandler.h"
+
+    #include <QWebEngineProfile>
     #include <QWebEngineSettings>
 #else
     #include <QWebFrame>
@@ -34,8 +43,23 @@
 #include <gtk/gtk.h>
 #endif
 
+#include <algorithm>
+
 using namespace Zeal;
 
+namespace {
+// How many of the most used docsets are prepared in the background after startup
+const int WarmUpDocsetCount = 5;
+// Rough memory use of a laid out docset page, decoded images included, see
+// Settings::pageCacheSize
+const int EstimatedPageSize = 4; // MiB
+// Typing pauses this long before the top result is rendered in the background
+const int PreloadDelay = 300; // ms
+
+// Bump whenever the format of Settings::tabSession changes
+const quint32 SessionVersion = 1;
+}
+
 MainWindow::MainWindow(Core::Application *app, QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
@@ -69,7 +93,10 @@ MainWindow::MainWindow(Core::Application *app, QWidget *parent) :
         }
     });
 
-    m_application->docsetRegistry()->initialiseDocsets(m_settings->docsetPath);
+    m_application->docsetRegistry()->initialiseDocsets(m_settings->localDocsetPaths(),
+                                                       m_settings->remoteDocsetPaths);
+    m_zealListModel->reload();
+    m_application->docsetRegistry()->warmUp(mostUsedDocsets());
 
     // initialise ui
     ui->setupUi(this);
@@ -83,13 +110,30 @@ MainWindow::MainWindow(Core::Application *app, QWidget *parent) :
     });
 
     applyWebPageStyle();
+    applyCacheSettings();
     m_zealNetworkManager = new NetworkAccessManager();
 #ifdef USE_WEBENGINE
     // FIXME AngularJS workaround (zealnetworkaccessmanager.cpp)
+    QWebEngineProfile::defaultProfile()->installUrlSchemeHandler(
+                DocsetContentCache::Scheme, new DocsetSchemeHandler(this));
 #else
     ui->webView->page()->setNetworkAccessManager(m_zealNetworkManager);
 #endif
 
+    // Speculative loading, see queryCompleted()
+    m_pageCache = new PageCache(ui->webView, [this]() {
+        return createPage();
+    });
+    m_preloadTimer = new QTimer(this);
+    m_preloadTimer->setSingleShot(true);
+    m_preloadTimer->setInterval(PreloadDelay);
+    connect(m_preloadTimer, &QTimer::timeout, this, &MainWindow::preloadResult);
+    connect(m_settings, &Core::Settings::updated, this, [this]() {
+        if (!m_settings->speculativeLoading)
+            m_pageCache->clear();
+        applyCacheSettings();
+    });
+
     // menu
     if (QKeySequence(QKeySequence::Quit) != QKeySequence("Ctrl+Q")) {
         ui->action_Quit->setShortcuts(QList<QKeySequence>{QKeySequence(
@@ -172,7 +216,8 @@ MainWindow::MainWindow(Core::Application *app, QWidget *parent) :
     ui->treeView->setItemDelegate(new SearchItemDelegate(ui->lineEdit, ui->treeView));
     m_treeViewClicked = false;
 
-    createTab();
+    if (!restoreSession(m_settings->tabSession))
+        createTab();
 
     connect(ui->treeView, &QTreeView::clicked, [this](const QModelIndex &index) {
         m_treeViewClicked = true;
@@ -187,14 +232,7 @@ MainWindow::MainWindow(Core::Application *app, QWidget *parent) :
     connect(ui->forwardButton, &QPushButton::clicked, this, &MainWindow::forward);
     connect(ui->backButton, &QPushButton::clicked, this, &MainWindow::back);
 
-    connect(ui->webView, &SearchableWebView::urlChanged, [this](const QUrl &url) {
-        const QString name = docsetName(url);
-        if (m_application->docsetRegistry()->contains(name))
-            loadSections(name, url);
-
-        m_tabBar->setTabIcon(m_tabBar->currentIndex(), docsetIcon(name));
-        displayViewActions();
-    });
+    connect(ui->webView, &SearchableWebView::urlChanged, this, &MainWindow::onUrlChanged);
 
     connect(ui->webView, &SearchableWebView::titleChanged, [this](const QString &) {
         displayViewActions();
@@ -212,7 +250,17 @@ MainWindow::MainWindow(Core::Application *app, QWidget *parent) :
     ui->sections->hide();
     ui->sections_lab->hide();
     ui->sections->setModel(&m_searchState->sectionsList);
+    connect(m_application->docsetRegistry(), &DocsetRegistry::queryResultsReady,
+            this, &MainWindow::onSearchResultsReady);
     connect(m_application->docsetRegistry(), &DocsetRegistry::queryCompleted, this, &MainWindow::onSearchComplete);
+    // Sections follow once the page has loaded, the tab may have been switched meanwhile
+    connect(m_application->docsetRegistry(), &DocsetRegistry::relatedLinksReady,
+            this, [this](const SearchResultBlock::Shared &results) {
+        for (SearchState *tab : m_tabs) {
+            if (tab->sectionsRequest == results->queryNum)
+                tab->sectionsList.onQueryCompleted(results);
+        }
+    });
     connect(ui->lineEdit, &QLineEdit::textChanged, [this](const QString &text) {
         if (text == m_searchState->searchQuery)
             return;
@@ -260,6 +308,11 @@ MainWindow::MainWindow(Core::Application *app, QWidget *parent) :
 
     connect(ui->openUrlButton, &QPushButton::clicked, [this]() {
         QUrl url(ui->webView->page()->history()->currentItem().url());
+        if (DocsetContentCache::isDocsetUrl(url)) {
+            const QString fragment = url.fragment();
+            url = QUrl::fromLocalFile(m_application->docsetContentCache()->localFile(url));
+            url.setFragment(fragment);
+        }
         if (url.scheme() != "qrc")
             QDesktopServices::openUrl(url);
     });
@@ -279,17 +332,25 @@ MainWindow::MainWindow(Core::Application *app, QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    saveTabState();
+    m_settings->tabSession = saveSession();
+
+    qDeleteAll(m_tabs);
     delete ui;
 }
 
 void MainWindow::openDocset(const QModelIndex &index)
 {
-    if (!index.sibling(index.row(), 1).data().isNull()) {
-        QStringList url_l = index.sibling(index.row(), 1).data().toString().split('#');
-        QUrl url = QUrl::fromLocalFile(url_l[0]);
-        if (url_l.count() > 1)
-            url.setFragment(url_l[1]);
-        ui->webView->load(url);
+    QString path;
+    const QUrl url = resultUrl(index, &path);
+    if (!url.isEmpty()) {
+        const QString name = docsetName(url);
+        if (!path.isEmpty())
+            m_application->docsetRegistry()->recordOpen(name, path);
+        loadUrl(url);
+
+        if (!name.isEmpty())
+            ++m_settings->docsetUsage[name];
 
         if (!m_treeViewClicked)
             ui->webView->focus();
@@ -298,28 +359,140 @@ void MainWindow::openDocset(const QModelIndex &index)
     }
 }
 
+// Returns the URL of the result at index, or an empty URL for rows without a page.
+// Also returns the path of the page within its docset in \a path, if the docset is known.
+QUrl MainWindow::resultUrl(const QModelIndex &index, QString *path) const
+{
+    if (index.sibling(index.row(), 1).data().isNull())
+        return QUrl();
+
+    QStringList url_l = index.sibling(index.row(), 1).data().toString().split('#');
+    QUrl url = QUrl::fromLocalFile(url_l[0]);
+    if (url_l.count() > 1)
+        url.setFragment(url_l[1]);
+
+    const QString name = docsetName(url);
+    const Docset docset = m_application->docsetRegistry()->entry(name);
+    if (!docset.isValid())
+        return url;
+
+    // Pages and their assets are served from memory, see DocsetContentCache
+    QString docsetPath = QDir(docset.documentPath()).relativeFilePath(url_l[0]);
+    if (url_l.count() > 1)
+        docsetPath += QLatin1Char('#') + url_l[1];
+    if (path)
+        *path = docsetPath;
+    return DocsetContentCache::url(name, docsetPath);
+}
+
+// Shows url in the current tab. A page rendered in the background is swapped in, when the
+// page cache has one, and the page shown so far is kept there.
+void MainWindow::loadUrl(const QUrl &url)
+{
+    QWebPage *page = m_settings->speculativeLoading ? m_pageCache->take(url) : nullptr;
+    if (!page) {
+        ui->webView->load(url);
+        return;
+    }
+
+    QWebPage *previous = m_searchState->page;
+#ifdef USE_WEBENGINE
+    m_searchState->swappedOut.append(previous->url());
+    const QUrl pageUrl = page->url();
+#else
+    m_searchState->swappedOut.append(previous->mainFrame()->url());
+    const QUrl pageUrl = page->mainFrame()->url();
+#endif
+    m_pageCache->insert(previous);
+
+    m_searchState->page = page;
+    ui->webView->setPage(page);
+
+    // Only the fragment differs, which merely scrolls
+    if (pageUrl != url)
+        ui->webView->load(url);
+    else
+        onUrlChanged(url);
+}
+
+void MainWindow::preloadResult()
+{
+    if (!m_settings->speculativeLoading || ui->treeView->model() != &m_searchState->zealSearch)
+        return;
+
+    QUrl url = resultUrl(ui->treeView->currentIndex());
+    url.setFragment(QString());
+#ifdef USE_WEBENGINE
+    QUrl shownUrl = ui->webView->page()->url();
+#else
+    QUrl shownUrl = ui->webView->page()->mainFrame()->url();
+#endif
+    shownUrl.setFragment(QString());
+    if (!url.isEmpty() && url != shownUrl)
+        m_pageCache->preload(url);
+}
+
+void MainWindow::onUrlChanged(const QUrl &url)
+{
+    const QString name = docsetName(url);
+    if (m_application->docsetRegistry()->contains(name))
+        loadSections(name, url);
+
+    m_tabBar->setTabIcon(m_tabBar->currentIndex(), docsetIcon(name));
+    displayViewActions();
+}
+
 QString MainWindow::docsetName(const QUrl &url) const
 {
+    if (DocsetContentCache::isDocsetUrl(url))
+        return DocsetContentCache::docsetName(url);
+
     const QRegExp docsetRegex(QStringLiteral("/([^/]+)[.]docset"));
     return docsetRegex.indexIn(url.path()) != -1 ? docsetRegex.cap(1) : QString();
 }
 
+// Returns the docsets most pages were opened from, most used first.
+QStringList MainWindow::mostUsedDocsets() const
+{
+    QList<QPair<int, QString>> usage;
+    for (auto it = m_settings->docsetUsage.cbegin(); it != m_settings->docsetUsage.cend(); ++it)
+        usage.append(qMakePair(-it.value(), it.key()));
+    std::sort(usage.begin(), usage.end());
+
+    QStringList names;
+    for (int i = 0; i < usage.size() && i < WarmUpDocsetCount; ++i)
+        names.append(usage.at(i).second);
+    return names;
+}
+
 QIcon MainWindow::docsetIcon(const QString &docsetName) const
 {
-    if (m_application->docsetRegistry()->contains(docsetName))
-        return m_application->docsetRegistry()->entry(docsetName).icon().pixmap(32, 32);
-    else
-        return QIcon();
+    const QPixmap pixmap = Core::Application::docsetIconCache()->pixmap(docsetName, 32);
+    return pixmap.isNull() ? QIcon() : QIcon(pixmap);
 }
 
+// Shows results as soon as the first ones arrive, the page is loaded once the query completes.
+void MainWindow::showSearchResults()
+{
+    if (ui->treeView->model() != &m_searchState->zealSearch) {
+        ui->treeView->setModel(&m_searchState->zealSearch);
+        ui->treeView->setColumnHidden(1, true);
+    }
+    ui->treeView->setCurrentIndex(m_searchState->zealSearch.index(0, 0, QModelIndex()));
+}
+
+// Opens the top result, unless speculative loading is enabled. It is then only rendered in
+// the background after typing pauses, and shown once opened.
 void MainWindow::queryCompleted()
 {
-    m_treeViewClicked = true;
+    showSearchResults();
 
-    ui->treeView->setModel(&m_searchState->zealSearch);
-    ui->treeView->reset();
-    ui->treeView->setColumnHidden(1, true);
-    ui->treeView->setCurrentIndex(m_searchState->zealSearch.index(0, 0, QModelIndex()));
+    if (m_settings->speculativeLoading) {
+        m_preloadTimer->start();
+        return;
+    }
+
+    m_treeViewClicked = true;
     ui->treeView->activated(ui->treeView->currentIndex());
 }
 
@@ -335,33 +508,28 @@ void MainWindow::closeTab(int index)
     if (index == -1)
         index = m_tabBar->currentIndex();
 
-    // TODO: proper deletion here
-    m_tabs.removeAt(index);
+    SearchState *tab = m_tabs.takeAt(index);
+    m_recentTabs.removeOne(tab);
+    // Switching away from a closed tab must not save into it
+    if (tab == m_searchState)
+        m_searchState = nullptr;
 
     if (m_tabs.count() == 0)
         createTab();
     m_tabBar->removeTab(index);
+
+    // The web view shows another tab's page by now
+    delete tab->page;
+    delete tab;
 }
 
 void MainWindow::createTab()
 {
     SearchState *newTab = new SearchState();
-    connect(&newTab->zealSearch, &SearchModel::queryCompleted, this,
-            &MainWindow::queryCompleted);
-    connect(&newTab->sectionsList, &SearchModel::queryCompleted, [=]() {
-        int resultCount = newTab->sectionsList.rowCount(QModelIndex());
-        ui->sections->setVisible(resultCount > 1);
-        ui->sections_lab->setVisible(resultCount > 1);
-    });
+    connectTab(newTab);
 
     ui->lineEdit->clear();
 
-    newTab->page = new QWebPage(ui->webView);
-#ifndef USE_WEBENGINE
-    newTab->page->setLinkDelegationPolicy(QWebPage::DelegateExternalLinks);
-    newTab->page->setNetworkAccessManager(m_zealNetworkManager);
-#endif
-
     ui->treeView->setModel(NULL);
     ui->treeView->setModel(m_zealListModel);
     ui->treeView->setColumnHidden(1, true);
@@ -373,11 +541,151 @@ void MainWindow::createTab()
     m_tabBar->setCurrentIndex(m_tabs.size() - 1);
 
     reloadTabState();
+}
+
+QWebPage *MainWindow::createPage()
+{
+    QWebPage *page = new QWebPage(ui->webView);
+#ifndef USE_WEBENGINE
+    page->setLinkDelegationPolicy(QWebPage::DelegateExternalLinks);
+    page->setNetworkAccessManager(m_zealNetworkManager);
+#endif
+    return page;
+}
+
+void MainWindow::connectTab(SearchState *tab)
+{
+    connect(&tab->zealSearch, &SearchModel::resultsAvailable, this,
+            &MainWindow::showSearchResults);
+    connect(&tab->zealSearch, &SearchModel::queryCompleted, this,
+            &MainWindow::queryCompleted);
+    connect(&tab->sectionsList, &SearchModel::queryCompleted, [=]() {
+        int resultCount = tab->sectionsList.rowCount(QModelIndex());
+        ui->sections->setVisible(resultCount > 1);
+        ui->sections_lab->setVisible(resultCount > 1);
+    });
+}
+
+// Writes the tabs and their histories. Search queries are left out, running them again
+// would open their top results.
+QByteArray MainWindow::saveSession()
+{
+    QByteArray session;
+    QDataStream stream(&session, QIODevice::WriteOnly);
+    stream << SessionVersion << qint32(m_tabBar->currentIndex()) << qint32(m_tabs.size());
+    for (SearchState *tab : m_tabs) {
+        storePage(tab);
+        stream << tab->url << tab->title << tab->history << tab->pageScroll
+               << qint32(tab->zoomFactor);
+    }
+    return session;
+}
+
+// Brings back the tabs written by saveSession(). Only the current tab loads its page,
+// the others wait until they are shown.
+bool MainWindow::restoreSession(const QByteArray &session)
+{
+    QDataStream stream(session);
+    quint32 version;
+    qint32 current;
+    qint32 count;
+    stream >> version >> current >> count;
+    if (stream.status() != QDataStream::Ok || version != SessionVersion || count <= 0)
+        return false;
+
+    QList<SearchState *> tabs;
+    for (int i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        SearchState *tab = new SearchState();
+        qint32 zoomFactor;
+        stream >> tab->url >> tab->title >> tab->history >> tab->pageScroll >> zoomFactor;
+        tab->zoomFactor = zoomFactor;
+        tabs.append(tab);
+    }
+
+    // A truncated session is dropped as a whole
+    if (stream.status() != QDataStream::Ok) {
+        qDeleteAll(tabs);
+        return false;
+    }
+
+    for (SearchState *tab : tabs) {
+        connectTab(tab);
+        m_tabs.append(tab);
+        m_tabBar->addTab(tab->title);
+        m_tabBar->setTabIcon(m_tabBar->count() - 1, docsetIcon(docsetName(tab->url)));
+    }
+
+    current = qBound(0, current, m_tabs.size() - 1);
+    m_searchState = m_tabs.at(current);
+    m_tabBar->setCurrentIndex(current);
+    reloadTabState();
+    return true;
+}
+
+// Creates the page of a tab that has none yet, restoring its history if it was suspended
+void MainWindow::restorePage(SearchState *tab)
+{
+    if (tab->page)
+        return;
+
+    tab->page = createPage();
+
+    if (tab->history.isEmpty()) {
 #ifdef USE_WEBENGINE
-    newTab->page->load(QUrl("qrc:///webpage/Welcome.html"));
+        tab->page->load(QUrl("qrc:///webpage/Welcome.html"));
 #else
-    newTab->page->mainFrame()->load(QUrl("qrc:///webpage/Welcome.html"));
+        tab->page->mainFrame()->load(QUrl("qrc:///webpage/Welcome.html"));
+#endif
+        return;
+    }
+
+    // Loads the current history item again
+    QDataStream stream(tab->history);
+    stream >> *tab->page->history();
+    tab->history.clear();
+
+#ifndef USE_WEBENGINE
+    if (!tab->pageScroll.isNull()) {
+        QWebFrame *frame = tab->page->mainFrame();
+        const QPoint scroll = tab->pageScroll;
+        QSharedPointer<QMetaObject::Connection> connection(new QMetaObject::Connection());
+        *connection = connect(frame, &QWebFrame::loadFinished, frame, [frame, scroll, connection]() {
+            frame->setScrollPosition(scroll);
+            QObject::disconnect(*connection);
+        });
+    }
 #endif
+    tab->pageScroll = QPoint();
+}
+
+// Keeps what is needed to restore the page of a tab, see restorePage()
+void MainWindow::storePage(SearchState *tab)
+{
+    if (!tab->page)
+        return;
+
+    tab->history.clear();
+    QDataStream stream(&tab->history, QIODevice::WriteOnly);
+    stream << *tab->page->history();
+#ifdef USE_WEBENGINE
+    tab->title = tab->page->title();
+    tab->url = tab->page->url();
+#else
+    tab->title = tab->page->history()->currentItem().title();
+    tab->url = tab->page->mainFrame()->url();
+    tab->pageScroll = tab->page->mainFrame()->scrollPosition();
+#endif
+}
+
+// Discards the page of a tab in the background
+void MainWindow::suspendTab(SearchState *tab)
+{
+    if (!tab->page || tab == m_searchState)
+        return;
+
+    storePage(tab);
+    tab->page->deleteLater();
+    tab->page = nullptr;
 }
 
 void MainWindow::displayTabs()
@@ -395,11 +703,14 @@ void MainWindow::displayTabs()
 
     for (int i = 0; i < m_tabs.count(); i++) {
         SearchState *state = m_tabs.at(i);
+        QString title = state->title;
+        if (state->page) {
 #ifdef USE_WEBENGINE
-        QString title = state->page->title();
+            title = state->page->title();
 #else
-        QString title = state->page->history()->currentItem().title();
+            title = state->page->history()->currentItem().title();
 #endif
+        }
         QAction *action = ui->menu_Tabs->addAction(title);
         action->setCheckable(true);
         action->setChecked(i == m_tabBar->currentIndex());
@@ -448,28 +759,53 @@ void MainWindow::reloadTabState()
     for (QModelIndex expandedIndex: m_searchState->expansions)
         ui->treeView->expand(expandedIndex);
 
+    restorePage(m_searchState);
     ui->webView->setPage(m_searchState->page);
     ui->webView->setZealZoomFactor(m_searchState->zoomFactor);
 
+    m_recentTabs.removeOne(m_searchState);
+    m_recentTabs.prepend(m_searchState);
+    for (int i = maxLiveTabs(); i < m_recentTabs.size(); ++i)
+        suspendTab(m_recentTabs.at(i));
+
     int resultCount = m_searchState->sectionsList.rowCount(QModelIndex());
     ui->sections->setVisible(resultCount > 1);
     ui->sections_lab->setVisible(resultCount > 1);
 
-    // scroll after the object gets loaded
-    /// TODO: [Qt 5.4] QTimer::singleShot(100, this, &MainWindow::scrollSearch);
-    QTimer::singleShot(100, this, SLOT(scrollSearch()));
+    restoreScroll(ui->treeView, m_searchState->scrollPosition, &m_treeViewScroll);
+    restoreScroll(ui->sections, m_searchState->sectionsScroll, &m_sectionsScroll);
 
     displayViewActions();
 }
 
-void MainWindow::scrollSearch()
+// Scrolls view to value as soon as its contents are laid out that far. Sections, for
+// instance, may still be on their way.
+void MainWindow::restoreScroll(QAbstractItemView *view, int value,
+                               QMetaObject::Connection *connection)
 {
-    ui->treeView->verticalScrollBar()->setValue(m_searchState->scrollPosition);
-    ui->sections->verticalScrollBar()->setValue(m_searchState->sectionsScroll);
+    disconnect(*connection);
+
+    view->doItemsLayout();
+    QScrollBar *scrollBar = view->verticalScrollBar();
+    if (value <= scrollBar->maximum()) {
+        scrollBar->setValue(value);
+        return;
+    }
+
+    *connection = connect(scrollBar, &QScrollBar::rangeChanged,
+                          this, [scrollBar, value, connection](int, int maximum) {
+        if (maximum < value)
+            return;
+        scrollBar->setValue(value);
+        QObject::disconnect(*connection);
+    });
 }
 
 void MainWindow::saveTabState()
 {
+    if (!m_searchState)
+        return;
+
     m_searchState->searchQuery = ui->lineEdit->text();
     m_searchState->selections = ui->treeView->selectionModel()->selectedIndexes();
     m_searchState->scrollPosition = ui->treeView->verticalScrollBar()->value();
@@ -477,35 +813,49 @@ void MainWindow::saveTabState()
     m_searchState->zoomFactor = ui->webView->zealZoomFactor();
 }
 
-void MainWindow::onSearchComplete()
+void MainWindow::onSearchResultsReady(const SearchResultBlock::Shared &batch)
 {
-    m_searchState->zealSearch.onQueryCompleted(m_application->docsetRegistry()->queryResults());
+    m_searchState->zealSearch.onQueryResultsReady(batch);
+}
+
+void MainWindow::onSearchComplete(const SearchResultBlock::Shared &results)
+{
+    m_searchState->zealSearch.onQueryFinished(results);
 }
 
 void MainWindow::loadSections(const QString &docsetName, const QUrl &url)
 {
-    QString dir = m_application->docsetRegistry()->entry(docsetName).documentPath();
-    QString urlPath = url.path();
-    int dirPosition = urlPath.indexOf(dir);
-    QString path = url.path().mid(dirPosition + dir.size() + 1);
+    QString path;
+    if (DocsetContentCache::isDocsetUrl(url)) {
+        path = DocsetContentCache::documentPath(url);
+    } else {
+        QString dir = m_application->docsetRegistry()->entry(docsetName).documentPath();
+        QString urlPath = url.path();
+        int dirPosition = urlPath.indexOf(dir);
+        path = url.path().mid(dirPosition + dir.size() + 1);
+    }
     // resolve the url to use the docset related path.
-    QList<SearchResult> results = m_application->docsetRegistry()->relatedLinks(docsetName, path);
-    m_searchState->sectionsList.onQueryCompleted(results);
+    m_searchState->sectionsRequest
+            = m_application->docsetRegistry()->requestRelatedLinks(docsetName, path);
 }
 
 // Sets up the search box autocompletions.
 void MainWindow::setupSearchBoxCompletions()
 {
     QStringList completions;
-    for (const Docset &docset: m_application->docsetRegistry()->docsets())
-        completions << QString("%1:").arg(docset.prefix);
+    const DocsetRegistry::Snapshot docsets = m_application->docsetRegistry()->snapshot();
+    for (const Docset &docset : *docsets)
+        completions << QString("%1:").arg(docset.prefix());
     ui->lineEdit->setCompletions(completions);
 }
 
 void MainWindow::displayViewActions()
 {
-    ui->action_Back->setEnabled(ui->webView->canGoBack());
-    ui->backButton->setEnabled(ui->webView->canGoBack());
+    // Pages swapped out of the tab are returned to after its own history
+    const bool canGoBack = ui->webView->canGoBack()
+            || (m_searchState && !m_searchState->swappedOut.isEmpty());
+    ui->action_Back->setEnabled(canGoBack);
+    ui->backButton->setEnabled(canGoBack);
     ui->action_Forward->setEnabled(ui->webView->canGoForward());
     ui->forwardButton->setEnabled(ui->webView->canGoForward());
 
@@ -530,7 +880,22 @@ void MainWindow::displayViewActions()
 
 void MainWindow::back()
 {
-    ui->webView->back();
+    if (!ui->webView->canGoBack() && !m_searchState->swappedOut.isEmpty()) {
+        // Loaded into the current page, if the page cache dropped it meanwhile.
+        // The current page stays in the cache, but cannot be gone forward to.
+        const QUrl url = m_searchState->swappedOut.takeLast();
+        QWebPage *page = m_pageCache->take(url);
+        if (!page) {
+            ui->webView->load(url);
+        } else {
+            m_pageCache->insert(m_searchState->page);
+            m_searchState->page = page;
+            ui->webView->setPage(page);
+            onUrlChanged(url);
+        }
+    } else {
+        ui->webView->back();
+    }
     displayViewActions();
 }
 
@@ -686,6 +1051,28 @@ void MainWindow::changeMinFontSize(int minFont)
     QWebSettings::globalSettings()->setFontSize(QWebSettings::MinimumFontSize, minFont);
 }
 
+// Half of the page cache size goes to tabs in the background, the other half to pages
+// kept for back and forward navigation
+void MainWindow::applyCacheSettings()
+{
+#ifndef USE_WEBENGINE
+    // WebEngine does not let its back and forward cache be configured
+    QWebSettings::setMaximumPagesInCache(qMax(0, m_settings->pageCacheSize / 2
+                                                 / EstimatedPageSize));
+#endif
+
+    if (!m_searchState)
+        return;
+    for (int i = maxLiveTabs(); i < m_recentTabs.size(); ++i)
+        suspendTab(m_recentTabs.at(i));
+}
+
+// The current tab always keeps its page
+int MainWindow::maxLiveTabs() const
+{
+    return qMax(1, m_settings->pageCacheSize / 2 / EstimatedPageSize);
+}
+
 void MainWindow::applyWebPageStyle()
 {
     QWebSettings::globalSettings()->setFontSize(QWebSettings::MinimumFontSize,
@@ -6,6 +6,8 @@
 #include <QDialog>
 #include <QMainWindow>
 #include <QModelIndex>
+#include <QPoint>
+#include <QUrl>
 
 #ifdef USE_LIBAPPINDICATOR
 #undef signals
@@ -24,8 +26,11 @@
 
 class QxtGlobalShortcut;
 
+class QAbstractItemView;
+
 class QSystemTrayIcon;
 class QTabBar;
+class QTimer;
 
 namespace Ui {
 class MainWindow;
@@ -40,6 +45,7 @@ class Settings;
 
 class ListModel;
 class NetworkAccessManager;
+class PageCache;
 class SettingsDialog;
 
 }
@@ -48,7 +54,14 @@ class SettingsDialog;
 // needs to contain [search input, search model, section model, url]
 struct SearchState
 {
-    QWebPage *page;
+    // nullptr until the tab is first shown, and again after MainWindow::suspendTab()
+    QWebPage *page = nullptr;
+    // Kept while the page is discarded, see MainWindow::storePage()
+    QByteArray history;
+    QString title;
+    QUrl url;
+    QPoint pageScroll;
+
     // model representing sections
     Zeal::SearchModel sectionsList;
     // model representing searched for items
@@ -63,7 +76,11 @@ struct SearchState
 
     int scrollPosition;
     int sectionsScroll;
-    int zoomFactor;
+    // Latest DocsetRegistry::requestRelatedLinks() for the page shown
+    int sectionsRequest = -1;
+    // URLs of pages swapped out of the tab, most recent last. See MainWindow::loadUrl().
+    QList<QUrl> swappedOut;
+    int zoomFactor = 0;
 };
 
 class MainWindow : public QMainWindow
@@ -87,30 +104,54 @@ private slots:
     void changeMinFontSize(int minFont);
     void back();
     void forward();
-    void onSearchComplete();
+    void onSearchResultsReady(const Zeal::SearchResultBlock::Shared &batch);
+    void onSearchComplete(const Zeal::SearchResultBlock::Shared &results);
     void openDocset(const QModelIndex &index);
+    void showSearchResults();
     void queryCompleted();
-    void scrollSearch();
     void saveTabState();
     void goToTab(int index);
     void closeTab(int index = -1);
     void applyWebPageStyle();
+    void preloadResult();
+    void onUrlChanged(const QUrl &url);
 
 private:
     void displayViewActions();
     void loadSections(const QString &docsetName, const QUrl &url);
     void setupSearchBoxCompletions();
     void reloadTabState();
+    void connectTab(SearchState *tab);
+    void restoreScroll(QAbstractItemView *view, int value, QMetaObject::Connection *connection);
+    QByteArray saveSession();
+    bool restoreSession(const QByteArray &session);
+    void applyCacheSettings();
+    int maxLiveTabs() const;
+    QUrl resultUrl(const QModelIndex &index, QString *path = nullptr) const;
+    void loadUrl(const QUrl &url);
+    QWebPage *createPage();
+    void restorePage(SearchState *tab);
+    void storePage(SearchState *tab);
+    void suspendTab(SearchState *tab);
     void displayTabs();
     QString docsetName(const QUrl &url) const;
+    QStringList mostUsedDocsets() const;
     QIcon docsetIcon(const QString &docsetName) const;
     QAction *addHistoryAction(QWebHistory *history, QWebHistoryItem item);
     void createTrayIcon();
 
     QList<SearchState *> m_tabs;
+    // Most recently shown first, only the first few keep their pages
+    QList<SearchState *> m_recentTabs;
 
     SearchState *m_searchState = nullptr;
     Zeal::NetworkAccessManager *m_zealNetworkManager = nullptr;
+    // Pages rendered in the background, see loadUrl()
+    Zeal::PageCache *m_pageCache = nullptr;
+    QTimer *m_preloadTimer = nullptr;
+    // Pending restoreScroll() of the search results and sections
+    QMetaObject::Connection m_treeViewScroll;
+    QMetaObject::Connection m_sectionsScroll;
 
     Ui::MainWindow *ui = nullptr;
     Zeal::Core::Application *m_application = nullptr;
@@ -1,5 +1,9 @@
 #include "networkaccessmanager.h"
 
+#include "docsetreply.h"
+#include "core/application.h"
+#include "registry/docsetcontentcache.h"
+
 #include <QNetworkRequest>
 
 using namespace Zeal;
@@ -18,6 +22,10 @@ QNetworkReply *NetworkAccessManager::createRequest(QNetworkAccessManager::Operat
     if (scheme == QLatin1String("qrc"))
         return QNetworkAccessManager::createRequest(op, req, outgoingData);
 
+    // Docset content, which is looked up once and then served from memory
+    if (DocsetContentCache::isDocsetUrl(req.url()))
+        return new DocsetReply(req, Core::Application::docsetContentCache()->file(req.url()), this);
+
     const bool nonFileScheme = scheme != QLatin1String("file");
     const bool nonLocalFile = !nonFileScheme && !req.url().host().isEmpty();
 
@@ -0,0 +1,99 @@
+#include "pagecache.h"
+
+#include <QWidget>
+
+#ifndef USE_WEBENGINE
+    #include <QWebFrame>
+#endif
+
+using namespace Zeal;
+
+namespace {
+// Each page holds its whole layout and decoded images
+const int MaxPages = 4;
+}
+
+PageCache::PageCache(QWidget *view, const PageFactory &createPage) :
+    QObject(view),
+    m_view(view),
+    m_createPage(createPage)
+{
+}
+
+// Pages are children of the view, and deleted along with it
+PageCache::~PageCache()
+{
+}
+
+void PageCache::preload(const QUrl &url)
+{
+    const QUrl pageUrl = key(url);
+    for (int i = 0; i < m_entries.size(); ++i) {
+        if (m_entries.at(i).url == pageUrl) {
+            m_entries.move(i, 0);
+            return;
+        }
+    }
+
+    // Reusing a page spares setting up another one
+    Entry entry;
+    entry.url = pageUrl;
+    entry.page = m_entries.size() >= MaxPages ? m_entries.takeLast().page : m_createPage();
+#ifdef USE_WEBENGINE
+    entry.page->load(pageUrl);
+#else
+    // Laid out like it will be shown, so that showing it does not lay it out again
+    entry.page->setViewportSize(m_view->size());
+    entry.page->mainFrame()->load(pageUrl);
+#endif
+    m_entries.prepend(entry);
+}
+
+QWebPage *PageCache::take(const QUrl &url)
+{
+    const QUrl pageUrl = key(url);
+    for (int i = 0; i < m_entries.size(); ++i) {
+        if (m_entries.at(i).url == pageUrl)
+            return m_entries.takeAt(i).page;
+    }
+    return nullptr;
+}
+
+void PageCache::insert(QWebPage *page)
+{
+    Entry entry;
+#ifdef USE_WEBENGINE
+    entry.url = key(page->url());
+#else
+    entry.url = key(page->mainFrame()->url());
+#endif
+    entry.page = page;
+
+    // A page swapped out replaces an older one with the same URL
+    if (QWebPage *previous = take(entry.url))
+        previous->deleteLater();
+
+    m_entries.prepend(entry);
+    trim();
+}
+
+void PageCache::clear()
+{
+    for (const Entry &entry : m_entries)
+        delete entry.page;
+    m_entries.clear();
+}
+
+// Fragments only scroll, the page with any of them is the same
+QUrl PageCache::key(const QUrl &url)
+{
+    QUrl pageUrl = url;
+    pageUrl.setFragment(QString());
+    return pageUrl;
+}
+
+void PageCache::trim()
+{
+    while (m_entries.size() > MaxPages)
+        m_entries.takeLast().page->deleteLater();
+}
@@ -0,0 +1,65 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <QList>
+#include <QObject>
+#include <QUrl>
+
+#include <functional>
+
+#ifdef USE_WEBENGINE
+    #include <QWebEnginePage>
+    #define QWebPage QWebEnginePage
+#else
+    #include <QWebPage>
+#endif
+
+class QWidget;
+
+namespace Zeal {
+
+/**
+ * @short Hidden pages, rendered ahead of being shown in a tab.
+ *
+ * Holds pages preloaded for likely next pages, and pages recently swapped out of tabs,
+ * so that going back and forth between them needs no loading. Pages are looked up by
+ * URL without fragment. The least recently used page is reused for the next preload.
+ */
+class PageCache : public QObject
+{
+    Q_OBJECT
+public:
+    // Returns a new page set up like the pages of tabs, and owned by the view
+    typedef std::function<QWebPage *()> PageFactory;
+
+    // Hidden pages are laid out at the size of \a view, which owns the cache
+    explicit PageCache(QWidget *view, const PageFactory &createPage);
+    ~PageCache() override;
+
+    // Starts loading \a url in a hidden page, unless a cached page has it already
+    void preload(const QUrl &url);
+    // Hands over the cached page with \a url, which may still be loading, or returns nullptr
+    QWebPage *take(const QUrl &url);
+    // Takes ownership of \a page, kept until it is the least recently used one
+    void insert(QWebPage *page);
+    void clear();
+
+private:
+    struct Entry
+    {
+        QUrl url; // without fragment
+        QWebPage *page;
+    };
+
+    static QUrl key(const QUrl &url);
+    void trim();
+
+    QWidget *m_view = nullptr;
+    PageFactory m_createPage;
+    // Most recently used first
+    QList<Entry> m_entries;
+};
+
+} // namespace Zeal
+
+#endif // PAGECACHE_H
@@ -1,17 +1,35 @@
 #include "searchitemdelegate.h"
 
 #include "searchitemstyle.h"
+#include "registry/fuzzymatcher.h"
 #include "registry/searchquery.h"
 
 #include <QApplication>
-#include <QFontMetrics>
 #include <QPainter>
 
+namespace {
+// Rows kept laid out, a few screens worth
+const int MaxCachedRows = 512;
+}
+
 SearchItemDelegate::SearchItemDelegate(QLineEdit *lineEdit, QWidget *view) :
     QStyledItemDelegate(view),
     m_lineEdit(lineEdit),
-    m_view(view)
+    m_view(view),
+    m_style(new ZealSearchItemStyle()),
+    m_rows(MaxCachedRows),
+    m_metrics(m_font)
 {
+    // The query is parsed once as it changes, instead of for every painted row
+    if (m_lineEdit) {
+        connect(m_lineEdit, &QLineEdit::textChanged, this, &SearchItemDelegate::updateHighlight);
+        updateHighlight();
+    }
+}
+
+SearchItemDelegate::~SearchItemDelegate()
+{
+    delete m_style;
 }
 
 void SearchItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option_,
@@ -19,17 +37,19 @@ void SearchItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &op
 {
     painter->save();
 
+    const QString text = index.data().toString();
+    const QVariant decoration = index.data(Qt::DecorationRole);
+
     QStyleOptionViewItem option(option_);
-    option.text = index.data().toString();
+    option.text = text;
     option.features |= QStyleOptionViewItem::HasDisplay;
 
-    if (!index.data(Qt::DecorationRole).isNull()) {
+    if (!decoration.isNull()) {
         option.features |= QStyleOptionViewItem::HasDecoration;
-        option.icon = index.data(Qt::DecorationRole).value<QIcon>();
+        option.icon = decorationIcon(decoration);
     }
 
-    ZealSearchItemStyle style;
-    style.drawControl(QStyle::CE_ItemViewItem, &option, painter, m_view);
+    m_style->drawControl(QStyle::CE_ItemViewItem, &option, painter, m_view);
 
     if (option.state & QStyle::State_Selected) {
 #ifdef Q_OS_WIN32
@@ -40,38 +60,104 @@ void SearchItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &op
     }
 
     QRect rect = qApp->style()->subElementRect(QStyle::SE_ItemViewItemText, &option, m_view);
-    const int margin = style.pixelMetric(QStyle::PM_FocusFrameHMargin, 0, m_view);
+    const int margin = m_style->pixelMetric(QStyle::PM_FocusFrameHMargin, 0, m_view);
     rect.adjust(margin, 0, 2, 0); // +2px for bold text
 
-    QFont bold(painter->font());
-    bold.setBold(true);
-    const QFontMetrics metricsBold(bold);
-
-    const QFontMetrics metrics(painter->font());
-    QString elided = metrics.elidedText(index.data().toString(), option.textElideMode, rect.width());
-
-    QString highlight;
-    if (m_lineEdit)
-        highlight = Zeal::SearchQuery(m_lineEdit->text()).coreQuery();
-
-    int from = 0;
-    while (from < elided.size()) {
-        const int until = highlight.isEmpty() ? -1 : elided.toLower().indexOf(highlight.toLower(), from);
-
-        if (until == -1) {
-            painter->drawText(rect, elided.mid(from));
-            from = elided.size();
-        } else {
-            painter->drawText(rect, elided.mid(from, until - from));
-            rect.setLeft(rect.left() + metrics.width(elided.mid(from, until - from)));
-            QFont old(painter->font());
-            painter->setFont(bold);
-            painter->drawText(rect, elided.mid(until, highlight.size()));
-            painter->setFont(old);
-            rect.setLeft(rect.left() + metricsBold.width(elided.mid(until, highlight.size())));
-            from = until + highlight.size();
-        }
+    if (painter->font() != m_font) {
+        m_font = painter->font();
+        m_metrics = QFontMetrics(m_font);
+        m_rows.clear();
     }
 
+    rowLayout(text, rect.width(), option.textElideMode).draw(painter, rect.topLeft());
+
     painter->restore();
 }
+
+void SearchItemDelegate::updateHighlight()
+{
+    const QString highlight = Zeal::SearchQuery(m_lineEdit->text()).coreQuery();
+    if (highlight == m_highlight)
+        return;
+
+    m_highlight = highlight;
+    m_rows.clear();
+}
+
+const QTextLayout &SearchItemDelegate::rowLayout(const QString &text, int width,
+                                                 Qt::TextElideMode elideMode) const
+{
+    if (Row *row = m_rows.object(text)) {
+        if (row->width == width && row->elideMode == elideMode)
+            return row->layout;
+    }
+
+    const QString elided = m_metrics.elidedText(text, elideMode, width);
+
+    // Positions of highlighted characters: every occurrence of the query, or the
+    // characters of a fuzzy match if there is none.
+    QVector<int> positions;
+    if (!m_highlight.isEmpty()) {
+        int pos = elided.indexOf(m_highlight, 0, Qt::CaseInsensitive);
+        while (pos != -1) {
+            for (int i = 0; i < m_highlight.size(); ++i)
+                positions.append(pos + i);
+            pos = elided.indexOf(m_highlight, pos + m_highlight.size(), Qt::CaseInsensitive);
+        }
+
+        if (positions.isEmpty())
+            Zeal::FuzzyMatcher::match(m_highlight, elided, &positions);
+    }
+
+    // Consecutive positions become a single bold range
+    QList<QTextLayout::FormatRange> ranges;
+    for (int i = 0; i < positions.size(); ++i) {
+        if (!ranges.isEmpty() && ranges.last().start + ranges.last().length == positions.at(i)) {
+            ++ranges.last().length;
+            continue;
+        }
+
+        QTextLayout::FormatRange range;
+        range.start = positions.at(i);
+        range.length = 1;
+        range.format.setFontWeight(QFont::Bold);
+        ranges.append(range);
+    }
+
+    Row *row = new Row;
+    row->width = width;
+    row->elideMode = elideMode;
+
+    QTextOption textOption;
+    textOption.setWrapMode(QTextOption::NoWrap);
+
+    QTextLayout &layout = row->layout;
+    layout.setText(elided);
+    layout.setFont(m_font);
+    layout.setTextOption(textOption);
+    layout.setAdditionalFormats(ranges);
+    layout.setCacheEnabled(true);
+    layout.beginLayout();
+    QTextLine line = layout.createLine();
+    if (line.isValid()) {
+        line.setLineWidth(width);
+        line.setPosition(QPointF(0, 0));
+    }
+    layout.endLayout();
+
+    m_rows.insert(text, row);
+    return row->layout;
+}
+
+QIcon SearchItemDelegate::decorationIcon(const QVariant &decoration) const
+{
+    if (decoration.type() != QVariant::Pixmap)
+        return decoration.value<QIcon>();
+
+    // Docset icons come as pixmaps, see DocsetIconCache
+    const QPixmap pixmap = qvariant_cast<QPixmap>(decoration);
+    auto it = m_icons.find(pixmap.cacheKey());
+    if (it == m_icons.end())
+        it = m_icons.insert(pixmap.cacheKey(), QIcon(pixmap));
+    return it.value();
+}
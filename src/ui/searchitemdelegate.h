@@ -1,20 +1,53 @@
 #ifndef SEARCHITEMDELEGATE_H
 #define SEARCHITEMDELEGATE_H
 
+#include <QCache>
+#include <QFont>
+#include <QFontMetrics>
+#include <QHash>
+#include <QIcon>
 #include <QLineEdit>
 #include <QStyledItemDelegate>
+#include <QTextLayout>
+
+class ZealSearchItemStyle;
 
 class SearchItemDelegate : public QStyledItemDelegate
 {
     Q_OBJECT
 public:
     explicit SearchItemDelegate(QLineEdit *lineEdit_ = nullptr, QWidget *view = nullptr);
+    ~SearchItemDelegate() override;
+
     void paint(QPainter *painter, const QStyleOptionViewItem &option,
-               const QModelIndex &index) const;
+               const QModelIndex &index) const override;
+
+private slots:
+    void updateHighlight();
 
 private:
+    // Text of a row elided to a width, laid out with the matched characters in bold
+    struct Row
+    {
+        int width;
+        Qt::TextElideMode elideMode;
+        QTextLayout layout;
+    };
+
+    const QTextLayout &rowLayout(const QString &text, int width, Qt::TextElideMode elideMode) const;
+    QIcon decorationIcon(const QVariant &decoration) const;
+
     QLineEdit *m_lineEdit;
     QWidget *m_view;
+    ZealSearchItemStyle *m_style;
+    QString m_highlight; // core query of the line edit
+
+    // Valid for the current highlight and font, by row text
+    mutable QCache<QString, Row> m_rows;
+    mutable QFont m_font;
+    mutable QFontMetrics m_metrics;
+    // Icons wrapping the pixmaps of the model, by QPixmap::cacheKey()
+    mutable QHash<qint64, QIcon> m_icons;
 };
 
 #endif // SEARCHITEMDELEGATE_H
@@ -1,21 +1,27 @@
 #include "settingsdialog.h"
 
+#include "availabledocsetmodel.h"
 #include "progressitemdelegate.h"
 #include "ui_settingsdialog.h"
 #include "core/application.h"
+#include "core/download.h"
+#include "core/downloadqueue.h"
+#include "core/mirrorranker.h"
 #include "core/settings.h"
 #include "registry/docsetregistry.h"
 #include "registry/listmodel.h"
 
 #include <QClipboard>
+#include <QDateTime>
 #include <QDir>
 #include <QFileDialog>
 #include <QFutureWatcher>
 #include <QInputDialog>
 #include <QNetworkReply>
 #include <QNetworkRequest>
+#include <QStandardPaths>
 #include <QMessageBox>
-#include <QTemporaryFile>
+#include <QTimer>
 
 #include <QtConcurrent/QtConcurrent>
 
@@ -24,10 +30,75 @@ using namespace Zeal;
 namespace {
 const char *ApiUrl = "http://api.zealdocs.org";
 
-// QNetworkReply properties
+const char *KapeliUrls[] = {
+    "http://sanfrancisco.kapeli.com",
+    "http://sanfrancisco2.kapeli.com",
+    "http://london.kapeli.com",
+    "http://london2.kapeli.com",
+    "http://london3.kapeli.com",
+    "http://newyork.kapeli.com",
+    "http://newyork2.kapeli.com",
+    "http://sydney.kapeli.com",
+    "http://tokyo.kapeli.com",
+    "http://tokyo2.kapeli.com"
+};
+
+// Docset transfers receiving nothing for this long move on to the next mirror
+const int StallTimeout = 15000; // ms
+
+// Archives are kept here while they download, so interrupted downloads can resume
+QString archivePath(const QString &docsetName)
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QLatin1String("/downloads/") + docsetName + QLatin1String(".tgz");
+}
+
+void removeArchive(const QString &docsetName)
+{
+    const QString fileName = archivePath(docsetName);
+    QFile::remove(fileName);
+    QFile::remove(fileName + QLatin1String(".state"));
+}
+
+// QNetworkReply and Core::Download properties
 const char *DocsetMetadataProperty = "docsetMetadata";
 const char *DownloadTypeProperty = "downloadType";
 const char *ListItemIndexProperty = "listItem";
+const char *ExtractionStartedProperty = "extractionStarted";
+const char *MirrorsProperty = "mirrors"; // left to try, as strings
+const char *StalledProperty = "stalled";
+const char *StallTimerName = "stallTimer";
+const char *DownloadStartedProperty = "downloadStarted";
+const char *PriorityProperty = "priority"; // see Core::DownloadQueue
+
+// Parsed on a worker thread, the list has hundreds of docsets
+struct DocsetList
+{
+    QMap<QString, DocsetMetadata> docsets; // by name
+    QString errorString;
+};
+
+DocsetList parseDocsetList(const QByteArray &data)
+{
+    DocsetList docsetList;
+
+    QJsonParseError jsonError;
+    const QJsonDocument jsonDoc = QJsonDocument::fromJson(data, &jsonError);
+    if (jsonError.error != QJsonParseError::NoError) {
+        docsetList.errorString = jsonError.errorString();
+        return docsetList;
+    }
+
+    for (const QJsonValue &v : jsonDoc.array()) {
+        QJsonObject docsetJson = v.toObject();
+        docsetJson[QStringLiteral("source")] = QStringLiteral("kapeli");
+
+        const DocsetMetadata metadata(docsetJson);
+        docsetList.docsets.insert(metadata.name(), metadata);
+    }
+
+    return docsetList;
+}
 }
 
 SettingsDialog::SettingsDialog(Core::Application *app, ListModel *listModel, QWidget *parent) :
@@ -35,7 +106,8 @@ SettingsDialog::SettingsDialog(Core::Application *app, ListModel *listModel, QWi
     ui(new Ui::SettingsDialog()),
     m_application(app),
     m_docsetRegistry(app->docsetRegistry()),
-    m_zealListModel(listModel)
+    m_zealListModel(listModel),
+    m_availableDocsetModel(new AvailableDocsetModel(this))
 {
     ui->setupUi(this);
 
@@ -43,6 +115,11 @@ SettingsDialog::SettingsDialog(Core::Application *app, ListModel *listModel, QWi
     ui->docsetsProgress->hide();
 
     ui->listView->setModel(m_zealListModel);
+    ui->docsetsList->setModel(m_availableDocsetModel);
+    connect(ui->docsetsList->selectionModel(), &QItemSelectionModel::selectionChanged,
+            this, [this]() {
+        ui->downloadDocsetButton->setEnabled(ui->docsetsList->selectionModel()->hasSelection());
+    });
 
     ProgressItemDelegate *progressDelegate = new ProgressItemDelegate();
     ui->docsetsList->setItemDelegate(progressDelegate);
@@ -67,6 +144,10 @@ SettingsDialog::SettingsDialog(Core::Application *app, ListModel *listModel, QWi
             this, &SettingsDialog::extractionCompleted);
     connect(m_application, &Core::Application::extractionError,
             this, &SettingsDialog::extractionError);
+    connect(m_application, &Core::Application::extractionProgress,
+            this, &SettingsDialog::extractionProgress);
+    connect(m_application, &Core::Application::extractionDrained,
+            this, &SettingsDialog::extractionDrained);
 
     loadSettings();
 }
@@ -78,15 +159,10 @@ SettingsDialog::~SettingsDialog()
 
 void SettingsDialog::extractionCompleted(const QString &filePath)
 {
-    QString docsetName;
-
-    /// FIXME: Come up with a better approach
-    for (const QString &key : m_tmpFiles.keys()) {
-        if (m_tmpFiles[key]->fileName() == filePath) {
-            docsetName = key;
-            break;
-        }
-    }
+    // Docsets are extracted as streams named after them
+    const QString docsetName = filePath;
+    m_downloadedArchives.remove(docsetName);
+    removeArchive(docsetName);
 
     const QDir dataDir(m_application->settings()->docsetPath);
     const QString docsetPath = dataDir.absoluteFilePath(docsetName + QStringLiteral(".docset"));
@@ -98,30 +174,152 @@ void SettingsDialog::extractionCompleted(const QString &filePath)
             : m_userFeeds[docsetName];
     metadata.toFile(docsetPath + QStringLiteral("/meta.json"));
 
-    QMetaObject::invokeMethod(m_docsetRegistry, "addDocset", Qt::BlockingQueuedConnection,
+    // Opening the docset happens on the registry thread, which announces it to the models
+    QMetaObject::invokeMethod(m_docsetRegistry, "addDocset", Qt::QueuedConnection,
                               Q_ARG(QString, docsetPath));
 
-    m_zealListModel->resetModulesCounts();
-    emit refreshRequested();
-    ui->listView->reset();
-
-    QListWidgetItem *listItem = findDocsetListItem(metadata.title());
-    if (listItem) {
-        listItem->setData(ZealDocsetDoneInstalling, true);
-        listItem->setData(ProgressItemDelegate::ProgressFormatRole, "Done");
-        listItem->setData(ProgressItemDelegate::ProgressRole, 1);
-        listItem->setData(ProgressItemDelegate::ProgressMaxRole, 1);
+    const QModelIndex index = m_availableDocsetModel->index(m_availableDocsetModel->row(docsetName));
+    if (index.isValid()) {
+        m_availableDocsetModel->setData(index, true, ZealDocsetDoneInstalling);
+        m_availableDocsetModel->setData(index, QStringLiteral("Done"),
+                                        ProgressItemDelegate::ProgressFormatRole);
+        m_availableDocsetModel->setData(index, 1, ProgressItemDelegate::ProgressRole);
+        m_availableDocsetModel->setData(index, 1, ProgressItemDelegate::ProgressMaxRole);
     }
     endTasks();
-    delete m_tmpFiles.take(docsetName);
 }
 
 void SettingsDialog::extractionError(const QString &filePath, const QString &errorString)
 {
-    QString docsetName = QFileInfo(filePath).baseName() + QStringLiteral(".docset");
+    m_downloadedArchives.remove(filePath);
+
+    // Failed downloads were already reported, and their archives are kept to resume
+    if (m_abortedExtractions.remove(filePath))
+        return;
+
+    removeArchive(filePath);
+
+    const QString docsetName = filePath + QStringLiteral(".docset");
     QMessageBox::warning(this, QStringLiteral("Extraction Error"),
                          QString(QStringLiteral("Cannot extract docset '%1': %2")).arg(docsetName).arg(errorString));
-    delete m_tmpFiles.take(docsetName);
+}
+
+void SettingsDialog::extractionProgress(const QString &filePath, qint64 readBytes,
+                                        qint64 extractedBytes, int extractedEntries)
+{
+    const QModelIndex index = m_availableDocsetModel->index(m_availableDocsetModel->row(filePath));
+    if (!index.isValid())
+        return;
+
+    const QString files = QString(QStringLiteral("%1 files, %2 MB"))
+            .arg(extractedEntries).arg(extractedBytes / (1024 * 1024));
+
+    // Once downloaded, the bar follows the extractor through the archive
+    if (m_downloadedArchives.contains(filePath)) {
+        m_availableDocsetModel->setData(index, readBytes, ProgressItemDelegate::ProgressRole);
+        m_availableDocsetModel->setData(index, QStringLiteral("Extracting: %p% (") + files
+                                        + QLatin1Char(')'),
+                                        ProgressItemDelegate::ProgressFormatRole);
+    } else {
+        m_availableDocsetModel->setData(index, QStringLiteral("%p% (") + files + QLatin1Char(')'),
+                                        ProgressItemDelegate::ProgressFormatRole);
+    }
+}
+
+void SettingsDialog::extractionDrained(const QString &name)
+{
+    for (Core::Download *download : m_docsetDownloads) {
+        if (download->property(DocsetMetadataProperty).value<DocsetMetadata>().name() != name)
+            continue;
+
+        download->setDeliveryPaused(false);
+        QTimer *stallTimer = download->findChild<QTimer *>(QLatin1String(StallTimerName));
+        if (stallTimer && !download->isDeliveryPaused())
+            stallTimer->start();
+    }
+}
+
+/*!
+  \internal
+  Docset archives are handed to the extractor as they arrive, so extraction runs
+  alongside the download.
+*/
+void SettingsDialog::docsetDataReceived(const QByteArray &data)
+{
+    Core::Download *download = qobject_cast<Core::Download *>(sender());
+
+    const DocsetMetadata metadata = download->property(DocsetMetadataProperty).value<DocsetMetadata>();
+    if (!download->property(ExtractionStartedProperty).toBool()) {
+        m_application->startExtraction(metadata.name(), m_application->settings()->docsetPath,
+                                       metadata.name() + QStringLiteral(".docset"));
+        download->setProperty(ExtractionStartedProperty, true);
+    }
+
+    // The rest stays in the downloaded file until extraction catches up
+    if (!m_application->appendExtractionData(metadata.name(), data)) {
+        download->setDeliveryPaused(true);
+        if (QTimer *stallTimer = download->findChild<QTimer *>(QLatin1String(StallTimerName)))
+            stallTimer->stop();
+    }
+}
+
+void SettingsDialog::docsetDownloadFinished()
+{
+    Core::Download *download = qobject_cast<Core::Download *>(sender());
+    download->deleteLater();
+    m_docsetDownloads.removeOne(download);
+    progress.remove(download);
+
+    const DocsetMetadata metadata = download->property(DocsetMetadataProperty).value<DocsetMetadata>();
+
+    if (download->error() != QNetworkReply::NoError) {
+        if (download->property(ExtractionStartedProperty).toBool()) {
+            m_abortedExtractions.insert(metadata.name());
+            m_application->abortExtraction(metadata.name());
+        }
+
+        // Failed docset transfers are retried from the next mirror, unless cancelled
+        const bool stalled = download->property(StalledProperty).toBool();
+        const QStringList mirrors = download->property(MirrorsProperty).toStringList();
+        if (!mirrors.isEmpty() && (stalled || download->error() != QNetworkReply::OperationCanceledError)) {
+            m_application->mirrorRanker()->recordFailure(download->url());
+
+            QList<QUrl> urls;
+            for (const QString &mirror : mirrors)
+                urls.append(QUrl(mirror));
+            const int priority = download->property(PriorityProperty).toInt();
+            Core::Download *newDownload = startDocsetDownload(urls, metadata, priority);
+            newDownload->setProperty(ListItemIndexProperty, download->property(ListItemIndexProperty));
+
+            // The new transfer takes over the task of this one
+            endTasks();
+            return;
+        }
+
+        if (stalled)
+            QMessageBox::warning(this, QStringLiteral("Network Error"), QStringLiteral("Download stalled"));
+        else if (download->error() != QNetworkReply::OperationCanceledError)
+            QMessageBox::warning(this, QStringLiteral("Network Error"), download->errorString());
+
+        return;
+    }
+
+    // Waiting for the extraction to catch up, see extractionCompleted()
+    if (!download->property(ExtractionStartedProperty).toBool()) {
+        m_application->startExtraction(metadata.name(), m_application->settings()->docsetPath,
+                                       metadata.name() + QStringLiteral(".docset"));
+    }
+    m_application->finishExtraction(metadata.name());
+    m_downloadedArchives.insert(metadata.name());
+
+    const qint64 elapsed = QDateTime::currentMSecsSinceEpoch()
+            - download->property(DownloadStartedProperty).toLongLong();
+    m_application->mirrorRanker()->recordTransfer(download->url(), download->transferredBytes(),
+                                                  elapsed);
+
+    // If all enqueued downloads have finished executing
+    if (replies.isEmpty() && m_docsetDownloads.isEmpty())
+        resetProgress();
 }
 
 /*!
@@ -135,6 +333,7 @@ void SettingsDialog::downloadCompleted()
                 qobject_cast<QNetworkReply *>(sender()));
 
     replies.removeOne(reply.data());
+    progress.remove(reply.data());
 
     if (reply->error() != QNetworkReply::NoError) {
         if (reply->error() != QNetworkReply::OperationCanceledError)
@@ -158,6 +357,7 @@ void SettingsDialog::downloadCompleted()
         newReply->setProperty(DocsetMetadataProperty, reply->property(DocsetMetadataProperty));
         newReply->setProperty(DownloadTypeProperty, reply->property(DownloadTypeProperty));
         newReply->setProperty(ListItemIndexProperty, reply->property(ListItemIndexProperty));
+        newReply->setProperty(PriorityProperty, reply->property(PriorityProperty));
 
         connect(newReply, &QNetworkReply::finished, this, &SettingsDialog::downloadCompleted);
 
@@ -166,22 +366,22 @@ void SettingsDialog::downloadCompleted()
 
     switch (static_cast<DownloadType>(reply->property(DownloadTypeProperty).toUInt())) {
     case DownloadDocsetList: {
-        QJsonParseError jsonError;
-        const QJsonDocument jsonDoc = QJsonDocument::fromJson(reply->readAll(), &jsonError);
-
-        if (jsonError.error != QJsonParseError::NoError) {
-            QMessageBox::warning(this, QStringLiteral("Error"),
-                                 QStringLiteral("Corrupted docset list: ")
-                                 + jsonError.errorString());
-            break;
-        }
-
-        processDocsetList(jsonDoc.array());
+        // Continued in processDocsetList(), which also ends the task
+        QFutureWatcher<DocsetList> *watcher = new QFutureWatcher<DocsetList>(this);
+        connect(watcher, &QFutureWatcher<DocsetList>::finished, this, [this, watcher]() {
+            const DocsetList docsetList = watcher->result();
+            watcher->deleteLater();
 
-        if (!m_availableDocsets.isEmpty())
-            ui->downloadableGroup->show();
+            if (!docsetList.errorString.isEmpty()) {
+                QMessageBox::warning(this, QStringLiteral("Error"),
+                                     QStringLiteral("Corrupted docset list: ")
+                                     + docsetList.errorString);
+                return;
+            }
 
-        endTasks();
+            processDocsetList(docsetList.docsets);
+        });
+        watcher->setFuture(QtConcurrent::run(parseDocsetList, reply->readAll()));
         break;
     }
 
@@ -198,42 +398,32 @@ void SettingsDialog::downloadCompleted()
         if (oldMeta.isValid())
             oldMetadata = oldMeta.value<DocsetMetadata>();
 
-        /// TODO: Check revision
-        if (metadata.version().isEmpty() || oldMetadata.version() != metadata.version()) {
+        // Feeds without a version cannot tell whether the installed docset is current
+        const bool upToDate = !metadata.version().isEmpty()
+                && oldMetadata.version() == metadata.version()
+                && oldMetadata.revision() == metadata.revision();
+        if (!upToDate) {
             m_userFeeds[metadata.name()] = metadata;
-            QNetworkReply *newReply = startDownload(metadata.url());
-            newReply->setProperty(DocsetMetadataProperty, QVariant::fromValue(metadata));
-            newReply->setProperty(DownloadTypeProperty, DownloadDocset);
-            connect(newReply, &QNetworkReply::finished, this, &SettingsDialog::downloadCompleted);
+            Core::MirrorRanker *ranker = m_application->mirrorRanker();
+            startDocsetDownload(ranker->rank(metadata.urls()), metadata,
+                                reply->property(PriorityProperty).toInt());
+            // Measure the other mirrors for the next update
+            ranker->probe(metadata.urls());
         }
         break;
     }
 
-    case DownloadDocset: {
-        const DocsetMetadata metadata = reply->property(DocsetMetadataProperty).value<DocsetMetadata>();
-
-        QTemporaryFile *tmpFile = new QTemporaryFile();
-        tmpFile->open();
-        qint64 readBytes = 1;
-        const int BUFSIZE = 1024*1024;
-        char buf[BUFSIZE];
-        while (readBytes > 0) {
-            readBytes = reply->read(buf, BUFSIZE);
-            if (readBytes > 0)
-                tmpFile->write(buf, readBytes);
-        }
-        tmpFile->close();
-
-        m_tmpFiles.insert(metadata.name(), tmpFile);
-        m_application->extract(tmpFile->fileName(), m_application->settings()->docsetPath,
-                               metadata.name() + QStringLiteral(".docset"));
+    case DownloadDocset:
+        // Handled by docsetDownloadFinished()
         break;
     }
-    }
 
     // If all enqueued downloads have finished executing
-    if (replies.isEmpty())
+    if (replies.isEmpty() && m_docsetDownloads.isEmpty())
         resetProgress();
+
+    if (replies.isEmpty())
+        redownloadMissingMetadata();
 }
 
 void SettingsDialog::loadSettings()
@@ -250,6 +440,7 @@ void SettingsDialog::loadSettings()
 
     //
     ui->minFontSize->setValue(settings->minimumFontSize);
+    ui->speculativeLoadingCheckBox->setChecked(settings->speculativeLoading);
     ui->storageEdit->setText(QDir::toNativeSeparators(settings->docsetPath));
 
     // Network Tab
@@ -278,32 +469,30 @@ void SettingsDialog::on_downloadProgress(quint64 received, quint64 total)
     if (received < 10240)
         return;
 
-    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    // A QNetworkReply, or a Core::Download for docsets
+    QObject *reply = sender();
 
-    QPair<qint32, qint32> *previousProgress = progress[reply];
-    if (previousProgress == nullptr) {
-        previousProgress = new QPair<qint32, qint32>(0, 0);
-        progress[reply] = previousProgress;
-    }
+    TransferProgress &previousProgress = progress[reply];
 
     // Try to get the item associated to the request
-    QListWidgetItem *item = ui->docsetsList->item(reply->property(ListItemIndexProperty).toInt());
-    if (item) {
-        item->setData(ProgressItemDelegate::ProgressMaxRole, total);
-        item->setData(ProgressItemDelegate::ProgressRole, received);
+    const QModelIndex index = listIndex(reply);
+    if (index.isValid()) {
+        m_availableDocsetModel->setData(index, total, ProgressItemDelegate::ProgressMaxRole);
+        m_availableDocsetModel->setData(index, received, ProgressItemDelegate::ProgressRole);
     }
 
-    currentDownload += received - previousProgress->first;
-    totalDownload += total - previousProgress->second;
-    previousProgress->first = received;
-    previousProgress->second = total;
+    currentDownload += qint64(received) - previousProgress.received;
+    totalDownload += qint64(total) - previousProgress.total;
+    previousProgress.received = qint64(received);
+    previousProgress.total = qint64(total);
     displayProgress();
 }
 
 void SettingsDialog::displayProgress()
 {
-    ui->docsetsProgress->setValue(currentDownload);
-    ui->docsetsProgress->setMaximum(totalDownload);
+    // In KiB, which the int range of the progress bar fits
+    ui->docsetsProgress->setValue(int(currentDownload / 1024));
+    ui->docsetsProgress->setMaximum(int(totalDownload / 1024));
     ui->docsetsProgress->setVisible(tasksRunning > 0);
 }
 
@@ -324,16 +513,16 @@ void SettingsDialog::endTasks(qint8 tasks)
         return;
 
     // Remove completed items
-    for (int i = ui->docsetsList->count() - 1; i >= 0; --i) {
-        QListWidgetItem *item = ui->docsetsList->item(i);
-        if (item->data(ZealDocsetDoneInstalling).toBool()) {
-            item->setCheckState(Qt::Unchecked);
-            item->setHidden(true);
-            item->setData(ProgressItemDelegate::ProgressVisibleRole, false);
-            item->setData(ZealDocsetDoneInstalling, false);
-            item->setData(ProgressItemDelegate::ProgressFormatRole, QVariant());
-            item->setData(ProgressItemDelegate::ProgressRole, QVariant());
-            item->setData(ProgressItemDelegate::ProgressMaxRole, QVariant());
+    for (int i = m_availableDocsetModel->rowCount() - 1; i >= 0; --i) {
+        const QModelIndex index = m_availableDocsetModel->index(i);
+        if (index.data(ZealDocsetDoneInstalling).toBool()) {
+            m_availableDocsetModel->setData(index, Qt::Unchecked, Qt::CheckStateRole);
+            ui->docsetsList->setRowHidden(i, true);
+            m_availableDocsetModel->setData(index, false, ProgressItemDelegate::ProgressVisibleRole);
+            m_availableDocsetModel->setData(index, false, ZealDocsetDoneInstalling);
+            m_availableDocsetModel->setData(index, QVariant(), ProgressItemDelegate::ProgressFormatRole);
+            m_availableDocsetModel->setData(index, QVariant(), ProgressItemDelegate::ProgressRole);
+            m_availableDocsetModel->setData(index, QVariant(), ProgressItemDelegate::ProgressMaxRole);
         }
     }
 }
@@ -343,8 +532,9 @@ void SettingsDialog::updateFeedDocsets()
     ui->downloadableGroup->show();
     bool missingMetadata = false;
 
-    for (const Docset &docset : m_docsetRegistry->docsets()) {
-        const DocsetMetadata metadata = docset.metadata;
+    const DocsetRegistry::Snapshot docsets = m_docsetRegistry->snapshot();
+    for (const Docset &docset : *docsets) {
+        const DocsetMetadata metadata = docset.metadata();
         if (metadata.source().isEmpty())
             missingMetadata = true;
 
@@ -356,9 +546,9 @@ void SettingsDialog::updateFeedDocsets()
         QNetworkReply *reply = startDownload(feedUrl);
         reply->setProperty(DownloadTypeProperty, DownloadDashFeed);
 
-        QListWidgetItem *listItem = findDocsetListItem(metadata.title());
-        if (listItem)
-            reply->setProperty(ListItemIndexProperty, ui->docsetsList->row(listItem));
+        const int row = m_availableDocsetModel->row(metadata.name());
+        if (row != -1)
+            reply->setProperty(ListItemIndexProperty, row);
 
         reply->setProperty(DocsetMetadataProperty, QVariant::fromValue(metadata));
         connect(reply, &QNetworkReply::finished, this, &SettingsDialog::downloadCompleted);
@@ -373,118 +563,111 @@ void SettingsDialog::updateFeedDocsets()
     if (r == QMessageBox::No)
         return;
 
+    // Waits for the docset list and running feed downloads, see redownloadMissingMetadata()
+    m_redownloadMissingMetadata = true;
     if (m_availableDocsets.isEmpty())
         downloadDocsetList();
+    else
+        redownloadMissingMetadata();
+}
 
-    // There must be a better way to do this.
-    QFuture<void> future = QtConcurrent::run([=] {
-        while (m_availableDocsets.isEmpty() || replies.size())
-            QThread::yieldCurrentThread();
-    });
+void SettingsDialog::redownloadMissingMetadata()
+{
+    if (!m_redownloadMissingMetadata || m_availableDocsets.isEmpty() || !replies.isEmpty())
+        return;
+
+    m_redownloadMissingMetadata = false;
+
+    const DocsetRegistry::Snapshot docsets = m_docsetRegistry->snapshot();
+    for (const Docset &docset : *docsets) {
+        if (docset.metadata().source().isEmpty() || !m_availableDocsets.contains(docset.name()))
+            continue;
 
-    QFutureWatcher<void> *watcher = new QFutureWatcher<void>;
-    watcher->setFuture(future);
-    connect(watcher, &QFutureWatcher<void>::finished, [=] {
-        for (const Docset &docset : m_docsetRegistry->docsets()) {
-            if (!docset.metadata.source().isEmpty() && m_availableDocsets.contains(docset.name()))
-                downloadDashDocset(docset.name());
+        // Skip docsets already at the published revision
+        const DocsetMetadata &available = m_availableDocsets[docset.name()];
+        if (!docset.metadata().revision().isEmpty()
+                && docset.metadata().version() == available.version()
+                && docset.metadata().revision() == available.revision()) {
+            continue;
         }
-    });
+
+        downloadDashDocset(docset.name(), Core::DownloadQueue::BackgroundPriority);
+    }
 }
 
-void SettingsDialog::processDocsetList(const QJsonArray &list)
+void SettingsDialog::processDocsetList(const QMap<QString, DocsetMetadata> &docsets)
 {
-    for (const QJsonValue &v : list) {
-        QJsonObject docsetJson = v.toObject();
-        QString source = QStringLiteral("source");
-        docsetJson[source] = QStringLiteral("kapeli");
+    m_availableDocsets = docsets;
+    m_availableDocsetModel->setDocsets(m_availableDocsets.values());
 
-        DocsetMetadata metadata(docsetJson);
-        m_availableDocsets.insert(metadata.name(), metadata);
+    // Hidden rows are kept by the view, and reset along with the model
+    for (int row = 0; row < m_availableDocsetModel->rowCount(); ++row) {
+        if (m_docsetRegistry->contains(m_availableDocsetModel->metadata(row).name()))
+            ui->docsetsList->setRowHidden(row, true);
     }
 
-    /// TODO: Move into a dedicated method
-    for (const DocsetMetadata &metadata : m_availableDocsets) {
-        const QIcon icon(QString(QStringLiteral("icons:%1.png")).arg(metadata.icon()));
-
-        QListWidgetItem *listItem = new QListWidgetItem(icon, metadata.title(), ui->docsetsList);
-        listItem->setData(ListModel::DocsetNameRole, metadata.name());
-        listItem->setCheckState(Qt::Unchecked);
+    if (!m_availableDocsets.isEmpty())
+        ui->downloadableGroup->show();
 
-        if (m_docsetRegistry->contains(metadata.name()))
-            listItem->setHidden(true);
-    }
+    endTasks();
+    redownloadMissingMetadata();
 }
 
-void SettingsDialog::downloadDashDocset(const QString &name)
-{
-    /// TODO: Select fastest mirror
-    static const QStringList kapeliUrls = {
-        QStringLiteral("http://sanfrancisco.kapeli.com"),
-        QStringLiteral("http://sanfrancisco2.kapeli.com"),
-        QStringLiteral("http://london.kapeli.com"),
-        QStringLiteral("http://london2.kapeli.com"),
-        QStringLiteral("http://london3.kapeli.com"),
-        QStringLiteral("http://newyork.kapeli.com"),
-        QStringLiteral("http://newyork2.kapeli.com"),
-        QStringLiteral("http://sydney.kapeli.com"),
-        QStringLiteral("http://tokyo.kapeli.com"),
-        QStringLiteral("http://tokyo2.kapeli.com")
-    };
-
+void SettingsDialog::downloadDashDocset(const QString &name, int priority)
+{
     if (!m_availableDocsets.contains(name))
         return;
 
-    const QUrl url = QString(QStringLiteral("%1/feeds/%2.tgz"))
-            .arg(kapeliUrls.at(qrand() % kapeliUrls.size()))
-            .arg(name);
+    QList<QUrl> urls;
+    for (const char *mirror : KapeliUrls)
+        urls.append(QString(QStringLiteral("%1/feeds/%2.tgz")).arg(QLatin1String(mirror), name));
 
-    QNetworkReply *reply = startDownload(url);
-    reply->setProperty(DocsetMetadataProperty, QVariant::fromValue(m_availableDocsets[name]));
-    reply->setProperty(DownloadTypeProperty, DownloadDocset);
-    reply->setProperty(ListItemIndexProperty,
-                       ui->docsetsList->row(findDocsetListItem(m_availableDocsets[name].title())));
-
-    connect(reply, &QNetworkReply::finished, this, &SettingsDialog::downloadCompleted);
+    Core::Download *download = startDocsetDownload(m_application->mirrorRanker()->rank(urls),
+                                                   m_availableDocsets[name], priority);
+    const int row = m_availableDocsetModel->row(name);
+    if (row != -1)
+        download->setProperty(ListItemIndexProperty, row);
 }
 
 void SettingsDialog::downloadDocsetList()
 {
     ui->downloadButton->hide();
-    ui->docsetsList->clear();
+    m_availableDocsetModel->clear();
     m_availableDocsets.clear();
 
     QNetworkReply *reply = startDownload(QUrl(ApiUrl + QStringLiteral("/docsets")));
     reply->setProperty(DownloadTypeProperty, DownloadDocsetList);
     connect(reply, &QNetworkReply::finished, this, &SettingsDialog::downloadCompleted);
-}
 
-void SettingsDialog::on_docsetsList_itemSelectionChanged()
-{
-    ui->downloadDocsetButton->setEnabled(ui->docsetsList->selectedItems().count() > 0);
+    // Rank mirrors while the list is being chosen from
+    QList<QUrl> mirrors;
+    for (const char *mirror : KapeliUrls)
+        mirrors.append(QUrl(QLatin1String(mirror)));
+    m_application->mirrorRanker()->probe(mirrors);
 }
 
 void SettingsDialog::on_downloadDocsetButton_clicked()
 {
-    if (!replies.isEmpty()) {
+    // Docset archives are Core::Downloads, only lists and feeds are plain replies
+    if (!replies.isEmpty() || !m_docsetDownloads.isEmpty()) {
         stopDownloads();
         return;
     }
 
-    // Find each checked item, and create a NetworkRequest for it.
-    for (int i = 0; i < ui->docsetsList->count(); ++i) {
-        QListWidgetItem *item = ui->docsetsList->item(i);
-        if (item->checkState() != Qt::Checked)
-            continue;
+    // Find each checked item, and create a NetworkRequest for it. The first checked
+    // downloads first.
+    for (int i : m_availableDocsetModel->checkedRows()) {
+        const QModelIndex index = m_availableDocsetModel->index(i);
 
-        item->setData(ProgressItemDelegate::ProgressVisibleRole, true);
-        item->setData(ProgressItemDelegate::ProgressRole, 0);
-        item->setData(ProgressItemDelegate::ProgressMaxRole, 1);
+        m_availableDocsetModel->setData(index, true, ProgressItemDelegate::ProgressVisibleRole);
+        m_availableDocsetModel->setData(index, 0, ProgressItemDelegate::ProgressRole);
+        m_availableDocsetModel->setData(index, 1, ProgressItemDelegate::ProgressMaxRole);
 
-        downloadDashDocset(item->data(ListModel::DocsetNameRole).toString());
+        downloadDashDocset(index.data(ListModel::DocsetNameRole).toString(),
+                           Core::DownloadQueue::UserPriority);
     }
 
-    if (replies.count() > 0)
+    if (!replies.isEmpty() || !m_docsetDownloads.isEmpty())
         ui->downloadDocsetButton->setText("Stop downloads");
 }
 
@@ -528,9 +711,9 @@ void SettingsDialog::on_deleteButton_clicked()
             endTasks();
             ui->deleteButton->show();
 
-            QListWidgetItem *listItem = findDocsetListItem(docsetTitle);
-            if (listItem)
-                listItem->setHidden(false);
+            const int row = m_availableDocsetModel->row(docsetName);
+            if (row != -1)
+                ui->docsetsList->setRowHidden(row, false);
 
             watcher->deleteLater();
         });
@@ -559,31 +742,90 @@ void SettingsDialog::resetProgress()
 
 QNetworkReply *SettingsDialog::startDownload(const QUrl &url)
 {
-    startTasks(1);
-
     QNetworkReply *reply = m_application->download(url);
     connect(reply, &QNetworkReply::downloadProgress, this, &SettingsDialog::on_downloadProgress);
     replies.append(reply);
 
+    downloadStarted();
+    return reply;
+}
+
+/*!
+  \internal
+  Downloads the archive of a docset from the first of \a mirrors. The others are tried
+  in order if the transfer fails or stalls.
+*/
+Core::Download *SettingsDialog::startDocsetDownload(const QList<QUrl> &mirrors,
+                                                    const DocsetMetadata &metadata, int priority)
+{
+    Core::Download *download = m_application->download(mirrors.first(), archivePath(metadata.name()),
+                                                        priority);
+    download->setProperty(DocsetMetadataProperty, QVariant::fromValue(metadata));
+    download->setProperty(PriorityProperty, priority);
+    connect(download, &Core::Download::started, this, [download]() {
+        download->setProperty(DownloadStartedProperty, QDateTime::currentMSecsSinceEpoch());
+    });
+
+    QStringList remaining;
+    for (int i = 1; i < mirrors.size(); ++i)
+        remaining.append(mirrors.at(i).toString());
+    download->setProperty(MirrorsProperty, remaining);
+
+    connect(download, &Core::Download::progress, this, &SettingsDialog::on_downloadProgress);
+    connect(download, &Core::Download::dataAvailable, this, &SettingsDialog::docsetDataReceived);
+    connect(download, &Core::Download::finished, this, &SettingsDialog::docsetDownloadFinished);
+    m_docsetDownloads.append(download);
+
+    QTimer *stallTimer = new QTimer(download);
+    stallTimer->setObjectName(QLatin1String(StallTimerName));
+    stallTimer->setSingleShot(true);
+    stallTimer->setInterval(StallTimeout);
+    connect(stallTimer, &QTimer::timeout, download, [download]() {
+        download->setProperty(StalledProperty, true);
+        download->abort();
+    });
+    // Queued downloads cannot stall, nor can those waiting for the extractor, see
+    // docsetDataReceived(). Data handed out after the transfer completed counts as well.
+    const auto armStallTimer = [download, stallTimer]() {
+        if (!download->isDeliveryPaused())
+            stallTimer->start();
+    };
+    connect(download, &Core::Download::started, stallTimer, armStallTimer);
+    connect(download, &Core::Download::progress, stallTimer, armStallTimer);
+    connect(download, &Core::Download::dataAvailable, stallTimer, armStallTimer);
+
+    downloadStarted();
+    return download;
+}
+
+void SettingsDialog::downloadStarted()
+{
+    startTasks(1);
+
     ui->downloadDocsetButton->setText("Stop downloads");
     ui->downloadButton->setEnabled(false);
     ui->updateButton->setEnabled(false);
     ui->addFeedButton->setEnabled(false);
-
-    return reply;
 }
 
 void SettingsDialog::stopDownloads()
 {
     for (QNetworkReply *reply: replies) {
         // Hide progress bar
-        QListWidgetItem *listItem = ui->docsetsList->item(reply->property(ListItemIndexProperty).toInt());
-        if (!listItem)
+        const QModelIndex index = listIndex(reply);
+        if (!index.isValid())
             continue;
 
-        listItem->setData(ProgressItemDelegate::ProgressVisibleRole, false);
+        m_availableDocsetModel->setData(index, false, ProgressItemDelegate::ProgressVisibleRole);
         reply->abort();
     }
+
+    for (Core::Download *download : m_docsetDownloads) {
+        const QModelIndex index = listIndex(download);
+        if (index.isValid())
+            m_availableDocsetModel->setData(index, false, ProgressItemDelegate::ProgressVisibleRole);
+        download->abort();
+    }
 }
 
 void SettingsDialog::saveSettings()
@@ -600,10 +842,13 @@ void SettingsDialog::saveSettings()
 
     //
     settings->minimumFontSize = ui->minFontSize->text().toInt();
+    settings->speculativeLoading = ui->speculativeLoadingCheckBox->isChecked();
 
     if (QDir::fromNativeSeparators(ui->storageEdit->text()) != settings->docsetPath) {
         settings->docsetPath = QDir::fromNativeSeparators(ui->storageEdit->text());
-        m_docsetRegistry->initialiseDocsets(settings->docsetPath);
+        m_docsetRegistry->initialiseDocsets(settings->localDocsetPaths(),
+                                            settings->remoteDocsetPaths);
+        m_zealListModel->reload();
         emit refreshRequested();
     }
 
@@ -639,7 +884,7 @@ void SettingsDialog::on_tabWidget_currentChanged(int current)
     if (index.isValid())
         ui->listView->setCurrentIndex(index);
 
-    if (!ui->docsetsList->count())
+    if (!m_availableDocsetModel->rowCount())
         downloadDocsetList();
 }
 
@@ -660,16 +905,12 @@ void SettingsDialog::addDashFeed()
 
     QNetworkReply *reply = startDownload(feedUrl);
     reply->setProperty(DownloadTypeProperty, DownloadDashFeed);
+    reply->setProperty(PriorityProperty, Core::DownloadQueue::UserPriority);
     connect(reply, &QNetworkReply::finished, this, &SettingsDialog::downloadCompleted);
 }
 
-QListWidgetItem *SettingsDialog::findDocsetListItem(const QString &title) const
+QModelIndex SettingsDialog::listIndex(const QObject *transfer) const
 {
-    const QList<QListWidgetItem *> items
-            = ui->docsetsList->findItems(title, Qt::MatchFixedString);
-
-    if (items.isEmpty())
-        return nullptr;
-
-    return items.first();
+    const QVariant row = transfer->property(ListItemIndexProperty);
+    return row.isValid() ? m_availableDocsetModel->index(row.toInt()) : QModelIndex();
 }
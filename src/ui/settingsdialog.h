@@ -6,12 +6,12 @@
 #include <QDialog>
 #include <QHash>
 #include <QMap>
+#include <QSet>
 #include <QUrl>
 
 class QAbstractButton;
-class QListWidgetItem;
+class QModelIndex;
 class QNetworkReply;
-class QTemporaryFile;
 
 namespace Ui {
 class SettingsDialog;
@@ -19,11 +19,13 @@ class SettingsDialog;
 
 namespace Zeal {
 
+class AvailableDocsetModel;
 class DocsetRegistry;
 class ListModel;
 
 namespace Core {
 class Application;
+class Download;
 }
 
 class SettingsDialog : public QDialog
@@ -41,8 +43,13 @@ signals:
 private slots:
     void extractionCompleted(const QString &filePath);
     void extractionError(const QString &filePath, const QString &errorString);
+    void extractionProgress(const QString &filePath, qint64 readBytes, qint64 extractedBytes,
+                            int extractedEntries);
+    void extractionDrained(const QString &name);
 
     void downloadCompleted();
+    void docsetDataReceived(const QByteArray &data);
+    void docsetDownloadFinished();
 
     void on_downloadProgress(quint64 received, quint64 total);
     void on_downloadDocsetButton_clicked();
@@ -50,7 +57,6 @@ private slots:
     void on_deleteButton_clicked();
     void on_listView_clicked(const QModelIndex &index);
     void on_tabWidget_currentChanged(int current);
-    void on_docsetsList_itemSelectionChanged();
     void addDashFeed();
 
 private:
@@ -60,17 +66,22 @@ private:
         DownloadDocsetList
     };
 
-    QListWidgetItem *findDocsetListItem(const QString &title) const;
+    // Returns the row of the docset list a reply or Core::Download belongs to, if any
+    QModelIndex listIndex(const QObject *transfer) const;
 
     /// TODO: Create a special model
     QMap<QString, DocsetMetadata> m_availableDocsets;
     QMap<QString, DocsetMetadata> m_userFeeds;
 
-    QHash<QString, QTemporaryFile *> m_tmpFiles;
+    // Names of docsets whose download failed while they were being extracted
+    QSet<QString> m_abortedExtractions;
+    // Names of docsets fully downloaded and still being extracted
+    QSet<QString> m_downloadedArchives;
 
     void downloadDocsetList();
-    void processDocsetList(const QJsonArray &list);
-    void downloadDashDocset(const QString &name);
+    void processDocsetList(const QMap<QString, DocsetMetadata> &docsets);
+    void redownloadMissingMetadata();
+    void downloadDashDocset(const QString &name, int priority);
 
     void startTasks(qint8 tasks = 1);
     void endTasks(qint8 tasks = 1);
@@ -79,6 +90,9 @@ private:
     void updateFeedDocsets();
     void resetProgress();
     QNetworkReply *startDownload(const QUrl &url);
+    Core::Download *startDocsetDownload(const QList<QUrl> &mirrors, const DocsetMetadata &metadata,
+                                        int priority);
+    void downloadStarted();
     void stopDownloads();
     void saveSettings();
 
@@ -91,10 +105,21 @@ private:
     DocsetRegistry *m_docsetRegistry = nullptr;
 
     ListModel *m_zealListModel = nullptr;
+    AvailableDocsetModel *m_availableDocsetModel = nullptr;
+    // Set by updateFeedDocsets() until the docset list and feeds are in
+    bool m_redownloadMissingMetadata = false;
     QList<QNetworkReply *> replies;
-    QHash<QNetworkReply *, QPair<qint32, qint32> *> progress;
-    qint32 totalDownload = 0;
-    qint32 currentDownload = 0;
+    QList<Core::Download *> m_docsetDownloads;
+    struct TransferProgress
+    {
+        qint64 received = 0;
+        qint64 total = 0;
+    };
+
+    // Of running transfers, finished ones only count towards the totals
+    QHash<QObject *, TransferProgress> progress;
+    qint64 totalDownload = 0;
+    qint64 currentDownload = 0;
     qint32 tasksRunning = 0;
 };
 
@@ -1,5 +1,8 @@
 #include "searchablewebview.h"
 
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
 #include <QShortcut>
 #include <QStyle>
 #include <QResizeEvent>
@@ -13,30 +16,58 @@
     #include <QWebPage>
 #endif
 
+namespace {
+// Pages are only searched once typing pauses this long
+const int FindDelay = 100; // ms
+
+QString findScript()
+{
+    QFile file(QStringLiteral(":/webpage/find.js"));
+    file.open(QIODevice::ReadOnly);
+    return QString::fromUtf8(file.readAll());
+}
+
+// Returns text as a JavaScript string literal
+QString scriptString(const QString &text)
+{
+    QJsonArray array;
+    array.append(text);
+    const QByteArray json = QJsonDocument(array).toJson(QJsonDocument::Compact);
+    return QString::fromUtf8(json.mid(1, json.size() - 2));
+}
+}
+
 SearchableWebView::SearchableWebView(QWidget *parent) :
     QWidget(parent),
     lineEdit(this),
+    matchLabel(this),
     webView(this)
 {
     webView.setAttribute(Qt::WA_AcceptTouchEvents, false);
     lineEdit.hide();
-    connect(&lineEdit, &QLineEdit::textChanged, [&](const QString &text) {
-        // clear selection:
-#ifdef USE_WEBENGINE
-        webView.findText(text);
-#else
-        webView.findText(QString());
-        webView.findText(QString(), QWebPage::HighlightAllOccurrences);
-        if (!text.isEmpty()) {
-            // select&scroll to one occurence:
-            webView.findText(text, QWebPage::FindWrapsAroundDocument);
-            // highlight other occurences:
-            webView.findText(text, QWebPage::HighlightAllOccurrences);
-        }
-#endif
+    matchLabel.hide();
+    matchLabel.setAutoFillBackground(true);
+    matchLabel.setMargin(2);
+
+    // Matches of the previous text are reused as long as the text is only extended,
+    // see webpage/find.js
+    findTimer.setSingleShot(true);
+    findTimer.setInterval(FindDelay);
+    connect(&findTimer, &QTimer::timeout, [&]() {
+        runFindScript(QStringLiteral("zealFind.search(%1)").arg(scriptString(searchText)));
+    });
 
+    connect(&lineEdit, &QLineEdit::textChanged, [&](const QString &text) {
         // store text for later searches
         searchText = text;
+
+        // Clearing is cheap, and should not leave highlights behind for a moment
+        if (text.isEmpty()) {
+            findTimer.stop();
+            runFindScript(QStringLiteral("zealFind.search('')"));
+        } else {
+            findTimer.start();
+        }
     });
 
     QShortcut *shortcut = new QShortcut(QKeySequence::Find, this);
@@ -72,7 +103,7 @@ SearchableWebView::SearchableWebView(QWidget *parent) :
         Q_UNUSED(title)
         Q_UNUSED(textContent)
 #endif
-        if (!link.startsWith("file:///"))
+        if (!link.startsWith("file:///") && !link.startsWith("zeal://"))
             setToolTip(link);
     });
 }
@@ -80,6 +111,43 @@ SearchableWebView::SearchableWebView(QWidget *parent) :
 void SearchableWebView::setPage(QWebPage *page)
 {
     webView.setPage(page);
+
+    // The match count belongs to the previous page
+    matchLabel.hide();
+    if (!searchText.isEmpty())
+        findTimer.start();
+}
+
+void SearchableWebView::runFindScript(const QString &call)
+{
+    static const QString script = findScript();
+
+#ifdef USE_WEBENGINE
+    webView.page()->runJavaScript(script + call, [this](const QVariant &state) {
+        updateMatchCount(state);
+    });
+#else
+    updateMatchCount(webView.page()->mainFrame()->evaluateJavaScript(script + call));
+#endif
+}
+
+void SearchableWebView::updateMatchCount(const QVariant &state)
+{
+    if (searchText.isEmpty()) {
+        matchLabel.hide();
+        return;
+    }
+
+    const QVariantMap map = state.toMap();
+    const int count = map.value(QStringLiteral("count")).toInt();
+    const int current = map.value(QStringLiteral("current")).toInt();
+    if (count == 0)
+        matchLabel.setText(tr("No matches"));
+    else
+        matchLabel.setText(tr("%1 of %2").arg(current).arg(count));
+    matchLabel.adjustSize();
+    matchLabel.show();
+    moveLineEdit();
 }
 
 void SearchableWebView::moveLineEdit()
@@ -93,6 +161,10 @@ void SearchableWebView::moveLineEdit()
 #endif
     lineEdit.move(rect().right() - frameWidth - sz.width(), rect().top());
     lineEdit.raise();
+
+    matchLabel.move(lineEdit.x() - matchLabel.width(),
+                    rect().top() + (sz.height() - matchLabel.height()) / 2);
+    matchLabel.raise();
 }
 
 void SearchableWebView::resizeEvent(QResizeEvent *event)
@@ -104,15 +176,16 @@ void SearchableWebView::resizeEvent(QResizeEvent *event)
 
 void SearchableWebView::keyPressEvent(QKeyEvent *event)
 {
-    if (event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter) {
-#ifdef USE_WEBENGINE
-        QWebPage::FindFlags flags = 0;
-#else
-        QWebPage::FindFlags flags = QWebPage::FindWrapsAroundDocument;
-#endif
-        if (event->modifiers() & Qt::ShiftModifier)
-            flags |= QWebPage::FindBackward;
-        webView.findText(searchText, flags);
+    if ((event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter)
+            && !searchText.isEmpty()) {
+        // Searches right away when typing has not paused yet
+        if (findTimer.isActive()) {
+            findTimer.stop();
+            runFindScript(QStringLiteral("zealFind.search(%1)").arg(scriptString(searchText)));
+        }
+        const bool backward = event->modifiers() & Qt::ShiftModifier;
+        runFindScript(QStringLiteral("zealFind.next(%1)")
+                      .arg(backward ? QStringLiteral("true") : QStringLiteral("false")));
     }
 
     if (event->key() == Qt::Key_Slash) {
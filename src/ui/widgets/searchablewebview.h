@@ -3,7 +3,9 @@
 
 #include "zealwebview.h"
 
+#include <QLabel>
 #include <QLineEdit>
+#include <QTimer>
 
 #ifdef USE_WEBENGINE
     #include <QWebEngineView>
@@ -52,9 +54,16 @@ public slots:
 
 private:
     QLineEdit lineEdit;
+    // Shows the current match and the number of matches
+    QLabel matchLabel;
     ZealWebView webView;
     QString searchText;
+    // Typing restarts it, the page is searched once it fires
+    QTimer findTimer;
     void moveLineEdit();
+    // Runs \a call of the find script in webpage/find.js on the current page
+    void runFindScript(const QString &call);
+    void updateMatchCount(const QVariant &state);
 };
 
 #endif // SEARCHABLEWEBVIEW_H
@@ -0,0 +1,237 @@
+// Find-in-page for SearchableWebView. The text of the page is searched as one string, so
+// that matches may span elements, e.g. "<b>Qt</b>Widgets". It is kept between calls along
+// with the matches, so that extending the needle only checks the previous matches.
+// Only matches around the viewport are highlighted, in an overlay on top of the page.
+if (!window.zealFind) {
+    window.zealFind = (function () {
+        // Matches this far outside of the viewport are highlighted as well, in pixels
+        var MARGIN = 1000;
+        // Highlights follow scrolling with this delay, in milliseconds
+        var RENDER_DELAY = 50;
+
+        var index = null; // see buildIndex(), null once the page changed
+        var needle = '';
+        var matches = []; // offsets into index.text, in document order
+        var current = -1;
+        var overlay = null;
+        var renderPending = false;
+
+        // Lowercases without changing the length, so that offsets stay valid. Characters
+        // with a longer lowercase form, like U+0130, are kept as they are.
+        function fold(data) {
+            var lower = data.toLowerCase();
+            if (lower.length === data.length)
+                return lower;
+
+            var result = '';
+            for (var i = 0; i < data.length; ++i) {
+                var c = data.charAt(i).toLowerCase();
+                result += c.length === 1 ? c : data.charAt(i);
+            }
+            return result;
+        }
+
+        // The folded text of the page, and the text nodes it is made of with their offsets
+        function buildIndex() {
+            var nodes = [];
+            var starts = [];
+            var parts = [];
+            var length = 0;
+            var walker = document.createTreeWalker(document.body, NodeFilter.SHOW_TEXT, {
+                acceptNode: function (node) {
+                    var name = node.parentNode.nodeName;
+                    return name === 'SCRIPT' || name === 'STYLE'
+                        ? NodeFilter.FILTER_REJECT : NodeFilter.FILTER_ACCEPT;
+                }
+            }, false);
+
+            for (var node = walker.nextNode(); node; node = walker.nextNode()) {
+                nodes.push(node);
+                starts.push(length);
+                parts.push(fold(node.data));
+                length += node.data.length;
+            }
+            return {nodes: nodes, starts: starts, text: parts.join('')};
+        }
+
+        function collect(text) {
+            // Overlapping matches are kept, a longer needle may only match the later one
+            var result = [];
+            for (var i = index.text.indexOf(text); i !== -1; i = index.text.indexOf(text, i + 1))
+                result.push(i);
+            return result;
+        }
+
+        function isIndexValid() {
+            return index !== null && (observer !== null || index.nodes.every(isAttached));
+        }
+
+        // Rebuilds the index and the matches after the page changed, e.g. through scripts
+        function update() {
+            if (isIndexValid())
+                return;
+
+            index = buildIndex();
+            matches = needle ? collect(needle) : [];
+            if (current >= matches.length)
+                current = -1;
+        }
+
+        function isAttached(node) {
+            return document.body.contains(node);
+        }
+
+        // Node and offset of \a position in the index text. Ends at the boundary of two
+        // nodes stay in the earlier one.
+        function locate(position, isEnd) {
+            var starts = index.starts;
+            var low = 0;
+            var high = starts.length - 1;
+            while (low < high) {
+                var middle = (low + high + 1) >> 1;
+                if (isEnd ? starts[middle] < position : starts[middle] <= position)
+                    low = middle;
+                else
+                    high = middle - 1;
+            }
+            return {node: index.nodes[low], offset: position - starts[low]};
+        }
+
+        function rangeOf(match) {
+            var start = locate(match, false);
+            var end = locate(match + needle.length, true);
+            var range = document.createRange();
+            range.setStart(start.node, start.offset);
+            range.setEnd(end.node, end.offset);
+            return range;
+        }
+
+        // Index of the first match ending below y, relative to the viewport. Document order
+        // is taken for vertical order, which holds for all but unusual layouts.
+        function firstBelow(y) {
+            var low = 0;
+            var high = matches.length;
+            while (low < high) {
+                var middle = (low + high) >> 1;
+                if (rangeOf(matches[middle]).getBoundingClientRect().bottom < y)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            return low;
+        }
+
+        function render() {
+            renderPending = false;
+            update();
+            if (overlay) {
+                while (overlay.firstChild)
+                    overlay.removeChild(overlay.firstChild);
+            }
+            if (!matches.length)
+                return;
+
+            // Not part of the body, the match walk never sees it
+            if (!overlay || !overlay.parentNode) {
+                overlay = document.createElement('div');
+                overlay.style.cssText = 'position: absolute; top: 0; left: 0; '
+                    + 'pointer-events: none; z-index: 2147483647;';
+                document.documentElement.appendChild(overlay);
+            }
+
+            var bottom = window.innerHeight + MARGIN;
+            var fragment = document.createDocumentFragment();
+            for (var i = firstBelow(-MARGIN); i < matches.length; ++i) {
+                var rects = rangeOf(matches[i]).getClientRects();
+                if (rects.length && rects[0].top > bottom)
+                    break;
+
+                for (var j = 0; j < rects.length; ++j) {
+                    var box = document.createElement('div');
+                    box.style.cssText = 'position: absolute; background: rgba(255, 230, 0, 0.5);'
+                        + 'left: ' + (rects[j].left + window.pageXOffset) + 'px;'
+                        + 'top: ' + (rects[j].top + window.pageYOffset) + 'px;'
+                        + 'width: ' + rects[j].width + 'px;'
+                        + 'height: ' + rects[j].height + 'px;';
+                    fragment.appendChild(box);
+                }
+            }
+            overlay.appendChild(fragment);
+        }
+
+        function scheduleRender() {
+            if (renderPending)
+                return;
+            renderPending = true;
+            window.setTimeout(render, RENDER_DELAY);
+        }
+
+        function select(index) {
+            current = index;
+            var range = rangeOf(matches[index]);
+            var selection = window.getSelection();
+            selection.removeAllRanges();
+            selection.addRange(range);
+
+            var rect = range.getBoundingClientRect();
+            if (rect.top < 0 || rect.bottom > window.innerHeight)
+                window.scrollBy(0, rect.top - window.innerHeight / 3);
+        }
+
+        function state() {
+            return {current: current + 1, count: matches.length};
+        }
+
+        window.addEventListener('scroll', scheduleRender, false);
+        window.addEventListener('resize', scheduleRender, false);
+
+        // Without it, the nodes of the index are checked on each use instead
+        var observer = null;
+        if (window.MutationObserver) {
+            observer = new MutationObserver(function () {
+                index = null;
+            });
+            observer.observe(document.body, {childList: true, characterData: true, subtree: true});
+        }
+
+        return {
+            search: function (text) {
+                text = fold(text);
+
+                // An extended needle can only match where the previous one did
+                var extended = needle && text.indexOf(needle) === 0 && isIndexValid();
+                if (!isIndexValid())
+                    index = buildIndex();
+
+                if (!text) {
+                    matches = [];
+                } else if (extended) {
+                    matches = matches.filter(function (match) {
+                        return index.text.substr(match, text.length) === text;
+                    });
+                } else {
+                    matches = collect(text);
+                }
+
+                needle = text;
+                current = -1;
+                if (matches.length)
+                    select(Math.min(firstBelow(0), matches.length - 1));
+                else
+                    window.getSelection().removeAllRanges();
+
+                render();
+                return state();
+            },
+
+            next: function (backward) {
+                update();
+                if (matches.length) {
+                    select((current + (backward ? -1 : 1) + matches.length) % matches.length);
+                    render();
+                }
+                return state();
+            }
+        };
+    })();
+}